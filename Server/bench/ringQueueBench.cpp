@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+/**
+ * \file    ringQueueBench.cpp
+ *
+ * \brief   Enqueue to dequeue latency of the ring queues and the queues they replaced
+ * \details Producers push their enqueue time and consumers record the time until it was popped.
+ *          With a rate, the producers are paced so the latency is the handoff and wakeup cost.
+ *          With rate 0 they push as fast as they can, so the latency includes the time spent
+ *          waiting in a full queue.
+ *
+ *          Usage: ringQueueBench [messages per producer] [rate per producer/s, 0 is unpaced]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "ringQueue.hpp"
+
+#define BENCH_QUEUE_SIZE        4096        ///< Capacity of the bounded queues
+
+typedef std::chrono::steady_clock bench_clock;
+
+static inline uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * safeQueue as removed - mutex protected std::queue, the consumer sleeps 10ms when it is empty
+ */
+class safeQueue {
+public:
+    safeQueue() { pthread_mutex_init(&mutex, NULL); }
+    ~safeQueue() { pthread_mutex_destroy(&mutex); }
+
+    bool push(uint64_t const &elem) {
+        pthread_mutex_lock(&mutex);
+        q.push(elem);
+        pthread_mutex_unlock(&mutex);
+        return true;
+    }
+
+    bool pop(uint64_t &elem) {
+        for (;;) {
+            pthread_mutex_lock(&mutex);
+
+            if (q.size() > 0) {
+                elem = q.front();
+                q.pop();
+                pthread_mutex_unlock(&mutex);
+                return true;
+            }
+
+            pthread_mutex_unlock(&mutex);
+            usleep(10000);
+        }
+    }
+
+private:
+    pthread_mutex_t         mutex;
+    std::queue<uint64_t>    q;
+};
+
+/**
+ * Bounded mutex and condition variable queue, the usual blocking queue without a ring
+ */
+class condQueue {
+public:
+    bool push(uint64_t const &elem) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return q.size() < BENCH_QUEUE_SIZE; });
+        q.push(elem);
+        not_empty.notify_one();
+        return true;
+    }
+
+    bool pop(uint64_t &elem) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return q.size() > 0; });
+        elem = q.front();
+        q.pop();
+        not_full.notify_one();
+        return true;
+    }
+
+private:
+    std::mutex              mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::queue<uint64_t>    q;
+};
+
+/**
+ * Run producers and consumers over the queue and print the latency percentiles
+ *
+ * \param [in] name         Queue name
+ * \param [in] queue        Queue, zero is the stop message
+ * \param [in] producers    Number of producer threads
+ * \param [in] consumers    Number of consumer threads
+ * \param [in] count        Messages per producer
+ * \param [in] rate         Messages per second per producer, zero is unpaced
+ */
+template <typename Q>
+static void run(const char *name, Q &queue, int producers, int consumers, size_t count, size_t rate) {
+    std::vector<std::vector<uint64_t> > lat(consumers);
+    std::vector<std::thread> threads;
+
+    uint64_t start = nowNs();
+
+    for (int c = 0; c < consumers; c++) {
+        lat[c].reserve(count * producers);
+
+        threads.push_back(std::thread([&queue, &lat, c] {
+            uint64_t t;
+
+            while (queue.pop(t) and t != 0)
+                lat[c].push_back(nowNs() - t);
+        }));
+    }
+
+    std::vector<std::thread> prod;
+
+    for (int p = 0; p < producers; p++) {
+        prod.push_back(std::thread([&queue, count, rate] {
+            bench_clock::time_point next = bench_clock::now();
+            std::chrono::nanoseconds interval(rate > 0 ? 1000000000 / rate : 0);
+
+            for (size_t i = 0; i < count; i++) {
+                if (rate > 0) {
+                    next += interval;
+                    std::this_thread::sleep_until(next);
+                }
+
+                queue.push(nowNs());
+            }
+        }));
+    }
+
+    for (size_t i = 0; i < prod.size(); i++)
+        prod[i].join();
+
+    for (int c = 0; c < consumers; c++)
+        queue.push(0);
+
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    double secs = (nowNs() - start) / 1e9;
+
+    std::vector<uint64_t> all;
+    for (int c = 0; c < consumers; c++)
+        all.insert(all.end(), lat[c].begin(), lat[c].end());
+
+    std::sort(all.begin(), all.end());
+
+    printf("%-16s %dp/%dc %9zu %10.1f %10.1f %10.1f %10.1f %9.2f\n", name, producers, consumers, all.size(),
+           all[all.size() / 2] / 1e3, all[all.size() * 99 / 100] / 1e3, all[all.size() * 999 / 1000] / 1e3,
+           all.back() / 1e3, all.size() / secs / 1e6);
+}
+
+int main(int argc, char **argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    size_t rate = argc > 2 ? strtoul(argv[2], NULL, 10) : 20000;
+
+    printf("%zu messages per producer, %s, %u CPUs\n", count,
+           rate > 0 ? (std::to_string(rate) + "/s per producer").c_str() : "unpaced",
+           std::thread::hardware_concurrency());
+    printf("%-16s %5s %9s %10s %10s %10s %10s %9s\n", "queue", "p/c", "msgs", "p50 us", "p99 us", "p99.9 us",
+           "max us", "Mmsg/s");
+
+    {
+        spscQueue<uint64_t> *q = new spscQueue<uint64_t>(BENCH_QUEUE_SIZE);
+        run("spscQueue", *q, 1, 1, count, rate);
+        delete q;
+    }
+
+    for (int n = 1; n <= 4; n *= 4) {
+        mpmcQueue<uint64_t> *q = new mpmcQueue<uint64_t>(BENCH_QUEUE_SIZE);
+        run("mpmcQueue", *q, n, n, count, rate);
+        delete q;
+    }
+
+    for (int n = 1; n <= 4; n *= 4) {
+        condQueue q;
+        run("mutex+condvar", q, n, n, count, rate);
+    }
+
+    for (int n = 1; n <= 4; n *= 4) {
+        safeQueue q;
+        run("safeQueue", q, n, n, count, rate);
+    }
+
+    return 0;
+}
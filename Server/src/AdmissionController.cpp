@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "AdmissionController.h"
+
+/**
+ * Class constructor
+ *
+ * \param [in] logPtr   Pointer to Logger instance
+ * \param [in] cfg      Pointer to the config instance
+ */
+AdmissionController::AdmissionController(Logger *logPtr, Config *cfg) {
+    logger = logPtr;
+    this->cfg = cfg;
+    debug = cfg->debug_general;
+
+    window = cfg->max_concurrent_routers > 0 ? cfg->max_concurrent_routers : 1;
+    threshold = MAX_THREADS;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        cpus = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &last_wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &last_cpu);
+}
+
+/**
+ * Sample the load and adjust the window, does nothing until ADMISSION_SAMPLE_MS has passed
+ *
+ * \param [in] threads      Router threads
+ * \param [in] starting     Number of routers still dumping their initial RIB
+ */
+void AdmissionController::sample(std::vector<ThreadMgmt *> &threads, int starting) {
+    timespec wall, cpu;
+
+    if (not cfg->admission_adaptive)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+
+    int64_t wall_ms = elapsedMs(last_wall, wall);
+    if (wall_ms < ADMISSION_SAMPLE_MS)
+        return;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+
+    int cpu_pct = (int)(elapsedMs(last_cpu, cpu) * 100 / (wall_ms * cpus));
+
+    last_wall = wall;
+    last_cpu = cpu;
+
+    int buf_pct = 0, queue_pct = 0, running = 0;
+
+    for (size_t i = 0; i < threads.size(); i++) {
+        if (not threads[i]->running)
+            continue;
+
+        buf_pct += threads[i]->client.bufFill.load(std::memory_order_relaxed);
+        queue_pct += threads[i]->client.queueFill.load(std::memory_order_relaxed);
+        running++;
+    }
+
+    if (running > 0) {
+        buf_pct /= running;
+        queue_pct /= running;
+    }
+
+    SELF_DEBUG("Admission: cpu=%d%% buffer=%d%% queue=%d%% starting=%d window=%d",
+               cpu_pct, buf_pct, queue_pct, starting, window);
+
+    if (cpu_pct > cfg->admission_cpu_max or buf_pct > cfg->admission_fill_max or
+            queue_pct > cfg->admission_fill_max) {
+
+        if (window > 1) {
+            window /= 2;
+            threshold = window > 1 ? window : 2;
+
+            LOG_INFO("Startup admission overloaded (cpu=%d%% buffer=%d%% queue=%d%%), window reduced to %d",
+                     cpu_pct, buf_pct, queue_pct, window);
+        }
+
+    } else if (starting >= window and window < MAX_THREADS) {
+        window = window < threshold ? window * 2 : window + 1;
+
+        if (window > MAX_THREADS)
+            window = MAX_THREADS;
+
+        SELF_DEBUG("Startup admission has headroom, window increased to %d", window);
+    }
+}
+
+/**
+ * Check if a new router can be admitted
+ *
+ * \param [in] starting     Number of routers still dumping their initial RIB
+ *
+ * \return true if a new router can be admitted
+ */
+bool AdmissionController::admit(int starting) {
+    if (cfg->admission_adaptive)
+        return starting < window;
+
+    return starting < cfg->max_concurrent_routers;
+}
+
+/**
+ * Check if a router is done with its initial RIB dump
+ *
+ * \param [in] thr          Router thread
+ *
+ * \return true if the router should no longer count as starting
+ */
+bool AdmissionController::startupDone(ThreadMgmt *thr) {
+    int initial_time = cfg->initial_router_time;
+
+    if (cfg->admission_adaptive) {
+        // End-of-RIB from all peers, initial_router_time is only the upper bound
+        if (thr->client.initDumpDone)
+            return true;
+
+    } else {
+        std::string hash(reinterpret_cast<char*>(thr->client.hash_id), 16);
+
+        //if calculate_baseline is true and the baseline time for the router is calculated, use the baseline time
+        if (cfg->calculate_baseline && cfg->router_baseline_time.find(hash) != cfg->router_baseline_time.end())
+            initial_time = cfg->router_baseline_time[hash];
+    }
+
+    timeval now;
+    gettimeofday(&now, NULL);
+
+    return now.tv_sec - thr->client.startTime.tv_sec >= initial_time;
+}
+
+/**
+ * Milliseconds between two times
+ */
+int64_t AdmissionController::elapsedMs(const timespec &start, const timespec &end) {
+    return (int64_t)(end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+}
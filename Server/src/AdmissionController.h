@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef ADMISSIONCONTROLLER_H_
+#define ADMISSIONCONTROLLER_H_
+
+#include <vector>
+#include <ctime>
+
+#include "client_thread.h"
+#include "Logger.h"
+#include "Config.h"
+
+#define ADMISSION_SAMPLE_MS     1000            ///< Milliseconds between load samples
+
+/**
+ * \class   AdmissionController
+ *
+ * \brief   Decides when a new router may connect while others are dumping their RIB
+ * \details In adaptive mode, the number of routers allowed to dump at the same time (the window)
+ *          starts at max_concurrent_routers.  Each sample the collector CPU use and the average
+ *          router buffer and kafka producer queue fill are measured.  The window is halved when any
+ *          is above its limit.  Otherwise, if the window is full, it doubles until the first overload
+ *          and then grows by one, so the routers converge as fast as the hardware allows.
+ *
+ *          In fixed mode, at most max_concurrent_routers are admitted.
+ */
+class AdmissionController {
+public:
+    /**
+     * Class constructor
+     *
+     * \param [in] logPtr   Pointer to Logger instance
+     * \param [in] cfg      Pointer to the config instance
+     */
+    AdmissionController(Logger *logPtr, Config *cfg);
+
+    /**
+     * Sample the load and adjust the window, does nothing until ADMISSION_SAMPLE_MS has passed
+     *
+     * \param [in] threads      Router threads
+     * \param [in] starting     Number of routers still dumping their initial RIB
+     */
+    void sample(std::vector<ThreadMgmt *> &threads, int starting);
+
+    /**
+     * Check if a new router can be admitted
+     *
+     * \param [in] starting     Number of routers still dumping their initial RIB
+     *
+     * \return true if a new router can be admitted
+     */
+    bool admit(int starting);
+
+    /**
+     * Check if a router is done with its initial RIB dump
+     *
+     * \param [in] thr          Router thread
+     *
+     * \return true if the router should no longer count as starting
+     */
+    bool startupDone(ThreadMgmt *thr);
+
+private:
+    Logger      *logger;                    ///< Logging class pointer
+    Config      *cfg;                       ///< Config pointer
+    bool        debug;                      ///< debug flag to indicate debugging
+
+    int         window;                     ///< Routers allowed to dump at the same time
+    int         threshold;                  ///< Window doubles below this and grows by one above it
+    int         cpus;                       ///< Number of online CPUs
+
+    timespec    last_wall;                  ///< Wall time of the last sample
+    timespec    last_cpu;                   ///< Process CPU time of the last sample
+
+    /**
+     * Milliseconds between two times
+     */
+    static int64_t elapsedMs(const timespec &start, const timespec &end);
+};
+
+#endif /* ADMISSIONCONTROLLER_H_ */
@@ -35,11 +35,14 @@ Config::Config() {
     debug_bmp           = false;
     debug_msgbus        = false;
     bmp_buffer_size     = 15 * 1024 * 1024; // 15MB
+    buf_high_watermark  = 80;
+    buf_low_watermark   = 50;
     svr_ipv6            = false;
     svr_ipv4            = true;
     bind_ipv4           = "";
     bind_ipv6           = "";
     heartbeat_interval  = 60 * 5;        // Default is 5 minutes
+    output_type         = "kafka";
     kafka_brokers       = "localhost:9092";
     tx_max_bytes        = 1000000;
     rx_max_bytes        = 100000000;
@@ -51,29 +54,74 @@ Config::Config() {
     msg_send_max_retry  = 2;
     retry_backoff_ms    = 100;
     compression         = "snappy";
+    journal_dir         = "";
+    journal_segment_size = 64 * 1024 * 1024;        // 64MB
+    journal_max_size    = 8192ULL * 1024 * 1024;    // 8GB
+    file_dir            = "/var/lib/openbmp/output";
+    file_segment_size   = 256 * 1024 * 1024;        // 256MB
+    file_rotate_interval = 300;                     // Default is 5 minutes
+    file_compress       = false;
+    null_encode         = false;
+    null_report_interval = 10;
     max_concurrent_routers = 2;
     initial_router_time = 60;
     calculate_baseline  = true;
+    admission_adaptive  = true;
+    admission_cpu_max   = 85;
+    admission_fill_max  = 50;
     pat_enabled		= false;
+    adj_rib_in          = true;
+    peer_down_withdraw  = false;
+    snapshot_file       = "/var/lib/openbmp/rib.snapshot";
+    query_socket        = "";
+    takeover_socket     = "";
+    metrics_port        = 0;
+    metrics_address     = "127.0.0.1";
+    latency_sample_rate = 0;
+    flap_enabled        = false;
+    flap_half_life      = 900;
+    flap_withdraw_penalty = 1000;
+    flap_attr_penalty   = 500;
+    flap_report_threshold = 2000;
+    flap_forget_threshold = 250;
+    flap_report_interval = 60;
+    peer_stats_interval = 60;
+    warm_restart_dir    = "";
+    warm_restart_interval = 300;
+    encode_threads      = 0;
+    parse_threads       = 0;
+    pipeline_queue_size = 1024;
+    CPU_ZERO(&ingest_cpus);
+    CPU_ZERO(&parse_cpus);
+    CPU_ZERO(&encode_cpus);
+    CPU_ZERO(&kafka_cpus);
     bzero(admin_id, sizeof(admin_id));
 
+    live_gen            = 0;
+    parse_live          = new live_settings;
+
     /*
      * Initialized the kafka topic names
      *      The keys match the configuration node/vars. Topic name nodes will be ignored if
      *      not initialized here.
      */
-    topic_names_map[MSGBUS_TOPIC_VAR_COLLECTOR]        = MSGBUS_TOPIC_COLLECTOR;
-    topic_names_map[MSGBUS_TOPIC_VAR_ROUTER]           = MSGBUS_TOPIC_ROUTER;
-    topic_names_map[MSGBUS_TOPIC_VAR_PEER]             = MSGBUS_TOPIC_PEER;
-    topic_names_map[MSGBUS_TOPIC_VAR_BMP_STAT]         = MSGBUS_TOPIC_BMP_STAT;
-    topic_names_map[MSGBUS_TOPIC_VAR_BMP_RAW]          = MSGBUS_TOPIC_BMP_RAW;
-    topic_names_map[MSGBUS_TOPIC_VAR_BASE_ATTRIBUTE]   = MSGBUS_TOPIC_BASE_ATTRIBUTE;
-    topic_names_map[MSGBUS_TOPIC_VAR_UNICAST_PREFIX]   = MSGBUS_TOPIC_UNICAST_PREFIX;
-    topic_names_map[MSGBUS_TOPIC_VAR_LS_NODE]          = MSGBUS_TOPIC_LS_NODE;
-    topic_names_map[MSGBUS_TOPIC_VAR_LS_LINK]          = MSGBUS_TOPIC_LS_LINK;
-    topic_names_map[MSGBUS_TOPIC_VAR_LS_PREFIX]        = MSGBUS_TOPIC_LS_PREFIX;
-    topic_names_map[MSGBUS_TOPIC_VAR_L3VPN]            = MSGBUS_TOPIC_L3VPN;
-    topic_names_map[MSGBUS_TOPIC_VAR_EVPN]             = MSGBUS_TOPIC_EVPN;
+    parse_live->topic_names_map[MSGBUS_TOPIC_VAR_COLLECTOR]        = MSGBUS_TOPIC_COLLECTOR;
+    parse_live->topic_names_map[MSGBUS_TOPIC_VAR_ROUTER]           = MSGBUS_TOPIC_ROUTER;
+    parse_live->topic_names_map[MSGBUS_TOPIC_VAR_PEER]             = MSGBUS_TOPIC_PEER;
+    parse_live->topic_names_map[MSGBUS_TOPIC_VAR_BMP_STAT]         = MSGBUS_TOPIC_BMP_STAT;
+    parse_live->topic_names_map[MSGBUS_TOPIC_VAR_BMP_RAW]          = MSGBUS_TOPIC_BMP_RAW;
+    parse_live->topic_names_map[MSGBUS_TOPIC_VAR_FLAP]             = MSGBUS_TOPIC_FLAP;
+    parse_live->topic_names_map[MSGBUS_TOPIC_VAR_PEER_STATS]       = MSGBUS_TOPIC_PEER_STATS;
+    parse_live->topic_names_map[MSGBUS_TOPIC_VAR_BASE_ATTRIBUTE]   = MSGBUS_TOPIC_BASE_ATTRIBUTE;
+    parse_live->topic_names_map[MSGBUS_TOPIC_VAR_UNICAST_PREFIX]   = MSGBUS_TOPIC_UNICAST_PREFIX;
+    parse_live->topic_names_map[MSGBUS_TOPIC_VAR_LS_NODE]          = MSGBUS_TOPIC_LS_NODE;
+    parse_live->topic_names_map[MSGBUS_TOPIC_VAR_LS_LINK]          = MSGBUS_TOPIC_LS_LINK;
+    parse_live->topic_names_map[MSGBUS_TOPIC_VAR_LS_PREFIX]        = MSGBUS_TOPIC_LS_PREFIX;
+    parse_live->topic_names_map[MSGBUS_TOPIC_VAR_L3VPN]            = MSGBUS_TOPIC_L3VPN;
+    parse_live->topic_names_map[MSGBUS_TOPIC_VAR_EVPN]             = MSGBUS_TOPIC_EVPN;
+
+    live.reset(parse_live);
+    parse_live = NULL;
 }
 
 /*********************************************************************//**
@@ -86,6 +134,10 @@ void Config::load(const char *cfg_filename) {
     if (debug_general)
         std::cout << "---| Loading configuration file |----------------------------- " << std::endl;
 
+    // Live settings are parsed into a copy, which is published once the whole file is loaded
+    std::unique_ptr<live_settings> next(new live_settings(*getLive()));
+    parse_live = next.get();
+
     try {
         YAML::Node root = YAML::LoadFile(cfg_filename);
 
@@ -104,6 +156,16 @@ void Config::load(const char *cfg_filename) {
                         parseDebug(node);
                     else if (key.compare("kafka") == 0)
                         parseKafka(node);
+                    else if (key.compare("file") == 0)
+                        parseFile(node);
+                    else if (key.compare("null") == 0)
+                        parseNull(node);
+                    else if (key.compare("flap") == 0)
+                        parseFlap(node);
+                    else if (key.compare("pipeline") == 0)
+                        parsePipeline(node);
+                    else if (key.compare("affinity") == 0)
+                        parseAffinity(node);
                     else if (key.compare("mapping") == 0)
                         parseMapping(node);
 
@@ -127,10 +189,56 @@ void Config::load(const char *cfg_filename) {
         throw err.what();
     }
 
+    parse_live = NULL;
+    std::atomic_store(&live, live_ptr(next.release()));
+    live_gen++;
+
+    filename = cfg_filename;
+
     if (debug_general)
         std::cout << "---| Done Loading configuration file |------------------------- " << std::endl;
 }
 
+/*********************************************************************//**
+ * Reload the live settings (mapping and kafka topics) from the loaded file
+ *
+ * \throws const char * with the error message, the current settings are kept
+ ***********************************************************************/
+void Config::reload() {
+    std::lock_guard<std::mutex> lock(reload_mutex);
+
+    if (filename.size() == 0)
+        throw "no configuration file was loaded";
+
+    // Parse into a new instance so the file is checked with the defaults it was loaded with
+    Config fresh;
+
+    try {
+        fresh.load(filename.c_str());
+
+    } catch (YAML::Exception &err) {
+        throw "invalid configuration file, see the log";
+    }
+
+    std::atomic_store(&live, fresh.getLive());
+    live_gen++;
+}
+
+/**
+ * Get the topic name by topic var
+ *
+ * \param [in] topic_var    MSGBUS_TOPIC_VAR_<name>
+ *
+ * \return topic name, empty if the topic is disabled or unknown
+ */
+const std::string &Config::live_settings::topicName(const std::string &topic_var) const {
+    static const std::string empty;
+
+    std::map<std::string, std::string>::const_iterator it = topic_names_map.find(topic_var);
+
+    return it != topic_names_map.end() ? it->second : empty;
+}
+
 /**
  * Parse the base configuration
  *
@@ -186,6 +294,22 @@ void Config::parseBase(const YAML::Node &node) {
             std::cout << "   Config: listen_ipv6: " << bind_ipv6 << "\n";
     }
 
+    if (node["output"]) {
+        try {
+            output_type = node["output"].as<std::string>();
+
+            if (output_type.compare("kafka") != 0 and output_type.compare("file") != 0
+                    and output_type.compare("null") != 0)
+                throw "invalid output, must be kafka, file or null";
+
+            if (debug_general)
+                std::cout << "   Config: output is " << output_type << std::endl;
+
+        } catch (YAML::TypedBadConversion<std::string> err) {
+            printWarning("output is not of type string", node["output"]);
+        }
+    }
+
     if (node["listen_mode"]) {
         try {
             value = node["listen_mode"].as<std::string>();
@@ -225,6 +349,39 @@ void Config::parseBase(const YAML::Node &node) {
                 printWarning("buffers.router is not of type int", node["buffers"]["router"]);
             }
         }
+
+        if (node["buffers"]["high_watermark"]) {
+            try {
+                buf_high_watermark = node["buffers"]["high_watermark"].as<int>();
+
+                if (buf_high_watermark < 10 || buf_high_watermark > 100)
+                    throw "invalid buffers high_watermark, not within range of 10 - 100";
+
+                if (debug_general)
+                    std::cout << "   Config: buffers high watermark: " << buf_high_watermark << std::endl;
+
+            } catch (YAML::TypedBadConversion<int> err) {
+                printWarning("buffers.high_watermark is not of type int", node["buffers"]["high_watermark"]);
+            }
+        }
+
+        if (node["buffers"]["low_watermark"]) {
+            try {
+                buf_low_watermark = node["buffers"]["low_watermark"].as<int>();
+
+                if (buf_low_watermark < 0 || buf_low_watermark > 100)
+                    throw "invalid buffers low_watermark, not within range of 0 - 100";
+
+                if (debug_general)
+                    std::cout << "   Config: buffers low watermark: " << buf_low_watermark << std::endl;
+
+            } catch (YAML::TypedBadConversion<int> err) {
+                printWarning("buffers.low_watermark is not of type int", node["buffers"]["low_watermark"]);
+            }
+        }
+
+        if (buf_low_watermark >= buf_high_watermark)
+            throw "invalid buffers low_watermark, must be less than high_watermark";
     }
 
     if (node["heartbeat"]) {
@@ -292,6 +449,55 @@ void Config::parseBase(const YAML::Node &node) {
             }
         }
 
+        if (node["startup"]["admission"]) {
+            try {
+                std::string value = node["startup"]["admission"].as<std::string>();
+
+                if (value.compare("adaptive") == 0)
+                    admission_adaptive = true;
+                else if (value.compare("fixed") == 0)
+                    admission_adaptive = false;
+                else
+                    throw "invalid admission, must be adaptive or fixed";
+
+                if (debug_general)
+                    std::cout << "   Config: admission: " << value << std::endl;
+
+            } catch (YAML::TypedBadConversion<std::string> err) {
+                printWarning("admission is not of type string", node["startup"]["admission"]);
+            }
+        }
+
+        if (node["startup"]["admission_cpu_max"]) {
+            try {
+                admission_cpu_max = node["startup"]["admission_cpu_max"].as<int>();
+
+                if (admission_cpu_max < 10 || admission_cpu_max > 100)
+                    throw "invalid admission_cpu_max, not within range of 10 - 100";
+
+                if (debug_general)
+                    std::cout << "   Config: admission_cpu_max: " << admission_cpu_max << std::endl;
+
+            } catch (YAML::TypedBadConversion<int> err) {
+                printWarning("admission_cpu_max is not of type int", node["startup"]["admission_cpu_max"]);
+            }
+        }
+
+        if (node["startup"]["admission_fill_max"]) {
+            try {
+                admission_fill_max = node["startup"]["admission_fill_max"].as<int>();
+
+                if (admission_fill_max < 1 || admission_fill_max > 100)
+                    throw "invalid admission_fill_max, not within range of 1 - 100";
+
+                if (debug_general)
+                    std::cout << "   Config: admission_fill_max: " << admission_fill_max << std::endl;
+
+            } catch (YAML::TypedBadConversion<int> err) {
+                printWarning("admission_fill_max is not of type int", node["startup"]["admission_fill_max"]);
+            }
+        }
+
         if (node["startup"]["pat_enabled"]) {
             try {
                 pat_enabled = node["startup"]["pat_enabled"].as<bool>();
@@ -305,6 +511,149 @@ void Config::parseBase(const YAML::Node &node) {
         }
     }
 
+    if (node["adj_rib_in"]) {
+        try {
+            adj_rib_in = node["adj_rib_in"].as<bool>();
+
+            if (debug_general)
+                std::cout << "   Config: adj_rib_in: " << adj_rib_in << std::endl;
+
+        } catch (YAML::TypedBadConversion<bool> err) {
+            printWarning("adj_rib_in is not of type bool", node["adj_rib_in"]);
+        }
+    }
+
+    if (node["peer_down_withdraw"]) {
+        try {
+            peer_down_withdraw = node["peer_down_withdraw"].as<bool>();
+
+            if (debug_general)
+                std::cout << "   Config: peer_down_withdraw: " << peer_down_withdraw << std::endl;
+
+        } catch (YAML::TypedBadConversion<bool> err) {
+            printWarning("peer_down_withdraw is not of type bool", node["peer_down_withdraw"]);
+        }
+    }
+
+    if (node["snapshot_file"]) {
+        try {
+            snapshot_file = node["snapshot_file"].as<std::string>();
+
+            if (debug_general)
+                std::cout << "   Config: snapshot_file: " << snapshot_file << std::endl;
+
+        } catch (YAML::TypedBadConversion<std::string> err) {
+            printWarning("snapshot_file is not of type string", node["snapshot_file"]);
+        }
+    }
+
+    if (node["query_socket"]) {
+        try {
+            query_socket = node["query_socket"].as<std::string>();
+
+            if (debug_general)
+                std::cout << "   Config: query_socket: " << query_socket << std::endl;
+
+        } catch (YAML::TypedBadConversion<std::string> err) {
+            printWarning("query_socket is not of type string", node["query_socket"]);
+        }
+    }
+
+    if (node["takeover_socket"]) {
+        try {
+            takeover_socket = node["takeover_socket"].as<std::string>();
+
+            if (debug_general)
+                std::cout << "   Config: takeover_socket: " << takeover_socket << std::endl;
+
+        } catch (YAML::TypedBadConversion<std::string> err) {
+            printWarning("takeover_socket is not of type string", node["takeover_socket"]);
+        }
+    }
+
+    if (node["metrics_port"]) {
+        try {
+            metrics_port = node["metrics_port"].as<uint16_t>();
+
+            if (debug_general)
+                std::cout << "   Config: metrics_port: " << metrics_port << std::endl;
+
+        } catch (YAML::TypedBadConversion<uint16_t> err) {
+            printWarning("metrics_port is not of type unsigned 16 bit", node["metrics_port"]);
+        }
+    }
+
+    if (node["metrics_address"]) {
+        try {
+            metrics_address = node["metrics_address"].as<std::string>();
+
+            if (debug_general)
+                std::cout << "   Config: metrics_address: " << metrics_address << std::endl;
+
+        } catch (YAML::TypedBadConversion<std::string> err) {
+            printWarning("metrics_address is not of type string", node["metrics_address"]);
+        }
+    }
+
+    if (node["latency_sample_rate"]) {
+        try {
+            latency_sample_rate = node["latency_sample_rate"].as<int>();
+
+            if (latency_sample_rate < 0 || latency_sample_rate > 1000000)
+                throw "invalid latency_sample_rate, not within range of 0 - 1000000";
+
+            if (debug_general)
+                std::cout << "   Config: latency_sample_rate: " << latency_sample_rate << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("latency_sample_rate is not of type int", node["latency_sample_rate"]);
+        }
+    }
+
+    if (node["peer_stats_interval"]) {
+        try {
+            peer_stats_interval = node["peer_stats_interval"].as<int>();
+
+            if (peer_stats_interval < 0 || peer_stats_interval > 3600)
+                throw "invalid peer_stats_interval, not within range of 0 - 3600";
+
+            if (debug_general)
+                std::cout << "   Config: peer_stats_interval: " << peer_stats_interval << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("peer_stats_interval is not of type int", node["peer_stats_interval"]);
+        }
+    }
+
+    if (node["warm_restart"]) {
+        if (node["warm_restart"]["directory"]) {
+            try {
+                warm_restart_dir = node["warm_restart"]["directory"].as<std::string>();
+
+                if (debug_general)
+                    std::cout << "   Config: warm_restart directory: " << warm_restart_dir << std::endl;
+
+            } catch (YAML::TypedBadConversion<std::string> err) {
+                printWarning("warm_restart.directory is not of type string", node["warm_restart"]["directory"]);
+            }
+        }
+
+        if (node["warm_restart"]["interval"]) {
+            try {
+                warm_restart_interval = node["warm_restart"]["interval"].as<int>();
+
+                if (warm_restart_interval < 0 || warm_restart_interval > 86400)
+                    throw "invalid warm_restart interval, not within range of 0 - 86400";
+
+                if (debug_general)
+                    std::cout << "   Config: warm_restart interval: " << warm_restart_interval << std::endl;
+
+            } catch (YAML::TypedBadConversion<int> err) {
+                printWarning("warm_restart.interval is not of type int", node["warm_restart"]["interval"]);
+            }
+        }
+    }
+
 }
 
 /**
@@ -576,6 +925,402 @@ void Config::parseKafka(const YAML::Node &node) {
     if (node["topics"] && node["topics"].Type() == YAML::NodeType::Map) {
         parseTopics(node["topics"]);
     }
+
+    if (node["journal"] && node["journal"].Type() == YAML::NodeType::Map) {
+        parseJournal(node["journal"]);
+    }
+}
+
+/**
+ * Parse the kafka journal configuration
+ *
+ * \param [in] node     Reference to the yaml NODE
+ */
+void Config::parseJournal(const YAML::Node &node) {
+    if (node["directory"]) {
+        try {
+            journal_dir = node["directory"].as<std::string>();
+
+            if (debug_general)
+                std::cout << "   Config: kafka journal directory: " << journal_dir << std::endl;
+
+        } catch (YAML::TypedBadConversion<std::string> err) {
+            printWarning("kafka.journal.directory is not of type string", node["directory"]);
+        }
+    }
+
+    if (node["segment_size"]) {
+        try {
+            int value = node["segment_size"].as<int>();
+
+            if (value < 1 || value > 1024)
+                throw "invalid kafka journal segment size, not within range of 1 - 1024";
+
+            journal_segment_size = value * 1024ULL * 1024;    // MB to bytes
+
+            if (debug_general)
+                std::cout << "   Config: kafka journal segment size: " << journal_segment_size << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("kafka.journal.segment_size is not of type int", node["segment_size"]);
+        }
+    }
+
+    if (node["max_size"]) {
+        try {
+            int value = node["max_size"].as<int>();
+
+            if (value < 0)
+                throw "invalid kafka journal max size, should be 0 (unlimited) or greater";
+
+            journal_max_size = value * 1024ULL * 1024;        // MB to bytes
+
+            if (debug_general)
+                std::cout << "   Config: kafka journal max size: " << journal_max_size << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("kafka.journal.max_size is not of type int", node["max_size"]);
+        }
+    }
+}
+
+/**
+ * Parse the file output configuration
+ *
+ * \param [in] node     Reference to the yaml NODE
+ */
+void Config::parseFile(const YAML::Node &node) {
+    if (node["directory"]) {
+        try {
+            file_dir = node["directory"].as<std::string>();
+
+            if (debug_general)
+                std::cout << "   Config: file directory: " << file_dir << std::endl;
+
+        } catch (YAML::TypedBadConversion<std::string> err) {
+            printWarning("file.directory is not of type string", node["directory"]);
+        }
+    }
+
+    if (node["segment_size"]) {
+        try {
+            int value = node["segment_size"].as<int>();
+
+            if (value < 1 || value > 4096)
+                throw "invalid file segment size, not within range of 1 - 4096";
+
+            file_segment_size = value * 1024ULL * 1024;    // MB to bytes
+
+            if (debug_general)
+                std::cout << "   Config: file segment size: " << file_segment_size << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("file.segment_size is not of type int", node["segment_size"]);
+        }
+    }
+
+    if (node["rotate_interval"]) {
+        try {
+            file_rotate_interval = node["rotate_interval"].as<int>();
+
+            if (file_rotate_interval < 0)
+                throw "invalid file rotate interval, should be 0 (disabled) or greater";
+
+            if (debug_general)
+                std::cout << "   Config: file rotate interval: " << file_rotate_interval << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("file.rotate_interval is not of type int", node["rotate_interval"]);
+        }
+    }
+
+    if (node["compression"]) {
+        try {
+            std::string value = node["compression"].as<std::string>();
+
+            if (value.compare("gzip") == 0)
+                file_compress = true;
+            else if (value.compare("none") == 0)
+                file_compress = false;
+            else
+                throw "invalid file compression, must be none or gzip";
+
+            if (debug_general)
+                std::cout << "   Config: file compression: " << value << std::endl;
+
+        } catch (YAML::TypedBadConversion<std::string> err) {
+            printWarning("file.compression is not of type string", node["compression"]);
+        }
+    }
+}
+
+/**
+ * Parse the null output configuration
+ *
+ * \param [in] node     Reference to the yaml NODE
+ */
+void Config::parseNull(const YAML::Node &node) {
+    if (node["encode"]) {
+        try {
+            null_encode = node["encode"].as<bool>();
+
+            if (debug_general)
+                std::cout << "   Config: null encode: " << null_encode << std::endl;
+
+        } catch (YAML::TypedBadConversion<bool> err) {
+            printWarning("null.encode is not of type boolean", node["encode"]);
+        }
+    }
+
+    if (node["report_interval"]) {
+        try {
+            null_report_interval = node["report_interval"].as<int>();
+
+            if (null_report_interval < 1 || null_report_interval > 3600)
+                throw "invalid null report interval, not within range of 1 - 3600";
+
+            if (debug_general)
+                std::cout << "   Config: null report interval: " << null_report_interval << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("null.report_interval is not of type int", node["report_interval"]);
+        }
+    }
+}
+
+
+/**
+ * Parse the flap tracking configuration
+ *
+ * \param [in] node     Reference to the yaml NODE
+ */
+void Config::parseFlap(const YAML::Node &node) {
+    if (node["enabled"]) {
+        try {
+            flap_enabled = node["enabled"].as<bool>();
+
+            if (debug_general)
+                std::cout << "   Config: flap enabled: " << flap_enabled << std::endl;
+
+        } catch (YAML::TypedBadConversion<bool> err) {
+            printWarning("flap.enabled is not of type boolean", node["enabled"]);
+        }
+    }
+
+    if (node["half_life"]) {
+        try {
+            flap_half_life = node["half_life"].as<int>();
+
+            if (flap_half_life < 1 || flap_half_life > 86400)
+                throw "invalid flap half life, not within range of 1 - 86400";
+
+            if (debug_general)
+                std::cout << "   Config: flap half life: " << flap_half_life << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("flap.half_life is not of type int", node["half_life"]);
+        }
+    }
+
+    if (node["withdraw_penalty"]) {
+        try {
+            flap_withdraw_penalty = node["withdraw_penalty"].as<int>();
+
+            if (flap_withdraw_penalty < 0 || flap_withdraw_penalty > 20000)
+                throw "invalid flap withdraw penalty, not within range of 0 - 20000";
+
+            if (debug_general)
+                std::cout << "   Config: flap withdraw penalty: " << flap_withdraw_penalty << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("flap.withdraw_penalty is not of type int", node["withdraw_penalty"]);
+        }
+    }
+
+    if (node["attr_penalty"]) {
+        try {
+            flap_attr_penalty = node["attr_penalty"].as<int>();
+
+            if (flap_attr_penalty < 0 || flap_attr_penalty > 20000)
+                throw "invalid flap attr penalty, not within range of 0 - 20000";
+
+            if (debug_general)
+                std::cout << "   Config: flap attr penalty: " << flap_attr_penalty << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("flap.attr_penalty is not of type int", node["attr_penalty"]);
+        }
+    }
+
+    if (node["report_threshold"]) {
+        try {
+            flap_report_threshold = node["report_threshold"].as<int>();
+
+            if (flap_report_threshold < 1 || flap_report_threshold > 20000)
+                throw "invalid flap report threshold, not within range of 1 - 20000";
+
+            if (debug_general)
+                std::cout << "   Config: flap report threshold: " << flap_report_threshold << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("flap.report_threshold is not of type int", node["report_threshold"]);
+        }
+    }
+
+    if (node["forget_threshold"]) {
+        try {
+            flap_forget_threshold = node["forget_threshold"].as<int>();
+
+            if (flap_forget_threshold < 1 || flap_forget_threshold > 20000)
+                throw "invalid flap forget threshold, not within range of 1 - 20000";
+
+            if (debug_general)
+                std::cout << "   Config: flap forget threshold: " << flap_forget_threshold << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("flap.forget_threshold is not of type int", node["forget_threshold"]);
+        }
+    }
+
+    if (node["report_interval"]) {
+        try {
+            flap_report_interval = node["report_interval"].as<int>();
+
+            if (flap_report_interval < 1 || flap_report_interval > 3600)
+                throw "invalid flap report interval, not within range of 1 - 3600";
+
+            if (debug_general)
+                std::cout << "   Config: flap report interval: " << flap_report_interval << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("flap.report_interval is not of type int", node["report_interval"]);
+        }
+    }
+}
+
+/**
+ * Parse the pipeline configuration
+ *
+ * \param [in] node     Reference to the yaml NODE
+ */
+void Config::parsePipeline(const YAML::Node &node) {
+    if (node["encode_threads"]) {
+        try {
+            encode_threads = node["encode_threads"].as<int>();
+
+            if (encode_threads < 0 || encode_threads > 64)
+                throw "invalid pipeline encode threads, not within range of 0 - 64";
+
+            if (debug_general)
+                std::cout << "   Config: pipeline encode threads: " << encode_threads << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("pipeline.encode_threads is not of type int", node["encode_threads"]);
+        }
+    }
+
+    if (node["parse_threads"]) {
+        try {
+            parse_threads = node["parse_threads"].as<int>();
+
+            if (parse_threads < 0 || parse_threads > 64)
+                throw "invalid pipeline parse threads, not within range of 0 - 64";
+
+            if (debug_general)
+                std::cout << "   Config: pipeline parse threads: " << parse_threads << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("pipeline.parse_threads is not of type int", node["parse_threads"]);
+        }
+    }
+
+    if (node["queue_size"]) {
+        try {
+            pipeline_queue_size = node["queue_size"].as<int>();
+
+            if (pipeline_queue_size < 16 || pipeline_queue_size > 65536)
+                throw "invalid pipeline queue size, not within range of 16 - 65536";
+
+            if (debug_general)
+                std::cout << "   Config: pipeline queue size: " << pipeline_queue_size << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("pipeline.queue_size is not of type int", node["queue_size"]);
+        }
+    }
+}
+
+/**
+ * Parse the CPU affinity configuration
+ *
+ * \param [in] node     Reference to the yaml NODE
+ */
+void Config::parseAffinity(const YAML::Node &node) {
+    if (node["ingest_cpus"])
+        parseCpuList(node["ingest_cpus"], "ingest_cpus", ingest_cpus);
+
+    if (node["parse_cpus"])
+        parseCpuList(node["parse_cpus"], "parse_cpus", parse_cpus);
+
+    if (node["encode_cpus"])
+        parseCpuList(node["encode_cpus"], "encode_cpus", encode_cpus);
+
+    if (node["kafka_cpus"])
+        parseCpuList(node["kafka_cpus"], "kafka_cpus", kafka_cpus);
+}
+
+/**
+ * Parse a CPU list, such as "0-3,8,10-11"
+ *
+ * \param [in]  node     CPU list node - should be a scalar
+ * \param [in]  name     Option name, used for messages
+ * \param [out] cpus     CPU set updated with the listed CPUs
+ */
+void Config::parseCpuList(const YAML::Node &node, const char *name, cpu_set_t &cpus) {
+    std::string list;
+
+    try {
+        list = node.as<std::string>();
+
+    } catch (YAML::TypedBadConversion<std::string> err) {
+        printWarning(std::string("affinity.") + name + " is not of type string", node);
+        return;
+    }
+
+    CPU_ZERO(&cpus);
+
+    const char *p = list.c_str();
+    while (*p != 0) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+
+        if (end == p)
+            throw "invalid affinity cpu list, expected a list of cpus and ranges such as 0-3,8";
+
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+
+            if (end == p)
+                throw "invalid affinity cpu list, expected a list of cpus and ranges such as 0-3,8";
+        }
+
+        if (first < 0 or last < first or last >= CPU_SETSIZE)
+            throw "invalid affinity cpu range, not within range of 0 - 1023";
+
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, &cpus);
+
+        while (*end == ',' or *end == ' ')
+            end++;
+
+        p = end;
+    }
+
+    if (debug_general)
+        std::cout << "   Config: affinity " << name << ": " << list << " (" << CPU_COUNT(&cpus)
+                  << " cpus)" << std::endl;
 }
 
 
@@ -594,7 +1339,7 @@ void Config::parseTopics(const YAML::Node &node) {
 
                 // make sure user-defined variable doesn't override app specific ones
                 if (var.compare("router_group") and var.compare("peer_group"))
-                    topic_vars_map[var] = it->second.as<std::string>();
+                    parse_live->topic_vars_map[var] = it->second.as<std::string>();
 
             } catch (YAML::TypedBadConversion<std::string> err) {
                 printWarning("kafka.topics.variables error in map.  Make sure to define var: <string value>", it->second);
@@ -602,7 +1347,7 @@ void Config::parseTopics(const YAML::Node &node) {
         }
 
         if (debug_general) {
-            for (topic_vars_map_iter it = topic_vars_map.begin(); it != topic_vars_map.end(); ++it) {
+            for (topic_vars_map_iter it = parse_live->topic_vars_map.begin(); it != parse_live->topic_vars_map.end(); ++it) {
                 std::cout << "   Config: kafka.topics.variables: " << it->first << " = " << it->second << std::endl;
             }
         }
@@ -612,11 +1357,11 @@ void Config::parseTopics(const YAML::Node &node) {
         for (YAML::const_iterator it = node["names"].begin(); it != node["names"].end(); ++it) {
             try {
                 // Only add topic names that are initialized, otherwise ignore them
-                if (topic_names_map.find(it->first.as<std::string>()) != topic_names_map.end()) {
+                if (parse_live->topic_names_map.find(it->first.as<std::string>()) != parse_live->topic_names_map.end()) {
                     if (it->second.Type() == YAML::NodeType::Null) {
-                        topic_names_map[it->first.as<std::string>()] = "";
+                        parse_live->topic_names_map[it->first.as<std::string>()] = "";
                     } else {
-                        topic_names_map[it->first.as<std::string>()] = it->second.as<std::string>();
+                        parse_live->topic_names_map[it->first.as<std::string>()] = it->second.as<std::string>();
                     }
                 } else if (debug_general)
                     std::cout << "   Ignore: '" << it->first.as<std::string>()
@@ -629,7 +1374,7 @@ void Config::parseTopics(const YAML::Node &node) {
         }
 
         if (debug_general) {
-            for (topic_names_map_iter it = topic_names_map.begin(); it != topic_names_map.end(); ++it) {
+            for (topic_names_map_iter it = parse_live->topic_names_map.begin(); it != parse_live->topic_names_map.end(); ++it) {
                 std::cout << "   Config: kafka.topics.names: " << it->first << " = " << it->second << std::endl;
             }
         }
@@ -639,7 +1384,7 @@ void Config::parseTopics(const YAML::Node &node) {
     topicSubstitutions();
 
     if (debug_general) {
-        for (topic_names_map_iter it = topic_names_map.begin(); it != topic_names_map.end(); ++it) {
+        for (topic_names_map_iter it = parse_live->topic_names_map.begin(); it != parse_live->topic_names_map.end(); ++it) {
             std::cout << "   Config: postsub: kafka.topics.names: " << it->first << " = " << it->second << std::endl;
         }
     }
@@ -670,7 +1415,7 @@ void Config::parseMapping(const YAML::Node &node) {
                     if (cur_node["regexp_hostname"] and
                         cur_node["regexp_hostname"].Type() == YAML::NodeType::Sequence) {
 
-                        parseRegexpList(cur_node["regexp_hostname"], name, match_router_group_by_name);
+                        parseRegexpList(cur_node["regexp_hostname"], name, parse_live->match_router_group_by_name);
 
                     } else if (cur_node["regexp_hostname"])
                         throw "Invalid mapping.groups.router_group.regexp_hostname, should be of type list/sequence";
@@ -679,7 +1424,7 @@ void Config::parseMapping(const YAML::Node &node) {
                     if (debug_general) std::cout << "   Config: getting prefix_range list" << std::endl;
                     if (cur_node["prefix_range"] and cur_node["prefix_range"].Type() == YAML::NodeType::Sequence) {
 
-                        parsePrefixList(cur_node["prefix_range"], name, match_router_group_by_ip);
+                        parsePrefixList(cur_node["prefix_range"], name, parse_live->match_router_group_by_ip);
 
                     } else if (cur_node["prefix_range"])
                         throw "Invalid mapping.groups.router_group.prefix_range, should be of type list/sequence";
@@ -704,7 +1449,7 @@ void Config::parseMapping(const YAML::Node &node) {
                     if (cur_node["regexp_hostname"] and
                         cur_node["regexp_hostname"].Type() == YAML::NodeType::Sequence) {
 
-                        parseRegexpList(cur_node["regexp_hostname"], name, match_peer_group_by_name);
+                        parseRegexpList(cur_node["regexp_hostname"], name, parse_live->match_peer_group_by_name);
 
                     } else if (cur_node["regexp_hostname"])
                         throw "Invalid mapping.groups.peer_group.regexp_hostname, should be of type list/sequence";
@@ -713,7 +1458,7 @@ void Config::parseMapping(const YAML::Node &node) {
                     if (debug_general) std::cout << "   Config: getting prefix_range list" << std::endl;
                     if (cur_node["prefix_range"] and cur_node["prefix_range"].Type() == YAML::NodeType::Sequence) {
 
-                        parsePrefixList(cur_node["prefix_range"], name, match_peer_group_by_ip);
+                        parsePrefixList(cur_node["prefix_range"], name, parse_live->match_peer_group_by_ip);
 
                     } else if (cur_node["prefix_range"])
                         throw "Invalid mapping.groups.peer_group.prefix_range, should be of type list/sequence";
@@ -726,7 +1471,7 @@ void Config::parseMapping(const YAML::Node &node) {
                             if (cur_node["asn"][i].Type() == YAML::NodeType::Scalar) {
                                 try {
                                     uint32_t asn = cur_node["asn"][i].as<std::uint32_t>();
-                                    match_peer_group_by_asn[name].push_back(asn);
+                                    parse_live->match_peer_group_by_asn[name].push_back(asn);
                                 } catch (YAML::TypedBadConversion<std::string> err) {
                                     printWarning(
                                             "mapping.groups.peer_group.asn int parse error. ASN must be uint32: ",
@@ -842,12 +1587,12 @@ void Config::parsePrefixList(const YAML::Node &node, std::string name,
  */
 void Config::topicSubstitutions() {
     // not the fastest update, but this is fine since it's only done on startup
-    for (topic_vars_map_iter v_it = topic_vars_map.begin(); v_it != topic_vars_map.end(); ++v_it) {
+    for (topic_vars_map_iter v_it = parse_live->topic_vars_map.begin(); v_it != parse_live->topic_vars_map.end(); ++v_it) {
         std::string var = "{";
         var += v_it->first;
         var += "}";
 
-        for (topic_names_map_iter n_it = topic_names_map.begin(); n_it != topic_names_map.end(); ++n_it) {
+        for (topic_names_map_iter n_it = parse_live->topic_names_map.begin(); n_it != parse_live->topic_names_map.end(); ++n_it) {
             boost::replace_all(n_it->second, var, v_it->second);
         }
     }
@@ -13,6 +13,10 @@
 #include <string>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <sched.h>
 #include <yaml-cpp/yaml.h>
 #include <boost/xpressive/xpressive.hpp>
 #include <boost/exception/all.hpp>
@@ -33,6 +37,7 @@ public:
     u_char      c_hash_id[16];            ///< Collector Hash ID (raw format)
     char        admin_id[64];             ///< Admin ID
 
+    std::string output_type;              ///< Message bus output type: kafka, file or null
     std::string kafka_brokers;            ///< metadata.broker.list
     uint16_t    bmp_port;                 ///< BMP listening port
     std::string bind_ipv4;                ///< IP to listen on for IPv4
@@ -40,6 +45,8 @@ public:
 
     int         bmp_buffer_size;          ///< BMP buffer size in bytes (min is 2M max is 128M)
     bool        svr_ipv4;                 ///< Indicates if server should listen for IPv4 connections
+    int         buf_high_watermark;       ///< Percent of buffer/queue used before throttling the previous stage
+    int         buf_low_watermark;        ///< Percent of buffer/queue used before resuming the previous stage
     bool        svr_ipv6;                 ///< Indicates if server should listen for IPv6 connections
 
     bool        debug_general;
@@ -58,10 +65,47 @@ public:
     int         msg_send_max_retry;      ///< No. of times to resend failed msgs
     int         retry_backoff_ms;        ///< Backoff time before resending msgs  
     std::string compression;		 ///< Compression to use :none, gzip, snappy
+    std::string journal_dir;             ///< Kafka journal directory, empty if the journal is disabled
+    uint64_t    journal_segment_size;    ///< Kafka journal segment size in bytes
+    uint64_t    journal_max_size;        ///< Kafka journal max size in bytes, zero is unlimited
+    std::string file_dir;                ///< File output directory
+    uint64_t    file_segment_size;       ///< File output segment size in bytes
+    int         file_rotate_interval;    ///< File output segment rotate interval in seconds, zero to disable
+    bool        file_compress;           ///< Indicates if file output segments are gzip compressed
+    bool        null_encode;             ///< Indicates if the null output encodes messages before counting
+    int         null_report_interval;    ///< Null output stats report interval in seconds
     int         max_concurrent_routers;  ///<Maximum allowed routers that can connect
     int         initial_router_time;     ///<Initial time in allowing another concurrent router
     bool        calculate_baseline;      ///<Indicates if router baseline time should be calculated
+    bool        admission_adaptive;      ///< Indicates if new routers are admitted based on measured headroom
+    int         admission_cpu_max;       ///< Percent CPU used before fewer routers are admitted
+    int         admission_fill_max;      ///< Percent buffer/queue used before fewer routers are admitted
     bool        pat_enabled;             ///<Indicates if router hash needs to be based on INIT message instead of source IP
+    bool        adj_rib_in;              ///< Indicates if per peer RIBs are kept to only send changed prefixes
+    bool        peer_down_withdraw;      ///< Indicates if the peer RIB is withdrawn (del rows) on peer down
+    std::string snapshot_file;           ///< RIB snapshot filename, written on SIGUSR1
+    std::string query_socket;            ///< RIB query UNIX socket path, empty to disable
+    std::string takeover_socket;         ///< Session takeover UNIX socket path, empty to disable
+    uint16_t    metrics_port;            ///< Metrics HTTP port, zero to disable
+    std::string metrics_address;         ///< Metrics HTTP listening address
+    int         latency_sample_rate;     ///< Trace the latency of one in this many route monitoring messages, zero to disable
+    bool        flap_enabled;            ///< Indicates if route flaps are tracked per peer
+    int         flap_half_life;          ///< Flap penalty half life in seconds
+    int         flap_withdraw_penalty;   ///< Flap penalty added on withdraw
+    int         flap_attr_penalty;       ///< Flap penalty added on attribute change
+    int         flap_report_threshold;   ///< Minimum flap penalty to report the prefix
+    int         flap_forget_threshold;   ///< Flap penalty below which the prefix is no longer tracked
+    int         flap_report_interval;    ///< Flap report interval in seconds
+    int         peer_stats_interval;     ///< Collector computed peer stats interval in seconds, zero to disable
+    std::string warm_restart_dir;        ///< Peer RIB digest directory, empty to disable warm restart
+    int         warm_restart_interval;   ///< Seconds between peer RIB digest saves, zero to only save on disconnect
+    int         encode_threads;          ///< Shared message encode threads, zero to encode in the router thread
+    int         parse_threads;           ///< Shared BGP parse threads, zero to parse in the router thread
+    int         pipeline_queue_size;     ///< Max messages queued between pipeline stages
+    cpu_set_t   ingest_cpus;             ///< CPUs of the router socket and reader threads, empty to not pin
+    cpu_set_t   parse_cpus;              ///< CPUs of the parse threads, empty to not pin
+    cpu_set_t   encode_cpus;             ///< CPUs of the encode threads, empty to not pin
+    cpu_set_t   kafka_cpus;              ///< CPUs of the producer and librdkafka threads, empty to not pin
 
     /**
      * matching structs and maps
@@ -77,38 +121,57 @@ public:
     };
 
     /**
-     * Matching router group map - used to regex/ip match the router to group name
+     * Iterators of the matching and topic maps in live_settings
      */
-    std::map<std::string, std::list<match_type_regex>> match_router_group_by_name;
-    typedef std::map<std::string, std::list<match_type_regex>>::iterator match_router_group_by_name_iter;
-
-    std::map<std::string, std::list<match_type_ip>> match_router_group_by_ip;
-    typedef std::map<std::string, std::list<match_type_ip>>::iterator match_router_group_by_ip_iter;
-
-
-    /**
-     * Matching peer group map - used to regex/ip match the peer to group name
-     */
-    std::map<std::string, std::list<match_type_regex>> match_peer_group_by_name;
-    typedef std::map<std::string, std::list<match_type_regex>>::iterator match_peer_group_by_name_iter;
-
-    std::map<std::string,  std::list<match_type_ip>> match_peer_group_by_ip;
-    typedef std::map<std::string, std::list<match_type_ip>>::iterator match_peer_group_by_ip_iter;
-
-    std::map<std::string,  std::list<uint32_t>> match_peer_group_by_asn;
-    typedef std::map<std::string, std::list<uint32_t>>::iterator match_peer_group_by_asn_iter;
-
-    /**
-     * kafka topic variables
-     */
-    std::map<std::string, std::string> topic_vars_map;
+    typedef std::map<std::string, std::list<match_type_regex>>::const_iterator match_router_group_by_name_iter;
+    typedef std::map<std::string, std::list<match_type_ip>>::const_iterator match_router_group_by_ip_iter;
+    typedef std::map<std::string, std::list<match_type_regex>>::const_iterator match_peer_group_by_name_iter;
+    typedef std::map<std::string, std::list<match_type_ip>>::const_iterator match_peer_group_by_ip_iter;
+    typedef std::map<std::string, std::list<uint32_t>>::const_iterator match_peer_group_by_asn_iter;
     typedef std::map<std::string, std::string>::iterator topic_vars_map_iter;
+    typedef std::map<std::string, std::string>::iterator topic_names_map_iter;
 
     /**
-     * kafka topic names
+     * Settings that can be reloaded while running - mapping groups and kafka topics
+     *
+     * \details A published snapshot is never changed.  Readers hold it with a shared_ptr and a
+     *          reload publishes a new one, so the old one is freed with its last reader.
      */
-    std::map<std::string, std::string> topic_names_map;
-    typedef std::map<std::string, std::string>::iterator topic_names_map_iter;
+    struct live_settings {
+        /**
+         * Matching router group map - used to regex/ip match the router to group name
+         */
+        std::map<std::string, std::list<match_type_regex>> match_router_group_by_name;
+        std::map<std::string, std::list<match_type_ip>> match_router_group_by_ip;
+
+        /**
+         * Matching peer group map - used to regex/ip match the peer to group name
+         */
+        std::map<std::string, std::list<match_type_regex>> match_peer_group_by_name;
+        std::map<std::string,  std::list<match_type_ip>> match_peer_group_by_ip;
+        std::map<std::string,  std::list<uint32_t>> match_peer_group_by_asn;
+
+        /**
+         * kafka topic variables
+         */
+        std::map<std::string, std::string> topic_vars_map;
+
+        /**
+         * kafka topic names
+         */
+        std::map<std::string, std::string> topic_names_map;
+
+        /**
+         * Get the topic name by topic var
+         *
+         * \param [in] topic_var    MSGBUS_TOPIC_VAR_<name>
+         *
+         * \return topic name, empty if the topic is disabled or unknown
+         */
+        const std::string &topicName(const std::string &topic_var) const;
+    };
+
+    typedef std::shared_ptr<const live_settings> live_ptr;
 
     /**
      * map for router baseline times
@@ -128,7 +191,37 @@ public:
      ***********************************************************************/
     void load(const char *cfg_filename);
 
+    /*********************************************************************//**
+     * Reload the live settings (mapping and kafka topics) from the loaded file
+     *
+     * \details The whole file is parsed and checked again, but only the live settings are
+     *          applied.  Other changes need a restart.
+     *
+     * \throws const char * with the error message, the current settings are kept
+     ***********************************************************************/
+    void reload();
+
+    /*********************************************************************//**
+     * Get the current live settings snapshot
+     ***********************************************************************/
+    inline live_ptr getLive() const {
+        return std::atomic_load(&live);
+    }
+
+    /*********************************************************************//**
+     * Live settings generation, changes with each reload
+     ***********************************************************************/
+    inline uint32_t getLiveGen() const {
+        return live_gen.load(std::memory_order_acquire);
+    }
+
 private:
+    std::string     filename;                   ///< Loaded configuration file, used by reload()
+    live_ptr        live;                       ///< Published live settings, use getLive()
+    std::atomic<uint32_t> live_gen;             ///< Live settings generation
+    live_settings   *parse_live;                ///< Live settings being parsed by load()
+    std::mutex      reload_mutex;               ///< Serializes reloads
+
     /**
      * Parse the base configuration
      *
@@ -157,6 +250,57 @@ private:
      */
     void parseTopics(const YAML::Node &node);
 
+    /**
+     * Parse the kafka journal configuration
+     *
+     * \param [in] node     Reference to the yaml NODE
+     */
+    void parseJournal(const YAML::Node &node);
+
+    /**
+     * Parse the file output configuration
+     *
+     * \param [in] node     Reference to the yaml NODE
+     */
+    void parseFile(const YAML::Node &node);
+
+    /**
+     * Parse the null output configuration
+     *
+     * \param [in] node     Reference to the yaml NODE
+     */
+    void parseNull(const YAML::Node &node);
+
+    /**
+     * Parse the flap tracking configuration
+     *
+     * \param [in] node     Reference to the yaml NODE
+     */
+    void parseFlap(const YAML::Node &node);
+
+    /**
+     * Parse the pipeline configuration
+     *
+     * \param [in] node     Reference to the yaml NODE
+     */
+    void parsePipeline(const YAML::Node &node);
+
+    /**
+     * Parse the CPU affinity configuration
+     *
+     * \param [in] node     Reference to the yaml NODE
+     */
+    void parseAffinity(const YAML::Node &node);
+
+    /**
+     * Parse a CPU list, such as "0-3,8,10-11"
+     *
+     * \param [in]  node     CPU list node - should be a scalar
+     * \param [in]  name     Option name, used for messages
+     * \param [out] cpus     CPU set updated with the listed CPUs
+     */
+    void parseCpuList(const YAML::Node &node, const char *name, cpu_set_t &cpus);
+
     /**
      * Parse the mapping configuration
      *
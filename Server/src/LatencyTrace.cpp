@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <sys/ioctl.h>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+#include "LatencyTrace.h"
+
+int                     LatencyTrace::sample_rate   = 0;
+thread_local uint64_t   LatencyTrace::current       = 0;
+double                  LatencyTrace::ns_per_tick   = 1.0;
+LatencyHistogram        LatencyTrace::stages[STAGE_MAX];
+
+/**
+ * Stage names by LatencyTrace::STAGES
+ */
+static const char *stage_names[LatencyTrace::STAGE_MAX] = { "framed", "parsed", "encoded", "delivered" };
+
+/**
+ * Quantiles rendered for each stage
+ */
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+LatencyHistogram::LatencyHistogram() {
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+        counts[i] = 0;
+
+    sum_ns = 0;
+}
+
+/**
+ * Highest value of a bucket
+ */
+uint64_t LatencyHistogram::bucketMax(int bucket) {
+    if (bucket < (1 << LATENCY_SUB_BUCKET_BITS))
+        return bucket;
+
+    int shift = (bucket >> LATENCY_SUB_BUCKET_BITS) - 1;
+    uint64_t sub = bucket & ((1 << LATENCY_SUB_BUCKET_BITS) - 1);
+
+    return (((1ULL << LATENCY_SUB_BUCKET_BITS) + sub) << shift) + (1ULL << shift) - 1;
+}
+
+/**
+ * Append the quantiles, sum and count in the Prometheus summary format
+ *
+ * \param [out] out     Metrics text
+ * \param [in]  name    Metric name
+ * \param [in]  labels  Labels without the braces
+ */
+void LatencyHistogram::render(std::string &out, const std::string &name, const std::string &labels) const {
+    uint64_t snapshot[LATENCY_BUCKETS];
+    uint64_t count = 0;
+    char buf[128];
+
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        snapshot[i] = counts[i].load(std::memory_order_relaxed);
+        count += snapshot[i];
+    }
+
+    for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+        uint64_t target = (uint64_t) ceil(quantiles[q] * count);
+        uint64_t seen = 0;
+        uint64_t value = 0;
+
+        for (int i = 0; i < LATENCY_BUCKETS and count > 0; i++) {
+            seen += snapshot[i];
+
+            if (seen >= target and seen > 0) {
+                value = bucketMax(i);
+                break;
+            }
+        }
+
+        snprintf(buf, sizeof(buf), "{%s,quantile=\"%g\"} %.9f\n", labels.c_str(), quantiles[q], value / 1e9);
+        out += name + buf;
+    }
+
+    snprintf(buf, sizeof(buf), "_sum{%s} %.9f\n", labels.c_str(), sum_ns.load(std::memory_order_relaxed) / 1e9);
+    out += name + buf;
+
+    snprintf(buf, sizeof(buf), "_count{%s} %llu\n", labels.c_str(), (unsigned long long) count);
+    out += name + buf;
+}
+
+LatencyArrivals::LatencyArrivals() : stamps(LATENCY_ARRIVALS_SIZE) {
+    received_total = 0;
+    has_pending = false;
+    forwarded_total = 0;
+    has_front = false;
+}
+
+/**
+ * Stamp bytes read from the router socket - router thread only
+ *
+ * \param [in] bytes    Number of bytes read
+ */
+void LatencyArrivals::received(size_t bytes) {
+    received_total += bytes;
+
+    if (has_pending) {
+        pending.end = received_total;           // Merged, keeps the time of the first read
+
+    } else {
+        pending.end = received_total;
+        pending.ticks = LatencyTrace::now();
+        has_pending = true;
+    }
+
+    if (stamps.tryPush(pending))
+        has_pending = false;
+}
+
+/**
+ * Time the next unread byte of the reader pipe was read from the socket - reader thread only
+ *
+ * \param [in] pipe_fd  Read end of the reader pipe
+ *
+ * \return time in LatencyTrace::now() ticks, zero if unknown
+ */
+uint64_t LatencyArrivals::arrival(int pipe_fd) {
+    // Forwarded first, bytes forwarded after it only make the offset earlier
+    uint64_t forwarded = forwarded_total.load(std::memory_order_acquire);
+    int unread = 0;
+
+    if (ioctl(pipe_fd, FIONREAD, &unread) != 0 or (uint64_t) unread > forwarded)
+        return 0;
+
+    uint64_t offset = forwarded - unread;
+
+    while (not has_front or front.end <= offset) {
+        if (not stamps.tryPop(front)) {
+            has_front = false;
+            return 0;
+        }
+
+        has_front = true;
+    }
+
+    return front.ticks;
+}
+
+/**
+ * Enable tracing and calibrate the clock
+ *
+ * \param [in] rate     Trace one in this many route monitoring messages, zero to disable
+ */
+void LatencyTrace::init(int rate) {
+    sample_rate = rate;
+
+    if (rate <= 0)
+        return;
+
+#if defined(__x86_64__) || defined(__i386__)
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t start_ticks = now();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    uint64_t ticks = now() - start_ticks;
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+    if (ticks > 0)
+        ns_per_tick = (double) ns / ticks;
+#endif
+}
+
+/**
+ * Append the stage latencies in the Prometheus text format, nothing if disabled
+ *
+ * \param [out] out     Metrics text
+ */
+void LatencyTrace::render(std::string &out) {
+    if (sample_rate <= 0)
+        return;
+
+    out += "# HELP openbmp_latency_seconds Sampled route monitoring latency from the socket read to each stage\n";
+    out += "# TYPE openbmp_latency_seconds summary\n";
+
+    for (int i = 0; i < STAGE_MAX; i++)
+        stages[i].render(out, "openbmp_latency_seconds", std::string("stage=\"") + stage_names[i] + "\"");
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef LATENCYTRACE_H_
+#define LATENCYTRACE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "ringQueue.hpp"
+
+#define LATENCY_SUB_BUCKET_BITS     4           ///< Sub buckets per power of two, 2^bits (6.25% precision)
+#define LATENCY_MAX_BITS            46          ///< Values up to 2^46 ns (~19 hours) are recorded
+#define LATENCY_BUCKETS             ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_ARRIVALS_SIZE       1024        ///< Socket reads waiting to be matched to a message
+
+/**
+ * \class   LatencyHistogram
+ *
+ * \brief   High dynamic range latency histogram
+ * \details Log-linear buckets like HdrHistogram: values below 2^LATENCY_SUB_BUCKET_BITS ns are exact,
+ *          larger values keep LATENCY_SUB_BUCKET_BITS significant bits.  Recording is lock free.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    /**
+     * Record a value
+     *
+     * \param [in] ns       Latency in nanoseconds
+     */
+    inline void record(uint64_t ns) {
+        counts[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    /**
+     * Append the quantiles, sum and count in the Prometheus summary format
+     *
+     * \param [out] out     Metrics text
+     * \param [in]  name    Metric name
+     * \param [in]  labels  Labels without the braces
+     */
+    void render(std::string &out, const std::string &name, const std::string &labels) const;
+
+private:
+    std::atomic<uint64_t> counts[LATENCY_BUCKETS];
+    std::atomic<uint64_t> sum_ns;
+
+    /**
+     * Bucket of a value
+     */
+    static inline int bucket(uint64_t ns) {
+        if (ns < (1ULL << LATENCY_SUB_BUCKET_BITS))
+            return (int) ns;
+
+        int msb = 63 - __builtin_clzll(ns);
+        if (msb >= LATENCY_MAX_BITS)
+            return LATENCY_BUCKETS - 1;
+
+        int shift = msb - LATENCY_SUB_BUCKET_BITS;
+        return ((msb - LATENCY_SUB_BUCKET_BITS + 1) << LATENCY_SUB_BUCKET_BITS) +
+               (int) ((ns >> shift) & ((1ULL << LATENCY_SUB_BUCKET_BITS) - 1));
+    }
+
+    /**
+     * Highest value of a bucket
+     */
+    static uint64_t bucketMax(int bucket);
+};
+
+/**
+ * \class   LatencyArrivals
+ *
+ * \brief   Socket read times of a router, used to find when the first byte of a message was read
+ * \details The router thread stamps each socket read with the byte offset it ends at and counts the
+ *          bytes forwarded to the reader pipe.  The reader finds the offset of its next message from
+ *          the forwarded bytes still in the pipe, and the read that contains it.  When the stamps
+ *          queue is full, reads are merged and keep the time of the first one.
+ */
+class LatencyArrivals : public ringQueueAligned {
+public:
+    LatencyArrivals();
+
+    /**
+     * Stamp bytes read from the router socket - router thread only
+     *
+     * \param [in] bytes    Number of bytes read
+     */
+    void received(size_t bytes);
+
+    /**
+     * Count bytes written to the reader pipe - router thread only
+     *
+     * \param [in] bytes    Number of bytes written
+     */
+    inline void forwarded(size_t bytes) {
+        forwarded_total.fetch_add(bytes, std::memory_order_release);
+    }
+
+    /**
+     * Time the next unread byte of the reader pipe was read from the socket - reader thread only
+     *
+     * \param [in] pipe_fd  Read end of the reader pipe
+     *
+     * \return time in LatencyTrace::now() ticks, zero if unknown
+     */
+    uint64_t arrival(int pipe_fd);
+
+private:
+    struct stamp {
+        uint64_t    end;                        ///< Socket byte offset the read ends at
+        uint64_t    ticks;                      ///< Time of the read
+    };
+
+    spscQueue<stamp>        stamps;             ///< Reads not yet matched by the reader
+
+    uint64_t                received_total;     ///< Bytes read from the socket, router thread
+    stamp                   pending;            ///< Reads not queued because the queue was full
+    bool                    has_pending;
+
+    std::atomic<uint64_t>   forwarded_total;    ///< Bytes written to the reader pipe
+
+    stamp                   front;              ///< Oldest read not yet passed by the reader
+    bool                    has_front;
+};
+
+/**
+ * \class   LatencyTrace
+ *
+ * \brief   Sampled latency of route monitoring messages, from the socket read to each stage
+ * \details One in latency_sample_rate route monitoring messages of each router is traced.  The trace is
+ *          the time the first byte of the message was read from the router socket.  It is carried by
+ *          the parse task, by the thread parsing it (current) and by the prefix messages encoded
+ *          for it, which pass it to librdkafka as the message opaque for the delivery report.
+ *
+ *          Times are read with rdtsc where available, which needs an invariant TSC synchronized
+ *          across cores, and converted to nanoseconds only when recorded.
+ */
+class LatencyTrace {
+public:
+    /**
+     * Traced stages, each is recorded as the time since the socket read
+     */
+    enum STAGES { STAGE_FRAMED=0, STAGE_PARSED, STAGE_ENCODED, STAGE_DELIVERED, STAGE_MAX };
+
+    static int                  sample_rate;    ///< Trace one in this many messages, zero if disabled
+    static thread_local uint64_t current;       ///< Trace of the message parsed by this thread, zero if none
+
+    /**
+     * Enable tracing and calibrate the clock
+     *
+     * \param [in] rate     Trace one in this many route monitoring messages, zero to disable
+     */
+    static void init(int rate);
+
+    /**
+     * Current time in ticks
+     */
+    static inline uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /**
+     * Record a stage of a trace
+     *
+     * \param [in] stage    Stage, STAGES
+     * \param [in] start    Trace, the time of the socket read in ticks
+     */
+    static inline void record(int stage, uint64_t start) {
+        uint64_t end = now();
+
+        stages[stage].record(end > start ? (uint64_t) ((end - start) * ns_per_tick) : 0);
+    }
+
+    /**
+     * Append the stage latencies in the Prometheus text format, nothing if disabled
+     *
+     * \param [out] out     Metrics text
+     */
+    static void render(std::string &out);
+
+    /**
+     * Sets the trace of the current thread until it goes out of scope
+     */
+    class Scope {
+    public:
+        explicit Scope(uint64_t trace) : prev(current) {
+            current = trace;
+        }
+
+        ~Scope() {
+            current = prev;
+        }
+
+    private:
+        uint64_t    prev;
+    };
+
+private:
+    static double               ns_per_tick;    ///< Tick to nanosecond ratio
+    static LatencyHistogram     stages[STAGE_MAX];
+};
+
+#endif /* LATENCYTRACE_H_ */
@@ -14,10 +14,39 @@
 #include <cstring>
 #include <ctime>
 #include <cerrno>
+#include <cstdlib>
 #include <stdarg.h>
 
 #include "Logger.h"
 
+/**
+ * Logging state of a thread - releases the ring of the thread when it exits
+ */
+struct logThreadState {
+    Logger              *owner;                 ///< Logger the ring belongs to
+    Logger::threadRing  *ring;                  ///< Ring of the thread, NULL until first use
+    bool                in_log;                 ///< Set while queueing, a nested call is from a signal handler
+
+    logThreadState() : owner(NULL), ring(NULL), in_log(false) { }
+
+    ~logThreadState() {
+        if (ring != NULL) {
+            ring->closed = true;
+            release(ring);
+        }
+    }
+
+    /**
+     * Release a reference to the ring, the last one frees it with the records not written
+     */
+    static void release(Logger::threadRing *ring) {
+        if (--ring->refs == 0)
+            delete ring;
+    }
+};
+
+static thread_local logThreadState log_thread;
+
 /*********************************************************************//**
  * Constructor for class
  *
@@ -36,6 +65,11 @@ Logger::Logger(const char *log_filename, const char *debug_filename) {
     debugFile_REALFILE  = false;
     width_filename      = 20;
     width_function      = 20;
+    async               = false;
+    writer_run          = false;
+    writer_thr          = NULL;
+    dropped             = 0;
+    dropped_reported    = 0;
 
     /*
      * Open log file
@@ -73,6 +107,17 @@ Logger::Logger(const char *log_filename, const char *debug_filename) {
  ***********************************************************************/
 Logger::~Logger() {
 
+    stopWriter();
+
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+
+        for (size_t i = 0; i < rings.size(); i++)
+            logThreadState::release(rings[i]);
+
+        rings.clear();
+    }
+
     /*
      * Close open files
      */
@@ -138,86 +183,287 @@ void Logger::DebugPrint(const char *filename, int line_num, const char *func_nam
     // Begin the args
     va_start (args, msg);
 
-    printV("DEBUG", debugFile, filename, line_num, func_name, msg, args);
+    // Debug messages are not dropped, the caller waits for room in the ring instead
+    queueV(debugFile, "DEBUG", filename, line_num, func_name, msg, args, true);
 
     // Free/end the args
     va_end(args);
 }
 
-void Logger::Print(const char *sev, const char *func_name, const char *msg, ...)
+/*********************************************************************//**
+ * Prints the message
+ *
+ *
+ * \param[in]  site         rate limit state of the call site, NULL to not limit
+ * \param[in]  sev          the logging severity
+ * \param[in]  func_name    function name of the calling function
+ * \param[in]  msg          message to print, can contain sprintf formats
+ * \param[in]  ...          Optional list of args for vfprintf
+ ***********************************************************************/
+void Logger::Print(callSite *site, const char *sev, const char *func_name, const char *msg, ...)
 {
     va_list     args;                                     // varialbe args
 
+    if (site != NULL) {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+        // First message of a new second resets the window and reports what was suppressed
+        uint32_t second = (uint32_t) now.tv_sec;
+        uint32_t prev = site->second.load(std::memory_order_relaxed);
+
+        if (prev != second and site->second.compare_exchange_strong(prev, second)) {
+            site->count.store(0, std::memory_order_relaxed);
+
+            uint32_t suppressed = site->suppressed.exchange(0);
+            if (suppressed > 0)
+                queueF(logFile, sev, func_name, "%u messages suppressed by the rate limit", suppressed);
+        }
+
+        if (site->count.fetch_add(1, std::memory_order_relaxed) >= LOG_SITE_RATE) {
+            site->suppressed++;
+            return;
+        }
+    }
+
     // Begin the args
     va_start (args, msg);
 
     // Print without the filename and line number included
-    printV(sev, logFile, NULL, 0, func_name, msg, args);
-    fflush(logFile);
+    queueV(logFile, sev, NULL, 0, func_name, msg, args, false);
 
     // Free/end the args
     va_end(args);
 }
 
 /*********************************************************************//**
- * Prints the message
+ * Start the writer thread - messages are written synchronously until then
+ ***********************************************************************/
+void Logger::startWriter(void) {
+    if (writer_thr != NULL)
+        return;
+
+    writer_run = true;
+    writer_thr = new std::thread(&Logger::writerLoop, this);
+    pthread_setname_np(writer_thr->native_handle(), "logger");
+
+    async = true;
+}
+
+/*********************************************************************//**
+ * Stop the writer thread and write the queued messages
+ ***********************************************************************/
+void Logger::stopWriter(void) {
+    if (writer_thr == NULL)
+        return;
+
+    // New messages are written by the caller from here on
+    async = false;
+
+    writer_run = false;
+    writer_signal.wake();
+
+    writer_thr->join();
+    delete writer_thr;
+    writer_thr = NULL;
+
+    drainRings();
+
+    fflush(logFile);
+    if (debugFile != logFile)
+        fflush(debugFile);
+}
+
+/**
+ * Format the message and queue it, or write it when the writer is not running
  *
+ * \param [in]  output      File to write to
+ * \param [in]  sev         the logging severity
+ * \param [in]  filename    the source file, NULL to not include the file and line
+ * \param [in]  line_num    the line number from the file
+ * \param [in]  func_name   function name of the calling function
+ * \param [in]  msg         message to print, can contain sprintf formats
+ * \param [in]  args        variable list of args for vfprintf
+ * \param [in]  block       wait for room in the ring instead of dropping the message
+ */
+void Logger::queueV(FILE *output, const char *sev, const char *filename, int line_num, const char *func_name,
+                    const char *msg, va_list args, bool block) {
+    record rec;
+
+    rec.output = output;
+    rec.sev = sev;
+    rec.filename = filename;
+    rec.line_num = line_num;
+    rec.func_name = func_name;
+    gettimeofday(&rec.tv, NULL);
+
+    // Longer messages are truncated
+    if (vsnprintf(rec.msg, sizeof(rec.msg), msg, args) < 0)
+        rec.msg[0] = 0;
+
+    threadRing *ring = async ? getRing() : NULL;
+
+    if (ring == NULL) {
+        writeRecord(&rec);
+        fflush(output);
+        return;
+    }
+
+    log_thread.in_log = true;
+
+    if (block ? ring->queue.push(rec) : ring->queue.tryPush(rec))
+        writer_signal.wake();
+    else
+        dropped++;
+
+    log_thread.in_log = false;
+}
+
+/**
+ * Format the message and queue it, without a filename - see queueV()
+ */
+void Logger::queueF(FILE *output, const char *sev, const char *func_name, const char *msg, ...) {
+    va_list args;
+
+    va_start(args, msg);
+    queueV(output, sev, NULL, 0, func_name, msg, args, false);
+    va_end(args);
+}
+
+/**
+ * Ring of the calling thread, registered on first use
  *
- * \param[in]  sev          the logging severity
- * \param[in]  func_name    function name of the calling function
- * \param[in]  msg          message to print, can contain sprintf formats
- * \param[in]  ...          Optional list of args for vfprintf
- ***********************************************************************/
-void Logger::printV(const char *sev,
-                   FILE *output,
-                   const char *filename,
-                   int line_num,
-                   const char *func_name,
-                   const char *msg,
-                   va_list args)
-{
-    char        bufmsg[4096];                             // Updated message that includes filename/line number
-    const char  *fname;                                   // Filename pointer
+ * \return ring, NULL if it cannot be used from here
+ */
+Logger::threadRing *Logger::getRing(void) {
+    // A signal handler interrupted this thread while it was queueing, write directly instead
+    if (log_thread.in_log)
+        return NULL;
 
-    char        fmt[512];                                 // Updated message that includes filename/line number
+    if (log_thread.ring == NULL) {
+        log_thread.ring = new threadRing;
+        log_thread.owner = this;
 
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        rings.push_back(log_thread.ring);
+    }
+
+    return log_thread.owner == this ? log_thread.ring : NULL;
+}
+
+/**
+ * Write the queued records of all rings
+ *
+ * \return number of records written
+ */
+size_t Logger::drainRings(void) {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    record rec;
+    size_t total = 0;
+
+    for (std::vector<threadRing *>::iterator it = rings.begin(); it != rings.end(); ) {
+        threadRing *ring = *it;
+
+        // Read before draining, the thread does not queue anything after closing
+        bool closed = ring->closed;
+
+        // Bounded so a busy thread does not hold back the others, pop() wakes a blocked push()
+        size_t count = 0;
+        while (count < LOG_RING_SIZE and ring->queue.pop(rec, 0)) {
+            writeRecord(&rec);
+            count++;
+        }
+
+        total += count;
+
+        if (closed) {
+            it = rings.erase(it);
+            logThreadState::release(ring);
+        } else
+            ++it;
+    }
+
+    return total;
+}
+
+/**
+ * Writer thread loop
+ */
+void Logger::writerLoop(void) {
+    while (writer_run) {
+        size_t written = drainRings();
+
+        uint64_t drops = dropped.load();
+        if (drops != dropped_reported) {
+            record rec;
+
+            rec.output = logFile;
+            rec.sev = "WARN";
+            rec.filename = NULL;
+            rec.func_name = __FUNCTION__;
+            gettimeofday(&rec.tv, NULL);
+            snprintf(rec.msg, sizeof(rec.msg), "%lu log messages dropped, thread ring full",
+                     (unsigned long)(drops - dropped_reported));
+
+            writeRecord(&rec);
+            dropped_reported = drops;
+            written++;
+        }
+
+        if (written > 0) {
+            fflush(logFile);
+            if (debugFile != logFile)
+                fflush(debugFile);
+            continue;
+        }
+
+        uint32_t seq = writer_signal.prepare();
+
+        bool pending = false;
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex);
+
+            for (size_t i = 0; i < rings.size() and not pending; i++)
+                pending = rings[i]->queue.count() > 0 or rings[i]->closed;
+        }
+
+        if (pending or not writer_run) {
+            writer_signal.cancel();
+            continue;
+        }
+
+        writer_signal.wait(seq, 1000);
+    }
+}
 
+/*********************************************************************//**
+ * Writes a record with the severity, time, filename and function prefix
+ *
+ * \param[in]  rec          Record to write
+ ***********************************************************************/
+void Logger::writeRecord(const record *rec)
+{
+    const char  *fname;                                   // Filename pointer
     char        time_str[128];
-    struct      timeval tv;
     struct      tm t;
 
-    // Get current time
-    gettimeofday(&tv,NULL);
-    gmtime_r(&tv.tv_sec, &t);
+    gmtime_r(&rec->tv.tv_sec, &t);
     strftime(time_str,sizeof(time_str), "%Y-%m-%dT%H:%M:%S", &t);
 
     // If we have a filename, include it in the print
-    if (filename != NULL) {
+    if (rec->filename != NULL) {
 
         // Strip off the path on filename if exists
-        (fname = strrchr(filename, '/')) != NULL ? fname++ : fname = filename;
-
-        // Build the format spec
-        snprintf(fmt, sizeof(fmt), "%%s.%%06u | %%-8s | %%%ds[%%05d] | %%-%ds | %%s\n",
-                width_filename, width_function);
+        (fname = strrchr(rec->filename, '/')) != NULL ? fname++ : fname = rec->filename;
 
-        // Update the message to include file/line
-        snprintf(bufmsg, sizeof(bufmsg), fmt /*"%s.%06u | %-10s | %20s[%05d] | %-26s | %s\n"*/,
-                time_str, tv.tv_usec, sev,
-                fname, line_num, func_name, msg);
+        fprintf(rec->output, "%s.%06u | %-8s | %*s[%05d] | %-*s | %s\n",
+                time_str, (unsigned int) rec->tv.tv_usec, rec->sev,
+                width_filename, fname, rec->line_num, width_function, rec->func_name, rec->msg);
     }
 
     else {
-        // Build the format spec
-        snprintf(fmt, sizeof(fmt), "%%s.%%06u | %%-8s | %%-%ds | %%s\n",  width_function);
-
-        // Update the message to include function name only
-        snprintf(bufmsg, sizeof(bufmsg), fmt /* "%s.%06u | %-10s | %-30s | %s\n" */,
-                time_str, tv.tv_usec, sev,
-                func_name, msg);
+        fprintf(rec->output, "%s.%06u | %-8s | %-*s | %s\n",
+                time_str, (unsigned int) rec->tv.tv_usec, rec->sev,
+                width_function, rec->func_name, rec->msg);
     }
-
-    // Print the message
-    vfprintf(output, bufmsg, args);
 }
-
@@ -12,6 +12,18 @@
 #include <cstdio>
 #include <iostream>
 #include <cstdint>
+#include <cstdarg>
+#include <sys/time.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ringQueue.hpp"
+
+#define LOG_RING_SIZE       256             ///< Records queued per thread before messages are dropped
+#define LOG_SITE_RATE       100             ///< Messages per second logged by a call site, the rest are suppressed
+#define LOG_MSG_SIZE        1024            ///< Max message length, each ring slot has a buffer of this size
 
 
 /*
@@ -21,12 +33,15 @@
 #define SELF_DEBUG(...) if (debug) logger->DebugPrint(__FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
 
 /*
- * Below defines LOG macros for various severities
+ * Below defines LOG macros for various severities - each call site has its own rate limit
  */
-#define LOG_INFO(...)    logger->Print("INFO",   __FUNCTION__, __VA_ARGS__)
-#define LOG_WARN(...)    logger->Print("WARN",   __FUNCTION__, __VA_ARGS__)
-#define LOG_NOTICE(...)  logger->Print("NOTICE", __FUNCTION__, __VA_ARGS__)
-#define LOG_ERR(...)     logger->Print("ERROR",  __FUNCTION__, __VA_ARGS__)
+#define LOG_PRINT(sev, ...) do { static Logger::callSite log_site; \
+                                 logger->Print(&log_site, sev, __FUNCTION__, __VA_ARGS__); } while (0)
+
+#define LOG_INFO(...)    LOG_PRINT("INFO",   __VA_ARGS__)
+#define LOG_WARN(...)    LOG_PRINT("WARN",   __VA_ARGS__)
+#define LOG_NOTICE(...)  LOG_PRINT("NOTICE", __VA_ARGS__)
+#define LOG_ERR(...)     LOG_PRINT("ERROR",  __VA_ARGS__)
 
 /**
  * \class   Logger
@@ -48,6 +63,12 @@
  *
  *          LOG_<sev>() macros are used for general logging, not DEBUG.
  *
+ *          Once startWriter() is called, messages are formatted by the calling
+ *          thread into its own ring and written by a writer thread, so a burst
+ *          of messages does not block the caller on disk I/O.  Messages are
+ *          dropped and counted when the ring of the thread is full.  Each LOG_<sev>()
+ *          call site logs at most LOG_SITE_RATE messages per second.
+ *
  *      \code{.cpp}
  *      public:
  *      void Logger::disableDebug(void) {
@@ -65,6 +86,16 @@
  */
 class Logger {
 public:
+    /**
+     * Rate limit state of a LOG_<sev>() call site
+     */
+    struct callSite {
+        std::atomic<uint32_t>   second;         ///< Second of the current window
+        std::atomic<uint32_t>   count;          ///< Messages logged in the window
+        std::atomic<uint32_t>   suppressed;     ///< Messages suppressed since the last logged one
+
+        callSite() : second(0), count(0), suppressed(0) { }
+    };
 
     /*********************************************************************//**
      * Constructor for class
@@ -106,16 +137,36 @@ public:
     void setWidthFilename(u_char width);
 
 
+    /*********************************************************************//**
+     * Start the writer thread - messages are written synchronously until then
+     *
+     * \details Must be called after the daemon fork, the thread does not survive it.
+     ***********************************************************************/
+    void startWriter(void);
+
+    /*********************************************************************//**
+     * Stop the writer thread and write the queued messages
+     ***********************************************************************/
+    void stopWriter(void);
+
+    /*********************************************************************//**
+     * Number of messages dropped because a thread ring was full
+     ***********************************************************************/
+    inline uint64_t getDropped(void) {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
     /*********************************************************************//**
      * Prints the message
      *
      *
+     * \param[in]  site         rate limit state of the call site, NULL to not limit
      * \param[in]  sev          the logging severity
      * \param[in]  func_name    function name of the calling function
      * \param[in]  msg          message to print, can contain sprintf formats
      * \param[in]  ...          Optional list of args for vfprintf
      ***********************************************************************/
-    void Print(const char *sev, const char *func_name, const char *msg, ...);
+    void Print(callSite *site, const char *sev, const char *func_name, const char *msg, ...);
 
     /*********************************************************************//**
      * Prints debug message if debug is enabled
@@ -131,6 +182,32 @@ public:
 
 
 private:
+    friend struct logThreadState;
+
+    /**
+     * Formatted message queued for the writer thread
+     */
+    struct record {
+        FILE        *output;                    ///< File to write to
+        timeval     tv;                         ///< Time the message was logged
+        const char  *sev;                       ///< Severity
+        const char  *filename;                  ///< Source file, NULL to not include the file and line
+        int         line_num;                   ///< Source line
+        const char  *func_name;                 ///< Function name
+        char        msg[LOG_MSG_SIZE];          ///< Message, nul terminated
+    };
+
+    /**
+     * Ring of a logging thread, released by both the thread and the logger
+     */
+    struct threadRing : public ringQueueAligned {
+        spscQueue<record>       queue;          ///< Records, the thread is the producer
+        std::atomic<bool>       closed;         ///< Thread has exited
+        std::atomic<int>        refs;           ///< Released by the thread and the logger
+
+        threadRing() : queue(LOG_RING_SIZE), closed(false), refs(2) { }
+    };
+
     bool    logFile_REALFILE;           ///< Indicates if the log file is using a real file or not
     bool    debugFile_REALFILE;         ///< Indicates if the debug log file is using a real file or not
     FILE    *debugFile;                 ///< Debug log file
@@ -141,25 +218,59 @@ private:
     u_char  width_function;             ///< Defines the width of the function field when printed
     u_char  width_filename;             ///< Defines the width of the filename field when printed
 
+    std::atomic<bool>   async;                  ///< Messages are queued for the writer thread
+    std::atomic<bool>   writer_run;             ///< Writer thread runs while true
+    std::thread         *writer_thr;            ///< Writer thread
+    ringQueueSignal     writer_signal;          ///< Wakes the writer thread
+    std::mutex          rings_mutex;            ///< Protects rings
+    std::vector<threadRing *> rings;            ///< Rings of the logging threads
+    std::atomic<uint64_t> dropped;              ///< Messages dropped because a ring was full
+    uint64_t            dropped_reported;       ///< Dropped messages already reported, writer thread only
 
     /**
-     * Prints the message using a variable arg list
+     * Format the message and queue it, or write it when the writer is not running
      *
+     * \param [in]  output      File to write to
      * \param [in]  sev         the logging severity
-     * \param [in]  filename    the source file that originated the debug message
-     *                          IF NULL, then the filename and line number will not be included
-     * \param [in]  line_num    the line number from the file that originated the debug message
+     * \param [in]  filename    the source file, NULL to not include the file and line
+     * \param [in]  line_num    the line number from the file
      * \param [in]  func_name   function name of the calling function
      * \param [in]  msg         message to print, can contain sprintf formats
      * \param [in]  args        variable list of args for vfprintf
+     * \param [in]  block       wait for room in the ring instead of dropping the message
+     */
+    void queueV(FILE *output, const char *sev, const char *filename, int line_num, const char *func_name,
+                const char *msg, va_list args, bool block);
+
+    /**
+     * Format the message and queue it, without a filename - see queueV()
+     */
+    void queueF(FILE *output, const char *sev, const char *func_name, const char *msg, ...);
+
+    /**
+     * Writes a record with the severity, time, filename and function prefix
+     *
+     * \param [in]  rec         Record to write
      */
-    void printV(const char *sev,
-                FILE *output,
-                const char *filename,
-                int line_num,
-                const char *func_name,
-                const char *msg,
-                va_list args);
+    void writeRecord(const record *rec);
 
+    /**
+     * Ring of the calling thread, registered on first use
+     *
+     * \return ring, NULL if it cannot be used from here
+     */
+    threadRing *getRing(void);
+
+    /**
+     * Write the queued records of all rings
+     *
+     * \return number of records written
+     */
+    size_t drainRings(void);
+
+    /**
+     * Writer thread loop
+     */
+    void writerLoop(void);
 };
 #endif /* LOGGER_H_ */
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cstdio>
+#include <map>
+
+#include "Metrics.h"
+
+const uint64_t MetricsHistogram::bounds_ns[METRICS_HIST_BUCKETS] = {
+        10000, 25000, 50000, 100000, 250000, 500000,                    // 10us - 500us
+        1000000, 2500000, 5000000, 10000000, 25000000, 50000000,        // 1ms - 50ms
+        100000000, 250000000, 500000000, 1000000000 };                  // 100ms - 1s
+
+std::mutex                  RouterMetrics::registry_mutex;
+std::list<RouterMetrics *>  RouterMetrics::registry;
+RouterMetrics::Values       RouterMetrics::closed = {};
+
+/**
+ * BMP message type names by parseBMP::BMP_TYPE
+ */
+static const char *bmp_type_names[METRICS_BMP_TYPES] = {
+        "route_monitoring", "stats_report", "peer_down", "peer_up", "initiation", "termination",
+        "route_mirroring" };
+
+/**
+ * Counters and gauges rendered the same way, global and per router
+ */
+static const struct {
+    const char  *name;
+    const char  *help;
+    const char  *type;
+    uint64_t    RouterMetrics::Values::*field;
+} scalar_metrics[] = {
+    { "bytes_read_total",           "Bytes read from the router sockets",       "counter",
+      &RouterMetrics::Values::bytes_read },
+    { "bgp_updates_total",          "BGP UPDATE messages parsed",               "counter",
+      &RouterMetrics::Values::updates },
+    { "prefixes_announced_total",   "NLRI announced in BGP UPDATEs",            "counter",
+      &RouterMetrics::Values::announced },
+    { "prefixes_withdrawn_total",   "NLRI withdrawn in BGP UPDATEs",            "counter",
+      &RouterMetrics::Values::withdrawn },
+    { "buffer_used_bytes",          "Bytes in the router buffers not yet given to the readers", "gauge",
+      &RouterMetrics::Values::buf_used },
+    { "buffer_size_bytes",          "Size of the router buffers",               "gauge",
+      &RouterMetrics::Values::buf_size },
+    { "kafka_outq_messages",        "Messages in the Kafka producer queues",    "gauge",
+      &RouterMetrics::Values::kafka_outq },
+    { "kafka_produce_errors_total", "Messages that failed to produce to Kafka", "counter",
+      &RouterMetrics::Values::produce_errors },
+};
+
+MetricsHistogram::MetricsHistogram() {
+    for (int i = 0; i <= METRICS_HIST_BUCKETS; i++)
+        counts[i] = 0;
+
+    sum_ns = 0;
+}
+
+/**
+ * Add the histogram to the values
+ *
+ * \param [in,out] values   Values to add to
+ */
+void MetricsHistogram::read(Values &values) const {
+    for (int i = 0; i <= METRICS_HIST_BUCKETS; i++)
+        values.counts[i] += counts[i].load(std::memory_order_relaxed);
+
+    values.sum_ns += sum_ns.load(std::memory_order_relaxed);
+}
+
+/**
+ * Constructor for class - Adds the session to the registry
+ *
+ * \param [in] router   Router IP address in printed form
+ */
+RouterMetrics::RouterMetrics(const std::string &router) : router(router) {
+    bytes_read = 0;
+    for (int i = 0; i < METRICS_BMP_TYPES; i++)
+        bmp_msgs[i] = 0;
+    updates = 0;
+    announced = 0;
+    withdrawn = 0;
+    buf_used = 0;
+    buf_size = 0;
+    kafka_outq = 0;
+    produce_errors = 0;
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.push_back(this);
+}
+
+/**
+ * Destructor for class - Removes the session and adds its counters to the closed totals
+ */
+RouterMetrics::~RouterMetrics() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.remove(this);
+
+    // Gauges only count for open sessions
+    read(closed);
+    closed.buf_used = 0;
+    closed.buf_size = 0;
+    closed.kafka_outq = 0;
+}
+
+/**
+ * Add the counters and gauges to the values
+ *
+ * \param [in,out] values   Values to add to
+ */
+void RouterMetrics::read(Values &values) const {
+    values.bytes_read += bytes_read.load(std::memory_order_relaxed);
+    for (int i = 0; i < METRICS_BMP_TYPES; i++)
+        values.bmp_msgs[i] += bmp_msgs[i].load(std::memory_order_relaxed);
+    values.updates += updates.load(std::memory_order_relaxed);
+    values.announced += announced.load(std::memory_order_relaxed);
+    values.withdrawn += withdrawn.load(std::memory_order_relaxed);
+    values.buf_used += buf_used.load(std::memory_order_relaxed);
+    values.buf_size += buf_size.load(std::memory_order_relaxed);
+    values.kafka_outq += kafka_outq.load(std::memory_order_relaxed);
+    values.produce_errors += produce_errors.load(std::memory_order_relaxed);
+
+    parse_time.read(values.parse_time);
+    encode_time.read(values.encode_time);
+}
+
+/**
+ * Append the HELP and TYPE lines of a metric
+ */
+static void renderHeader(std::string &out, const std::string &name, const char *help, const char *type) {
+    out += "# HELP " + name + " " + help + "\n";
+    out += "# TYPE " + name + " " + type + "\n";
+}
+
+/**
+ * Append a sample
+ *
+ * \param [out] out     Metrics text
+ * \param [in]  name    Metric name
+ * \param [in]  labels  Labels without the braces, empty if none
+ * \param [in]  value   Sample value
+ */
+static void renderSample(std::string &out, const std::string &name, const std::string &labels, uint64_t value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), " %llu\n", (unsigned long long) value);
+
+    out += name;
+    if (labels.size() > 0)
+        out += "{" + labels + "}";
+    out += buf;
+}
+
+/**
+ * Append the samples of a histogram
+ *
+ * \param [out] out     Metrics text
+ * \param [in]  name    Metric name
+ * \param [in]  labels  Labels without the braces, empty if none
+ * \param [in]  values  Histogram values
+ */
+static void renderHistogram(std::string &out, const std::string &name, const std::string &labels,
+                            const MetricsHistogram::Values &values) {
+    char buf[64];
+    std::string sep = labels.size() > 0 ? labels + "," : "";
+    uint64_t count = 0;
+
+    for (int i = 0; i <= METRICS_HIST_BUCKETS; i++) {
+        count += values.counts[i];
+
+        if (i < METRICS_HIST_BUCKETS)
+            snprintf(buf, sizeof(buf), "le=\"%g\"", MetricsHistogram::bounds_ns[i] / 1e9);
+        else
+            snprintf(buf, sizeof(buf), "le=\"+Inf\"");
+
+        renderSample(out, name + "_bucket", sep + buf, count);
+    }
+
+    snprintf(buf, sizeof(buf), " %.9f\n", values.sum_ns / 1e9);
+    out += name + "_sum";
+    if (labels.size() > 0)
+        out += "{" + labels + "}";
+    out += buf;
+
+    renderSample(out, name + "_count", labels, count);
+}
+
+/**
+ * Render all sessions and the global totals in the Prometheus text format
+ *
+ * \details Sessions of the same router are added together.
+ *
+ * \param [out] out     Metrics text
+ */
+void RouterMetrics::render(std::string &out) {
+    std::map<std::string, Values> routers;
+    Values total;
+    size_t sessions;
+
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+
+        total = closed;
+        sessions = registry.size();
+
+        for (std::list<RouterMetrics *>::iterator it = registry.begin(); it != registry.end(); it++) {
+            std::map<std::string, Values>::iterator r_it = routers.find((*it)->router);
+            if (r_it == routers.end())
+                r_it = routers.insert(std::make_pair((*it)->router, Values())).first;
+
+            (*it)->read(r_it->second);
+            (*it)->read(total);
+        }
+    }
+
+    out.clear();
+
+    renderHeader(out, "openbmp_router_sessions", "Connected router sessions", "gauge");
+    renderSample(out, "openbmp_router_sessions", "", sessions);
+
+    for (size_t m = 0; m < sizeof(scalar_metrics) / sizeof(scalar_metrics[0]); m++) {
+        std::string name = std::string("openbmp_") + scalar_metrics[m].name;
+        renderHeader(out, name, scalar_metrics[m].help, scalar_metrics[m].type);
+        renderSample(out, name, "", total.*scalar_metrics[m].field);
+
+        name = std::string("openbmp_router_") + scalar_metrics[m].name;
+        renderHeader(out, name, scalar_metrics[m].help, scalar_metrics[m].type);
+        for (std::map<std::string, Values>::iterator it = routers.begin(); it != routers.end(); it++)
+            renderSample(out, name, "router=\"" + it->first + "\"", it->second.*scalar_metrics[m].field);
+    }
+
+    renderHeader(out, "openbmp_bmp_messages_total", "BMP messages read by type", "counter");
+    for (int i = 0; i < METRICS_BMP_TYPES; i++)
+        renderSample(out, "openbmp_bmp_messages_total", std::string("type=\"") + bmp_type_names[i] + "\"",
+                     total.bmp_msgs[i]);
+
+    renderHeader(out, "openbmp_router_bmp_messages_total", "BMP messages read by type", "counter");
+    for (std::map<std::string, Values>::iterator it = routers.begin(); it != routers.end(); it++) {
+        for (int i = 0; i < METRICS_BMP_TYPES; i++)
+            renderSample(out, "openbmp_router_bmp_messages_total",
+                         "router=\"" + it->first + "\",type=\"" + bmp_type_names[i] + "\"", it->second.bmp_msgs[i]);
+    }
+
+    renderHeader(out, "openbmp_parse_seconds", "Route monitoring message parse time", "histogram");
+    renderHistogram(out, "openbmp_parse_seconds", "", total.parse_time);
+
+    renderHeader(out, "openbmp_router_parse_seconds", "Route monitoring message parse time", "histogram");
+    for (std::map<std::string, Values>::iterator it = routers.begin(); it != routers.end(); it++)
+        renderHistogram(out, "openbmp_router_parse_seconds", "router=\"" + it->first + "\"", it->second.parse_time);
+
+    renderHeader(out, "openbmp_encode_seconds", "Prefix message encode time", "histogram");
+    renderHistogram(out, "openbmp_encode_seconds", "", total.encode_time);
+
+    renderHeader(out, "openbmp_router_encode_seconds", "Prefix message encode time", "histogram");
+    for (std::map<std::string, Values>::iterator it = routers.begin(); it != routers.end(); it++)
+        renderHistogram(out, "openbmp_router_encode_seconds", "router=\"" + it->first + "\"", it->second.encode_time);
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+
+#define METRICS_HIST_BUCKETS    16              ///< Histogram buckets, not counting +Inf
+#define METRICS_BMP_TYPES       7               ///< BMP message types counted, parseBMP::BMP_TYPE
+
+/**
+ * \class   MetricsHistogram
+ *
+ * \brief   Latency histogram with fixed buckets from 10us to 1s
+ * \details Observations are lock free, the buckets are not cumulative until rendered.
+ */
+class MetricsHistogram {
+public:
+    static const uint64_t bounds_ns[METRICS_HIST_BUCKETS];     ///< Bucket upper bounds in nanoseconds
+
+    /**
+     * Histogram values read at one point in time
+     */
+    struct Values {
+        uint64_t    counts[METRICS_HIST_BUCKETS + 1];          ///< Per bucket counts, the last is +Inf
+        uint64_t    sum_ns;                                    ///< Sum of the observations in nanoseconds
+    };
+
+    MetricsHistogram();
+
+    /**
+     * Add an observation
+     *
+     * \param [in] ns       Duration in nanoseconds
+     */
+    inline void observe(uint64_t ns) {
+        int i = 0;
+        while (i < METRICS_HIST_BUCKETS and ns > bounds_ns[i])
+            i++;
+
+        counts[i].fetch_add(1, std::memory_order_relaxed);
+        sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    /**
+     * Add the histogram to the values
+     *
+     * \param [in,out] values   Values to add to
+     */
+    void read(Values &values) const;
+
+private:
+    std::atomic<uint64_t> counts[METRICS_HIST_BUCKETS + 1];
+    std::atomic<uint64_t> sum_ns;
+};
+
+/**
+ * \class   MetricsTimer
+ *
+ * \brief   Observes the time until it goes out of scope
+ */
+class MetricsTimer {
+public:
+    /**
+     * \param [in] hist     Histogram to observe, NULL to not time
+     */
+    explicit MetricsTimer(MetricsHistogram *hist) : hist(hist) {
+        if (hist != NULL)
+            start = std::chrono::steady_clock::now();
+    }
+
+    ~MetricsTimer() {
+        if (hist != NULL)
+            hist->observe(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    MetricsHistogram                        *hist;
+    std::chrono::steady_clock::time_point   start;
+};
+
+/**
+ * \class   RouterMetrics
+ *
+ * \brief   Counters of a router session
+ * \details Updated by the router, reader, parse, encode and producer threads of the session with
+ *          relaxed atomics.  Shared by the router thread and its message bus.  Sessions are added to
+ *          the registry when created; when deleted, their counters are added to the totals of the
+ *          closed sessions so the global counters don't go back.
+ */
+class RouterMetrics {
+public:
+    /**
+     * Counters and gauges read at one point in time
+     */
+    struct Values {
+        uint64_t    bytes_read;                                 ///< Bytes read from the router socket
+        uint64_t    bmp_msgs[METRICS_BMP_TYPES];                ///< BMP messages by type
+        uint64_t    updates;                                    ///< BGP UPDATEs parsed
+        uint64_t    announced;                                  ///< NLRI announced
+        uint64_t    withdrawn;                                  ///< NLRI withdrawn
+        uint64_t    buf_used;                                   ///< Bytes in the router buffer
+        uint64_t    buf_size;                                   ///< Size of the router buffer
+        uint64_t    kafka_outq;                                 ///< Messages in the Kafka producer queue
+        uint64_t    produce_errors;                             ///< Messages that failed to produce
+        MetricsHistogram::Values parse_time;                    ///< Route monitoring parse time
+        MetricsHistogram::Values encode_time;                   ///< Prefix message encode time
+    };
+
+    std::atomic<uint64_t>   bytes_read;
+    std::atomic<uint64_t>   bmp_msgs[METRICS_BMP_TYPES];
+    std::atomic<uint64_t>   updates;
+    std::atomic<uint64_t>   announced;
+    std::atomic<uint64_t>   withdrawn;
+    std::atomic<uint64_t>   buf_used;
+    std::atomic<uint64_t>   buf_size;
+    std::atomic<uint64_t>   kafka_outq;
+    std::atomic<uint64_t>   produce_errors;
+    MetricsHistogram        parse_time;
+    MetricsHistogram        encode_time;
+
+    /**
+     * Constructor for class - Adds the session to the registry
+     *
+     * \param [in] router   Router IP address in printed form
+     */
+    explicit RouterMetrics(const std::string &router);
+
+    /**
+     * Destructor for class - Removes the session and adds its counters to the closed totals
+     */
+    ~RouterMetrics();
+
+    /**
+     * Add the counters and gauges to the values
+     *
+     * \param [in,out] values   Values to add to
+     */
+    void read(Values &values) const;
+
+    /**
+     * Render all sessions and the global totals in the Prometheus text format
+     *
+     * \param [out] out     Metrics text
+     */
+    static void render(std::string &out);
+
+private:
+    std::string             router;                             ///< Router IP address in printed form
+
+    static std::mutex                   registry_mutex;         ///< Protects the registry and closed totals
+    static std::list<RouterMetrics *>   registry;               ///< Active sessions
+    static Values                       closed;                 ///< Counters of the closed sessions
+};
+
+#endif /* METRICS_H_ */
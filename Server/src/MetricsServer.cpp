@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+
+#include "MetricsServer.h"
+#include "Metrics.h"
+#include "LatencyTrace.h"
+
+/**
+ * Constructor for class - Opens the listening socket and starts the metrics thread
+ *
+ * \param [in] logPtr   Pointer to Logger instance
+ * \param [in] cfg      Pointer to the config instance
+ *
+ * \throw (char const *str) message indicate error
+ */
+MetricsServer::MetricsServer(Logger *logPtr, Config *cfg) {
+    logger = logPtr;
+    this->cfg = cfg;
+    debug = cfg->debug_general;
+    metrics_thread = NULL;
+
+    sockaddr_storage addr;
+    socklen_t addr_len;
+    bzero(&addr, sizeof(addr));
+
+    sockaddr_in *addr_v4 = (sockaddr_in *) &addr;
+    sockaddr_in6 *addr_v6 = (sockaddr_in6 *) &addr;
+
+    if (inet_pton(AF_INET, cfg->metrics_address.c_str(), &addr_v4->sin_addr) == 1) {
+        addr_v4->sin_family = AF_INET;
+        addr_v4->sin_port = htons(cfg->metrics_port);
+        addr_len = sizeof(sockaddr_in);
+
+    } else if (inet_pton(AF_INET6, cfg->metrics_address.c_str(), &addr_v6->sin6_addr) == 1) {
+        addr_v6->sin6_family = AF_INET6;
+        addr_v6->sin6_port = htons(cfg->metrics_port);
+        addr_len = sizeof(sockaddr_in6);
+
+    } else
+        throw "ERROR: Invalid metrics address";
+
+    if ((sock = socket(addr.ss_family, SOCK_STREAM, 0)) < 0)
+        throw "ERROR: Cannot open metrics socket";
+
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    if (::bind(sock, (struct sockaddr *) &addr, addr_len) < 0) {
+        close(sock);
+        throw "ERROR: Cannot bind to the metrics address and port";
+    }
+
+    listen(sock, 10);
+
+    running = true;
+    metrics_thread = new std::thread(&MetricsServer::metricsLoop, this);
+
+    LOG_INFO("Metrics listening on %s port %u", cfg->metrics_address.c_str(), cfg->metrics_port);
+}
+
+/**
+ * Destructor for class - Stops the metrics thread and closes the socket
+ */
+MetricsServer::~MetricsServer() {
+    running = false;
+
+    if (metrics_thread != NULL) {
+        metrics_thread->join();
+        delete metrics_thread;
+    }
+
+    close(sock);
+}
+
+/**
+ * Metrics thread loop - Accepts and serves clients
+ */
+void MetricsServer::metricsLoop() {
+    pollfd pfd;
+
+    while (running) {
+        pfd.fd = sock;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        if (poll(&pfd, 1, 500) <= 0)
+            continue;
+
+        int fd = accept(sock, NULL, NULL);
+        if (fd < 0) {
+            LOG_WARN("Failed to accept metrics connection: %s", strerror(errno));
+            continue;
+        }
+
+        serveClient(fd);
+        close(fd);
+    }
+}
+
+/**
+ * Read the request and send the reply
+ *
+ * \param [in] fd       Client socket
+ */
+void MetricsServer::serveClient(int fd) {
+    std::string request;
+    char read_buf[1024];
+    pollfd pfd;
+
+    // Only the request line is used, the rest of the headers are read so the client sees the reply
+    while (request.find("\r\n\r\n") == std::string::npos and request.find("\n\n") == std::string::npos) {
+        if (request.size() > METRICS_MAX_REQUEST)
+            return;
+
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        if (poll(&pfd, 1, METRICS_CLIENT_TIMEOUT) <= 0)
+            return;
+
+        ssize_t n = read(fd, read_buf, sizeof(read_buf));
+        if (n <= 0)
+            return;
+
+        request.append(read_buf, n);
+    }
+
+    std::string line = request.substr(0, request.find_first_of("\r\n"));
+    std::string status = "200 OK";
+    std::string body;
+
+    SELF_DEBUG("Metrics request: %s", line.c_str());
+
+    if (line.compare(0, 4, "GET ") != 0) {
+        status = "405 Method Not Allowed";
+        body = "Only GET is supported\n";
+
+    } else if (line.compare(4, 9, "/metrics ") != 0 and line.compare(4, 9, "/metrics?") != 0) {
+        status = "404 Not Found";
+        body = "See /metrics\n";
+
+    } else {
+        RouterMetrics::render(body);
+        LatencyTrace::render(body);
+    }
+
+    char hdr[256];
+    snprintf(hdr, sizeof(hdr), "HTTP/1.0 %s\r\n"
+                               "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                               "Content-Length: %zu\r\n"
+                               "Connection: close\r\n\r\n", status.c_str(), body.size());
+
+    std::string reply = hdr + body;
+
+    for (size_t sent = 0; sent < reply.size(); ) {
+        ssize_t n = send(fd, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return;
+        sent += n;
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef METRICSSERVER_H_
+#define METRICSSERVER_H_
+
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include "Logger.h"
+#include "Config.h"
+
+/**
+ * \class   MetricsServer
+ *
+ * \brief   HTTP endpoint for the metrics in the Prometheus text format
+ * \details Serves "GET /metrics" (see RouterMetrics::render() and LatencyTrace::render()), anything else gets a 404.  Each
+ *          connection serves one request and is closed.  Clients are served one at a time by the
+ *          metrics thread.
+ */
+class MetricsServer {
+public:
+    #define METRICS_MAX_REQUEST         4096        ///< Max request header length
+    #define METRICS_CLIENT_TIMEOUT      5000        ///< Milliseconds to wait for the request before closing
+
+    /**
+     * Constructor for class - Opens the listening socket and starts the metrics thread
+     *
+     * \param [in] logPtr   Pointer to Logger instance
+     * \param [in] cfg      Pointer to the config instance
+     *
+     * \throw (char const *str) message indicate error
+     */
+    MetricsServer(Logger *logPtr, Config *cfg);
+
+    /**
+     * Destructor for class - Stops the metrics thread and closes the socket
+     */
+    ~MetricsServer();
+
+private:
+    Config          *cfg;                       ///< Configuration instance
+    Logger          *logger;                    ///< Logging class pointer
+    bool            debug;                      ///< debug flag to indicate debugging
+
+    int             sock;                       ///< Listening socket
+    std::atomic<bool> running;                  ///< Indicates the metrics thread should run
+    std::thread     *metrics_thread;            ///< Metrics thread
+
+    /**
+     * Metrics thread loop - Accepts and serves clients
+     */
+    void metricsLoop();
+
+    /**
+     * Read the request and send the reply
+     *
+     * \param [in] fd       Client socket
+     */
+    void serveClient(int fd);
+};
+
+#endif /* METRICSSERVER_H_ */
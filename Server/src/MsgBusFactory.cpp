@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include "MsgBusFactory.h"
+#include "MsgBusImpl_kafka.h"
+#include "MsgBusImpl_file.h"
+#include "MsgBusImpl_null.h"
+
+/*********************************************************************//**
+ * Create the message bus implementation selected by the configuration (base.output)
+ *
+ * \param [in] logPtr      Pointer to Logger instance
+ * \param [in] cfg         Pointer to the config instance
+ * \param [in] c_hash_id   Collector Hash ID
+ *
+ * \return Pointer to the new message bus instance, caller must delete it
+ ***********************************************************************/
+MsgBusInterface *newMsgBus(Logger *logPtr, Config *cfg, u_char *c_hash_id) {
+    if (cfg->output_type.compare("file") == 0)
+        return new msgBus_file(logPtr, cfg, c_hash_id);
+
+    else if (cfg->output_type.compare("null") == 0)
+        return new msgBus_null(logPtr, cfg, c_hash_id);
+
+    return new msgBus_kafka(logPtr, cfg, c_hash_id);
+}
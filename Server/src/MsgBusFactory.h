@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef MSGBUSFACTORY_H_
+#define MSGBUSFACTORY_H_
+
+#include "MsgBusInterface.hpp"
+#include "Logger.h"
+#include "Config.h"
+
+/*********************************************************************//**
+ * Create the message bus implementation selected by the configuration (base.output)
+ *
+ * \param [in] logPtr      Pointer to Logger instance
+ * \param [in] cfg         Pointer to the config instance
+ * \param [in] c_hash_id   Collector Hash ID
+ *
+ * \return Pointer to the new message bus instance, caller must delete it
+ ***********************************************************************/
+MsgBusInterface *newMsgBus(Logger *logPtr, Config *cfg, u_char *c_hash_id);
+
+#endif /* MSGBUSFACTORY_H_ */
@@ -15,10 +15,14 @@
 #include <vector>
 #include <list>
 #include <string>
+#include <atomic>
+#include <memory>
 #include <cstdio>
 #include <ctime>
 #include <sys/time.h>
 
+#include "Metrics.h"
+
 /**
  * \class   MsgBusInterface
  *
@@ -28,6 +32,9 @@
  *
  *          It is required that the implementing class follow the
  *          internal schema to store the data as needed.
+ *
+ *          With parse threads the methods are called by more than one
+ *          thread at a time, the implementation must serialize them.
  */
 class MsgBusInterface {
 public:
@@ -36,7 +43,45 @@ public:
      * Msg data schema
      * ---------------------------------------------------------------------------
      */
-    uint64_t        ribSeq;         ///< RIB Message Seq
+    std::atomic<uint64_t> ribSeq;   ///< RIB Message Seq, updated by the parse threads
+
+    /**
+     * Metrics of the router session - NULL if not a router session.  Set by the router thread before
+     *      the message bus is used, shared so the session metrics live until the message bus is deleted.
+     */
+    std::shared_ptr<RouterMetrics> metrics;
+
+    /**
+     * Outputs (message types) that the implementation will send.
+     *
+     * \details Parsers check these to skip parsing and encoding work for outputs that are not
+     *          sent.  All outputs are enabled by default; implementations should clear the ones
+     *          that are disabled when initialized.  They can change with a configuration reload
+     *          while parsing.
+     */
+    struct obj_outputs {
+        std::atomic<bool> base_attribute;     ///< Base attributes
+        std::atomic<bool> unicast_prefix;     ///< Unicast prefixes
+        std::atomic<bool> l3vpn;              ///< L3VPN prefixes
+        std::atomic<bool> evpn;               ///< EVPN NLRI's
+        std::atomic<bool> ls_node;            ///< BGP-LS nodes
+        std::atomic<bool> ls_link;            ///< BGP-LS links
+        std::atomic<bool> ls_prefix;          ///< BGP-LS prefixes
+        std::atomic<bool> bmp_stat;           ///< BMP stats reports
+        std::atomic<bool> bmp_raw;            ///< BMP raw messages
+        std::atomic<bool> flap;               ///< Route flap reports
+        std::atomic<bool> peer_stats;         ///< Collector computed peer stats
+
+        /// True if any of the BGP-LS outputs are enabled
+        inline bool linkState() const {
+            return ls_node or ls_link or ls_prefix;
+        }
+
+        /// True if any output needs the path attributes (e.g. the path attribute hash)
+        inline bool pathAttrs() const {
+            return base_attribute or unicast_prefix or l3vpn or evpn or linkState();
+        }
+    } outputs;
 
     /**
      * OBJECT: collector
@@ -293,6 +338,44 @@ public:
         uint64_t        routes_loc_rib;         ///< type=8 number of routes in loc-rib
     };
 
+    /**
+     * OBJECT: peer_stats
+     *
+     * Collector computed peer stats schema
+     */
+    #define PEER_STATS_SIZE_BUCKETS 8               ///< UPDATE size histogram buckets
+    #define PEER_STATS_SIZE_MIN     64              ///< Upper bound (exclusive) of the first bucket, doubles per bucket
+
+    struct obj_peer_stats {
+        uint32_t        interval;               ///< Seconds covered by the report
+        uint64_t        updates;                ///< UPDATE messages received
+        uint64_t        announcements;          ///< Announced NLRI received
+        uint64_t        withdrawals;            ///< Withdrawn NLRI received
+        float           announce_rate;          ///< Announcements per second
+        float           withdraw_rate;          ///< Withdrawals per second
+        uint64_t        unique_prefixes;        ///< Prefixes in the peer RIB, zero if adj_rib_in is disabled
+        uint64_t        attr_sets;              ///< Distinct path attribute sets received
+        uint64_t        size_hist[PEER_STATS_SIZE_BUCKETS];     ///< UPDATE size histogram
+    };
+
+    /**
+     * OBJECT: flap_report
+     *
+     * Route flap report schema
+     */
+    struct obj_flap_report {
+        char            prefix[46];             ///< IPv4/IPv6 prefix in printed form
+        uint8_t         prefix_len;             ///< Length of prefix in bits
+        uint8_t         isIPv4;                 ///< 0 if IPv6, 1 if IPv4
+        uint8_t         rib_type;               ///< 0=pre-policy, 1=post-policy, 2=loc-rib
+        uint32_t        path_id;                ///< Add path ID - zero if not used
+        uint32_t        flaps;                  ///< Flaps since the last report
+        uint32_t        total_flaps;            ///< Flaps since the prefix started to be tracked
+        uint32_t        penalty;                ///< Current (decayed) penalty
+        uint32_t        first_flap;             ///< Time of the first flap in seconds since EPOC
+        uint32_t        last_flap;              ///< Time of the last flap in seconds since EPOC
+    };
+
     /**
      * OBJECT: ls_node
      *
@@ -405,6 +488,22 @@ public:
      * Abstract methods
      * ---------------------------------------------------------------------------
      */
+    MsgBusInterface() {
+        ribSeq = 0;
+
+        outputs.base_attribute  = true;
+        outputs.unicast_prefix  = true;
+        outputs.l3vpn           = true;
+        outputs.evpn            = true;
+        outputs.ls_node         = true;
+        outputs.ls_link         = true;
+        outputs.ls_prefix       = true;
+        outputs.bmp_stat        = true;
+        outputs.bmp_raw         = true;
+        outputs.flap            = true;
+        outputs.peer_stats      = true;
+    }
+
     virtual ~MsgBusInterface() { };
 
     /*****************************************************************//**
@@ -536,6 +635,26 @@ public:
      *****************************************************************/
     virtual void add_StatReport(obj_bgp_peer &peer, obj_stats_report &stats) = 0;
 
+    /*****************************************************************//**
+     * \brief       Add route flap reports
+     *
+     * \details     Will generate a message with the flapping prefixes of the peer.
+     *
+     * \param[in]   peer       Peer object
+     * \param[in]   flaps      List of one or more flap reports
+     *****************************************************************/
+    virtual void add_FlapReport(obj_bgp_peer &peer, std::vector<obj_flap_report> &flaps) = 0;
+
+    /*****************************************************************//**
+     * \brief       Add collector computed peer stats
+     *
+     * \details     Will generate a message with the counters of the peer since the last report.
+     *
+     * \param[in]   peer       Peer object
+     * \param[in]   stats      Peer stats object
+     *****************************************************************/
+    virtual void add_PeerStats(obj_bgp_peer &peer, obj_peer_stats &stats) = 0;
+
     /*****************************************************************//**
      * \brief       Add/Update BGP-LS nodes
      *
@@ -599,6 +718,37 @@ public:
      *****************************************************************/
     virtual void send_bmp_raw(u_char *r_hash, obj_bgp_peer &peer, u_char *data, size_t data_len) = 0;
 
+    /*****************************************************************//**
+     * \brief       Enable/disable debug logging for the implementation
+     *****************************************************************/
+    virtual void enableDebug() = 0;
+    virtual void disableDebug() = 0;
+
+    /*****************************************************************//**
+     * \brief       Get the sequence number of the next unicast prefix message
+     *
+     * \details     Consumers of a RIB snapshot use this to know where to continue
+     *              following the unicast prefix stream.
+     *****************************************************************/
+    virtual uint64_t getUnicastPrefixSeq() = 0;
+
+    /*****************************************************************//**
+     * \brief       Get the percent of the output queue used
+     *
+     * \details     Used by startup admission to measure the output headroom.
+     *              Zero if the output does not queue.
+     *****************************************************************/
+    virtual int getQueueFill() = 0;
+
+    /*****************************************************************//**
+     * \brief       Forget the router without terminating it
+     *
+     * \details     Used when the router session is handed over to a new
+     *              process.  No router term message is sent when the
+     *              message bus is deleted.
+     *****************************************************************/
+    virtual void handoverRouter() = 0;
+
 
     /* ---------------------------------------------------------------------------
      * Commonly used methods
@@ -641,7 +791,7 @@ public:
         timeval tv;
         std::time_t secs;
         uint32_t us;
-        tm *p_tm;
+        tm p_tm;
 
         if (time_secs <= 1000) {
             gettimeofday(&tv, NULL);
@@ -653,8 +803,8 @@ public:
             us = time_us;
         }
 
-        p_tm = std::gmtime(&secs);
-        std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", p_tm);
+        gmtime_r(&secs, &p_tm);                 // Encode workers call this concurrently
+        std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &p_tm);
         ts_str = buf;
 
         sprintf(buf, ".%06u", us);
@@ -0,0 +1,576 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <ctime>
+
+#include "Takeover.h"
+#include "BMPListener.h"
+#include "client_thread.h"
+
+/**
+ * Serialize the client info of a session, the socket is passed with the record
+ *
+ * \param [out] state   Serialized state
+ * \param [in]  c       Client info
+ */
+static void putClient(Takeover::State &state, BMPListener::ClientInfo &c) {
+    state.put(c.hash_id, sizeof(c.hash_id));
+    state.put(c.initRec);
+    state.put(c.c_addr);
+    state.put(c.s_addr);
+    state.put(c.c_port, sizeof(c.c_port));
+    state.put(c.c_ip, sizeof(c.c_ip));
+    state.put(c.s_port, sizeof(c.s_port));
+    state.put(c.s_ip, sizeof(c.s_ip));
+    state.put(c.startTime);
+    state.put((bool) c.initDumpDone);
+}
+
+/**
+ * Read the client info of a session
+ *
+ * \param [in]  state   Serialized state
+ * \param [out] c       Client info
+ */
+static void getClient(Takeover::State &state, BMPListener::ClientInfo &c) {
+    bool initDumpDone;
+
+    state.get(c.hash_id, sizeof(c.hash_id));
+    state.get(c.initRec);
+    state.get(c.c_addr);
+    state.get(c.s_addr);
+    state.get(c.c_port, sizeof(c.c_port));
+    state.get(c.c_ip, sizeof(c.c_ip));
+    state.get(c.s_port, sizeof(c.s_port));
+    state.get(c.s_ip, sizeof(c.s_ip));
+    state.get(c.startTime);
+    state.get(initDumpDone);
+
+    c.initDumpDone = initDumpDone;
+    c.pipe_sock = 0;
+    c.bufFill = 0;
+    c.queueFill = 0;
+}
+
+/**
+ * Constructor for class - Opens the takeover UNIX socket
+ *
+ * \param [in] logPtr   Pointer to Logger instance
+ * \param [in] cfg      Pointer to the config instance
+ *
+ * \throw (char const *str) message indicate error
+ */
+Takeover::Takeover(Logger *logPtr, Config *cfg) {
+    logger = logPtr;
+    this->cfg = cfg;
+    debug = cfg->debug_general;
+    sock = -1;
+
+    openSocket();
+
+    LOG_INFO("Takeover socket listening on %s", cfg->takeover_socket.c_str());
+}
+
+/**
+ * Destructor for class - Closes and removes the socket
+ */
+Takeover::~Takeover() {
+    closeSocket();
+}
+
+/**
+ * Open the listening socket
+ *
+ * \throw (char const *str) message indicate error
+ */
+void Takeover::openSocket() {
+    sockaddr_un addr;
+    bzero(&addr, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (cfg->takeover_socket.size() >= sizeof(addr.sun_path))
+        throw "ERROR: Takeover socket path is too long";
+
+    strncpy(addr.sun_path, cfg->takeover_socket.c_str(), sizeof(addr.sun_path) - 1);
+
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        throw "ERROR: Cannot open takeover socket";
+
+    // Remove the socket file left over from a previous run
+    unlink(cfg->takeover_socket.c_str());
+
+    if (::bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(sock);
+        sock = -1;
+        throw "ERROR: Cannot bind to the takeover socket path";
+    }
+
+    chmod(cfg->takeover_socket.c_str(), 0600);
+    listen(sock, 1);
+}
+
+/**
+ * Close the listening socket and remove its path
+ */
+void Takeover::closeSocket() {
+    if (sock < 0)
+        return;
+
+    close(sock);
+    sock = -1;
+    unlink(cfg->takeover_socket.c_str());
+}
+
+/**
+ * Check if a new process is connecting
+ *
+ * \return true if a connection is pending
+ */
+bool Takeover::pending() {
+    pollfd pfd;
+
+    if (sock < 0)
+        return false;
+
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/**
+ * Hand the listening sockets and router sessions over to the new process
+ *
+ * \details Accepts the pending connection.  The listening socket path is removed before the
+ *          last record so the new process can open it.
+ *
+ * \param [in] svr          BMP listener
+ * \param [in] thr_list     Router session threads
+ *
+ * \return true if the new process has the sessions and this one should exit, false if it continues
+ */
+bool Takeover::handover(BMPListener *svr, std::vector<ThreadMgmt *> &thr_list) {
+    timeval tv = { TAKEOVER_IO_TIMEOUT, 0 };
+    bool done = false;
+    int sessions = 0;
+    int pass_fd;
+
+    int fd = accept(sock, NULL, NULL);
+    if (fd < 0) {
+        LOG_WARN("Failed to accept takeover connection: %s", strerror(errno));
+        return false;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    try {
+        hello(fd, false);
+
+        LOG_NOTICE("Takeover by a new process, handing over %zu router sessions", thr_list.size());
+
+        requestSessions(thr_list);
+
+        // The new process opens the takeover socket once it has the sessions
+        closeSocket();
+
+        for (int i = 0; i < 2; i++) {
+            State state;
+            bool isIPv4 = (i == 0);
+
+            if (svr->getSocket(isIPv4) <= 0)
+                continue;
+
+            state.put(isIPv4);
+            sendRecord(fd, REC_LISTENER, state.data, svr->getSocket(isIPv4));
+        }
+
+        for (size_t i = 0; i < thr_list.size(); i++) {
+            ThreadMgmt *thr = thr_list.at(i);
+            State state;
+
+            if (thr->handover.load() != HANDOVER_READY)
+                continue;
+
+            putClient(state, thr->client);
+            state.put(thr->session_state.data(), thr->session_state.size());
+
+            sendRecord(fd, REC_SESSION, state.data, thr->client.c_sock);
+            sessions++;
+        }
+
+        sendRecord(fd, REC_DONE, std::string(), -1);
+
+        State ack;
+        if (recvRecord(fd, ack, pass_fd) != REC_ACK)
+            throw "unexpected record instead of the takeover ack";
+
+        done = true;
+
+    } catch (char const *str) {
+        LOG_ERR("Takeover failed, the router sessions continue here: %s", str);
+    }
+
+    close(fd);
+
+    // Release the sessions, they exit if sent or continue here
+    for (size_t i = 0; i < thr_list.size(); i++) {
+        ThreadMgmt *thr = thr_list.at(i);
+        int state = thr->handover.load();
+
+        if (state == HANDOVER_READY or state == HANDOVER_DECLINED) {
+            thr->session_state.clear();
+            thr->handover = (done and state == HANDOVER_READY) ? HANDOVER_SENT : HANDOVER_NONE;
+        }
+    }
+
+    if (done) {
+        LOG_NOTICE("Takeover done, handed over %d of %zu router sessions", sessions, thr_list.size());
+
+    } else if (sock < 0) {
+        try {
+            openSocket();
+        } catch (char const *str) {
+            LOG_WARN("%s: %s", str, cfg->takeover_socket.c_str());
+        }
+    }
+
+    return done;
+}
+
+/**
+ * Ask the sessions to stop at a message boundary and wait until they are ready or declined
+ *
+ * \param [in] thr_list     Router session threads
+ */
+void Takeover::requestSessions(std::vector<ThreadMgmt *> &thr_list) {
+    time_t end = time(NULL) + TAKEOVER_WAIT_SECS;
+    bool waiting = true;
+
+    for (size_t i = 0; i < thr_list.size(); i++) {
+        if (thr_list.at(i)->running)
+            thr_list.at(i)->handover = HANDOVER_REQUESTED;
+    }
+
+    while (waiting and time(NULL) < end) {
+        usleep(10000);
+
+        waiting = false;
+        for (size_t i = 0; i < thr_list.size() and not waiting; i++) {
+            if (thr_list.at(i)->running and thr_list.at(i)->handover.load() == HANDOVER_REQUESTED)
+                waiting = true;
+        }
+    }
+
+    // Sessions that didn't stop in time continue, they are closed if the takeover is done
+    for (size_t i = 0; i < thr_list.size(); i++) {
+        ThreadMgmt *thr = thr_list.at(i);
+        int expected = HANDOVER_REQUESTED;
+
+        if (thr->handover.compare_exchange_strong(expected, HANDOVER_NONE) and thr->running)
+            LOG_WARN("%s: session did not reach a message boundary in time, not handed over", thr->client.c_ip);
+
+        else if (expected == HANDOVER_DECLINED)
+            LOG_NOTICE("%s: session declined the takeover", thr->client.c_ip);
+    }
+}
+
+/**
+ * Take over the listening sockets and router sessions of the running process
+ *
+ * \details Used by the new process before it opens the BMP listener.  The sessions have the
+ *          client info, socket and session state set.
+ *
+ * \param [in]  logger      Pointer to Logger instance
+ * \param [in]  cfg         Pointer to the config instance
+ * \param [out] sock        IPv4 listening socket, zero if not received
+ * \param [out] sockv6      IPv6 listening socket, zero if not received
+ * \param [out] sessions    Router sessions, allocated with new
+ *
+ * \throw (char const *str) message indicate error
+ */
+void Takeover::receive(Logger *logger, Config *cfg, int &sock, int &sockv6, std::vector<ThreadMgmt *> &sessions) {
+    timeval tv = { TAKEOVER_WAIT_SECS + TAKEOVER_IO_TIMEOUT, 0 };
+    sockaddr_un addr;
+    bool debug = cfg->debug_general;
+    bool done = false;
+
+    sock = 0;
+    sockv6 = 0;
+
+    bzero(&addr, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (cfg->takeover_socket.size() == 0)
+        throw "takeover_socket is not configured";
+
+    if (cfg->takeover_socket.size() >= sizeof(addr.sun_path))
+        throw "takeover socket path is too long";
+
+    strncpy(addr.sun_path, cfg->takeover_socket.c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw "cannot open the takeover socket";
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(fd);
+        throw "cannot connect to the takeover socket of the running collector";
+    }
+
+    // The running collector waits for its sessions before sending them
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    try {
+        hello(fd, true);
+
+        LOG_NOTICE("Taking over the router sessions from the running collector");
+
+        while (not done) {
+            State state;
+            int pass_fd;
+
+            switch (recvRecord(fd, state, pass_fd)) {
+                case REC_LISTENER : {
+                    bool isIPv4;
+
+                    if (pass_fd < 0)
+                        throw "takeover listener record without a socket";
+
+                    state.get(isIPv4);
+                    if (isIPv4)
+                        sock = pass_fd;
+                    else
+                        sockv6 = pass_fd;
+                    break;
+                }
+
+                case REC_SESSION : {
+                    if (pass_fd < 0)
+                        throw "takeover session record without a socket";
+
+                    ThreadMgmt *thr = new ThreadMgmt;
+                    sessions.push_back(thr);
+
+                    thr->handover = HANDOVER_NONE;
+                    thr->client.c_sock = pass_fd;
+                    getClient(state, thr->client);
+                    thr->session_state.assign(state.data, state.pos, std::string::npos);
+
+                    SELF_DEBUG("%s: received session, %zu bytes of state", thr->client.c_ip,
+                               thr->session_state.size());
+                    break;
+                }
+
+                case REC_DONE :
+                    sendRecord(fd, REC_ACK, std::string(), -1);
+                    done = true;
+                    break;
+
+                default :
+                    if (pass_fd >= 0)
+                        close(pass_fd);
+                    throw "unexpected takeover record";
+            }
+        }
+
+    } catch (char const *str) {
+        close(fd);
+
+        // The running collector keeps the sessions, only close the copies received
+        for (size_t i = 0; i < sessions.size(); i++) {
+            close(sessions.at(i)->client.c_sock);
+            delete sessions.at(i);
+        }
+        sessions.clear();
+
+        if (sock > 0)
+            close(sock);
+        if (sockv6 > 0)
+            close(sockv6);
+
+        throw;
+    }
+
+    close(fd);
+
+    LOG_NOTICE("Took over %zu router sessions", sessions.size());
+}
+
+/**
+ * Exchange the hello, verifies the magic and version of the other process
+ *
+ * \param [in] fd           Takeover connection
+ * \param [in] first        True to send the hello before receiving it
+ *
+ * \throw (char const *str) message indicate error
+ */
+void Takeover::hello(int fd, bool first) {
+    State hello;
+    State peer;
+    uint32_t magic, version;
+    int pass_fd;
+
+    hello.put((uint32_t) TAKEOVER_MAGIC);
+    hello.put((uint32_t) TAKEOVER_VERSION);
+
+    if (first)
+        sendRecord(fd, REC_HELLO, hello.data, -1);
+
+    if (recvRecord(fd, peer, pass_fd) != REC_HELLO)
+        throw "unexpected record instead of the takeover hello";
+
+    peer.get(magic);
+    peer.get(version);
+
+    if (magic != TAKEOVER_MAGIC)
+        throw "takeover hello has the wrong magic";
+
+    if (version != TAKEOVER_VERSION)
+        throw "takeover version of the other collector is not supported";
+
+    if (not first)
+        sendRecord(fd, REC_HELLO, hello.data, -1);
+}
+
+/**
+ * Send a record
+ *
+ * \param [in] fd           Takeover connection
+ * \param [in] type         Record type, RECORD_TYPES
+ * \param [in] payload      Payload
+ * \param [in] pass_fd      Socket to pass, -1 if none
+ *
+ * \throw (char const *str) message indicate error
+ */
+void Takeover::sendRecord(int fd, uint32_t type, const std::string &payload, int pass_fd) {
+    record_hdr hdr;
+    iovec iov;
+    msghdr msg;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+
+    bzero(&hdr, sizeof(hdr));
+    hdr.type = type;
+    hdr.len = payload.size();
+
+    iov.iov_base = &hdr;
+    iov.iov_len = sizeof(hdr);
+
+    bzero(&msg, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (pass_fd >= 0) {
+        bzero(cbuf, sizeof(cbuf));
+        msg.msg_control = cbuf;
+        msg.msg_controllen = sizeof(cbuf);
+
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+    }
+
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(hdr))
+        throw "failed to send the takeover record header";
+
+    for (size_t sent = 0; sent < payload.size(); ) {
+        ssize_t n = send(fd, payload.data() + sent, payload.size() - sent, MSG_NOSIGNAL);
+
+        if (n <= 0) {
+            if (n < 0 and errno == EINTR)
+                continue;
+
+            throw "failed to send the takeover record";
+        }
+
+        sent += n;
+    }
+}
+
+/**
+ * Receive a record
+ *
+ * \param [in]  fd          Takeover connection
+ * \param [out] payload     Payload
+ * \param [out] pass_fd     Passed socket, -1 if none
+ *
+ * \return record type, RECORD_TYPES
+ *
+ * \throw (char const *str) message indicate error
+ */
+uint32_t Takeover::recvRecord(int fd, State &payload, int &pass_fd) {
+    record_hdr hdr;
+    iovec iov;
+    msghdr msg;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    ssize_t n;
+
+    pass_fd = -1;
+
+    iov.iov_base = &hdr;
+    iov.iov_len = sizeof(hdr);
+
+    bzero(&msg, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    // The socket comes with the first byte of the header
+    do {
+        n = recvmsg(fd, &msg, MSG_WAITALL);
+    } while (n < 0 and errno == EINTR);
+
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); n > 0 and cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET and cmsg->cmsg_type == SCM_RIGHTS)
+            memcpy(&pass_fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+
+    if (n != sizeof(hdr)) {
+        if (pass_fd >= 0)
+            close(pass_fd);
+
+        throw n == 0 ? "takeover connection closed by the other collector" : "failed to read the takeover record header";
+    }
+
+    if (msg.msg_flags & MSG_CTRUNC)
+        throw "takeover record socket was truncated";
+
+    payload.data.resize(hdr.len);
+    payload.pos = 0;
+
+    for (size_t read = 0; read < hdr.len; ) {
+        n = recv(fd, &payload.data[read], hdr.len - read, MSG_WAITALL);
+
+        if (n <= 0) {
+            if (n < 0 and errno == EINTR)
+                continue;
+
+            if (pass_fd >= 0)
+                close(pass_fd);
+
+            throw "failed to read the takeover record";
+        }
+
+        read += n;
+    }
+
+    return hdr.type;
+}
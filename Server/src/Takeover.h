@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef TAKEOVER_H_
+#define TAKEOVER_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Logger.h"
+#include "Config.h"
+
+struct ThreadMgmt;
+class BMPListener;
+
+/**
+ * \class   Takeover
+ *
+ * \brief   Hands the listening sockets and router sessions over to a new openbmpd process
+ * \details The running process listens on the takeover UNIX socket.  A new process started with
+ *          -takeover connects to it and both exchange a hello with the takeover version.  The running
+ *          process then asks each router session to stop at the next BMP message boundary.  Each
+ *          session saves its unread buffer and peer state (see BMPReader::saveState()) and waits.
+ *
+ *          Records are a header (type and payload length) followed by the payload.  The listening
+ *          sockets and router sockets are passed with SCM_RIGHTS on the record header:
+ *
+ *              HELLO       magic and version, sent by both
+ *              LISTENER    listening socket, payload is the address family
+ *              SESSION     router socket, payload is the client info and the session state
+ *              DONE        last record, the new process replies with ACK
+ *
+ *          Once the ACK is received the sessions are handed over and the running process exits
+ *          without terminating them.  On any error before the ACK the sessions continue in the
+ *          running process.  Sessions that don't reach a message boundary in time or are finishing
+ *          a warm restart digest are not handed over and are closed as usual.
+ */
+class Takeover {
+public:
+    #define TAKEOVER_MAGIC          0x504d424f      ///< "OBMP" (little endian), first word of the hello
+    #define TAKEOVER_VERSION        1               ///< Change when the records or the session state change
+    #define TAKEOVER_WAIT_SECS      30              ///< Max seconds for the sessions to reach a message boundary
+    #define TAKEOVER_IO_TIMEOUT     30              ///< Max seconds to wait on the other process
+
+    /**
+     * Handover state of a router session (ThreadMgmt::handover)
+     *
+     *      NONE -> REQUESTED           Set by the main loop, the session stops at a message boundary
+     *      REQUESTED -> READY          Set by the session once ThreadMgmt::session_state is saved
+     *      REQUESTED -> DECLINED       Set by the session if it can't be handed over
+     *      READY -> SENT               Set by the main loop once the new process has the session
+     *      READY/REQUESTED -> NONE     Set by the main loop if the takeover failed, the session continues
+     */
+    enum HANDOVER_STATES { HANDOVER_NONE=0, HANDOVER_REQUESTED, HANDOVER_READY, HANDOVER_DECLINED, HANDOVER_SENT };
+
+    /**
+     * Takeover record types
+     */
+    enum RECORD_TYPES { REC_HELLO=1, REC_LISTENER, REC_SESSION, REC_DONE, REC_ACK };
+
+    /**
+     * \class   State
+     *
+     * \brief   Serialized state
+     * \details Both processes are on the same host, values are in host byte order.
+     */
+    class State {
+    public:
+        std::string     data;                   ///< Serialized state
+        size_t          pos;                    ///< Read position
+
+        State() : pos(0) { }
+
+        /**
+         * Append bytes
+         *
+         * \param [in] buf      Bytes to append
+         * \param [in] len      Number of bytes
+         */
+        inline void put(const void *buf, size_t len) {
+            data.append((const char *)buf, len);
+        }
+
+        /**
+         * Append a value, only for integer and POD types
+         */
+        template <typename T>
+        inline void put(const T &value) {
+            put(&value, sizeof(value));
+        }
+
+        /**
+         * Append a length prefixed string
+         */
+        inline void putString(const std::string &str) {
+            put((uint64_t) str.size());
+            data.append(str);
+        }
+
+        /**
+         * Read bytes
+         *
+         * \param [out] buf     Buffer for the bytes
+         * \param [in]  len     Number of bytes
+         *
+         * \throw (char const *str) if the state is truncated
+         */
+        inline void get(void *buf, size_t len) {
+            if (data.size() - pos < len)
+                throw "takeover state is truncated";
+
+            memcpy(buf, data.data() + pos, len);
+            pos += len;
+        }
+
+        /**
+         * Read a value, only for integer and POD types
+         */
+        template <typename T>
+        inline void get(T &value) {
+            get(&value, sizeof(value));
+        }
+
+        /**
+         * Read a length prefixed string
+         */
+        inline void getString(std::string &str) {
+            uint64_t len;
+            get(len);
+
+            if (data.size() - pos < len)
+                throw "takeover state is truncated";
+
+            str.assign(data, pos, len);
+            pos += len;
+        }
+    };
+
+    /**
+     * Constructor for class - Opens the takeover UNIX socket
+     *
+     * \param [in] logPtr   Pointer to Logger instance
+     * \param [in] cfg      Pointer to the config instance
+     *
+     * \throw (char const *str) message indicate error
+     */
+    Takeover(Logger *logPtr, Config *cfg);
+
+    /**
+     * Destructor for class - Closes and removes the socket
+     */
+    ~Takeover();
+
+    /**
+     * Check if a new process is connecting
+     *
+     * \return true if a connection is pending
+     */
+    bool pending();
+
+    /**
+     * Hand the listening sockets and router sessions over to the new process
+     *
+     * \details Accepts the pending connection.  The listening socket path is removed before the
+     *          last record so the new process can open it.
+     *
+     * \param [in] svr          BMP listener
+     * \param [in] thr_list     Router session threads
+     *
+     * \return true if the new process has the sessions and this one should exit, false if it continues
+     */
+    bool handover(BMPListener *svr, std::vector<ThreadMgmt *> &thr_list);
+
+    /**
+     * Take over the listening sockets and router sessions of the running process
+     *
+     * \details Used by the new process before it opens the BMP listener.  The sessions have the
+     *          client info, socket and session state set.
+     *
+     * \param [in]  logger      Pointer to Logger instance
+     * \param [in]  cfg         Pointer to the config instance
+     * \param [out] sock        IPv4 listening socket, zero if not received
+     * \param [out] sockv6      IPv6 listening socket, zero if not received
+     * \param [out] sessions    Router sessions, allocated with new
+     *
+     * \throw (char const *str) message indicate error
+     */
+    static void receive(Logger *logger, Config *cfg, int &sock, int &sockv6, std::vector<ThreadMgmt *> &sessions);
+
+private:
+    Config          *cfg;                       ///< Configuration instance
+    Logger          *logger;                    ///< Logging class pointer
+    bool            debug;                      ///< debug flag to indicate debugging
+
+    int             sock;                       ///< Listening socket, -1 if closed
+
+    /**
+     * Record header, the passed socket is attached to it
+     */
+    struct record_hdr {
+        uint32_t    type;                       ///< Record type, RECORD_TYPES
+        uint32_t    reserved;
+        uint64_t    len;                        ///< Payload length
+    };
+
+    /**
+     * Open the listening socket
+     *
+     * \throw (char const *str) message indicate error
+     */
+    void openSocket();
+
+    /**
+     * Close the listening socket and remove its path
+     */
+    void closeSocket();
+
+    /**
+     * Ask the sessions to stop at a message boundary and wait until they are ready or declined
+     *
+     * \param [in] thr_list     Router session threads
+     */
+    void requestSessions(std::vector<ThreadMgmt *> &thr_list);
+
+    /**
+     * Send a record
+     *
+     * \param [in] fd           Takeover connection
+     * \param [in] type         Record type, RECORD_TYPES
+     * \param [in] payload      Payload
+     * \param [in] pass_fd      Socket to pass, -1 if none
+     *
+     * \throw (char const *str) message indicate error
+     */
+    static void sendRecord(int fd, uint32_t type, const std::string &payload, int pass_fd);
+
+    /**
+     * Receive a record
+     *
+     * \param [in]  fd          Takeover connection
+     * \param [out] payload     Payload
+     * \param [out] pass_fd     Passed socket, -1 if none
+     *
+     * \return record type, RECORD_TYPES
+     *
+     * \throw (char const *str) message indicate error
+     */
+    static uint32_t recvRecord(int fd, State &payload, int &pass_fd);
+
+    /**
+     * Exchange the hello, verifies the magic and version of the other process
+     *
+     * \param [in] fd           Takeover connection
+     * \param [in] first        True to send the hello before receiving it
+     *
+     * \throw (char const *str) message indicate error
+     */
+    static void hello(int fd, bool first);
+};
+
+#endif /* TAKEOVER_H_ */
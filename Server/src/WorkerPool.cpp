@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <pthread.h>
+#include <inttypes.h>
+
+#include "WorkerPool.h"
+
+/**
+ * Class constructor - starts the worker threads
+ *
+ * \param [in] logPtr       Pointer to Logger instance
+ * \param [in] name         Pool name, used for logging and the thread names
+ * \param [in] threads      Number of worker threads
+ * \param [in] queue_size   Max tasks queued per worker
+ * \param [in] cpus         CPUs to pin the worker threads to, empty to not pin
+ */
+WorkerPool::WorkerPool(Logger *logPtr, const char *name, int threads, size_t queue_size, const cpu_set_t &cpus) {
+    logger = logPtr;
+    debug = false;
+    this->name = name;
+
+    if (threads < 1)
+        threads = 1;
+
+    max_pending = queue_size * threads;
+    pending = 0;
+    ready_count = 0;
+    stopping = false;
+    steals = 0;
+    idle_waiters = 0;
+    space_waiters = 0;
+
+    for (int i = 0; i < threads; i++)
+        workers.push_back(new worker);
+
+    for (int i = 0; i < threads; i++) {
+        workers[i]->thr = new std::thread(&WorkerPool::workerLoop, this, i);
+
+        char thr_name[16];
+        snprintf(thr_name, sizeof(thr_name), "%.11s-%d", name, i);
+        pthread_setname_np(workers[i]->thr->native_handle(), thr_name);
+
+        if (CPU_COUNT(&cpus) > 0 and
+                pthread_setaffinity_np(workers[i]->thr->native_handle(), sizeof(cpu_set_t), &cpus) != 0)
+            LOG_WARN("Unable to set the cpu affinity of the %s worker threads", name);
+    }
+
+    LOG_INFO("Started %d %s worker threads%s", threads, name, CPU_COUNT(&cpus) > 0 ? " pinned" : "");
+}
+
+/**
+ * Destructor - runs the tasks still queued and stops the worker threads
+ */
+WorkerPool::~WorkerPool() {
+    stopping = true;
+
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        idle_cond.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(space_mutex);
+        space_cond.notify_all();
+    }
+
+    // Join all before deleting, a worker can steal from the deque of another one until it exits
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i]->thr->join();
+
+    for (size_t i = 0; i < workers.size(); i++) {
+        delete workers[i]->thr;
+        delete workers[i];
+    }
+
+    workers.clear();
+
+    LOG_INFO("Stopped %s worker threads, %" PRIu64 " strands stolen", name.c_str(), steals.load());
+}
+
+/**
+ * Submit a task, blocks while the pool is full
+ *
+ * \param [in] shard        Shard key, tasks with the same key run in order, one at a time
+ * \param [in] task         Task to run, the pool takes ownership
+ */
+void WorkerPool::submit(uint32_t shard, Task *task) {
+    if (stopping) {
+        // Pool is stopping, run it here so the task is not lost
+        task->run();
+        delete task;
+        return;
+    }
+
+    if (pending >= max_pending) {
+        std::unique_lock<std::mutex> lock(space_mutex);
+
+        space_waiters++;
+        while (pending >= max_pending and not stopping)
+            space_cond.wait(lock);
+        space_waiters--;
+    }
+
+    pending++;
+
+    strand *s = &strands[shard % WORKER_POOL_STRANDS];
+    bool schedule;
+
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+
+        task->next = NULL;
+        if (s->head == NULL)
+            s->head = task;
+        else
+            s->tail->next = task;
+        s->tail = task;
+
+        schedule = not s->scheduled;
+        s->scheduled = true;
+    }
+
+    // The home worker of the shard gets the strand, an idle worker can steal it
+    if (schedule)
+        pushReady(shard % workers.size(), s);
+}
+
+/**
+ * Percent of the pool queue used
+ */
+int WorkerPool::getQueueFill() {
+    return (int)(pending * 100 / max_pending);
+}
+
+/**
+ * Worker thread loop, runs until the pool is stopped and no strand is ready
+ *
+ * \param [in] self         Index of the worker
+ */
+void WorkerPool::workerLoop(int self) {
+    while (true) {
+        strand *s = takeStrand(self);
+
+        if (s != NULL) {
+            runStrand(self, s);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idle_mutex);
+
+        idle_waiters++;
+        if (ready_count == 0) {
+            if (stopping) {
+                idle_waiters--;
+                break;
+            }
+
+            idle_cond.wait(lock);
+        }
+        idle_waiters--;
+    }
+}
+
+/**
+ * Take a ready strand, from the own deque first and then from the other workers
+ *
+ * \param [in] self         Index of the worker
+ *
+ * \return strand, NULL if none is ready
+ */
+WorkerPool::strand *WorkerPool::takeStrand(int self) {
+    strand *s = NULL;
+
+    {
+        worker *w = workers[self];
+        std::lock_guard<std::mutex> lock(w->mutex);
+
+        if (not w->ready.empty()) {
+            s = w->ready.front();
+            w->ready.pop_front();
+        }
+    }
+
+    // Steal from the back of the other deques, starting with the next worker
+    for (size_t i = 1; s == NULL and i < workers.size(); i++) {
+        worker *w = workers[(self + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(w->mutex);
+
+        if (not w->ready.empty()) {
+            s = w->ready.back();
+            w->ready.pop_back();
+            steals++;
+        }
+    }
+
+    if (s != NULL)
+        ready_count--;
+
+    return s;
+}
+
+/**
+ * Run a batch of tasks of the strand and reschedule it if it has more
+ *
+ * \param [in] self         Index of the worker
+ * \param [in] s            Strand taken by the worker
+ */
+void WorkerPool::runStrand(int self, strand *s) {
+    Task *tasks[WORKER_POOL_BATCH];
+    size_t count = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+
+        while (count < WORKER_POOL_BATCH and s->head != NULL) {
+            tasks[count++] = s->head;
+            s->head = s->head->next;
+        }
+
+        if (s->head == NULL)
+            s->tail = NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        try {
+            tasks[i]->run();
+
+        } catch (char const *str) {
+            LOG_ERR("%s worker: task failed: %s", name.c_str(), str);
+        }
+
+        delete tasks[i];
+    }
+
+    pending -= count;
+
+    if (space_waiters > 0) {
+        std::lock_guard<std::mutex> lock(space_mutex);
+        space_cond.notify_all();
+    }
+
+    bool more;
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+
+        more = s->head != NULL;
+        if (not more)
+            s->scheduled = false;
+    }
+
+    // Tasks were added while running, keep the strand on this worker unless it is stolen
+    if (more)
+        pushReady(self, s);
+}
+
+/**
+ * Add a strand to the back of the deque of a worker and wake an idle worker
+ *
+ * \param [in] w            Index of the worker
+ * \param [in] s            Strand with tasks
+ */
+void WorkerPool::pushReady(int w, strand *s) {
+    {
+        std::lock_guard<std::mutex> lock(workers[w]->mutex);
+        workers[w]->ready.push_back(s);
+    }
+
+    ready_count++;
+
+    if (idle_waiters > 0) {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        idle_cond.notify_one();
+    }
+}
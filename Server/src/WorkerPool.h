@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef WORKERPOOL_H_
+#define WORKERPOOL_H_
+
+#include <sched.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Logger.h"
+
+#define WORKER_POOL_BATCH       64              ///< Max tasks of a strand run before it is rescheduled
+#define WORKER_POOL_STRANDS     4096            ///< Number of strands, shard keys are hashed into these
+
+/**
+ * \class   WorkerPool
+ *
+ * \brief   Work stealing pool of worker threads
+ * \details Tasks are submitted with a shard key.  Tasks with the same key go to the same strand, a
+ *          list of tasks that run one at a time in the order submitted.  Using the peer hash as the
+ *          key keeps the per peer order while peers are spread over the workers.
+ *
+ *          Each worker has a deque of strands that have tasks.  A worker runs the strands of its
+ *          own deque first and steals from the other deques when it has none, so a busy router
+ *          does not leave the other workers idle.  A strand is only in one deque or run by one
+ *          worker at a time.  After a batch of tasks the strand goes to the back of the deque of
+ *          the worker that ran it.
+ */
+class WorkerPool {
+public:
+    /**
+     * Unit of work - deleted by the pool after run()
+     */
+    class Task {
+    public:
+        Task() : next(NULL) { }
+        virtual ~Task() { }
+
+        /**
+         * Run the task on the worker thread
+         */
+        virtual void run() = 0;
+
+    private:
+        friend class WorkerPool;
+
+        Task *next;                             ///< Next task of the strand
+    };
+
+    /**
+     * Class constructor - starts the worker threads
+     *
+     * \param [in] logPtr       Pointer to Logger instance
+     * \param [in] name         Pool name, used for logging and the thread names
+     * \param [in] threads      Number of worker threads
+     * \param [in] queue_size   Max tasks queued per worker
+     * \param [in] cpus         CPUs to pin the worker threads to, empty to not pin
+     */
+    WorkerPool(Logger *logPtr, const char *name, int threads, size_t queue_size, const cpu_set_t &cpus);
+
+    /**
+     * Destructor - runs the tasks still queued and stops the worker threads
+     */
+    ~WorkerPool();
+
+    /**
+     * Submit a task, blocks while the pool is full
+     *
+     * \param [in] shard        Shard key, tasks with the same key run in order, one at a time
+     * \param [in] task         Task to run, the pool takes ownership
+     */
+    void submit(uint32_t shard, Task *task);
+
+    /**
+     * Number of worker threads
+     */
+    inline int size() {
+        return (int) workers.size();
+    }
+
+    /**
+     * Percent of the pool queue used
+     */
+    int getQueueFill();
+
+private:
+    /**
+     * Tasks of a shard, run one at a time
+     */
+    struct strand {
+        std::mutex      mutex;                  ///< Protects the task list and scheduled flag
+        Task            *head;                  ///< First task, NULL if none
+        Task            *tail;                  ///< Last task
+        bool            scheduled;              ///< In a worker deque or being run
+
+        strand() : head(NULL), tail(NULL), scheduled(false) { }
+    };
+
+    /**
+     * Worker thread and its deque of strands
+     */
+    struct worker {
+        std::mutex          mutex;              ///< Protects the deque
+        std::deque<strand *> ready;             ///< Strands with tasks, owner takes the front, thieves the back
+        std::thread         *thr;               ///< Worker thread
+    };
+
+    Logger          *logger;                    ///< Logging class pointer
+    bool            debug;                      ///< debug flag to indicate debugging
+    std::string     name;                       ///< Pool name
+
+    std::vector<worker *> workers;              ///< Workers
+    strand          strands[WORKER_POOL_STRANDS];
+
+    size_t          max_pending;                ///< Max tasks queued in the pool
+    std::atomic<size_t> pending;                ///< Tasks queued and not yet run
+    std::atomic<int> ready_count;               ///< Strands in the worker deques
+    std::atomic<bool> stopping;                 ///< Set when the pool is deleted
+    std::atomic<uint64_t> steals;               ///< Strands taken from the deque of another worker
+
+    std::mutex      idle_mutex;                 ///< Used with idle_cond
+    std::condition_variable idle_cond;          ///< Signaled when a strand is ready
+    std::atomic<int> idle_waiters;              ///< Workers waiting on idle_cond
+
+    std::mutex      space_mutex;                ///< Used with space_cond
+    std::condition_variable space_cond;         ///< Signaled when tasks are done and the pool was full
+    std::atomic<int> space_waiters;             ///< Submitters waiting on space_cond
+
+    /**
+     * Worker thread loop, runs until the pool is stopped and no strand is ready
+     *
+     * \param [in] self         Index of the worker
+     */
+    void workerLoop(int self);
+
+    /**
+     * Take a ready strand, from the own deque first and then from the other workers
+     *
+     * \param [in] self         Index of the worker
+     *
+     * \return strand, NULL if none is ready
+     */
+    strand *takeStrand(int self);
+
+    /**
+     * Run a batch of tasks of the strand and reschedule it if it has more
+     *
+     * \param [in] self         Index of the worker
+     * \param [in] s            Strand taken by the worker
+     */
+    void runStrand(int self, strand *s);
+
+    /**
+     * Add a strand to the back of the deque of a worker and wake an idle worker
+     *
+     * \param [in] w            Index of the worker
+     * \param [in] s            Strand with tasks
+     */
+    void pushReady(int w, strand *s);
+};
+
+#endif /* WORKERPOOL_H_ */
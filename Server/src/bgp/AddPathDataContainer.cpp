@@ -90,3 +90,27 @@ bool AddPathDataContainer::isAddPathEnabled(int afi, int safi) {
             );
     }
 }
+
+/**
+ * Walk the Add Path data, used to save the peer state for a takeover
+ *
+ * \param [in] cb               Callback called for each AFI/SAFI
+ */
+void AddPathDataContainer::walk(const walk_cb &cb) {
+    for (AddPathMap::iterator it = this->addPathMap.begin(); it != this->addPathMap.end(); ++it)
+        cb(it->first, it->second.sendReceiveCodeForSentOpenMessage, it->second.sendReceiveCodeForReceivedOpenMessage);
+}
+
+/**
+ * Restore Add Path data saved by walk()
+ *
+ * \param [in] key              AFI/SAFI key
+ * \param [in] sent_code        Send Recieve code from the sent open message
+ * \param [in] recv_code        Send Recieve code from the received open message
+ */
+void AddPathDataContainer::restore(const std::string &key, int sent_code, int recv_code) {
+    sendReceiveCodesForSentAndReceivedOpenMessageStructure &entry = this->addPathMap[key];
+
+    entry.sendReceiveCodeForSentOpenMessage = sent_code;
+    entry.sendReceiveCodeForReceivedOpenMessage = recv_code;
+}
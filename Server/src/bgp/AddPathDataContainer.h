@@ -12,6 +12,7 @@
 
 #include "bgp_common.h"
 
+#include <functional>
 #include <map>
 #include <memory>
 
@@ -65,6 +66,27 @@ public:
      */
     bool isAddPathEnabled(int afi, int safi);
 
+    /**
+     * Callback for walk() - key is the AFI/SAFI key, codes are from the sent and received OPEN messages
+     */
+    typedef std::function<void(const std::string &key, int sent_code, int recv_code)> walk_cb;
+
+    /**
+     * Walk the Add Path data, used to save the peer state for a takeover
+     *
+     * \param [in] cb               Callback called for each AFI/SAFI
+     */
+    void walk(const walk_cb &cb);
+
+    /**
+     * Restore Add Path data saved by walk()
+     *
+     * \param [in] key              AFI/SAFI key
+     * \param [in] sent_code        Send Recieve code from the sent open message
+     * \param [in] recv_code        Send Recieve code from the received open message
+     */
+    void restore(const std::string &key, int sent_code, int recv_code);
+
 };
 
 
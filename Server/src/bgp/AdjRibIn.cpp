@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cstring>
+
+#include "AdjRibIn.h"
+#include "AttrTable.h"
+
+/**
+ * Get the bit of the prefix at the bit position (0 is the most significant bit)
+ */
+static inline int prefixBit(const uint8_t *prefix, uint8_t pos) {
+    return (prefix[pos >> 3] >> (7 - (pos & 7))) & 1;
+}
+
+/**
+ * Get the number of leading bits that are the same in both prefixes, up to max_bits
+ */
+static uint8_t commonBits(const uint8_t *a, const uint8_t *b, uint8_t max_bits) {
+    uint8_t bits = 0;
+
+    // Whole bytes first
+    while (bits + 8 <= max_bits and a[bits >> 3] == b[bits >> 3])
+        bits += 8;
+
+    while (bits < max_bits and prefixBit(a, bits) == prefixBit(b, bits))
+        bits++;
+
+    return bits;
+}
+
+/**
+ * Copy the prefix, zeroing the bits past len
+ */
+static void copyPrefix(uint8_t *dst, const uint8_t *src, uint8_t len) {
+    int bytes = len >> 3;
+
+    memset(dst, 0, 16);
+    memcpy(dst, src, bytes);
+
+    if (len & 7)
+        dst[bytes] = src[bytes] & (0xFF << (8 - (len & 7)));
+}
+
+AdjRibIn::AdjRibIn() {
+    memset(root, 0, sizeof(root));
+    prefix_count = 0;
+}
+
+AdjRibIn::~AdjRibIn() {
+    clear();
+}
+
+/**
+ * Add or update the prefix
+ *
+ * \param [in] rib          RIB type, RIB_TYPES
+ * \param [in] isIPv4       True if IPv4, false if IPv6
+ * \param [in] prefix       Prefix in binary form (network byte order)
+ * \param [in] len          Prefix length in bits
+ * \param [in] path_id      Add path ID, zero if not used
+ * \param [in] attr_id      Interned attributes ID, zero if unknown (always treated as changed)
+ * \param [in] label_hash   Hash of the prefix labels, zero if none
+ * \param [out] replaced    Set to true if an existing path was changed, false if new or unchanged (optional)
+ *
+ * \return true if the prefix is new or its attributes changed, false if unchanged
+ */
+bool AdjRibIn::update(int rib, bool isIPv4, const uint8_t *prefix, uint8_t len, uint32_t path_id,
+                      uint32_t attr_id, uint32_t label_hash, bool *replaced) {
+    uint8_t key[16];
+    node **parent_pp, **node_pp;
+
+    if (replaced != NULL)
+        *replaced = false;
+
+    if (rib < 0 or rib >= RIB_MAX or len > (isIPv4 ? 32 : 128))
+        return true;
+
+    copyPrefix(key, prefix, len);
+
+    node *n = find(&root[rib][isIPv4 ? 0 : 1], key, len, true, &parent_pp, &node_pp);
+
+    for (size_t i=0; i < n->paths.size(); i++) {
+        if (n->paths[i].path_id == path_id) {
+            path_entry &path = n->paths[i];
+
+            // Interned IDs are equal only if every attribute is, see AttrTable::intern()
+            if (attr_id != 0 and path.attr_id == attr_id and path.label_hash == label_hash)
+                return false;
+
+            if (path.attr_id != attr_id) {
+                AttrTable::instance().addRef(attr_id);
+                AttrTable::instance().release(path.attr_id);
+                path.attr_id = attr_id;
+            }
+
+            path.label_hash = label_hash;
+
+            if (replaced != NULL)
+                *replaced = true;
+
+            return true;
+        }
+    }
+
+    path_entry entry;
+    entry.path_id = path_id;
+    entry.attr_id = attr_id;
+    entry.label_hash = label_hash;
+    AttrTable::instance().addRef(attr_id);
+
+    n->paths.push_back(entry);
+    prefix_count++;
+
+    return true;
+}
+
+/**
+ * Withdraw the prefix
+ *
+ * \param [in] rib          RIB type, RIB_TYPES
+ * \param [in] isIPv4       True if IPv4, false if IPv6
+ * \param [in] prefix       Prefix in binary form (network byte order)
+ * \param [in] len          Prefix length in bits
+ * \param [in] path_id      Add path ID, zero if not used
+ *
+ * \return true if the prefix was in the RIB, false if not
+ */
+bool AdjRibIn::withdraw(int rib, bool isIPv4, const uint8_t *prefix, uint8_t len, uint32_t path_id) {
+    uint8_t key[16];
+    node **parent_pp, **node_pp;
+
+    if (rib < 0 or rib >= RIB_MAX or len > (isIPv4 ? 32 : 128))
+        return true;
+
+    copyPrefix(key, prefix, len);
+
+    node *n = find(&root[rib][isIPv4 ? 0 : 1], key, len, false, &parent_pp, &node_pp);
+
+    if (n == NULL)
+        return false;
+
+    for (size_t i=0; i < n->paths.size(); i++) {
+        if (n->paths[i].path_id == path_id) {
+            AttrTable::instance().release(n->paths[i].attr_id);
+            n->paths.erase(n->paths.begin() + i);
+            prefix_count--;
+
+            prune(parent_pp, node_pp);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Remove all prefixes, e.g. when the peer goes down
+ */
+void AdjRibIn::clear() {
+    for (int rib=0; rib < RIB_MAX; rib++) {
+        for (int afi=0; afi < 2; afi++) {
+            freeTrie(root[rib][afi]);
+            root[rib][afi] = NULL;
+        }
+    }
+
+    prefix_count = 0;
+}
+
+/**
+ * Walk all prefixes of a RIB and address family, in prefix order
+ *
+ * \param [in] rib          RIB type, RIB_TYPES
+ * \param [in] isIPv4       True if IPv4, false if IPv6
+ * \param [in] cb           Callback called for each prefix and add path ID
+ */
+void AdjRibIn::walk(int rib, bool isIPv4, const walk_cb &cb) {
+    if (rib < 0 or rib >= RIB_MAX)
+        return;
+
+    walkTrie(root[rib][isIPv4 ? 0 : 1], cb);
+}
+
+/**
+ * Longest prefix match - Finds the most specific prefix that covers the address/len
+ *
+ * \param [in] rib          RIB type, RIB_TYPES
+ * \param [in] isIPv4       True if IPv4, false if IPv6
+ * \param [in] addr         Address or prefix in binary form (network byte order)
+ * \param [in] len          Length in bits, 32/128 to match an address
+ * \param [in] cb           Callback called for each add path ID of the matching prefix
+ *
+ * \return true if a covering prefix was found, false if not
+ */
+bool AdjRibIn::lookup(int rib, bool isIPv4, const uint8_t *addr, uint8_t len, const walk_cb &cb) {
+    node *best = NULL;
+
+    if (rib < 0 or rib >= RIB_MAX or len > (isIPv4 ? 32 : 128))
+        return false;
+
+    node *n = root[rib][isIPv4 ? 0 : 1];
+
+    while (n != NULL and n->len <= len and commonBits(n->prefix, addr, n->len) == n->len) {
+        if (n->paths.size() > 0)
+            best = n;
+
+        if (n->len == len)
+            break;
+
+        n = n->child[prefixBit(addr, n->len)];
+    }
+
+    if (best == NULL)
+        return false;
+
+    for (size_t i=0; i < best->paths.size(); i++)
+        cb(best->prefix, best->len, best->paths[i].path_id, best->paths[i].attr_id, best->paths[i].label_hash);
+
+    return true;
+}
+
+/**
+ * Find the node for the prefix, optionally inserting it
+ *
+ * \param [in] rootp        Pointer to the trie root
+ * \param [in] prefix       Prefix in binary form, bits past len must be zero
+ * \param [in] len          Prefix length in bits
+ * \param [in] insert       True to insert the node if not found
+ * \param [out] parent_pp   Set to the link of the parent node (NULL if none), used for removal
+ * \param [out] node_pp     Set to the link of the found node, used for removal
+ *
+ * \return node pointer or NULL if not found
+ */
+AdjRibIn::node *AdjRibIn::find(node **rootp, const uint8_t *prefix, uint8_t len, bool insert,
+                               node ***parent_pp, node ***node_pp) {
+    node **pp = rootp;
+    node **parent = NULL;
+    node *n = *pp;
+
+    while (n != NULL and n->len <= len and commonBits(n->prefix, prefix, n->len) == n->len) {
+        if (n->len == len) {
+            *parent_pp = parent;
+            *node_pp = pp;
+            return n;
+        }
+
+        parent = pp;
+        pp = &n->child[prefixBit(prefix, n->len)];
+        n = *pp;
+    }
+
+    if (not insert)
+        return NULL;
+
+    node *new_node = new node;
+    copyPrefix(new_node->prefix, prefix, len);
+    new_node->len = len;
+    new_node->child[0] = new_node->child[1] = NULL;
+
+    if (n == NULL) {
+        *pp = new_node;
+
+    } else {
+        uint8_t common = commonBits(n->prefix, prefix, n->len < len ? n->len : len);
+
+        if (common == len) {
+            // New node is a less specific of the existing node
+            new_node->child[prefixBit(n->prefix, len)] = n;
+            *pp = new_node;
+
+        } else {
+            // Prefixes diverge, join them with a glue node
+            node *glue = new node;
+            copyPrefix(glue->prefix, prefix, common);
+            glue->len = common;
+            glue->child[prefixBit(n->prefix, common)] = n;
+            glue->child[prefixBit(prefix, common)] = new_node;
+
+            *pp = glue;
+            parent = pp;
+            pp = &glue->child[prefixBit(prefix, common)];
+        }
+    }
+
+    *parent_pp = parent;
+    *node_pp = pp;
+    return new_node;
+}
+
+/**
+ * Remove the node if it no longer has paths, collapsing glue nodes
+ *
+ * \param [in] parent_pp    Link of the parent node, NULL if none
+ * \param [in] node_pp      Link of the node
+ */
+void AdjRibIn::prune(node **parent_pp, node **node_pp) {
+    node *n = *node_pp;
+
+    // Keep the node if it still has paths or is needed as a glue node
+    if (n->paths.size() > 0 or (n->child[0] != NULL and n->child[1] != NULL))
+        return;
+
+    node *child = n->child[0] != NULL ? n->child[0] : n->child[1];
+    *node_pp = child;
+    delete n;
+
+    // Parent glue node is no longer needed if it is left with only one child
+    if (child == NULL and parent_pp != NULL) {
+        node *parent = *parent_pp;
+
+        if (parent->paths.size() == 0) {
+            *parent_pp = parent->child[0] != NULL ? parent->child[0] : parent->child[1];
+            delete parent;
+        }
+    }
+}
+
+/**
+ * Walk the trie, calling the callback for each path
+ *
+ * \param [in] n            Trie root
+ * \param [in] cb           Callback
+ */
+void AdjRibIn::walkTrie(node *n, const walk_cb &cb) {
+    if (n == NULL)
+        return;
+
+    for (size_t i=0; i < n->paths.size(); i++)
+        cb(n->prefix, n->len, n->paths[i].path_id, n->paths[i].attr_id, n->paths[i].label_hash);
+
+    walkTrie(n->child[0], cb);
+    walkTrie(n->child[1], cb);
+}
+
+/**
+ * Free all nodes of the trie, releasing their attributes
+ *
+ * \param [in] n            Trie root
+ */
+void AdjRibIn::freeTrie(node *n) {
+    if (n == NULL)
+        return;
+
+    for (size_t i=0; i < n->paths.size(); i++)
+        AttrTable::instance().release(n->paths[i].attr_id);
+
+    freeTrie(n->child[0]);
+    freeTrie(n->child[1]);
+    delete n;
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef OPENBMP_ADJRIBIN_H
+#define OPENBMP_ADJRIBIN_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+
+/**
+ * \class   AdjRibIn
+ *
+ * \brief   Compact per peer RIB used to detect unchanged announcements
+ * \details Path compressed binary radix trie per RIB (pre-policy, post-policy, loc-rib) and
+ *          address family, keyed by prefix/len.  Each prefix holds the interned attributes ID
+ *          (AttrTable) per add-path ID.  The RIB holds a reference to each attributes ID.
+ */
+class AdjRibIn {
+public:
+    /**
+     * RIB of the peer, the same peer can be sent pre and post policy
+     */
+    enum RIB_TYPES { RIB_PRE_POLICY=0, RIB_POST_POLICY, RIB_LOC, RIB_MAX };
+
+    AdjRibIn();
+    ~AdjRibIn();
+
+    /**
+     * Add or update the prefix
+     *
+     * \param [in] rib          RIB type, RIB_TYPES
+     * \param [in] isIPv4       True if IPv4, false if IPv6
+     * \param [in] prefix       Prefix in binary form (network byte order)
+     * \param [in] len          Prefix length in bits
+     * \param [in] path_id      Add path ID, zero if not used
+     * \param [in] attr_id      Interned attributes ID, zero if unknown (always treated as changed)
+     * \param [in] label_hash   Hash of the prefix labels, zero if none
+     * \param [out] replaced    Set to true if an existing path was changed, false if new or unchanged (optional)
+     *
+     * \return true if the prefix is new or its attributes changed, false if unchanged
+     */
+    bool update(int rib, bool isIPv4, const uint8_t *prefix, uint8_t len, uint32_t path_id,
+                uint32_t attr_id, uint32_t label_hash, bool *replaced = NULL);
+
+    /**
+     * Withdraw the prefix
+     *
+     * \param [in] rib          RIB type, RIB_TYPES
+     * \param [in] isIPv4       True if IPv4, false if IPv6
+     * \param [in] prefix       Prefix in binary form (network byte order)
+     * \param [in] len          Prefix length in bits
+     * \param [in] path_id      Add path ID, zero if not used
+     *
+     * \return true if the prefix was in the RIB, false if not
+     */
+    bool withdraw(int rib, bool isIPv4, const uint8_t *prefix, uint8_t len, uint32_t path_id);
+
+    /**
+     * Remove all prefixes, e.g. when the peer goes down
+     */
+    void clear();
+
+    /**
+     * Callback for walk() - prefix is in binary form (network byte order), bits past len are zero.
+     *      label_hash is zero if the prefix has no labels.
+     */
+    typedef std::function<void(const uint8_t *prefix, uint8_t len, uint32_t path_id, uint32_t attr_id,
+                               uint32_t label_hash)> walk_cb;
+
+    /**
+     * Walk all prefixes of a RIB and address family, in prefix order
+     *
+     * \param [in] rib          RIB type, RIB_TYPES
+     * \param [in] isIPv4       True if IPv4, false if IPv6
+     * \param [in] cb           Callback called for each prefix and add path ID
+     */
+    void walk(int rib, bool isIPv4, const walk_cb &cb);
+
+    /**
+     * Longest prefix match - Finds the most specific prefix that covers the address/len
+     *
+     * \param [in] rib          RIB type, RIB_TYPES
+     * \param [in] isIPv4       True if IPv4, false if IPv6
+     * \param [in] addr         Address or prefix in binary form (network byte order)
+     * \param [in] len          Length in bits, 32/128 to match an address
+     * \param [in] cb           Callback called for each add path ID of the matching prefix
+     *
+     * \return true if a covering prefix was found, false if not
+     */
+    bool lookup(int rib, bool isIPv4, const uint8_t *addr, uint8_t len, const walk_cb &cb);
+
+    /**
+     * Number of prefixes (including add paths) in all RIBs
+     */
+    inline size_t size() {
+        return prefix_count;
+    }
+
+private:
+    friend struct AdjRibInTest;                 ///< Unit tests check the trie shape
+
+    /**
+     * Path entry of a prefix
+     */
+    struct path_entry {
+        uint32_t    path_id;                    ///< Add path ID
+        uint32_t    attr_id;                    ///< Interned attributes ID (AttrTable)
+        uint32_t    label_hash;                 ///< Hash of the prefix labels
+    } __attribute__ ((__packed__));
+
+    /**
+     * Trie node - Nodes without paths are glue nodes that only join two children
+     */
+    struct node {
+        uint8_t     prefix[16];                 ///< Prefix in binary form, bits past len are zero
+        uint8_t     len;                        ///< Prefix length in bits
+        node        *child[2];                  ///< Children by the bit after len
+        std::vector<path_entry> paths;          ///< Paths, normally one unless add paths are used
+    };
+
+    node            *root[RIB_MAX][2];          ///< Trie roots by RIB and address family (0=IPv4, 1=IPv6)
+    size_t          prefix_count;               ///< Number of prefixes (paths) in all RIBs
+
+    // Not copyable, nodes are owned by the instance
+    AdjRibIn(const AdjRibIn &);
+    AdjRibIn &operator=(const AdjRibIn &);
+
+    /**
+     * Find the node for the prefix, optionally inserting it
+     *
+     * \param [in] rootp        Pointer to the trie root
+     * \param [in] prefix       Prefix in binary form, bits past len must be zero
+     * \param [in] len          Prefix length in bits
+     * \param [in] insert       True to insert the node if not found
+     * \param [out] parent_pp   Set to the link of the parent node (NULL if none), used for removal
+     * \param [out] node_pp     Set to the link of the found node, used for removal
+     *
+     * \return node pointer or NULL if not found
+     */
+    node *find(node **rootp, const uint8_t *prefix, uint8_t len, bool insert,
+               node ***parent_pp, node ***node_pp);
+
+    /**
+     * Remove the node if it no longer has paths, collapsing glue nodes
+     *
+     * \param [in] parent_pp    Link of the parent node, NULL if none
+     * \param [in] node_pp      Link of the node
+     */
+    void prune(node **parent_pp, node **node_pp);
+
+    /**
+     * Walk the trie, calling the callback for each path
+     *
+     * \param [in] n            Trie root
+     * \param [in] cb           Callback
+     */
+    void walkTrie(node *n, const walk_cb &cb);
+
+    /**
+     * Free all nodes of the trie, releasing their attributes
+     *
+     * \param [in] n            Trie root
+     */
+    void freeTrie(node *n);
+};
+
+#endif //OPENBMP_ADJRIBIN_H
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include "AttrTable.h"
+#include "md5.h"
+
+/**
+ * Add a length prefixed string to the hash, so adjacent fields cannot run into each other
+ */
+static void hashString(MD5 &hash, const char *str, size_t len) {
+    uint32_t size = len;
+
+    hash.update((unsigned char *) &size, sizeof(size));
+    hash.update((unsigned char *) str, len);
+}
+
+/**
+ * Add a fixed size C string field to the hash
+ */
+static inline void hashField(MD5 &hash, const char *str, size_t max_len) {
+    hashString(hash, str, strnlen(str, max_len));
+}
+
+AttrTable::AttrTable() {
+}
+
+AttrTable::~AttrTable() {
+    for (int i=0; i < ATTR_TABLE_SHARDS; i++) {
+        for (size_t s=0; s < shards[i].slots.size(); s++)
+            delete shards[i].slots[s];
+    }
+}
+
+/**
+ * Get the collector wide instance
+ */
+AttrTable &AttrTable::instance() {
+    static AttrTable table;
+    return table;
+}
+
+/**
+ * Intern the attributes and take a reference
+ *
+ * \param [in] attr     Attributes, hash_id must be set
+ *
+ * \return ID of the attributes, zero if the hash is not set
+ */
+uint32_t AttrTable::intern(const MsgBusInterface::obj_path_attr &attr) {
+    hash_key key;
+    attrKey(attr, (u_char *) key.h);
+
+    int shard_idx = key.h[0] & (ATTR_TABLE_SHARDS - 1);
+    shard &s = shards[shard_idx];
+    uint32_t slot;
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    auto it = s.ids.find(key);
+    if (it != s.ids.end() and sameAttrs(s.slots[it->second]->attr, attr)) {
+        slot = it->second;
+        s.slots[slot]->refcnt++;
+
+    } else {
+        if (s.free_slots.size() > 0) {
+            slot = s.free_slots.back();
+            s.free_slots.pop_back();
+        } else {
+            slot = s.slots.size();
+            s.slots.push_back(new entry);
+        }
+
+        entry *e = s.slots[slot];
+        e->attr = attr;
+        bzero(e->attr.hash_id, sizeof(e->attr.hash_id));
+        e->refcnt = 1;
+        e->key = key;
+
+        // A colliding key keeps the first entry indexed, this one is not shared
+        e->indexed = it == s.ids.end();
+        if (e->indexed)
+            s.ids[key] = slot;
+    }
+
+    return ((slot << ATTR_TABLE_SHARD_BITS) | shard_idx) + 1;
+}
+
+/**
+ * Take another reference to interned attributes
+ *
+ * \param [in] id       Attributes ID, zero is ignored
+ */
+void AttrTable::addRef(uint32_t id) {
+    uint32_t slot;
+    shard *s = idShard(id, slot);
+
+    if (s == NULL)
+        return;
+
+    std::lock_guard<std::mutex> lock(s->mutex);
+
+    if (slot < s->slots.size() and s->slots[slot]->refcnt > 0)
+        s->slots[slot]->refcnt++;
+}
+
+/**
+ * Release a reference, the attributes are removed when the last reference is released
+ *
+ * \param [in] id       Attributes ID, zero is ignored
+ */
+void AttrTable::release(uint32_t id) {
+    uint32_t slot;
+    shard *s = idShard(id, slot);
+
+    if (s == NULL)
+        return;
+
+    std::lock_guard<std::mutex> lock(s->mutex);
+
+    if (slot >= s->slots.size() or s->slots[slot]->refcnt == 0)
+        return;
+
+    entry *e = s->slots[slot];
+    if (--e->refcnt == 0) {
+        if (e->indexed)
+            s->ids.erase(e->key);
+
+        // Free the strings now, the entry itself is reused
+        e->attr = MsgBusInterface::obj_path_attr();
+        s->free_slots.push_back(slot);
+    }
+}
+
+/**
+ * Get a copy of the interned attributes
+ *
+ * \param [in]  id      Attributes ID
+ * \param [out] attr    Attributes
+ *
+ * \return true if found, false if the ID is not in use
+ */
+bool AttrTable::get(uint32_t id, MsgBusInterface::obj_path_attr &attr) {
+    uint32_t slot;
+    shard *s = idShard(id, slot);
+
+    if (s == NULL)
+        return false;
+
+    std::lock_guard<std::mutex> lock(s->mutex);
+
+    if (slot >= s->slots.size() or s->slots[slot]->refcnt == 0)
+        return false;
+
+    attr = s->slots[slot]->attr;
+    return true;
+}
+
+/**
+ * Number of distinct attribute sets in the table
+ */
+size_t AttrTable::size() {
+    size_t count = 0;
+
+    for (int i=0; i < ATTR_TABLE_SHARDS; i++) {
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        count += shards[i].ids.size();
+    }
+
+    return count;
+}
+
+/**
+ * Key of the attributes, an MD5 of every attribute without the peer
+ *
+ * \param [in]  attr    Attributes
+ * \param [out] key     16 byte key
+ */
+void AttrTable::attrKey(const MsgBusInterface::obj_path_attr &attr, u_char *key) {
+    MD5 hash;
+
+    hashField(hash, attr.origin, sizeof(attr.origin));
+    hashString(hash, attr.as_path.data(), attr.as_path.size());
+    hash.update((unsigned char *) &attr.as_path_count, sizeof(attr.as_path_count));
+    hash.update((unsigned char *) &attr.origin_as, sizeof(attr.origin_as));
+    hash.update((unsigned char *) &attr.nexthop_isIPv4, sizeof(attr.nexthop_isIPv4));
+    hashField(hash, attr.next_hop, sizeof(attr.next_hop));
+    hashField(hash, attr.aggregator, sizeof(attr.aggregator));
+    hash.update((unsigned char *) &attr.atomic_agg, sizeof(attr.atomic_agg));
+    hash.update((unsigned char *) &attr.med, sizeof(attr.med));
+    hash.update((unsigned char *) &attr.local_pref, sizeof(attr.local_pref));
+    hashString(hash, attr.community_list.data(), attr.community_list.size());
+    hashString(hash, attr.ext_community_list.data(), attr.ext_community_list.size());
+    hashString(hash, attr.large_community_list.data(), attr.large_community_list.size());
+    hashString(hash, attr.cluster_list.data(), attr.cluster_list.size());
+    hashField(hash, attr.originator_id, sizeof(attr.originator_id));
+
+    hash.finalize();
+
+    unsigned char *hash_raw = hash.raw_digest();
+    memcpy(key, hash_raw, 16);
+    delete[] hash_raw;
+}
+
+/**
+ * Path attribute hash ID of a peer, as sent by the message bus (base_attribute and unicast_prefix)
+ *
+ * \param [in]  attr            Attributes
+ * \param [in]  peer_hash_id    Peer hash ID
+ * \param [out] hash_id         16 byte path attribute hash ID
+ */
+void AttrTable::pathHash(const MsgBusInterface::obj_path_attr &attr, const u_char *peer_hash_id, u_char *hash_id) {
+    std::string p_hash_str;
+    MsgBusInterface::hash_toStr(peer_hash_id, p_hash_str);
+
+    MD5 hash;
+
+    hash.update((unsigned char *) attr.as_path.c_str(), attr.as_path.length());
+    hash.update((unsigned char *) attr.next_hop, strlen(attr.next_hop));
+    hash.update((unsigned char *) attr.aggregator, strlen(attr.aggregator));
+    hash.update((unsigned char *) attr.origin, strlen(attr.origin));
+    hash.update((unsigned char *) &attr.med, sizeof(attr.med));
+    hash.update((unsigned char *) &attr.local_pref, sizeof(attr.local_pref));
+
+    hash.update((unsigned char *) attr.community_list.c_str(), attr.community_list.length());
+    hash.update((unsigned char *) attr.ext_community_list.c_str(), attr.ext_community_list.length());
+    hash.update((unsigned char *) p_hash_str.c_str(), p_hash_str.length());
+
+    hash.finalize();
+
+    unsigned char *hash_raw = hash.raw_digest();
+    memcpy(hash_id, hash_raw, 16);
+    delete[] hash_raw;
+}
+
+/**
+ * Compare every attribute except the hash_id
+ */
+bool AttrTable::sameAttrs(const MsgBusInterface::obj_path_attr &a, const MsgBusInterface::obj_path_attr &b) {
+    return strncmp(a.origin, b.origin, sizeof(a.origin)) == 0 and
+           a.as_path == b.as_path and
+           a.as_path_count == b.as_path_count and
+           a.origin_as == b.origin_as and
+           a.nexthop_isIPv4 == b.nexthop_isIPv4 and
+           strncmp(a.next_hop, b.next_hop, sizeof(a.next_hop)) == 0 and
+           strncmp(a.aggregator, b.aggregator, sizeof(a.aggregator)) == 0 and
+           a.atomic_agg == b.atomic_agg and
+           a.med == b.med and
+           a.local_pref == b.local_pref and
+           a.community_list == b.community_list and
+           a.ext_community_list == b.ext_community_list and
+           a.large_community_list == b.large_community_list and
+           a.cluster_list == b.cluster_list and
+           strncmp(a.originator_id, b.originator_id, sizeof(a.originator_id)) == 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef OPENBMP_ATTRTABLE_H
+#define OPENBMP_ATTRTABLE_H
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+#include "MsgBusInterface.hpp"
+
+/**
+ * \class   AttrTable
+ *
+ * \brief   Collector wide table of interned path attributes
+ * \details The number of distinct attribute sets is small compared to the number of routes, so
+ *          each set is stored once, keyed by a hash of all its attributes, and referenced by a
+ *          small integer ID.  Sets are shared by all peers and routers; two IDs are equal only if
+ *          the attributes are.  Entries are reference counted and removed when the last
+ *          reference is released.
+ *
+ *          The table is split in shards by hash, each with its own lock, so that reader threads
+ *          of different routers rarely contend.  ID zero is never used and means no attributes.
+ */
+class AttrTable {
+public:
+    #define ATTR_TABLE_SHARD_BITS   4
+    #define ATTR_TABLE_SHARDS       (1 << ATTR_TABLE_SHARD_BITS)
+
+    /**
+     * Get the collector wide instance
+     */
+    static AttrTable &instance();
+
+    /**
+     * Intern the attributes and take a reference
+     *
+     * \details The hash_id is not stored, it includes the peer.  See pathHash().
+     *
+     * \param [in] attr     Attributes
+     *
+     * \return ID of the attributes
+     */
+    uint32_t intern(const MsgBusInterface::obj_path_attr &attr);
+
+    /**
+     * Take another reference to interned attributes
+     *
+     * \param [in] id       Attributes ID, zero is ignored
+     */
+    void addRef(uint32_t id);
+
+    /**
+     * Release a reference, the attributes are removed when the last reference is released
+     *
+     * \param [in] id       Attributes ID, zero is ignored
+     */
+    void release(uint32_t id);
+
+    /**
+     * Get a copy of the interned attributes
+     *
+     * \param [in]  id      Attributes ID
+     * \param [out] attr    Attributes, hash_id is cleared
+     *
+     * \return true if found, false if the ID is not in use
+     */
+    bool get(uint32_t id, MsgBusInterface::obj_path_attr &attr);
+
+    /**
+     * Number of distinct attribute sets in the table
+     */
+    size_t size();
+
+    /**
+     * Key of the attributes, an MD5 of every attribute without the peer
+     *
+     * \param [in]  attr    Attributes
+     * \param [out] key     16 byte key
+     */
+    static void attrKey(const MsgBusInterface::obj_path_attr &attr, u_char *key);
+
+    /**
+     * Path attribute hash ID of a peer, as sent by the message bus (base_attribute and unicast_prefix)
+     *
+     * \param [in]  attr            Attributes
+     * \param [in]  peer_hash_id    Peer hash ID
+     * \param [out] hash_id         16 byte path attribute hash ID
+     */
+    static void pathHash(const MsgBusInterface::obj_path_attr &attr, const u_char *peer_hash_id, u_char *hash_id);
+
+private:
+    /**
+     * Attribute key (MD5) used as the key, see attrKey()
+     */
+    struct hash_key {
+        uint64_t    h[2];
+
+        bool operator==(const hash_key &other) const {
+            return h[0] == other.h[0] and h[1] == other.h[1];
+        }
+    };
+
+    struct hash_key_hasher {
+        size_t operator()(const hash_key &key) const {
+            return (size_t) key.h[0];           // Already a good hash
+        }
+    };
+
+    /**
+     * Interned attribute set
+     */
+    struct entry {
+        MsgBusInterface::obj_path_attr attr;    ///< Attributes
+        uint32_t    refcnt;                     ///< References, zero if the slot is free
+        hash_key    key;                        ///< Key of the attributes
+        bool        indexed;                    ///< In the key index, false if the key collided
+    };
+
+    /**
+     * Shard of the table - ID is (slot index << ATTR_TABLE_SHARD_BITS | shard) + 1
+     */
+    struct shard {
+        std::mutex                  mutex;      ///< Protects the shard
+        std::vector<entry *>        slots;      ///< Entries by slot index
+        std::vector<uint32_t>       free_slots; ///< Free slot indexes
+        std::unordered_map<hash_key, uint32_t, hash_key_hasher> ids;    ///< Slot index by key
+    };
+
+    shard           shards[ATTR_TABLE_SHARDS];
+
+    AttrTable();
+    ~AttrTable();
+
+    // Not copyable, there is only one instance
+    AttrTable(const AttrTable &);
+    AttrTable &operator=(const AttrTable &);
+
+    /**
+     * Compare every attribute except the hash_id
+     */
+    static bool sameAttrs(const MsgBusInterface::obj_path_attr &a, const MsgBusInterface::obj_path_attr &b);
+
+    /**
+     * Get the shard and slot index of the ID
+     *
+     * \return pointer to the shard, NULL if the ID is zero
+     */
+    inline shard *idShard(uint32_t id, uint32_t &slot) {
+        if (id == 0)
+            return NULL;
+
+        id--;
+        slot = id >> ATTR_TABLE_SHARD_BITS;
+        return &shards[id & (ATTR_TABLE_SHARDS - 1)];
+    }
+};
+
+#endif //OPENBMP_ATTRTABLE_H
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cmath>
+#include <ctime>
+#include <arpa/inet.h>
+
+#include "FlapTracker.h"
+
+/**
+ * FNV-1a of the key fields
+ */
+size_t FlapTracker::flap_key_hasher::operator()(const flap_key &key) const {
+    uint64_t hash = 14695981039346656037ULL;
+    const uint8_t *p = key.prefix;
+
+    for (size_t i = 0; i < sizeof(key.prefix); i++)
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+
+    hash = (hash ^ key.path_id) * 1099511628211ULL;
+    hash = (hash ^ ((key.len << 16) | (key.rib << 8) | key.isIPv4)) * 1099511628211ULL;
+
+    return (size_t) hash;
+}
+
+FlapTracker::FlapTracker() {
+    cfg = NULL;
+    wheel_time = 0;
+}
+
+/**
+ * Enable the tracker with the config, does nothing if flap tracking is disabled in the config
+ *
+ * \param [in] cfg      Pointer to the config instance
+ */
+void FlapTracker::init(Config *cfg) {
+    if (this->cfg != NULL or not cfg->flap_enabled)
+        return;
+
+    this->cfg = cfg;
+    wheel_time = time(NULL);
+}
+
+/**
+ * Record a flap of the prefix
+ *
+ * \param [in] rib          RIB type, AdjRibIn::RIB_TYPES
+ * \param [in] isIPv4       True if IPv4, false if IPv6
+ * \param [in] prefix       Prefix in binary form (network byte order)
+ * \param [in] len          Prefix length in bits
+ * \param [in] path_id      Add path ID, zero if not used
+ * \param [in] withdraw     True if withdrawn, false if the attributes changed
+ */
+void FlapTracker::flap(int rib, bool isIPv4, const uint8_t *prefix, uint8_t len, uint32_t path_id, bool withdraw) {
+    if (cfg == NULL)
+        return;
+
+    uint32_t now = time(NULL);
+    flap_key key;
+
+    memset(&key, 0, sizeof(key));
+    memcpy(key.prefix, prefix, isIPv4 ? 4 : 16);
+    key.path_id = path_id;
+    key.len = len;
+    key.rib = rib;
+    key.isIPv4 = isIPv4 ? 1 : 0;
+
+    std::pair<std::unordered_map<flap_key, flap_entry, flap_key_hasher>::iterator, bool> ins =
+            entries.insert(std::make_pair(key, flap_entry()));
+    flap_entry &entry = ins.first->second;
+
+    if (ins.second) {
+        memset(&entry, 0, sizeof(entry));
+        entry.first_flap = now;
+    }
+
+    entry.penalty = decayed(entry, now) + (withdraw ? cfg->flap_withdraw_penalty : cfg->flap_attr_penalty);
+    if (entry.penalty > FLAP_MAX_PENALTY)
+        entry.penalty = FLAP_MAX_PENALTY;
+
+    entry.last_update = now;
+    entry.last_flap = now;
+    entry.flaps++;
+    entry.total_flaps++;
+
+    // Time the penalty decays below the forget threshold, only moves later so the wheel slot is reused
+    uint32_t expire = now;
+    if (entry.penalty > cfg->flap_forget_threshold)
+        expire += (uint32_t) ceil(cfg->flap_half_life * log2(entry.penalty / cfg->flap_forget_threshold));
+
+    if (ins.second)
+        schedule(key, expire);
+
+    entry.expire = expire;
+}
+
+/**
+ * Advance the timer wheel to now, removing entries that have decayed
+ *
+ * \param [in] now          Current time in seconds
+ */
+void FlapTracker::tick(uint32_t now) {
+    std::vector<flap_key> keys;
+
+    if (cfg == NULL)
+        return;
+
+    while (wheel_time < now) {
+        wheel_time++;
+
+        // Move level 1 keys that are due in the next FLAP_WHEEL_SLOTS seconds down to level 0
+        if ((wheel_time & (FLAP_WHEEL_SLOTS - 1)) == 0) {
+            keys.swap(wheel[1][(wheel_time >> FLAP_WHEEL_BITS) & (FLAP_WHEEL_SLOTS - 1)]);
+
+            for (size_t i = 0; i < keys.size(); i++) {
+                std::unordered_map<flap_key, flap_entry, flap_key_hasher>::iterator it = entries.find(keys[i]);
+
+                if (it != entries.end())
+                    schedule(keys[i], it->second.expire);
+            }
+
+            keys.clear();
+        }
+
+        keys.swap(wheel[0][wheel_time & (FLAP_WHEEL_SLOTS - 1)]);
+
+        for (size_t i = 0; i < keys.size(); i++) {
+            std::unordered_map<flap_key, flap_entry, flap_key_hasher>::iterator it = entries.find(keys[i]);
+
+            if (it == entries.end())
+                continue;
+
+            // Flapped again since scheduled, the expire time moved later
+            if (it->second.expire > wheel_time)
+                schedule(keys[i], it->second.expire);
+            else
+                entries.erase(it);
+        }
+
+        keys.clear();
+    }
+}
+
+/**
+ * Get the prefixes that flapped since the last report and are at or above the report threshold
+ *
+ * \param [in]  now         Current time in seconds
+ * \param [out] reports     Flap report entries are appended
+ */
+void FlapTracker::report(uint32_t now, std::vector<MsgBusInterface::obj_flap_report> &reports) {
+    MsgBusInterface::obj_flap_report rpt;
+
+    if (cfg == NULL)
+        return;
+
+    for (std::unordered_map<flap_key, flap_entry, flap_key_hasher>::iterator it = entries.begin();
+                                                                              it != entries.end(); it++) {
+        const flap_key &key = it->first;
+        flap_entry &entry = it->second;
+
+        if (entry.flaps == 0)
+            continue;
+
+        float penalty = decayed(entry, now);
+
+        if (penalty >= cfg->flap_report_threshold) {
+            bzero(&rpt, sizeof(rpt));
+
+            inet_ntop(key.isIPv4 ? AF_INET : AF_INET6, key.prefix, rpt.prefix, sizeof(rpt.prefix));
+            rpt.prefix_len = key.len;
+            rpt.isIPv4 = key.isIPv4;
+            rpt.path_id = key.path_id;
+            rpt.rib_type = key.rib;
+            rpt.flaps = entry.flaps;
+            rpt.total_flaps = entry.total_flaps;
+            rpt.penalty = (uint32_t) penalty;
+            rpt.first_flap = entry.first_flap;
+            rpt.last_flap = entry.last_flap;
+
+            reports.push_back(rpt);
+        }
+
+        entry.flaps = 0;
+    }
+}
+
+/**
+ * Penalty of the entry at now, after decay
+ */
+float FlapTracker::decayed(const flap_entry &entry, uint32_t now) {
+    if (entry.penalty <= 0 or now <= entry.last_update)
+        return entry.penalty;
+
+    return entry.penalty * exp2(-(float)(now - entry.last_update) / cfg->flap_half_life);
+}
+
+/**
+ * Add the key to the wheel slot of the expire time
+ */
+void FlapTracker::schedule(const flap_key &key, uint32_t expire) {
+    uint32_t delta = expire > wheel_time ? expire - wheel_time : 0;
+
+    if (delta == 0)
+        wheel[0][(wheel_time + 1) & (FLAP_WHEEL_SLOTS - 1)].push_back(key);
+
+    else if (delta < FLAP_WHEEL_SLOTS)
+        wheel[0][expire & (FLAP_WHEEL_SLOTS - 1)].push_back(key);
+
+    else if (delta < FLAP_WHEEL_SLOTS * FLAP_WHEEL_SLOTS)
+        wheel[1][(expire >> FLAP_WHEEL_BITS) & (FLAP_WHEEL_SLOTS - 1)].push_back(key);
+
+    else    // Beyond the wheel, rescheduled when the last level 1 slot is reached
+        wheel[1][((wheel_time >> FLAP_WHEEL_BITS) - 1) & (FLAP_WHEEL_SLOTS - 1)].push_back(key);
+}
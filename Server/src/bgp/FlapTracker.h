@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef OPENBMP_FLAPTRACKER_H
+#define OPENBMP_FLAPTRACKER_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <unordered_map>
+
+#include "Config.h"
+#include "MsgBusInterface.hpp"
+
+/**
+ * \class   FlapTracker
+ *
+ * \brief   Per peer route flap tracker
+ * \details Keeps a decaying penalty per prefix (RFC 2439 style) for prefixes that were withdrawn or
+ *          changed.  The penalty decays exponentially with the configured half life and is computed
+ *          when needed.  Entries are removed by a two level timer wheel once the penalty has decayed
+ *          below the forget threshold, so only recently flapping prefixes use memory.
+ *
+ *          Used only by the reader thread of the router.
+ */
+class FlapTracker {
+public:
+    #define FLAP_WHEEL_BITS         8                           ///< Slots per wheel level as bits
+    #define FLAP_WHEEL_SLOTS        (1 << FLAP_WHEEL_BITS)      ///< Slots per wheel level
+    #define FLAP_MAX_PENALTY        20000                       ///< Penalty ceiling
+
+    FlapTracker();
+
+    /**
+     * Enable the tracker with the config, does nothing if flap tracking is disabled in the config
+     *
+     * \param [in] cfg      Pointer to the config instance
+     */
+    void init(Config *cfg);
+
+    /**
+     * Check if flap tracking is enabled
+     */
+    inline bool enabled() {
+        return cfg != NULL;
+    }
+
+    /**
+     * Record a flap of the prefix
+     *
+     * \param [in] rib          RIB type, AdjRibIn::RIB_TYPES
+     * \param [in] isIPv4       True if IPv4, false if IPv6
+     * \param [in] prefix       Prefix in binary form (network byte order)
+     * \param [in] len          Prefix length in bits
+     * \param [in] path_id      Add path ID, zero if not used
+     * \param [in] withdraw     True if withdrawn, false if the attributes changed
+     */
+    void flap(int rib, bool isIPv4, const uint8_t *prefix, uint8_t len, uint32_t path_id, bool withdraw);
+
+    /**
+     * Advance the timer wheel to now, removing entries that have decayed
+     *
+     * \param [in] now          Current time in seconds
+     */
+    void tick(uint32_t now);
+
+    /**
+     * Get the prefixes that flapped since the last report and are at or above the report threshold
+     *
+     * \details The flap counts since the last report are reset.
+     *
+     * \param [in]  now         Current time in seconds
+     * \param [out] reports     Flap report entries are appended
+     */
+    void report(uint32_t now, std::vector<MsgBusInterface::obj_flap_report> &reports);
+
+    /**
+     * Number of tracked prefixes
+     */
+    inline size_t size() {
+        return entries.size();
+    }
+
+private:
+    /**
+     * Tracked prefix key
+     */
+    struct flap_key {
+        uint8_t     prefix[16];                 ///< Prefix in binary form
+        uint32_t    path_id;                    ///< Add path ID
+        uint8_t     len;                        ///< Prefix length in bits
+        uint8_t     rib;                        ///< RIB type
+        uint8_t     isIPv4;                     ///< 1 if IPv4, 0 if IPv6
+
+        bool operator==(const flap_key &other) const {
+            return memcmp(prefix, other.prefix, sizeof(prefix)) == 0 and path_id == other.path_id and
+                   len == other.len and rib == other.rib and isIPv4 == other.isIPv4;
+        }
+    };
+
+    struct flap_key_hasher {
+        size_t operator()(const flap_key &key) const;
+    };
+
+    /**
+     * Tracked prefix state
+     */
+    struct flap_entry {
+        float       penalty;                    ///< Penalty at last_update
+        uint32_t    last_update;                ///< Time the penalty was last updated
+        uint32_t    expire;                     ///< Time the penalty decays below the forget threshold
+        uint32_t    first_flap;                 ///< Time of the first flap
+        uint32_t    last_flap;                  ///< Time of the last flap
+        uint32_t    flaps;                      ///< Flaps since the last report
+        uint32_t    total_flaps;                ///< Flaps since first tracked
+    };
+
+    Config          *cfg;                       ///< Configuration instance, NULL if disabled
+
+    std::unordered_map<flap_key, flap_entry, flap_key_hasher> entries;     ///< Tracked prefixes
+
+    /**
+     * Timer wheel - Level 0 slots are one second, level 1 slots are FLAP_WHEEL_SLOTS seconds.  Each
+     *      entry is in exactly one slot.
+     */
+    std::vector<flap_key> wheel[2][FLAP_WHEEL_SLOTS];
+    uint32_t        wheel_time;                 ///< Last time processed by the wheel
+
+    /**
+     * Penalty of the entry at now, after decay
+     */
+    float decayed(const flap_entry &entry, uint32_t now);
+
+    /**
+     * Add the key to the wheel slot of the expire time
+     */
+    void schedule(const flap_key &key, uint32_t expire);
+};
+
+#endif //OPENBMP_FLAPTRACKER_H
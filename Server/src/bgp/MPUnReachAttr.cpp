@@ -73,6 +73,9 @@ void MPUnReachAttr::parseUnReachNlriAttr(int attr_len, u_char *data, bgp_msg::Up
 
     if (nlri.nlri_len == 0) {
 	peer_info->endOfRIB = true;		// Indicates End-Of-RIB Marker is received
+
+        if (nlri.safi == bgp::BGP_SAFI_UNICAST or nlri.safi == bgp::BGP_SAFI_NLRI_LABEL)
+            peer_info->eor_afi = nlri.afi;
         LOG_INFO("%s: End-Of-RIB marker (mp_unreach len=0)", peer_addr.c_str());
 
     } else {
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cstring>
+#include <ctime>
+
+#include "PeerCounters.h"
+
+PeerCounters::PeerCounters() {
+    enabled_flag = false;
+    interval_start = 0;
+    updates = 0;
+    announcements = 0;
+    withdrawals = 0;
+    bzero(size_hist, sizeof(size_hist));
+}
+
+/**
+ * Enable the counters with the config, does nothing if peer stats are disabled in the config
+ *
+ * \param [in] cfg      Pointer to the config instance
+ */
+void PeerCounters::init(Config *cfg) {
+    if (enabled_flag or cfg->peer_stats_interval <= 0)
+        return;
+
+    enabled_flag = true;
+    interval_start = time(NULL);
+}
+
+/**
+ * Count a received UPDATE message
+ *
+ * \param [in] size     UPDATE message size in bytes, including the BGP header
+ */
+void PeerCounters::update(size_t size) {
+    int bucket = 0;
+
+    // Buckets are powers of two starting at PEER_STATS_SIZE_MIN, the last bucket has the rest
+    for (size_t limit = PEER_STATS_SIZE_MIN; size >= limit and bucket < PEER_STATS_SIZE_BUCKETS - 1; limit <<= 1)
+        bucket++;
+
+    size_hist[bucket]++;
+    updates++;
+}
+
+/**
+ * Count the path attribute set of an UPDATE
+ *
+ * \param [in] hash_id  Path attribute hash ID, ignored if zero
+ */
+void PeerCounters::attrSet(const u_char *hash_id) {
+    uint64_t key;
+
+    memcpy(&key, hash_id, sizeof(key));
+
+    if (key != 0)
+        attr_sets.insert(key);
+}
+
+/**
+ * Fill the report with the counts since the last report and reset them
+ *
+ * \param [in]  now             Current time in seconds
+ * \param [in]  unique_prefixes Number of prefixes in the peer RIB
+ * \param [out] report          Report to fill
+ */
+void PeerCounters::report(uint32_t now, uint64_t unique_prefixes, MsgBusInterface::obj_peer_stats &report) {
+    bzero(&report, sizeof(report));
+
+    report.interval = now > interval_start ? now - interval_start : 1;
+    report.updates = updates;
+    report.announcements = announcements;
+    report.withdrawals = withdrawals;
+    report.announce_rate = (float) announcements / report.interval;
+    report.withdraw_rate = (float) withdrawals / report.interval;
+    report.unique_prefixes = unique_prefixes;
+    report.attr_sets = attr_sets.size();
+    memcpy(report.size_hist, size_hist, sizeof(report.size_hist));
+
+    interval_start = now;
+    updates = 0;
+    announcements = 0;
+    withdrawals = 0;
+    bzero(size_hist, sizeof(size_hist));
+    attr_sets.clear();
+}
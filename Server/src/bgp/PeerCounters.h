@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef OPENBMP_PEERCOUNTERS_H
+#define OPENBMP_PEERCOUNTERS_H
+
+#include <cstdint>
+#include <unordered_set>
+
+#include "Config.h"
+#include "MsgBusInterface.hpp"
+
+/**
+ * \class   PeerCounters
+ *
+ * \brief   Per peer counters maintained by the parser
+ * \details Counts announcements, withdrawals, distinct attribute sets and UPDATE sizes since the
+ *          last report.  The counts are turned into a peer_stats report every peer stats interval.
+ *
+ *          Used only by the reader thread of the router.
+ */
+class PeerCounters {
+public:
+    PeerCounters();
+
+    /**
+     * Enable the counters with the config, does nothing if peer stats are disabled in the config
+     *
+     * \param [in] cfg      Pointer to the config instance
+     */
+    void init(Config *cfg);
+
+    /**
+     * Check if the counters are enabled
+     */
+    inline bool enabled() {
+        return enabled_flag;
+    }
+
+    /**
+     * Count a received UPDATE message
+     *
+     * \param [in] size     UPDATE message size in bytes, including the BGP header
+     */
+    void update(size_t size);
+
+    /**
+     * Count announced and withdrawn NLRI of an UPDATE
+     *
+     * \param [in] announced    Number of announced NLRI
+     * \param [in] withdrawn    Number of withdrawn NLRI
+     */
+    inline void nlri(size_t announced, size_t withdrawn) {
+        announcements += announced;
+        withdrawals += withdrawn;
+    }
+
+    /**
+     * Count the path attribute set of an UPDATE
+     *
+     * \param [in] hash_id  Path attribute hash ID, ignored if zero
+     */
+    void attrSet(const u_char *hash_id);
+
+    /**
+     * Fill the report with the counts since the last report and reset them
+     *
+     * \param [in]  now             Current time in seconds
+     * \param [in]  unique_prefixes Number of prefixes in the peer RIB
+     * \param [out] report          Report to fill
+     */
+    void report(uint32_t now, uint64_t unique_prefixes, MsgBusInterface::obj_peer_stats &report);
+
+private:
+    bool            enabled_flag;               ///< Indicates if counting is enabled
+    uint32_t        interval_start;             ///< Time the current interval started
+
+    uint64_t        updates;                    ///< UPDATE messages in the interval
+    uint64_t        announcements;              ///< Announced NLRI in the interval
+    uint64_t        withdrawals;                ///< Withdrawn NLRI in the interval
+    uint64_t        size_hist[PEER_STATS_SIZE_BUCKETS];     ///< UPDATE size histogram of the interval
+
+    std::unordered_set<uint64_t> attr_sets;     ///< Attribute sets seen in the interval
+};
+
+#endif //OPENBMP_PEERCOUNTERS_H
@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cinttypes>
+#include <ctime>
+#include <cerrno>
+#include <algorithm>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "PeerDigest.h"
+#include "AttrTable.h"
+#include "MsgBusInterface.hpp"
+
+/**
+ * Order of the digest entries
+ */
+static bool entryLess(const PeerDigest::digest_entry &a, const PeerDigest::digest_entry &b) {
+    if (a.rib != b.rib)
+        return a.rib < b.rib;
+
+    if (a.isIPv4 != b.isIPv4)
+        return a.isIPv4 > b.isIPv4;
+
+    int cmp = memcmp(a.prefix, b.prefix, sizeof(a.prefix));
+    if (cmp != 0)
+        return cmp < 0;
+
+    if (a.len != b.len)
+        return a.len < b.len;
+
+    return a.path_id < b.path_id;
+}
+
+/**
+ * Mix of the label hash into the digest hash
+ */
+static inline uint64_t labelMix(uint32_t label_hash) {
+    return label_hash * 0x9E3779B97F4A7C15ULL;
+}
+
+PeerDigest::PeerDigest() {
+    map_ptr = NULL;
+    map_len = 0;
+    entries = NULL;
+    count = 0;
+}
+
+PeerDigest::~PeerDigest() {
+    close();
+}
+
+/**
+ * Hash of the path attributes and labels stored in the digest
+ *
+ * \param [in] attr_hash_id     Path attribute key (16 bytes), see AttrTable::attrKey()
+ * \param [in] label_hash       Hash of the prefix labels, zero if none
+ *
+ * \return hash, zero if the attribute hash is unknown
+ */
+uint64_t PeerDigest::hash(const u_char *attr_hash_id, uint32_t label_hash) {
+    uint64_t value;
+
+    memcpy(&value, attr_hash_id, sizeof(value));
+
+    if (value == 0)
+        return 0;
+
+    return value ^ labelMix(label_hash);
+}
+
+/**
+ * Filename of the peer digest
+ */
+std::string PeerDigest::filename(const std::string &dir, const u_char *peer_hash_id) {
+    std::string hash_str;
+
+    MsgBusInterface::hash_toStr(peer_hash_id, hash_str);
+
+    return dir + "/" + hash_str + ".digest";
+}
+
+/**
+ * Save the digest of the peer RIB
+ *
+ * \param [in] logPtr       Pointer to Logger instance
+ * \param [in] dir          Directory of the digest files
+ * \param [in] peer_hash_id Peer hash ID
+ * \param [in] rib          Peer RIB
+ *
+ * \return true if saved, false on error
+ */
+bool PeerDigest::save(Logger *logPtr, const std::string &dir, const u_char *peer_hash_id, AdjRibIn &rib) {
+    Logger *logger = logPtr;
+    std::vector<digest_entry> list;
+    std::unordered_map<uint32_t, uint64_t> attr_hashes;     // Attribute ID to hash, saves table lookups
+    MsgBusInterface::obj_path_attr attr;
+    digest_entry entry;
+
+    list.reserve(rib.size());
+
+    for (int rib_type = 0; rib_type < AdjRibIn::RIB_MAX; rib_type++) {
+        for (int afi = 0; afi < 2; afi++) {
+            bool isIPv4 = (afi == 0);
+
+            rib.walk(rib_type, isIPv4, [&](const uint8_t *prefix, uint8_t len, uint32_t path_id, uint32_t attr_id,
+                                           uint32_t label_hash) {
+                std::unordered_map<uint32_t, uint64_t>::iterator it = attr_hashes.find(attr_id);
+                uint64_t attr_hash = 0;
+
+                if (it != attr_hashes.end())
+                    attr_hash = it->second;
+
+                else {
+                    if (attr_id != 0 and AttrTable::instance().get(attr_id, attr)) {
+                        // Every attribute, the path hash ID leaves some out
+                        u_char attr_key[16];
+                        AttrTable::attrKey(attr, attr_key);
+                        attr_hash = hash(attr_key, 0);
+                    }
+
+                    attr_hashes[attr_id] = attr_hash;
+                }
+
+                // Prefixes with unknown attributes are left out, so they are sent again
+                if (attr_hash == 0)
+                    return;
+
+                bzero(&entry, sizeof(entry));
+                entry.rib = rib_type;
+                entry.isIPv4 = isIPv4 ? 1 : 0;
+                entry.len = len;
+                entry.has_labels = label_hash != 0 ? 1 : 0;
+                entry.path_id = path_id;
+                memcpy(entry.prefix, prefix, isIPv4 ? 4 : 16);
+                entry.hash = attr_hash ^ labelMix(label_hash);
+
+                list.push_back(entry);
+            });
+        }
+    }
+
+    std::sort(list.begin(), list.end(), entryLess);
+
+    std::string name = filename(dir, peer_hash_id);
+    std::string tmp_name = name + ".tmp";
+
+    FILE *fp = fopen(tmp_name.c_str(), "w");
+    if (fp == NULL) {
+        LOG_ERR("Failed to open peer digest %s: %s", tmp_name.c_str(), strerror(errno));
+        return false;
+    }
+
+    digest_header hdr;
+    bzero(&hdr, sizeof(hdr));
+    memcpy(hdr.magic, PEER_DIGEST_MAGIC, sizeof(hdr.magic));
+    hdr.version = PEER_DIGEST_VERSION;
+    hdr.byte_order = PEER_DIGEST_BYTE_ORDER;
+    hdr.header_size = sizeof(hdr);
+    hdr.entry_size = sizeof(digest_entry);
+    hdr.timestamp = time(NULL);
+    hdr.count = list.size();
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+
+    if (ok and list.size() > 0)
+        ok = fwrite(&list[0], sizeof(digest_entry), list.size(), fp) == list.size();
+
+    if (fclose(fp) != 0)
+        ok = false;
+
+    if (not ok or rename(tmp_name.c_str(), name.c_str()) != 0) {
+        LOG_ERR("Failed to write peer digest %s: %s", name.c_str(), strerror(errno));
+        unlink(tmp_name.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Remove the saved digest of the peer
+ *
+ * \param [in] dir          Directory of the digest files
+ * \param [in] peer_hash_id Peer hash ID
+ */
+void PeerDigest::remove(const std::string &dir, const u_char *peer_hash_id) {
+    unlink(filename(dir, peer_hash_id).c_str());
+}
+
+/**
+ * Open (memory map) the saved digest of the peer
+ *
+ * \param [in] logPtr       Pointer to Logger instance
+ * \param [in] dir          Directory of the digest files
+ * \param [in] peer_hash_id Peer hash ID
+ *
+ * \return true if a digest was opened
+ */
+bool PeerDigest::open(Logger *logPtr, const std::string &dir, const u_char *peer_hash_id) {
+    Logger *logger = logPtr;
+    struct stat st;
+
+    close();
+
+    std::string name = filename(dir, peer_hash_id);
+
+    int fd = ::open(name.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) != 0 or st.st_size < (off_t) sizeof(digest_header)) {
+        ::close(fd);
+        LOG_WARN("Ignoring invalid peer digest %s", name.c_str());
+        return false;
+    }
+
+    map_ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (map_ptr == MAP_FAILED) {
+        map_ptr = NULL;
+        LOG_WARN("Failed to map peer digest %s: %s", name.c_str(), strerror(errno));
+        return false;
+    }
+
+    map_len = st.st_size;
+
+    const digest_header *hdr = (const digest_header *) map_ptr;
+
+    if (memcmp(hdr->magic, PEER_DIGEST_MAGIC, sizeof(hdr->magic)) != 0 or hdr->version != PEER_DIGEST_VERSION or
+            hdr->byte_order != PEER_DIGEST_BYTE_ORDER or hdr->entry_size != sizeof(digest_entry) or
+            hdr->header_size + hdr->count * sizeof(digest_entry) > map_len) {
+
+        LOG_WARN("Ignoring invalid peer digest %s", name.c_str());
+        close();
+        return false;
+    }
+
+    // Entries are read in order while the RIB dump is received
+    madvise(map_ptr, map_len, MADV_WILLNEED);
+
+    entries = (const digest_entry *)((const char *) map_ptr + hdr->header_size);
+    count = hdr->count;
+
+    received.assign(count, false);
+    bzero(finished, sizeof(finished));
+
+    LOG_INFO("Opened peer digest %s with %zu prefixes, saved %" PRIu64 " seconds ago", name.c_str(), count,
+             (uint64_t) time(NULL) - hdr->timestamp);
+
+    return true;
+}
+
+/**
+ * Find the entry index, -1 if not found
+ */
+ssize_t PeerDigest::find(int rib, bool isIPv4, const uint8_t *prefix, uint8_t len, uint32_t path_id) {
+    digest_entry key;
+
+    if (entries == NULL or len > (isIPv4 ? 32 : 128))
+        return -1;
+
+    bzero(&key, sizeof(key));
+    key.rib = rib;
+    key.isIPv4 = isIPv4 ? 1 : 0;
+    key.len = len;
+    key.path_id = path_id;
+
+    // Copy the prefix with the host bits zeroed, same as the RIB
+    memcpy(key.prefix, prefix, (len + 7) / 8);
+    if (len % 8)
+        key.prefix[len / 8] &= 0xFF << (8 - len % 8);
+
+    const digest_entry *it = std::lower_bound(entries, entries + count, key, entryLess);
+
+    if (it == entries + count or entryLess(key, *it))
+        return -1;
+
+    return it - entries;
+}
+
+/**
+ * Check a received prefix against the digest, the prefix is marked as received
+ *
+ * \param [in] rib          RIB type, AdjRibIn::RIB_TYPES
+ * \param [in] isIPv4       True if IPv4, false if IPv6
+ * \param [in] prefix       Prefix in binary form (network byte order)
+ * \param [in] len          Prefix length in bits
+ * \param [in] path_id      Add path ID, zero if not used
+ * \param [in] hash         Hash of the path attributes and labels, see hash()
+ *
+ * \return true if the prefix is in the digest with the same hash
+ */
+bool PeerDigest::match(int rib, bool isIPv4, const uint8_t *prefix, uint8_t len, uint32_t path_id, uint64_t hash) {
+    ssize_t i = find(rib, isIPv4, prefix, len, path_id);
+
+    if (i < 0)
+        return false;
+
+    received[i] = true;
+
+    return hash != 0 and entries[i].hash == hash;
+}
+
+/**
+ * Mark a withdrawn prefix as received
+ *
+ * \param [in] rib          RIB type, AdjRibIn::RIB_TYPES
+ * \param [in] isIPv4       True if IPv4, false if IPv6
+ * \param [in] prefix       Prefix in binary form (network byte order)
+ * \param [in] len          Prefix length in bits
+ * \param [in] path_id      Add path ID, zero if not used
+ *
+ * \return true if the prefix is in the digest
+ */
+bool PeerDigest::seen(int rib, bool isIPv4, const uint8_t *prefix, uint8_t len, uint32_t path_id) {
+    ssize_t i = find(rib, isIPv4, prefix, len, path_id);
+
+    if (i < 0 or received[i])
+        return false;
+
+    received[i] = true;
+    return true;
+}
+
+/**
+ * End of the RIB dump - Calls the callback for each prefix that was not received again
+ *
+ * \details The digest is closed once all RIBs and address families in it are finished.
+ *
+ * \param [in] rib          RIB type, AdjRibIn::RIB_TYPES
+ * \param [in] isIPv4       True if IPv4, false if IPv6
+ * \param [in] cb           Called with each prefix that was not received
+ */
+void PeerDigest::finish(int rib, bool isIPv4, entry_cb cb) {
+    bool done = true;
+
+    if (entries == NULL or rib < 0 or rib >= AdjRibIn::RIB_MAX)
+        return;
+
+    if (not finished[rib][isIPv4 ? 0 : 1]) {
+        finished[rib][isIPv4 ? 0 : 1] = true;
+
+        for (size_t i = 0; i < count; i++) {
+            if (entries[i].rib == rib and entries[i].isIPv4 == (isIPv4 ? 1 : 0) and not received[i])
+                cb(entries[i]);
+        }
+    }
+
+    // Close once every RIB and address family in the digest is finished
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i].rib < AdjRibIn::RIB_MAX and not finished[entries[i].rib][entries[i].isIPv4 ? 0 : 1]) {
+            done = false;
+            break;
+        }
+    }
+
+    if (done)
+        close();
+}
+
+/**
+ * Close the digest
+ */
+void PeerDigest::close() {
+    if (map_ptr != NULL)
+        munmap(map_ptr, map_len);
+
+    map_ptr = NULL;
+    map_len = 0;
+    entries = NULL;
+    count = 0;
+    received.clear();
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef OPENBMP_PEERDIGEST_H
+#define OPENBMP_PEERDIGEST_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include <sys/types.h>
+
+#include "AdjRibIn.h"
+#include "Logger.h"
+
+/**
+ * \class   PeerDigest
+ *
+ * \brief   Persisted digest of a peer RIB, used to suppress unchanged routes after a reconnect
+ * \details The digest maps (rib, prefix, path_id) to a hash of the path attributes and labels.  It is
+ *          saved per peer, periodically and when the router disconnects.  When the peer comes back up,
+ *          the saved digest is memory mapped; routes that match it are not sent again and the routes
+ *          that are not received again before End-of-RIB are withdrawn.
+ *
+ *          File layout (host byte order):
+ *
+ *              digest_header
+ *              digest_entry[count]         - Sorted by rib, address family, prefix, length and path ID
+ *
+ *          Used only by the reader thread of the router.
+ */
+class PeerDigest {
+public:
+    #define PEER_DIGEST_MAGIC           "OBPD"
+    #define PEER_DIGEST_VERSION         2           ///< 2 hashes every attribute, see AttrTable::attrKey()
+    #define PEER_DIGEST_BYTE_ORDER      0x0102          ///< Reads as 0x0201 if the byte order differs
+
+    struct digest_header {
+        char        magic[4];                   ///< PEER_DIGEST_MAGIC
+        uint16_t    version;                    ///< PEER_DIGEST_VERSION
+        uint16_t    byte_order;                 ///< PEER_DIGEST_BYTE_ORDER
+        uint32_t    header_size;                ///< Size of this header
+        uint32_t    entry_size;                 ///< Size of a digest entry
+        uint64_t    timestamp;                  ///< Time the digest was saved in seconds since EPOC
+        uint64_t    count;                      ///< Number of entries
+    } __attribute__ ((__packed__));
+
+    struct digest_entry {
+        uint8_t     rib;                        ///< RIB type, AdjRibIn::RIB_TYPES
+        uint8_t     isIPv4;                     ///< 1 if IPv4, 0 if IPv6
+        uint8_t     len;                        ///< Prefix length in bits
+        uint8_t     has_labels;                 ///< 1 if the prefix has labels
+        uint32_t    path_id;                    ///< Add path ID, zero if not used
+        uint8_t     prefix[16];                 ///< Prefix in binary form, host bits zero
+        uint64_t    hash;                       ///< Hash of the path attributes and labels
+    } __attribute__ ((__packed__));
+
+    typedef std::function<void(const digest_entry &entry)> entry_cb;
+
+    PeerDigest();
+    ~PeerDigest();
+
+    PeerDigest(const PeerDigest &) = delete;
+    PeerDigest &operator=(const PeerDigest &) = delete;
+
+    /**
+     * Hash of the path attributes and labels stored in the digest
+     *
+     * \param [in] attr_hash_id     Path attribute key (16 bytes), see AttrTable::attrKey()
+     * \param [in] label_hash       Hash of the prefix labels, zero if none
+     *
+     * \return hash, zero if the attribute hash is unknown
+     */
+    static uint64_t hash(const u_char *attr_hash_id, uint32_t label_hash);
+
+    /**
+     * Save the digest of the peer RIB
+     *
+     * \param [in] logPtr       Pointer to Logger instance
+     * \param [in] dir          Directory of the digest files
+     * \param [in] peer_hash_id Peer hash ID
+     * \param [in] rib          Peer RIB
+     *
+     * \return true if saved, false on error
+     */
+    static bool save(Logger *logPtr, const std::string &dir, const u_char *peer_hash_id, AdjRibIn &rib);
+
+    /**
+     * Remove the saved digest of the peer
+     *
+     * \param [in] dir          Directory of the digest files
+     * \param [in] peer_hash_id Peer hash ID
+     */
+    static void remove(const std::string &dir, const u_char *peer_hash_id);
+
+    /**
+     * Open (memory map) the saved digest of the peer
+     *
+     * \param [in] logPtr       Pointer to Logger instance
+     * \param [in] dir          Directory of the digest files
+     * \param [in] peer_hash_id Peer hash ID
+     *
+     * \return true if a digest was opened
+     */
+    bool open(Logger *logPtr, const std::string &dir, const u_char *peer_hash_id);
+
+    /**
+     * Check if a digest is open
+     */
+    inline bool active() {
+        return entries != NULL;
+    }
+
+    /**
+     * Check a received prefix against the digest, the prefix is marked as received
+     *
+     * \param [in] rib          RIB type, AdjRibIn::RIB_TYPES
+     * \param [in] isIPv4       True if IPv4, false if IPv6
+     * \param [in] prefix       Prefix in binary form (network byte order)
+     * \param [in] len          Prefix length in bits
+     * \param [in] path_id      Add path ID, zero if not used
+     * \param [in] hash         Hash of the path attributes and labels, see hash()
+     *
+     * \return true if the prefix is in the digest with the same hash
+     */
+    bool match(int rib, bool isIPv4, const uint8_t *prefix, uint8_t len, uint32_t path_id, uint64_t hash);
+
+    /**
+     * Mark a withdrawn prefix as received
+     *
+     * \param [in] rib          RIB type, AdjRibIn::RIB_TYPES
+     * \param [in] isIPv4       True if IPv4, false if IPv6
+     * \param [in] prefix       Prefix in binary form (network byte order)
+     * \param [in] len          Prefix length in bits
+     * \param [in] path_id      Add path ID, zero if not used
+     *
+     * \return true if the prefix is in the digest
+     */
+    bool seen(int rib, bool isIPv4, const uint8_t *prefix, uint8_t len, uint32_t path_id);
+
+    /**
+     * End of the RIB dump - Calls the callback for each prefix that was not received again
+     *
+     * \details The digest is closed once all RIBs and address families in it are finished.
+     *
+     * \param [in] rib          RIB type, AdjRibIn::RIB_TYPES
+     * \param [in] isIPv4       True if IPv4, false if IPv6
+     * \param [in] cb           Called with each prefix that was not received
+     */
+    void finish(int rib, bool isIPv4, entry_cb cb);
+
+    /**
+     * Close the digest
+     */
+    void close();
+
+private:
+    void            *map_ptr;                   ///< Mapped file
+    size_t          map_len;                    ///< Mapped length
+    const digest_entry *entries;                ///< Digest entries, NULL if not open
+    size_t          count;                      ///< Number of entries
+
+    std::vector<bool> received;                 ///< Entries received since the digest was opened
+    bool            finished[AdjRibIn::RIB_MAX][2];     ///< RIB and address family (0=IPv4) finished
+
+    /**
+     * Filename of the peer digest
+     */
+    static std::string filename(const std::string &dir, const u_char *peer_hash_id);
+
+    /**
+     * Find the entry index, -1 if not found
+     */
+    ssize_t find(int rib, bool isIPv4, const uint8_t *prefix, uint8_t len, uint32_t path_id);
+};
+
+#endif //OPENBMP_PEERDIGEST_H
@@ -31,12 +31,14 @@ namespace bgp_msg {
  * \param [in]     routerAddr       The router IP address - used for logging
  * \param [in,out] peer_info   Persistent peer information
  * \param [in]     enable_debug     Debug true to enable, false to disable
+ * \param [in]     enable_ls        True to parse BGP-LS, false to skip BGP-LS NLRI's and attributes
  */
 UpdateMsg::UpdateMsg(Logger *logPtr, std::string peerAddr, std::string routerAddr, BMPReader::peer_info *peer_info,
-                     bool enable_debug)
+                     bool enable_debug, bool enable_ls)
         : debug(enable_debug),
           logger(logPtr),
-          peer_info(peer_info) {
+          peer_info(peer_info),
+          parse_ls(enable_ls) {
 
     this->peer_addr = peerAddr;
     this->router_addr = routerAddr;
@@ -126,6 +128,7 @@ size_t UpdateMsg::parseUpdateMsg(u_char *data, size_t size, parsed_update_data &
     if (not uHdr.withdrawn_len and (size - read_size) <= 0 and not uHdr.attr_len) {
 
 	peer_info->endOfRIB = true;		// Indicates End-of-RIB Marker received
+        peer_info->eor_afi = bgp::BGP_AFI_IPV4;
         LOG_INFO("%s: rtr=%s: End-Of-RIB marker", peer_addr.c_str(), router_addr.c_str());
 
     } else {
@@ -439,6 +442,10 @@ void UpdateMsg::parseAttrData(u_char attr_type, uint16_t attr_len, u_char *data,
 
         case ATTR_TYPE_MP_REACH_NLRI :  // RFC4760
         {
+            // Skip BGP-LS NLRI's when not needed - AFI is the first two octets
+            if (not parse_ls and attr_len >= 2 and ((data[0] << 8) | data[1]) == bgp::BGP_AFI_BGPLS)
+                break;
+
             MPReachAttr mp(logger, peer_addr, peer_info, debug);
             mp.parseReachNlriAttr(attr_len, data, parsed_data);
             break;
@@ -446,6 +453,10 @@ void UpdateMsg::parseAttrData(u_char attr_type, uint16_t attr_len, u_char *data,
 
         case ATTR_TYPE_MP_UNREACH_NLRI : // RFC4760
         {
+            // Skip BGP-LS NLRI's when not needed - AFI is the first two octets
+            if (not parse_ls and attr_len >= 2 and ((data[0] << 8) | data[1]) == bgp::BGP_AFI_BGPLS)
+                break;
+
             MPUnReachAttr mp(logger, peer_addr, peer_info, debug);
             mp.parseUnReachNlriAttr(attr_len, data, parsed_data);
             break;
@@ -458,6 +469,9 @@ void UpdateMsg::parseAttrData(u_char attr_type, uint16_t attr_len, u_char *data,
 
         case ATTR_TYPE_BGP_LS:
         {
+            if (not parse_ls)
+                break;
+
             MPLinkStateAttr ls(logger, peer_addr, &parsed_data, debug);
             ls.parseAttrLinkState(attr_len, data);
             break;
@@ -158,9 +158,10 @@ public:
      * \param [in]     routerAddr  The router IP address - used for logging
      * \param [in,out] peer_info   Persistent peer information
      * \param [in]     enable_debug Debug true to enable, false to disable
+     * \param [in]     enable_ls    True to parse BGP-LS, false to skip BGP-LS NLRI's and attributes
      */
      UpdateMsg(Logger *logPtr, std::string peerAddr, std::string routerAddr, BMPReader::peer_info *peer_info,
-                bool enable_debug=false);
+                bool enable_debug=false, bool enable_ls=true);
      virtual ~UpdateMsg();
 
      /**
@@ -186,6 +187,7 @@ private:
     std::string             router_addr;                     ///< Router IP address - used for logging
     bool                    four_octet_asn;                  ///< Indicates true if 4 octets or false if 2
     BMPReader::peer_info    *peer_info;                      ///< Persistent Peer info pointer
+    bool                    parse_ls;                        ///< Indicates if BGP-LS should be parsed
 
 
     /**
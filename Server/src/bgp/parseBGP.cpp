@@ -18,6 +18,7 @@
 #include <string>
 #include <list>
 #include <memory>
+#include <functional>
 #include <arpa/inet.h>
 #include <bgp/linkstate/MPLinkStateAttr.h>
 
@@ -48,8 +49,10 @@ using namespace std;
  * \param [in,out] peer_info   Persistent peer information
  */
 parseBGP::parseBGP(Logger *logPtr, MsgBusInterface *mbus_ptr, MsgBusInterface::obj_bgp_peer *peer_entry, string routerAddr,
-                   BMPReader::peer_info *peer_info) {
+                   BMPReader::peer_info *peer_info, bool use_adj_rib_in) {
     debug = false;
+    this->use_adj_rib_in = use_adj_rib_in;
+    path_attr_id = 0;
 
     logger = logPtr;
 
@@ -72,6 +75,8 @@ parseBGP::parseBGP(Logger *logPtr, MsgBusInterface *mbus_ptr, MsgBusInterface::o
  * Desctructor
  */
 parseBGP::~parseBGP() {
+    // Peer RIB holds its own references
+    AttrTable::instance().release(path_attr_id);
 }
 
 /**
@@ -94,7 +99,8 @@ bool parseBGP::handleUpdate(u_char *data, size_t size) {
         /*
          * Parse the update message - stored results will be in parsed_data
          */
-        bgp_msg::UpdateMsg uMsg(logger, p_entry->peer_addr, router_addr, p_info, debug);
+        bgp_msg::UpdateMsg uMsg(logger, p_entry->peer_addr, router_addr, p_info, debug,
+                                mbus_ptr->outputs.linkState());
 
         if ((read_size=uMsg.parseUpdateMsg(data, data_bytes_remaining, parsed_data)) != (size - BGP_MSG_HDR_LEN)) {
             LOG_NOTICE("%s: rtr=%s: Failed to parse the update message, read %d expected %d", p_entry->peer_addr,
@@ -104,10 +110,29 @@ bool parseBGP::handleUpdate(u_char *data, size_t size) {
 
         data_bytes_remaining -= read_size;
 
+        // UpdateDB() consumes the prefix lists
+        size_t announced = parsed_data.advertised.size() + parsed_data.vpn.size() + parsed_data.evpn.size();
+        size_t withdrawn = parsed_data.withdrawn.size() + parsed_data.vpn_withdrawn.size() +
+                           parsed_data.evpn_withdrawn.size();
+
         /*
          * Update the DB with the update data
          */
         UpdateDB(parsed_data);
+
+        if (mbus_ptr->metrics != NULL) {
+            mbus_ptr->metrics->updates.fetch_add(1, std::memory_order_relaxed);
+            mbus_ptr->metrics->announced.fetch_add(announced, std::memory_order_relaxed);
+            mbus_ptr->metrics->withdrawn.fetch_add(withdrawn, std::memory_order_relaxed);
+        }
+
+        if (p_info->counters.enabled()) {
+            p_info->counters.update(size);
+            p_info->counters.nlri(announced, withdrawn);
+
+            if (announced > 0)
+                p_info->counters.attrSet(path_hash_id);
+        }
     }
 
     return false;
@@ -347,32 +372,54 @@ u_char parseBGP::parseBgpHeader(u_char *data, size_t size) {
  * \param  parsed_data          Reference to the parsed update data
  */
 void parseBGP::UpdateDB(bgp_msg::UpdateMsg::parsed_update_data &parsed_data) {
+    MsgBusInterface::obj_outputs &outputs = mbus_ptr->outputs;
+
+    // Read the outputs once, a config reload can change them while the message is handled
+    bool path_attrs     = outputs.pathAttrs();
+    bool link_state     = outputs.linkState();
+    bool unicast_prefix = outputs.unicast_prefix;
+    bool l3vpn          = outputs.l3vpn;
+    bool evpn           = outputs.evpn;
+
     /*
-     * Update the path attributes
+     * Update the path attributes, the peer RIB references them even if no output needs them
      */
-    UpdateDBAttrs(parsed_data.attrs);
+    if (path_attrs or use_adj_rib_in)
+        UpdateDBAttrs(parsed_data.attrs);
 
     /*
      * Update the bgp-ls data
      */
-    UpdateDbBgpLs(false, parsed_data.ls, parsed_data.ls_attrs);
-    UpdateDbBgpLs(true, parsed_data.ls_withdrawn, parsed_data.ls_attrs);
+    if (link_state) {
+        UpdateDbBgpLs(false, parsed_data.ls, parsed_data.ls_attrs);
+        UpdateDbBgpLs(true, parsed_data.ls_withdrawn, parsed_data.ls_attrs);
+    }
 
     /*
-     * Update the advertised prefixes (both ipv4 and ipv6)
+     * Update the advertised prefixes (both ipv4 and ipv6), the peer RIB is kept without the output
      */
-    UpdateDBAdvPrefixes(parsed_data.advertised, parsed_data.attrs);
+    if (unicast_prefix or use_adj_rib_in)
+        UpdateDBAdvPrefixes(parsed_data.advertised, parsed_data.attrs, unicast_prefix);
+    else
+        mbus_ptr->ribSeq += parsed_data.advertised.size();      // RIB sequence is used for the baseline rate
 
-    UpdateDBL3Vpn(false,parsed_data.vpn, parsed_data.attrs);
-    UpdateDBL3Vpn(true,parsed_data.vpn_withdrawn, parsed_data.attrs);
+    if (l3vpn) {
+        UpdateDBL3Vpn(false,parsed_data.vpn, parsed_data.attrs);
+        UpdateDBL3Vpn(true,parsed_data.vpn_withdrawn, parsed_data.attrs);
+    }
 
-    UpdateDBeVPN(false, parsed_data.evpn, parsed_data.attrs);
-    UpdateDBeVPN(true, parsed_data.evpn_withdrawn, parsed_data.attrs);
+    if (evpn) {
+        UpdateDBeVPN(false, parsed_data.evpn, parsed_data.attrs);
+        UpdateDBeVPN(true, parsed_data.evpn_withdrawn, parsed_data.attrs);
+    }
 
     /*
      * Update withdraws (both ipv4 and ipv6)
      */
-    UpdateDBWdrawnPrefixes(parsed_data.withdrawn);
+    if (unicast_prefix or use_adj_rib_in)
+        UpdateDBWdrawnPrefixes(parsed_data.withdrawn, unicast_prefix);
+    else
+        mbus_ptr->ribSeq += parsed_data.withdrawn.size();
 
 }
 
@@ -444,6 +491,8 @@ void parseBGP::UpdateDBAttrs(bgp_msg::UpdateMsg::parsed_attrs_map &attrs) {
         SELF_DEBUG("%s: no next-hop, must be unreach; not sending attributes to message bus", p_entry->peer_addr);
         bzero(base_attr.next_hop, sizeof(base_attr.next_hop));
         bzero(path_hash_id, sizeof(path_hash_id));
+        AttrTable::instance().release(path_attr_id);
+        path_attr_id = 0;
         return;
     }
 
@@ -454,6 +503,12 @@ void parseBGP::UpdateDBAttrs(bgp_msg::UpdateMsg::parsed_attrs_map &attrs) {
 
     // Update the class instance variable path_hash_id
     memcpy(path_hash_id, base_attr.hash_id, sizeof(path_hash_id));
+
+    // Intern the attributes so the peer RIB can reference them by ID
+    if (use_adj_rib_in) {
+        AttrTable::instance().release(path_attr_id);
+        path_attr_id = AttrTable::instance().intern(base_attr);
+    }
 }
 
 /**
@@ -626,13 +681,22 @@ void parseBGP::UpdateDBeVPN(bool remove, std::list<bgp::evpn_tuple> &nlris,
  *
  * \param  adv_prefixes         Reference to the list<prefix_tuple> of advertised prefixes
  * \param  attrs            Reference to the parsed attributes map
+ * \param  send             Send the prefixes, false to only update the peer RIB
  */
 void parseBGP::UpdateDBAdvPrefixes(std::list<bgp::prefix_tuple> &adv_prefixes,
-                                   bgp_msg::UpdateMsg::parsed_attrs_map &attrs) {
+                                   bgp_msg::UpdateMsg::parsed_attrs_map &attrs, bool send) {
     vector<MsgBusInterface::obj_rib> rib_list;
     MsgBusInterface::obj_rib         rib_entry;
     uint32_t                         value_32bit;
     uint64_t                         value_64bit;
+    size_t                           unchanged = 0;
+    size_t                           not_sent = 0;
+    u_char                           attr_key[16];
+
+    // The digest hashes every attribute, like the peer RIB compares them by interned ID
+    bzero(attr_key, sizeof(attr_key));
+    if (use_adj_rib_in and path_attr_id != 0 and p_info->digest.active())
+        AttrTable::attrKey(base_attr, attr_key);
 
     /*
      * Loop through all prefixes and add/update them in the DB
@@ -642,6 +706,37 @@ void parseBGP::UpdateDBAdvPrefixes(std::list<bgp::prefix_tuple> &adv_prefixes,
                                                 it++) {
         bgp::prefix_tuple &tuple = (*it);
 
+        // Skip the prefix if it's unchanged in the peer RIB
+        if (use_adj_rib_in) {
+            // Labels are per prefix, not part of the path attributes
+            uint32_t label_hash = tuple.labels.size() > 0 ? std::hash<std::string>()(tuple.labels) : 0;
+            bool replaced;
+
+            if (not p_info->adj_rib_in.update(adjRibType(), tuple.isIPv4, tuple.prefix_bin, tuple.len,
+                                              tuple.path_id, path_attr_id, label_hash, &replaced)) {
+                unchanged++;
+                continue;
+            }
+
+            // Attribute change of a known prefix counts as a flap
+            if (replaced and p_info->flaps.enabled())
+                p_info->flaps.flap(adjRibType(), tuple.isIPv4, tuple.prefix_bin, tuple.len, tuple.path_id, false);
+
+            // New since the reconnect but unchanged from the saved digest
+            if (not replaced and p_info->digest.active() and
+                    p_info->digest.match(adjRibType(), tuple.isIPv4, tuple.prefix_bin, tuple.len, tuple.path_id,
+                                         PeerDigest::hash(attr_key, label_hash))) {
+                unchanged++;
+                continue;
+            }
+        }
+
+        // Only the peer RIB is updated when the unicast_prefix output is disabled
+        if (not send) {
+            not_sent++;
+            continue;
+        }
+
         memcpy(rib_entry.path_attr_hash_id, path_hash_id, sizeof(rib_entry.path_attr_hash_id));
         memcpy(rib_entry.peer_hash_id, p_entry->hash_id, sizeof(rib_entry.peer_hash_id));
 
@@ -710,6 +805,13 @@ void parseBGP::UpdateDBAdvPrefixes(std::list<bgp::prefix_tuple> &adv_prefixes,
     if (rib_list.size() > 0)
         mbus_ptr->update_unicastPrefix(*p_entry, rib_list, &base_attr, mbus_ptr->UNICAST_PREFIX_ACTION_ADD);
 
+    if (unchanged > 0) {
+        SELF_DEBUG("%s: Skipped %zu unchanged prefixes", p_entry->peer_addr, unchanged);
+        mbus_ptr->ribSeq += unchanged;          // RIB sequence is used for the baseline rate
+    }
+
+    mbus_ptr->ribSeq += not_sent;
+
     rib_list.clear();
     adv_prefixes.clear();
 }
@@ -720,10 +822,13 @@ void parseBGP::UpdateDBAdvPrefixes(std::list<bgp::prefix_tuple> &adv_prefixes,
  * \details This method will update the database for the supplied advertised prefixes
  *
  * \param  wdrawn_prefixes         Reference to the list<prefix_tuple> of withdrawn prefixes
+ * \param  send             Send the withdraws, false to only update the peer RIB
  */
-void parseBGP::UpdateDBWdrawnPrefixes(std::list<bgp::prefix_tuple> &wdrawn_prefixes) {
+void parseBGP::UpdateDBWdrawnPrefixes(std::list<bgp::prefix_tuple> &wdrawn_prefixes, bool send) {
     vector<MsgBusInterface::obj_rib> rib_list;
     MsgBusInterface::obj_rib         rib_entry;
+    size_t                           unknown = 0;
+    size_t                           not_sent = 0;
 
     /*
      * Loop through all prefixes and add/update them in the DB
@@ -733,6 +838,25 @@ void parseBGP::UpdateDBWdrawnPrefixes(std::list<bgp::prefix_tuple> &wdrawn_prefi
                                                 it++) {
 
         bgp::prefix_tuple &tuple = (*it);
+
+        // Skip the withdraw if the prefix is not in the peer RIB, or in the saved digest after a reconnect
+        if (use_adj_rib_in and not p_info->adj_rib_in.withdraw(adjRibType(), tuple.isIPv4, tuple.prefix_bin,
+                                                               tuple.len, tuple.path_id) and
+                not (p_info->digest.active() and p_info->digest.seen(adjRibType(), tuple.isIPv4, tuple.prefix_bin,
+                                                                      tuple.len, tuple.path_id))) {
+            unknown++;
+            continue;
+        }
+
+        if (use_adj_rib_in and p_info->flaps.enabled())
+            p_info->flaps.flap(adjRibType(), tuple.isIPv4, tuple.prefix_bin, tuple.len, tuple.path_id, true);
+
+        // Only the peer RIB is updated when the unicast_prefix output is disabled
+        if (not send) {
+            not_sent++;
+            continue;
+        }
+
         memcpy(rib_entry.path_attr_hash_id, path_hash_id, sizeof(rib_entry.path_attr_hash_id));
         memcpy(rib_entry.peer_hash_id, p_entry->hash_id, sizeof(rib_entry.peer_hash_id));
         strncpy(rib_entry.prefix, tuple.prefix.c_str(), sizeof(rib_entry.prefix));
@@ -756,6 +880,13 @@ void parseBGP::UpdateDBWdrawnPrefixes(std::list<bgp::prefix_tuple> &wdrawn_prefi
     if (rib_list.size() > 0)
         mbus_ptr->update_unicastPrefix(*p_entry, rib_list, NULL, mbus_ptr->UNICAST_PREFIX_ACTION_DEL);
 
+    if (unknown > 0) {
+        SELF_DEBUG("%s: Skipped %zu withdrawn prefixes not in the peer RIB", p_entry->peer_addr, unknown);
+        mbus_ptr->ribSeq += unknown;            // RIB sequence is used for the baseline rate
+    }
+
+    mbus_ptr->ribSeq += not_sent;
+
     rib_list.clear();
     wdrawn_prefixes.clear();
 }
@@ -17,6 +17,7 @@
 #include "Logger.h"
 #include "bgp_common.h"
 #include "UpdateMsg.h"
+#include "AttrTable.h"
 
 
 using namespace std;
@@ -78,9 +79,10 @@ public:
      * \param [in,out] peer_entry  Pointer to peer entry
      * \param [in]     routerAddr  The router IP address - used for logging
      * \param [in,out] peer_info   Persistent peer information
+     * \param [in]     use_adj_rib_in  True to only send unicast prefixes that changed in the peer RIB
      */
     parseBGP(Logger *logPtr, MsgBusInterface *mbus_ptr, MsgBusInterface::obj_bgp_peer *peer_entry, string routerAddr,
-             BMPReader::peer_info *peer_info);
+             BMPReader::peer_info *peer_info, bool use_adj_rib_in=false);
 
     virtual ~parseBGP();
 
@@ -156,6 +158,8 @@ private:
     BMPReader::peer_info             *p_info;        ///< Persistent Peer information
 
     unsigned char path_hash_id[16];                  ///< current path hash ID
+    bool            use_adj_rib_in;                  ///< Indicates only changed prefixes are sent (p_info->adj_rib_in)
+    uint32_t        path_attr_id;                    ///< current interned path attributes ID (AttrTable), zero if none
 
     bool            debug;                           ///< debug flag to indicate debugging
     Logger          *logger;                         ///< Logging class pointer
@@ -200,8 +204,10 @@ private:
      *
      * \param  adv_prefixes         Reference to the list<prefix_tuple> of advertised prefixes
      * \param  attrs            Reference to the parsed attributes map
+     * \param  send             Send the prefixes, false to only update the peer RIB
      */
-    void UpdateDBAdvPrefixes(std::list<bgp::prefix_tuple> &adv_prefixes, bgp_msg::UpdateMsg::parsed_attrs_map &attrs);
+    void UpdateDBAdvPrefixes(std::list<bgp::prefix_tuple> &adv_prefixes, bgp_msg::UpdateMsg::parsed_attrs_map &attrs,
+                             bool send);
 
     /**
      * Update the Database withdrawn prefixes
@@ -209,8 +215,21 @@ private:
      * \details This method will update the database for the supplied advertised prefixes
      *
      * \param  wdrawn_prefixes         Reference to the list<prefix_tuple> of withdrawn prefixes
+     * \param  send             Send the withdraws, false to only update the peer RIB
      */
-    void UpdateDBWdrawnPrefixes(std::list<bgp::prefix_tuple> &wdrawn_prefixes);
+    void UpdateDBWdrawnPrefixes(std::list<bgp::prefix_tuple> &wdrawn_prefixes, bool send);
+
+    /**
+     * Get the peer RIB type (pre-policy, post-policy, loc-rib) of the peer entry
+     *
+     * \return AdjRibIn::RIB_TYPES value
+     */
+    inline int adjRibType() {
+        if (p_entry->isLocRib)
+            return AdjRibIn::RIB_LOC;
+
+        return p_entry->isPrePolicy ? AdjRibIn::RIB_PRE_POLICY : AdjRibIn::RIB_POST_POLICY;
+    }
 
     /**
      * Update the Database advertised l3vpn 
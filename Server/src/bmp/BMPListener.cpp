@@ -32,11 +32,13 @@ using namespace std;
  *
  *  \param [in] logPtr  Pointer to existing Logger for app logging
  *  \param [in] config  Pointer to the loaded configuration
+ *  \param [in] v4_sock IPv4 listening socket taken over from another process, zero to open it
+ *  \param [in] v6_sock IPv6 listening socket taken over from another process, zero to open it
  *
  */
-BMPListener::BMPListener(Logger *logPtr, Config *config) {
-    sock = 0;
-    sockv6 = 0;
+BMPListener::BMPListener(Logger *logPtr, Config *config, int v4_sock, int v6_sock) {
+    sock = v4_sock;
+    sockv6 = v6_sock;
     debug = false;
 
     // Update pointer to the config
@@ -66,8 +68,8 @@ BMPListener::BMPListener(Logger *logPtr, Config *config) {
         svr_addrv6.sin6_addr = in6addr_any;
     }
 
-    // Open listening sockets
-    open_socket(cfg->svr_ipv4, cfg->svr_ipv6);
+    // Open the listening sockets that were not taken over
+    open_socket(cfg->svr_ipv4 and sock <= 0, cfg->svr_ipv6 and sockv6 <= 0);
 }
 
 /**
@@ -227,6 +229,9 @@ void BMPListener::accept_connection(ClientInfo &c, bool isIPv4) {
     socklen_t c_addr_len = sizeof(c.c_addr);         // the client info length
     socklen_t s_addr_len = sizeof(c.s_addr);         // the client info length
     c.initRec=false;				     // To indicate INIT message not received
+    c.initDumpDone = false;
+    c.bufFill = 0;
+    c.queueFill = 0;
     int sock = isIPv4 ? this->sock : this->sockv6;
 
     sockaddr_in *v4_addr = (sockaddr_in *) &c.c_addr;
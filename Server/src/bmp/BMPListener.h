@@ -14,12 +14,15 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <ctime>
+#include <atomic>
 
 #include "Logger.h"
 #include "Config.h"
 
 using namespace std;
 
+class LatencyArrivals;
+
 /**
  * \class   BMPListener
  *
@@ -49,6 +52,11 @@ public:
         char        s_port[6];              ///< Server/collector port
         char        s_ip[46];               ///< Server/collector IP - printed form
 	struct timeval startTime;	    ///< Stores the time the client gets connected to the collector
+
+        std::atomic<bool> initDumpDone;     ///< True once the initial RIB dump is done, used for startup admission
+        std::atomic<int>  bufFill;          ///< Percent of the client buffer used
+        std::atomic<int>  queueFill;        ///< Percent of the message bus queue used
+        LatencyArrivals   *arrivals;        ///< Socket read times for latency tracing, NULL if disabled
     };
 
     /**
@@ -56,9 +64,11 @@ public:
      *
      *  \param [in] logPtr  Pointer to existing Logger for app logging
      *  \param [in] config  Pointer to the loaded configuration
+     *  \param [in] v4_sock IPv4 listening socket taken over from another process, zero to open it
+     *  \param [in] v6_sock IPv6 listening socket taken over from another process, zero to open it
      *
      */
-    BMPListener(Logger *logPtr, Config *config);
+    BMPListener(Logger *logPtr, Config *config, int v4_sock = 0, int v6_sock = 0);
 
     virtual ~BMPListener();
 
@@ -85,6 +95,17 @@ public:
      */
     void hashRouter(ClientInfo &client);
 
+    /**
+     * Get the listening socket, used to hand it over to a new process
+     *
+     * \param [in] isIPv4   True for the IPv4 socket, false for IPv6
+     *
+     * \return socket, zero if not open
+     */
+    inline int getSocket(bool isIPv4) {
+        return isIPv4 ? sock : sockv6;
+    }
+
     // Debug methods
     void enableDebug();
     void disableDebug();
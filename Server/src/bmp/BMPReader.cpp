@@ -18,17 +18,60 @@
 #include <cstdlib>
 #include <string>
 #include <cerrno>
+#include <poll.h>
+#include <ctime>
+#include <functional>
+#include <set>
+#include <thread>
 
 #include "BMPListener.h"
 #include "BMPReader.h"
 #include "parseBMP.h"
 #include "parseBGP.h"
 #include "MsgBusInterface.hpp"
+#include "AttrTable.h"
+#include "LatencyTrace.h"
 #include "Logger.h"
 #include "md5.h"
 
 using namespace std;
 
+std::mutex              BMPReader::readers_mutex;
+std::list<BMPReader *>  BMPReader::readers;
+
+WorkerPool             *BMPReader::parse_pool           = NULL;
+int                     BMPReader::parse_pool_refs      = 0;
+std::mutex              BMPReader::parse_pool_mutex;
+
+/**
+ * Message of a known peer given to the parse pool
+ */
+struct BMPReader::parse_task : public WorkerPool::Task {
+    BMPReader                       *reader;
+    MsgBusInterface                 *mbus_ptr;
+    MsgBusInterface::obj_bgp_peer   peer;
+    peer_info                       *info;      ///< Only used by the worker of the peer until it is done
+    std::string                     router_ip;
+    char                            bmp_type;
+    std::string                     data;       ///< BGP message of a route monitoring message
+    uint64_t                        trace;      ///< Latency trace of a route monitoring message, zero if not traced
+    MsgBusInterface::obj_stats_report stats;    ///< Stats of a stats report message
+
+    ~parse_task() {
+        reader->parse_pending--;
+    }
+
+    void run() {
+        reader->updatePeerInfo(*info, peer);
+
+        if (bmp_type == parseBMP::TYPE_ROUTE_MON) {
+            LatencyTrace::Scope scope(trace);
+            reader->parseRouteMon(mbus_ptr, peer, *info, router_ip, (u_char *)&data[0], data.size());
+        } else
+            mbus_ptr->add_StatReport(peer, stats);
+    }
+};
+
 /**
  * Class constructor
  *
@@ -48,13 +91,57 @@ BMPReader::BMPReader(Logger *logPtr, Config *config) {
     
     hasPrevRIBdumpTime = false;
     maxRIBdumpRate = 0;
+
+    reader_client = NULL;
+    reader_mbus = NULL;
+
+    last_flap_tick = 0;
+    last_flap_report = time(NULL);
+    last_peer_stats = last_flap_report;
+    last_queue_fill = 0;
+    last_digest_tick = 0;
+    last_digest_save = last_flap_report;
+
+    parse_pending = 0;
+    pause_state = PAUSE_NONE;
+    init_dump_ts = 0;
+    trace_count = 0;
+
+    bzero(router_hash_id, sizeof(router_hash_id));
+    bzero(&init_router, sizeof(init_router));
+    has_init_router = false;
+
+    if (cfg->parse_threads > 0) {
+        std::lock_guard<std::mutex> lock(parse_pool_mutex);
+
+        if (parse_pool == NULL)
+            parse_pool = new WorkerPool(logger, "parse", cfg->parse_threads, cfg->pipeline_queue_size,
+                                        cfg->parse_cpus);
+
+        parse_pool_refs++;
+    }
+
+    std::lock_guard<std::mutex> lock(readers_mutex);
+    readers.push_back(this);
 }
 
 /**
  * Destructor
  */
 BMPReader::~BMPReader() {
+    {
+        std::lock_guard<std::mutex> lock(readers_mutex);
+        readers.remove(this);
+    }
 
+    if (cfg->parse_threads > 0) {
+        std::lock_guard<std::mutex> lock(parse_pool_mutex);
+
+        if (--parse_pool_refs <= 0 and parse_pool != NULL) {
+            delete parse_pool;
+            parse_pool = NULL;
+        }
+    }
 }
 
 
@@ -70,10 +157,69 @@ BMPReader::~BMPReader() {
  * \throw (char const *str) message indicate error
  */
 void BMPReader::readerThreadLoop(bool &run, BMPListener::ClientInfo *client, MsgBusInterface *mbus_ptr) {
+    pollfd pfd;
+
+    {
+        std::lock_guard<std::mutex> lock(rib_mutex);
+        reader_client = client;
+        reader_mbus = mbus_ptr;
+    }
+
+    bool paused = false;
+
     while (run) {
 
         try {
-            if (not ReadIncomingMsg(client, mbus_ptr))
+            // Stop at the message boundary so the session can be handed over to a new process
+            if (pause_state.load() == PAUSE_REQUESTED) {
+                int expected = PAUSE_REQUESTED;
+                bool digest = false;
+
+                for (peer_info_map_iter it = peer_info_map.begin(); it != peer_info_map.end() and not digest; it++)
+                    digest = it->second.digest.active();
+
+                // A digest can't be handed over, the session stays here
+                if (digest) {
+                    if (pause_state.compare_exchange_strong(expected, PAUSE_DECLINED))
+                        LOG_INFO("%s: peer RIB digest is active, declining the takeover", client->c_ip);
+
+                } else if (pause_state.compare_exchange_strong(expected, PAUSE_DONE)) {
+                    paused = true;
+                    break;
+                }
+            }
+
+            flapTick(mbus_ptr);
+            peerStatsTick(mbus_ptr);
+
+            digestTick(mbus_ptr, client);
+
+            if (time(NULL) != last_queue_fill) {
+                last_queue_fill = time(NULL);
+                client->queueFill.store(mbus_ptr->getQueueFill(), std::memory_order_relaxed);
+            }
+
+            // Wait for data before taking the RIB lock so an idle router doesn't hold up a RIB snapshot
+            pfd.fd = client->pipe_sock > 0 ? client->pipe_sock : client->c_sock;
+            pfd.events = POLLIN | POLLHUP | POLLERR;
+            pfd.revents = 0;
+
+            if (poll(&pfd, 1, 100) == 0)
+                continue;
+
+            std::lock_guard<std::mutex> lock(rib_mutex);
+
+            bool more = ReadIncomingMsg(client, mbus_ptr);
+
+            // Keep reading while messages are ready so the parse threads stay busy, they are done before the unlock
+            if (parse_pool != NULL) {
+                for (int i = 1; more and i < PARSE_BATCH_MSGS and poll(&pfd, 1, 0) > 0; i++)
+                    more = ReadIncomingMsg(client, mbus_ptr);
+
+                drainParse(client, mbus_ptr);
+            }
+
+            if (not more)
                 break;
 
         } catch (char const *str) {
@@ -81,6 +227,14 @@ void BMPReader::readerThreadLoop(bool &run, BMPListener::ClientInfo *client, Msg
             break;
         }
     }
+
+    waitParse();
+
+    // Save the digests so the peer RIBs are not sent again when the router reconnects
+    if (not paused and cfg->warm_restart_dir.size() > 0 and cfg->adj_rib_in) {
+        std::lock_guard<std::mutex> lock(rib_mutex);
+        saveDigests(client);
+    }
 }
 
 /**
@@ -115,6 +269,7 @@ bool BMPReader::ReadIncomingMsg(BMPListener::ClientInfo *client, MsgBusInterface
     }
 
     char bmp_type = 0;
+    parse_task *task = NULL;                        // Message for the parse pool
 
     MsgBusInterface::obj_router r_object;
     memcpy(router_hash_id, client->hash_id, sizeof(router_hash_id));    // Cache the router hash ID (hash is generated by BMPListener)
@@ -125,13 +280,49 @@ bool BMPReader::ReadIncomingMsg(BMPListener::ClientInfo *client, MsgBusInterface
     memcpy(r_object.ip_addr, client->c_ip, sizeof(client->c_ip));
 
     try {
+        // Trace the latency of one in sample_rate route monitoring messages, from the socket read of the first byte
+        uint64_t trace = 0;
+        bool sample = false;
+
+        if (client->arrivals != NULL) {
+            if (trace_count < LatencyTrace::sample_rate)
+                trace_count++;
+
+            if ((sample = trace_count >= LatencyTrace::sample_rate))
+                trace = client->arrivals->arrival(read_fd);
+        }
+
         bmp_type = pBMP->handleMessage(read_fd);
 
+        if (sample and bmp_type == parseBMP::TYPE_ROUTE_MON) {
+            trace_count = 0;
+
+            if (trace != 0)
+                LatencyTrace::record(LatencyTrace::STAGE_FRAMED, trace);
+        } else
+            trace = 0;                              // Not route monitoring, the next message is sampled instead
+
+        if (mbus_ptr->metrics != NULL and bmp_type >= 0 and bmp_type < METRICS_BMP_TYPES)
+            mbus_ptr->metrics->bmp_msgs[(int)bmp_type].fetch_add(1, std::memory_order_relaxed);
+
         /*
          * Now that we have parsed the BMP message...
          *  add record to the database
          */
 
+        if (bmp_type < 4) {
+            peer_info_key =  p_entry.peer_addr;
+            peer_info_key += p_entry.peer_rd;
+        }
+
+        // Route monitoring and stats of known peers go to the parse pool, anything else waits for it
+        bool parallel = parse_pool != NULL and
+                        (bmp_type == parseBMP::TYPE_ROUTE_MON or bmp_type == parseBMP::TYPE_STATS_REPORT) and
+                        peer_info_map.find(peer_info_key) != peer_info_map.end();
+
+        if (not parallel)
+            waitParse();
+
         if (bmp_type != parseBMP::TYPE_INIT_MSG)
             mbus_ptr->update_Router(r_object, mbus_ptr->ROUTER_ACTION_FIRST);              // add the router entry
 
@@ -139,15 +330,26 @@ bool BMPReader::ReadIncomingMsg(BMPListener::ClientInfo *client, MsgBusInterface
         if (bmp_type < 4) {
             // Update p_entry hash_id now that add_Router updated it.
             memcpy(p_entry.router_hash_id, r_object.hash_id, sizeof(r_object.hash_id));
-            peer_info_key =  p_entry.peer_addr;
-            peer_info_key += p_entry.peer_rd;
 
             if (bmp_type != parseBMP::TYPE_PEER_UP)
                 mbus_ptr->update_Peer(p_entry, NULL, NULL, mbus_ptr->PEER_ACTION_FIRST);     // add the peer entry
 
-            if (not peer_info_map[peer_info_key].using_2_octet_asn and p_entry.isTwoOctet) {
-                peer_info_map[peer_info_key].using_2_octet_asn = true;
-            }
+            // The parse thread of the peer updates the info
+            if (not parallel)
+                updatePeerInfo(peer_info_map[peer_info_key], p_entry);
+        }
+
+        // Prepare the parse task
+        if (parallel) {
+            task = new parse_task;
+            task->reader = this;
+            task->mbus_ptr = mbus_ptr;
+            task->peer = p_entry;
+            task->info = &peer_info_map[peer_info_key];
+            task->router_ip = (char *)r_object.ip_addr;
+            task->bmp_type = bmp_type;
+            task->trace = trace;
+            parse_pending++;
         }
 
         /*
@@ -203,6 +405,18 @@ bool BMPReader::ReadIncomingMsg(BMPListener::ClientInfo *client, MsgBusInterface
 
                     delete pBGP;            // Free the bgp parser after each use.
 
+                    // Withdraw the peer RIB so consumers don't have to mass delete the peer routes
+                    if (cfg->adj_rib_in and cfg->peer_down_withdraw)
+                        withdrawPeerRib(mbus_ptr, p_entry, peer_info_map[peer_info_key]);
+
+                    // Peer RIB is no longer valid, the peer will send the full RIB when it comes back up
+                    peer_info_map[peer_info_key].adj_rib_in.clear();
+
+                    if (cfg->warm_restart_dir.size() > 0) {
+                        peer_info_map[peer_info_key].digest.close();
+                        PeerDigest::remove(cfg->warm_restart_dir, p_entry.hash_id);
+                    }
+
                     // Add event to the database
                     mbus_ptr->update_Peer(p_entry, NULL, &down_event, mbus_ptr->PEER_ACTION_DOWN);
 
@@ -243,9 +457,18 @@ bool BMPReader::ReadIncomingMsg(BMPListener::ClientInfo *client, MsgBusInterface
                         pBMP->parsePeerUpInfo(pBMP->bmp_data + read, (int)pBMP->bmp_data_len - read);
                     }
 
+                    // Peer will send the full RIB after the up
+                    peer_info_map[peer_info_key].adj_rib_in.clear();
+
                     // Add the up event to the DB
                     mbus_ptr->update_Peer(p_entry, &up_event, NULL, mbus_ptr->PEER_ACTION_UP);
 
+                    // The peer hash is known now, the saved digest suppresses unchanged prefixes of the RIB dump
+                    memcpy(peer_info_map[peer_info_key].peer_hash_id, p_entry.hash_id, sizeof(p_entry.hash_id));
+
+                    if (cfg->warm_restart_dir.size() > 0 and cfg->adj_rib_in)
+                        peer_info_map[peer_info_key].digest.open(logger, cfg->warm_restart_dir, p_entry.hash_id);
+
                 } else {
                     LOG_NOTICE("%s: PEER UP Received but failed to parse the BMP header.", client->c_ip);
                 }
@@ -255,42 +478,41 @@ bool BMPReader::ReadIncomingMsg(BMPListener::ClientInfo *client, MsgBusInterface
             case parseBMP::TYPE_ROUTE_MON : { // Route monitoring type
                 pBMP->bufferBMPMessage(read_fd);
 
+                if (parallel) {
+                    task->data.assign((char *)pBMP->bmp_data, pBMP->bmp_data_len);
+                    parse_pool->submit(std::hash<std::string>()(peer_info_key), task);
+                    task = NULL;
+
+                    // Checked once the parse pool is done
+                    init_dump_ts = p_entry.timestamp_secs;
+                    break;
+                }
+
                 /*
                  * Read and parse the the BGP message from the client.
                  *     parseBGP will update mysql directly
                  */
-                pBGP = new parseBGP(logger, mbus_ptr, &p_entry, (char *)r_object.ip_addr,
-                                    &peer_info_map[peer_info_key]);
-
-                if (cfg->debug_bgp)
-                    pBGP->enableDebug();
-
-                pBGP->handleUpdate(pBMP->bmp_data, pBMP->bmp_data_len);
-   		
-		string str(reinterpret_cast<char*>(client->hash_id), 16);  //storing the client hash in a string 
-		if(client->initRec && cfg->router_baseline_time.find(str) == cfg->router_baseline_time.end())	
-                //check if client has received init message and Baseline time is not already calculated
-		{
-		    peer_info_map_iter it = peer_info_map.begin();
-		    while (it != peer_info_map.end() && it->second.endOfRIB)
-		        ++it;
-
-		    if (it == peer_info_map.end() || checkRIBdumpRate(p_entry.timestamp_secs,mbus_ptr->ribSeq)) {  //End-Of-RIBs are received for all peers.
-		        timeval now;
-		        gettimeofday(&now, NULL);
-		        cfg->router_baseline_time[str] = 1.2 * (now.tv_sec - client->startTime.tv_sec);  //20% buffer for baseline time 
-		    }		
-		}
-                delete pBGP;
+                LatencyTrace::Scope scope(trace);
+                parseRouteMon(mbus_ptr, p_entry, peer_info_map[peer_info_key], (char *)r_object.ip_addr,
+                              pBMP->bmp_data, pBMP->bmp_data_len);
 
+                checkInitDump(client, mbus_ptr, p_entry.timestamp_secs);
                 break;
             }
 
             case parseBMP::TYPE_STATS_REPORT : { // Stats Report
                 MsgBusInterface::obj_stats_report stats = {};
-                if (! pBMP->handleStatsReport(read_fd, stats))
-                    // Add to mysql
-                    mbus_ptr->add_StatReport(p_entry, stats);
+                if (! pBMP->handleStatsReport(read_fd, stats)) {
+                    if (parallel) {
+                        task->stats = stats;
+                        parse_pool->submit(std::hash<std::string>()(peer_info_key), task);
+                        task = NULL;
+
+                    } else {
+                        // Add to mysql
+                        mbus_ptr->add_StatReport(p_entry, stats);
+                    }
+                }
 
                 break;
             }
@@ -306,6 +528,10 @@ bool BMPReader::ReadIncomingMsg(BMPListener::ClientInfo *client, MsgBusInterface
 		// Update the router entry with the details
                 mbus_ptr->update_Router(r_object, mbus_ptr->ROUTER_ACTION_INIT);
 
+                // Kept for a takeover, the new process sends it again
+                init_router = r_object;
+                has_init_router = true;
+
 		break;
             }
 
@@ -324,7 +550,13 @@ bool BMPReader::ReadIncomingMsg(BMPListener::ClientInfo *client, MsgBusInterface
             }
 
         }
+
+        delete task;                                // Not given to the parse pool
+
     } catch (char const *str) {
+        delete task;
+        waitParse();
+
         // Mark the router as disconnected and update the error to be a local disconnect (no term message received)
         LOG_INFO("%s: Caught: %s", client->c_ip, str);
         disconnect(client, mbus_ptr, parseBMP::TERM_REASON_OPENBMP_CONN_ERR, str);
@@ -334,7 +566,8 @@ bool BMPReader::ReadIncomingMsg(BMPListener::ClientInfo *client, MsgBusInterface
     }
     
     // Send BMP RAW packet data
-    mbus_ptr->send_bmp_raw(router_hash_id, p_entry, pBMP->bmp_packet, pBMP->bmp_packet_len);
+    if (mbus_ptr->outputs.bmp_raw)
+        mbus_ptr->send_bmp_raw(router_hash_id, p_entry, pBMP->bmp_packet, pBMP->bmp_packet_len);
 
     // Free the bmp parser
     delete pBMP;
@@ -342,6 +575,121 @@ bool BMPReader::ReadIncomingMsg(BMPListener::ClientInfo *client, MsgBusInterface
     return rval;
 }
 
+/**
+ * Update the persistent peer information from the peer entry of a message
+ *
+ * \param [in,out] info     Persistent peer information
+ * \param [in]  peer        Peer entry
+ */
+void BMPReader::updatePeerInfo(peer_info &info, MsgBusInterface::obj_bgp_peer &peer) {
+    // Keep the peer identity for RIB snapshots
+    memcpy(info.peer_hash_id, peer.hash_id, sizeof(info.peer_hash_id));
+    memcpy(info.peer_addr, peer.peer_addr, sizeof(info.peer_addr));
+    memcpy(info.peer_rd, peer.peer_rd, sizeof(info.peer_rd));
+    info.peer_as = peer.peer_as;
+    info.flaps.init(cfg);
+    info.counters.init(cfg);
+
+    if (not info.using_2_octet_asn and peer.isTwoOctet) {
+        info.using_2_octet_asn = true;
+    }
+}
+
+/**
+ * Parse the BGP UPDATE of a route monitoring message
+ *
+ * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+ * \param [in]  peer        Peer entry
+ * \param [in]  info        Persistent peer information of the peer
+ * \param [in]  router_ip   Router IP address in printed form
+ * \param [in]  data        BGP message
+ * \param [in]  len         Length of the BGP message
+ */
+void BMPReader::parseRouteMon(MsgBusInterface *mbus_ptr, MsgBusInterface::obj_bgp_peer &peer, peer_info &info,
+                              const std::string &router_ip, u_char *data, size_t len) {
+    MetricsTimer timer(mbus_ptr->metrics != NULL ? &mbus_ptr->metrics->parse_time : NULL);
+
+    parseBGP *pBGP = new parseBGP(logger, mbus_ptr, &peer, router_ip, &info, cfg->adj_rib_in);
+
+    if (cfg->debug_bgp)
+        pBGP->enableDebug();
+
+    pBGP->handleUpdate(data, len);
+
+    if (LatencyTrace::current != 0)
+        LatencyTrace::record(LatencyTrace::STAGE_PARSED, LatencyTrace::current);
+
+    // End-of-RIB for an address family, withdraw what was not received again since the reconnect
+    if (info.eor_afi != 0) {
+        int rib = peer.isLocRib ? AdjRibIn::RIB_LOC :
+                  (peer.isPrePolicy ? AdjRibIn::RIB_PRE_POLICY : AdjRibIn::RIB_POST_POLICY);
+
+        if (info.digest.active())
+            finishDigest(mbus_ptr, peer, info, rib, info.eor_afi == bgp::BGP_AFI_IPV4);
+
+        info.eor_afi = 0;
+    }
+
+    delete pBGP;
+}
+
+/**
+ * Check if the initial RIB dump of the router is done
+ *
+ * \param [in]  client      Client information pointer
+ * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+ * \param [in]  timestamp   Timestamp of the last route monitoring message
+ */
+void BMPReader::checkInitDump(BMPListener::ClientInfo *client, MsgBusInterface *mbus_ptr, uint32_t timestamp) {
+    string str(reinterpret_cast<char*>(client->hash_id), 16);  //storing the client hash in a string
+
+    //check if client has received init message and the initial RIB dump is not already done
+    if (client->initRec && not client->initDumpDone) {
+        peer_info_map_iter it = peer_info_map.begin();
+        while (it != peer_info_map.end() && it->second.endOfRIB)
+            ++it;
+
+        if (it == peer_info_map.end() || checkRIBdumpRate(timestamp, mbus_ptr->ribSeq)) {  //End-Of-RIBs are received for all peers.
+            client->initDumpDone = true;
+
+            if (cfg->router_baseline_time.find(str) == cfg->router_baseline_time.end()) {
+                timeval now;
+                gettimeofday(&now, NULL);
+                cfg->router_baseline_time[str] = 1.2 * (now.tv_sec - client->startTime.tv_sec);  //20% buffer for baseline time
+            }
+
+            LOG_INFO("%s: initial RIB dump done", client->c_ip);
+        }
+    }
+}
+
+/**
+ * Wait until the messages given to the parse pool are parsed
+ */
+void BMPReader::waitParse() {
+    for (int i = 0; parse_pending.load() > 0; i++) {
+        if (i < PARSE_WAIT_SPIN)
+            std::this_thread::yield();
+        else
+            usleep(100);
+    }
+}
+
+/**
+ * Wait for the parse pool and run the checks that were skipped while it was busy
+ *
+ * \param [in]  client      Client information pointer
+ * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+ */
+void BMPReader::drainParse(BMPListener::ClientInfo *client, MsgBusInterface *mbus_ptr) {
+    waitParse();
+
+    if (init_dump_ts != 0) {
+        checkInitDump(client, mbus_ptr, init_dump_ts);
+        init_dump_ts = 0;
+    }
+}
+
 bool BMPReader::checkRIBdumpRate(uint32_t timeStamp, int ribSeq) {
     int time, currRate;                                  
 
@@ -398,6 +746,593 @@ void BMPReader::disconnect(BMPListener::ClientInfo *client, MsgBusInterface *mbu
     client->c_sock = 0;
 }
 
+/**
+ * Fill a unicast prefix entry to withdraw a prefix
+ *
+ * \param [out] rib_entry   Entry to fill
+ * \param [in]  peer        Peer entry
+ * \param [in]  isIPv4      True if IPv4, false if IPv6
+ * \param [in]  prefix      Prefix in binary form (network byte order)
+ * \param [in]  len         Prefix length in bits
+ * \param [in]  path_id     Add path ID, zero if not used
+ * \param [in]  has_labels  True if the prefix has labels
+ */
+static void withdrawEntry(MsgBusInterface::obj_rib &rib_entry, MsgBusInterface::obj_bgp_peer &peer, bool isIPv4,
+                          const uint8_t *prefix, uint8_t len, uint32_t path_id, bool has_labels) {
+    bzero(&rib_entry, sizeof(rib_entry));
+
+    memcpy(rib_entry.peer_hash_id, peer.hash_id, sizeof(rib_entry.peer_hash_id));
+    memcpy(rib_entry.prefix_bin, prefix, isIPv4 ? 4 : 16);
+    inet_ntop(isIPv4 ? AF_INET : AF_INET6, prefix, rib_entry.prefix, sizeof(rib_entry.prefix));
+
+    rib_entry.prefix_len = len;
+    rib_entry.isIPv4 = isIPv4 ? 1 : 0;
+    rib_entry.path_id = path_id;
+
+    // Original labels are not kept, the prefix hash only depends on labels being present
+    if (has_labels)
+        snprintf(rib_entry.labels, sizeof(rib_entry.labels), "%d", PEER_DOWN_WITHDRAW_LABEL);
+}
+
+/**
+ * Withdraw all prefixes in the peer RIB
+ *
+ * \details Sends del unicast prefix rows, in batches, for each prefix in the peer RIB.
+ *
+ * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+ * \param [in]  peer        Peer entry of the down peer
+ * \param [in]  info        Persistent peer information of the peer
+ */
+void BMPReader::withdrawPeerRib(MsgBusInterface *mbus_ptr, MsgBusInterface::obj_bgp_peer &peer, peer_info &info) {
+    std::vector<MsgBusInterface::obj_rib> rib_list;
+    MsgBusInterface::obj_rib rib_entry;
+    MsgBusInterface::obj_bgp_peer rib_peer = peer;
+    size_t total = 0;
+
+    if (info.adj_rib_in.size() == 0)
+        return;
+
+    rib_list.reserve(PEER_DOWN_WITHDRAW_BATCH);
+
+    for (int rib = 0; rib < AdjRibIn::RIB_MAX; rib++) {
+
+        // Rows must carry the RIB flags of the peer that sent the prefixes
+        rib_peer.isLocRib = (rib == AdjRibIn::RIB_LOC);
+        rib_peer.isAdjIn = not rib_peer.isLocRib;
+        rib_peer.isPrePolicy = (rib == AdjRibIn::RIB_PRE_POLICY);
+
+        for (int afi = 0; afi < 2; afi++) {
+            bool isIPv4 = (afi == 0);
+
+            info.adj_rib_in.walk(rib, isIPv4, [&](const uint8_t *prefix, uint8_t len, uint32_t path_id, uint32_t attr_id,
+                                                   bool has_labels) {
+                withdrawEntry(rib_entry, rib_peer, isIPv4, prefix, len, path_id, has_labels);
+                rib_list.push_back(rib_entry);
+
+                if (rib_list.size() >= PEER_DOWN_WITHDRAW_BATCH) {
+                    mbus_ptr->update_unicastPrefix(rib_peer, rib_list, NULL, mbus_ptr->UNICAST_PREFIX_ACTION_DEL);
+                    total += rib_list.size();
+                    rib_list.clear();
+                }
+            });
+
+            if (rib_list.size() > 0) {
+                mbus_ptr->update_unicastPrefix(rib_peer, rib_list, NULL, mbus_ptr->UNICAST_PREFIX_ACTION_DEL);
+                total += rib_list.size();
+                rib_list.clear();
+            }
+        }
+    }
+
+    LOG_INFO("%s: PEER DOWN withdrew %zu prefixes from the peer RIB", peer.peer_addr, total);
+}
+
+/**
+ * Advance the peer flap trackers and send the flap reports when due
+ *
+ * \details Runs at most once a second.  Reports are sent per peer every flap report interval.
+ *
+ * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+ */
+void BMPReader::flapTick(MsgBusInterface *mbus_ptr) {
+    std::vector<MsgBusInterface::obj_flap_report> reports;
+    MsgBusInterface::obj_bgp_peer peer;
+
+    if (not cfg->flap_enabled)
+        return;
+
+    uint32_t now = time(NULL);
+    if (now == last_flap_tick)
+        return;
+
+    last_flap_tick = now;
+
+    bool send_report = now - last_flap_report >= (uint32_t) cfg->flap_report_interval;
+    if (send_report)
+        last_flap_report = now;
+
+    std::lock_guard<std::mutex> lock(rib_mutex);
+
+    for (peer_info_map_iter it = peer_info_map.begin(); it != peer_info_map.end(); it++) {
+        peer_info &info = it->second;
+
+        info.flaps.tick(now);
+
+        if (not send_report)
+            continue;
+
+        reports.clear();
+        info.flaps.report(now, reports);
+
+        if (reports.size() == 0)
+            continue;
+
+        peerFromInfo(info, peer);
+        peer.timestamp_secs = now;
+
+        SELF_DEBUG("%s: sending flap report with %zu prefixes, %zu tracked", info.peer_addr,
+                   reports.size(), info.flaps.size());
+
+        mbus_ptr->add_FlapReport(peer, reports);
+    }
+}
+
+/**
+ * Send the collector computed peer stats when due
+ *
+ * \details Each peer gets a report every peer stats interval, including idle peers.
+ *
+ * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+ */
+void BMPReader::peerStatsTick(MsgBusInterface *mbus_ptr) {
+    MsgBusInterface::obj_peer_stats stats;
+    MsgBusInterface::obj_bgp_peer peer;
+
+    if (cfg->peer_stats_interval <= 0)
+        return;
+
+    uint32_t now = time(NULL);
+    if (now - last_peer_stats < (uint32_t) cfg->peer_stats_interval)
+        return;
+
+    last_peer_stats = now;
+
+    std::lock_guard<std::mutex> lock(rib_mutex);
+
+    for (peer_info_map_iter it = peer_info_map.begin(); it != peer_info_map.end(); it++) {
+        peer_info &info = it->second;
+
+        if (not info.counters.enabled())
+            continue;
+
+        info.counters.report(now, info.adj_rib_in.size(), stats);
+
+        peerFromInfo(info, peer);
+        peer.timestamp_secs = now;
+
+        mbus_ptr->add_PeerStats(peer, stats);
+    }
+}
+
+/**
+ * Fill the peer entry from the persistent peer information
+ *
+ * \param [in]  info        Persistent peer information
+ * \param [out] peer        Peer entry
+ */
+void BMPReader::peerFromInfo(peer_info &info, MsgBusInterface::obj_bgp_peer &peer) {
+    bzero(&peer, sizeof(peer));
+    memcpy(peer.hash_id, info.peer_hash_id, sizeof(peer.hash_id));
+    memcpy(peer.router_hash_id, router_hash_id, sizeof(peer.router_hash_id));
+    memcpy(peer.peer_addr, info.peer_addr, sizeof(peer.peer_addr));
+    memcpy(peer.peer_rd, info.peer_rd, sizeof(peer.peer_rd));
+    peer.peer_as = info.peer_as;
+}
+
+/**
+ * Withdraw the digest prefixes that were not received again after the reconnect
+ *
+ * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+ * \param [in]  peer        Peer entry
+ * \param [in]  info        Persistent peer information of the peer
+ * \param [in]  rib         RIB type, AdjRibIn::RIB_TYPES
+ * \param [in]  isIPv4      True if IPv4, false if IPv6
+ */
+void BMPReader::finishDigest(MsgBusInterface *mbus_ptr, MsgBusInterface::obj_bgp_peer &peer, peer_info &info,
+                             int rib, bool isIPv4) {
+    std::vector<MsgBusInterface::obj_rib> rib_list;
+    MsgBusInterface::obj_rib rib_entry;
+    MsgBusInterface::obj_bgp_peer rib_peer = peer;
+    size_t total = 0;
+
+    // Rows must carry the RIB flags of the digest prefixes
+    rib_peer.isLocRib = (rib == AdjRibIn::RIB_LOC);
+    rib_peer.isAdjIn = not rib_peer.isLocRib;
+    rib_peer.isPrePolicy = (rib == AdjRibIn::RIB_PRE_POLICY);
+
+    info.digest.finish(rib, isIPv4, [&](const PeerDigest::digest_entry &entry) {
+        withdrawEntry(rib_entry, rib_peer, isIPv4, entry.prefix, entry.len, entry.path_id, entry.has_labels);
+        rib_list.push_back(rib_entry);
+
+        if (rib_list.size() >= PEER_DOWN_WITHDRAW_BATCH) {
+            mbus_ptr->update_unicastPrefix(rib_peer, rib_list, NULL, mbus_ptr->UNICAST_PREFIX_ACTION_DEL);
+            total += rib_list.size();
+            rib_list.clear();
+        }
+    });
+
+    if (rib_list.size() > 0) {
+        mbus_ptr->update_unicastPrefix(rib_peer, rib_list, NULL, mbus_ptr->UNICAST_PREFIX_ACTION_DEL);
+        total += rib_list.size();
+    }
+
+    if (total > 0)
+        LOG_INFO("%s: End-of-RIB after reconnect, withdrew %zu %s prefixes that were not received again",
+             peer.peer_addr, total, isIPv4 ? "IPv4" : "IPv6");
+}
+
+/**
+ * Finish the digests once the initial RIB dump is done and save the peer digests when due
+ *
+ * \details Routers that don't send End-of-RIB finish the digests when the dump rate drops off.
+ *
+ * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+ * \param [in]  client      Client information pointer
+ */
+void BMPReader::digestTick(MsgBusInterface *mbus_ptr, BMPListener::ClientInfo *client) {
+    MsgBusInterface::obj_bgp_peer peer;
+
+    if (cfg->warm_restart_dir.size() == 0 or not cfg->adj_rib_in)
+        return;
+
+    uint32_t now = time(NULL);
+    if (now == last_digest_tick)
+        return;
+
+    last_digest_tick = now;
+
+    std::lock_guard<std::mutex> lock(rib_mutex);
+
+    if (client->initDumpDone) {
+        for (peer_info_map_iter it = peer_info_map.begin(); it != peer_info_map.end(); it++) {
+            peer_info &info = it->second;
+
+            if (not info.digest.active())
+                continue;
+
+            peerFromInfo(info, peer);
+            peer.timestamp_secs = now;
+
+            for (int rib = 0; rib < AdjRibIn::RIB_MAX and info.digest.active(); rib++) {
+                finishDigest(mbus_ptr, peer, info, rib, true);
+
+                if (info.digest.active())
+                    finishDigest(mbus_ptr, peer, info, rib, false);
+            }
+        }
+    }
+
+    if (cfg->warm_restart_interval > 0 and now - last_digest_save >= (uint32_t) cfg->warm_restart_interval) {
+        last_digest_save = now;
+        saveDigests(client);
+    }
+}
+
+/**
+ * Save the digests of the peers that are not dumping their RIB
+ *
+ * \param [in]  client      Client information pointer
+ */
+void BMPReader::saveDigests(BMPListener::ClientInfo *client) {
+    size_t saved = 0;
+
+    for (peer_info_map_iter it = peer_info_map.begin(); it != peer_info_map.end(); it++) {
+        peer_info &info = it->second;
+
+        // A partial RIB would withdraw the rest on the next reconnect
+        if (info.digest.active() or not (info.endOfRIB or client->initDumpDone))
+            continue;
+
+        if (PeerDigest::save(logger, cfg->warm_restart_dir, info.peer_hash_id, info.adj_rib_in))
+            saved++;
+    }
+
+    SELF_DEBUG("%s: saved %zu peer digests", client->c_ip, saved);
+}
+
+/**
+ * Serialize path attributes for a takeover
+ *
+ * \param [out] state      Serialized state
+ * \param [in]  attr       Path attributes
+ */
+static void putAttr(Takeover::State &state, const MsgBusInterface::obj_path_attr &attr) {
+    state.put(attr.hash_id, sizeof(attr.hash_id));
+    state.put(attr.origin, sizeof(attr.origin));
+    state.putString(attr.as_path);
+    state.put(attr.as_path_count);
+    state.put(attr.origin_as);
+    state.put(attr.nexthop_isIPv4);
+    state.put(attr.next_hop, sizeof(attr.next_hop));
+    state.put(attr.aggregator, sizeof(attr.aggregator));
+    state.put(attr.atomic_agg);
+    state.put(attr.med);
+    state.put(attr.local_pref);
+    state.putString(attr.community_list);
+    state.putString(attr.ext_community_list);
+    state.putString(attr.large_community_list);
+    state.putString(attr.cluster_list);
+    state.put(attr.originator_id, sizeof(attr.originator_id));
+}
+
+/**
+ * Read path attributes saved by putAttr()
+ *
+ * \param [in]  state      Serialized state
+ * \param [out] attr       Path attributes
+ */
+static void getAttr(Takeover::State &state, MsgBusInterface::obj_path_attr &attr) {
+    state.get(attr.hash_id, sizeof(attr.hash_id));
+    state.get(attr.origin, sizeof(attr.origin));
+    state.getString(attr.as_path);
+    state.get(attr.as_path_count);
+    state.get(attr.origin_as);
+    state.get(attr.nexthop_isIPv4);
+    state.get(attr.next_hop, sizeof(attr.next_hop));
+    state.get(attr.aggregator, sizeof(attr.aggregator));
+    state.get(attr.atomic_agg);
+    state.get(attr.med);
+    state.get(attr.local_pref);
+    state.getString(attr.community_list);
+    state.getString(attr.ext_community_list);
+    state.getString(attr.large_community_list);
+    state.getString(attr.cluster_list);
+    state.get(attr.originator_id, sizeof(attr.originator_id));
+}
+
+/**
+ * Save the router and peer state for a takeover, the reader thread must be stopped
+ *
+ * \details Saves the peer info with the peer RIBs and the attributes they reference.  Flap
+ *          trackers, peer counters and digests are not saved.
+ *
+ * \param [out] state      Serialized state
+ */
+void BMPReader::saveState(Takeover::State &state) {
+    std::set<uint32_t> attr_ids;
+    MsgBusInterface::obj_path_attr attr;
+
+    std::lock_guard<std::mutex> lock(rib_mutex);
+
+    state.put(router_hash_id, sizeof(router_hash_id));
+
+    state.put(has_init_router);
+    if (has_init_router) {
+        state.put(init_router.hash_id, sizeof(init_router.hash_id));
+        state.put(init_router.hash_type);
+        state.put(init_router.name, sizeof(init_router.name));
+        state.put(init_router.descr, sizeof(init_router.descr));
+        state.put(init_router.ip_addr, sizeof(init_router.ip_addr));
+        state.put(init_router.bgp_id, sizeof(init_router.bgp_id));
+        state.put(init_router.asn);
+        state.put(init_router.initiate_data, sizeof(init_router.initiate_data));
+        state.put(init_router.timestamp_secs);
+        state.put(init_router.timestamp_us);
+    }
+
+    state.put(hasPrevRIBdumpTime);
+    state.put(isBelowThresholdDumpRate);
+    state.put(prevRIBdumpTime);
+    state.put(maxRIBdumpRate);
+    state.put(belowThresholdInitTime);
+
+    // Attribute IDs are only valid in this process, the attributes referenced by the RIBs go with the state
+    for (peer_info_map_iter it = peer_info_map.begin(); it != peer_info_map.end(); it++) {
+        for (int rib = 0; rib < AdjRibIn::RIB_MAX; rib++) {
+            for (int afi = 0; afi < 2; afi++) {
+                it->second.adj_rib_in.walk(rib, afi == 0, [&](const uint8_t *prefix, uint8_t len, uint32_t path_id,
+                                                              uint32_t attr_id, uint32_t label_hash) {
+                    if (attr_id != 0)
+                        attr_ids.insert(attr_id);
+                });
+            }
+        }
+    }
+
+    state.put((uint64_t) attr_ids.size());
+    for (std::set<uint32_t>::iterator it = attr_ids.begin(); it != attr_ids.end(); it++) {
+        if (not AttrTable::instance().get(*it, attr))
+            throw "BMPReader: peer RIB references an unknown attribute ID";
+
+        state.put(*it);
+        putAttr(state, attr);
+    }
+
+    state.put((uint64_t) peer_info_map.size());
+    for (peer_info_map_iter it = peer_info_map.begin(); it != peer_info_map.end(); it++) {
+        peer_info &info = it->second;
+        Takeover::State add_path;
+        uint32_t add_path_count = 0;
+
+        state.putString(it->first);
+
+        state.put(info.sent_four_octet_asn);
+        state.put(info.recv_four_octet_asn);
+        state.put(info.using_2_octet_asn);
+
+        info.add_path_capability.walk([&](const std::string &key, int sent_code, int recv_code) {
+            add_path.putString(key);
+            add_path.put(sent_code);
+            add_path.put(recv_code);
+            add_path_count++;
+        });
+
+        state.put(add_path_count);
+        state.put(add_path.data.data(), add_path.data.size());
+
+        state.putString(info.peer_group);
+        state.put(info.endOfRIB);
+        state.put(info.peer_hash_id, sizeof(info.peer_hash_id));
+        state.put(info.peer_addr, sizeof(info.peer_addr));
+        state.put(info.peer_rd, sizeof(info.peer_rd));
+        state.put(info.peer_as);
+        state.put(info.eor_afi);
+
+        state.put((uint64_t) info.adj_rib_in.size());
+        for (int rib = 0; rib < AdjRibIn::RIB_MAX; rib++) {
+            for (int afi = 0; afi < 2; afi++) {
+                info.adj_rib_in.walk(rib, afi == 0, [&](const uint8_t *prefix, uint8_t len, uint32_t path_id,
+                                                        uint32_t attr_id, uint32_t label_hash) {
+                    state.put((uint8_t) rib);
+                    state.put((uint8_t) afi);
+                    state.put(len);
+                    state.put(prefix, (len + 7) / 8);
+                    state.put(path_id);
+                    state.put(attr_id);
+                    state.put(label_hash);
+                });
+            }
+        }
+    }
+}
+
+/**
+ * Restore the router and peer state saved by saveState(), before the reader thread is started
+ *
+ * \param [in] state       Serialized state
+ *
+ * \throw (char const *str) message indicate error
+ */
+void BMPReader::restoreState(Takeover::State &state) {
+    std::map<uint32_t, uint32_t> attr_ids;          // Saved attribute ID to the ID interned here
+    MsgBusInterface::obj_path_attr attr;
+    uint64_t count;
+    size_t prefixes = 0;
+
+    std::lock_guard<std::mutex> lock(rib_mutex);
+
+    try {
+        state.get(router_hash_id, sizeof(router_hash_id));
+
+        state.get(has_init_router);
+        if (has_init_router) {
+            state.get(init_router.hash_id, sizeof(init_router.hash_id));
+            state.get(init_router.hash_type);
+            state.get(init_router.name, sizeof(init_router.name));
+            state.get(init_router.descr, sizeof(init_router.descr));
+            state.get(init_router.ip_addr, sizeof(init_router.ip_addr));
+            state.get(init_router.bgp_id, sizeof(init_router.bgp_id));
+            state.get(init_router.asn);
+            state.get(init_router.initiate_data, sizeof(init_router.initiate_data));
+            state.get(init_router.timestamp_secs);
+            state.get(init_router.timestamp_us);
+        }
+
+        state.get(hasPrevRIBdumpTime);
+        state.get(isBelowThresholdDumpRate);
+        state.get(prevRIBdumpTime);
+        state.get(maxRIBdumpRate);
+        state.get(belowThresholdInitTime);
+
+        // The interned attributes are referenced until the RIBs are restored
+        state.get(count);
+        for (uint64_t i = 0; i < count; i++) {
+            uint32_t id;
+
+            state.get(id);
+            getAttr(state, attr);
+            attr_ids[id] = AttrTable::instance().intern(attr);
+        }
+
+        state.get(count);
+        for (uint64_t i = 0; i < count; i++) {
+            std::string key;
+            uint32_t add_path_count;
+            uint64_t rib_count;
+
+            state.getString(key);
+            peer_info &info = peer_info_map[key];
+
+            state.get(info.sent_four_octet_asn);
+            state.get(info.recv_four_octet_asn);
+            state.get(info.using_2_octet_asn);
+
+            state.get(add_path_count);
+            for (uint32_t n = 0; n < add_path_count; n++) {
+                std::string afi_safi;
+                int sent_code, recv_code;
+
+                state.getString(afi_safi);
+                state.get(sent_code);
+                state.get(recv_code);
+                info.add_path_capability.restore(afi_safi, sent_code, recv_code);
+            }
+
+            state.getString(info.peer_group);
+            state.get(info.endOfRIB);
+            state.get(info.peer_hash_id, sizeof(info.peer_hash_id));
+            state.get(info.peer_addr, sizeof(info.peer_addr));
+            state.get(info.peer_rd, sizeof(info.peer_rd));
+            state.get(info.peer_as);
+            state.get(info.eor_afi);
+
+            info.flaps.init(cfg);
+            info.counters.init(cfg);
+
+            state.get(rib_count);
+            for (uint64_t n = 0; n < rib_count; n++) {
+                uint8_t rib, afi, len;
+                uint8_t prefix[16] = { 0 };
+                uint32_t path_id, attr_id, label_hash;
+
+                state.get(rib);
+                state.get(afi);
+                state.get(len);
+
+                if (rib >= AdjRibIn::RIB_MAX or afi > 1 or len > (afi == 0 ? 32 : 128))
+                    throw "takeover state has an invalid peer RIB entry";
+
+                state.get(prefix, (len + 7) / 8);
+                state.get(path_id);
+                state.get(attr_id);
+                state.get(label_hash);
+
+                std::map<uint32_t, uint32_t>::iterator id_it = attr_ids.find(attr_id);
+
+                info.adj_rib_in.update(rib, afi == 0, prefix, len, path_id,
+                                       id_it != attr_ids.end() ? id_it->second : 0, label_hash);
+                prefixes++;
+            }
+        }
+
+    } catch (char const *str) {
+        for (std::map<uint32_t, uint32_t>::iterator it = attr_ids.begin(); it != attr_ids.end(); it++)
+            AttrTable::instance().release(it->second);
+
+        throw;
+    }
+
+    // The RIBs hold their own references now
+    for (std::map<uint32_t, uint32_t>::iterator it = attr_ids.begin(); it != attr_ids.end(); it++)
+        AttrTable::instance().release(it->second);
+
+    LOG_INFO("Restored %zu peers with %zu prefixes and %zu attribute sets", peer_info_map.size(), prefixes,
+             attr_ids.size());
+}
+
+/**
+ * Send the router entry of the INIT message again, used when the session continues on a new
+ *      message bus after a takeover.  Nothing is sent if no INIT message was received.
+ *
+ * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+ */
+void BMPReader::resumeRouter(MsgBusInterface *mbus_ptr) {
+    if (not has_init_router)
+        return;
+
+    MsgBusInterface::obj_router r_object = init_router;
+    mbus_ptr->update_Router(r_object, mbus_ptr->ROUTER_ACTION_FIRST);
+}
 
 /**
  * Generate BMP router HASH
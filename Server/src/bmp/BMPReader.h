@@ -13,22 +13,53 @@
 #include "BMPListener.h"
 #include "BMPReader.h"
 #include "AddPathDataContainer.h"
+#include "AdjRibIn.h"
+#include "FlapTracker.h"
+#include "PeerCounters.h"
+#include "PeerDigest.h"
 #include "MsgBusInterface.hpp"
+#include "WorkerPool.h"
+#include "Takeover.h"
 #include "Logger.h"
 #include "Config.h"
 
+#include <atomic>
 #include <map>
+#include <list>
 #include <memory>
+#include <mutex>
 
 /**
  * \class   BMPReader
  *
  * \brief   Server class for the BMP instance
  * \details Maintains received connections and data from those connections.
+ *
+ *          With parse threads, route monitoring and stats messages of known peers are parsed by a
+ *          pool shared by all readers, sharded by the peer_info_map key so the peer order is kept.
+ *          Other messages wait until the pool is done with the messages of the reader.  The pool
+ *          is also done before rib_mutex is released, so the peer info is only used by one
+ *          thread at a time.
  */
 class BMPReader {
 
 public:
+    #define PEER_DOWN_WITHDRAW_BATCH    2000        ///< Max prefixes per del message on peer down
+    #define PEER_DOWN_WITHDRAW_LABEL    524288      ///< Label used for synthesized withdraws (RFC 3107 0x800000)
+    #define PARSE_BATCH_MSGS            1000        ///< Max messages read before waiting for the parse threads
+    #define PARSE_WAIT_SPIN             1000        ///< Yields before sleeping while waiting for the parse threads
+
+    /**
+     * Reader pause state, the reader stops at a message boundary so the session can be taken over
+     *
+     *      NONE -> REQUESTED           requestPause()
+     *      REQUESTED -> DONE           Reader stopped, readerThreadLoop() returns
+     *      REQUESTED -> DECLINED       Reader continues, a peer is finishing a warm restart digest
+     *      REQUESTED -> NONE           cancelPause()
+     *      DONE/DECLINED -> NONE       clearPause()
+     */
+    enum PAUSE_STATES { PAUSE_NONE=0, PAUSE_REQUESTED, PAUSE_DONE, PAUSE_DECLINED };
+
     /**
      * Persistent peer information structure
      *
@@ -41,6 +72,15 @@ public:
         AddPathDataContainer add_path_capability;               ///< Stores data about Add Path capability
         string peer_group;                                      ///< Peer group name of defined
 	bool endOfRIB;						///< Indicates if End-Of-RIB marker is received
+        AdjRibIn adj_rib_in;                                    ///< Peer RIB, used to only send changed prefixes
+        u_char peer_hash_id[16];                                ///< Peer hash ID, used by RIB snapshots
+        char peer_addr[46];                                     ///< Peer IP address in printed form
+        char peer_rd[32];                                       ///< Peer distinguisher in printed form
+        uint32_t peer_as;                                       ///< Peer ASN
+        FlapTracker flaps;                                      ///< Route flap tracker, enabled by config
+        PeerCounters counters;                                  ///< Collector computed peer stats, enabled by config
+        PeerDigest digest;                                      ///< Saved RIB digest while the RIB is dumped after a reconnect
+        uint16_t eor_afi;                                       ///< AFI of the End-of-RIB in the last unicast UPDATE, zero if none
     };
 
 
@@ -111,6 +151,64 @@ public:
 
     void hashRouter(BMPListener::ClientInfo *client, MsgBusInterface::obj_router &r_entry);
 
+    /**
+     * Ask the reader thread to stop at the next message boundary, see PAUSE_STATES
+     */
+    inline void requestPause() {
+        pause_state = PAUSE_REQUESTED;
+    }
+
+    /**
+     * Cancel the pause request if the reader did not act on it yet
+     *
+     * \return true if cancelled, false if the reader already stopped or declined
+     */
+    inline bool cancelPause() {
+        int expected = PAUSE_REQUESTED;
+        return pause_state.compare_exchange_strong(expected, PAUSE_NONE);
+    }
+
+    /**
+     * Reset the pause state once the reader stopped or declined
+     */
+    inline void clearPause() {
+        pause_state = PAUSE_NONE;
+    }
+
+    /**
+     * Get the pause state, PAUSE_STATES
+     */
+    inline int getPauseState() {
+        return pause_state.load();
+    }
+
+    /**
+     * Save the router and peer state for a takeover, the reader thread must be stopped
+     *
+     * \details Saves the peer info with the peer RIBs and the attributes they reference.  Flap
+     *          trackers, peer counters and digests are not saved.
+     *
+     * \param [out] state      Serialized state
+     */
+    void saveState(Takeover::State &state);
+
+    /**
+     * Restore the router and peer state saved by saveState(), before the reader thread is started
+     *
+     * \param [in] state       Serialized state
+     *
+     * \throw (char const *str) message indicate error
+     */
+    void restoreState(Takeover::State &state);
+
+    /**
+     * Send the router entry of the INIT message again, used when the session continues on a new
+     *      message bus after a takeover.  Nothing is sent if no INIT message was received.
+     *
+     * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+     */
+    void resumeRouter(MsgBusInterface *mbus_ptr);
+
     // Debug methods
     void enableDebug();
     void disableDebug();
@@ -120,21 +218,156 @@ public:
     Logger      *logger;                    ///< Logging class pointer
 
 private:
+    friend class RibSnapshot;
+    friend class RibQueryServer;
+
+    static std::mutex               readers_mutex;  ///< Protects the readers list
+    static std::list<BMPReader *>   readers;        ///< Active readers, used by RIB snapshots and queries
+
+    struct parse_task;
+
+    /**
+     * Parse pool shared by all readers - NULL if disabled
+     */
+    static WorkerPool               *parse_pool;
+    static int                      parse_pool_refs;    ///< Number of readers using the parse pool
+    static std::mutex               parse_pool_mutex;   ///< Protects parse pool creation/deletion
+
     Config      *cfg;                       ///< Config pointer
     bool        debug;                      ///< debug flag to indicate debugging
     u_char      router_hash_id[16];         ///< Router hash ID
+    MsgBusInterface::obj_router init_router;    ///< Router entry of the INIT message, sent again after a takeover
+    bool        has_init_router;            ///< True if the INIT message was received
 
     bool 	hasPrevRIBdumpTime;	    ///< True if first RIB dump has been received
     bool        isBelowThresholdDumpRate;   ///< True if RIB dump rate is below 15% of initial rate 
     int32_t 	prevRIBdumpTime;            ///< Stores the time the previous message was received
     int32_t 	maxRIBdumpRate;             ///< Stores the maximum RIB dump rate
     int32_t     belowThresholdInitTime;     ///< Stores the time when the RIB dump rate has dropped below threshold
+
+    std::mutex  rib_mutex;                  ///< Held while messages are processed and parsed, RIB snapshots lock it
+    BMPListener::ClientInfo *reader_client; ///< Client of the reader thread, NULL until started
+    MsgBusInterface *reader_mbus;           ///< Message bus of the reader thread, NULL until started
+
+    std::atomic<int> parse_pending;         ///< Messages submitted to the parse pool and not yet parsed
+    std::atomic<int> pause_state;           ///< Reader pause state for a takeover, PAUSE_STATES
+    uint32_t    init_dump_ts;               ///< Timestamp of the last route monitoring message given to the parse pool
+    int         trace_count;                ///< Route monitoring messages since the last latency trace
+
+    uint32_t    last_flap_tick;             ///< Time the flap trackers were last advanced
+    uint32_t    last_flap_report;           ///< Time of the last flap report
+    uint32_t    last_peer_stats;            ///< Time of the last peer stats report
+    uint32_t    last_queue_fill;            ///< Time the client queue fill was last updated
+    uint32_t    last_digest_tick;           ///< Time the peer digests were last checked
+    uint32_t    last_digest_save;           ///< Time the peer digests were last saved
+
     /**
      * Persistent peer info map, Key is the peer_hash_id.
      */
     std::map<std::string, peer_info> peer_info_map;
     typedef std::map<std::string, peer_info>::iterator peer_info_map_iter;
 
+    /**
+     * Update the persistent peer information from the peer entry of a message
+     *
+     * \param [in,out] info     Persistent peer information
+     * \param [in]  peer        Peer entry
+     */
+    void updatePeerInfo(peer_info &info, MsgBusInterface::obj_bgp_peer &peer);
+
+    /**
+     * Parse the BGP UPDATE of a route monitoring message
+     *
+     * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+     * \param [in]  peer        Peer entry
+     * \param [in]  info        Persistent peer information of the peer
+     * \param [in]  router_ip   Router IP address in printed form
+     * \param [in]  data        BGP message
+     * \param [in]  len         Length of the BGP message
+     */
+    void parseRouteMon(MsgBusInterface *mbus_ptr, MsgBusInterface::obj_bgp_peer &peer, peer_info &info,
+                       const std::string &router_ip, u_char *data, size_t len);
+
+    /**
+     * Check if the initial RIB dump of the router is done
+     *
+     * \param [in]  client      Client information pointer
+     * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+     * \param [in]  timestamp   Timestamp of the last route monitoring message
+     */
+    void checkInitDump(BMPListener::ClientInfo *client, MsgBusInterface *mbus_ptr, uint32_t timestamp);
+
+    /**
+     * Wait until the messages given to the parse pool are parsed
+     */
+    void waitParse();
+
+    /**
+     * Wait for the parse pool and run the checks that were skipped while it was busy
+     *
+     * \param [in]  client      Client information pointer
+     * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+     */
+    void drainParse(BMPListener::ClientInfo *client, MsgBusInterface *mbus_ptr);
+
+    /**
+     * Withdraw all prefixes in the peer RIB
+     *
+     * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+     * \param [in]  peer        Peer entry of the down peer
+     * \param [in]  info        Persistent peer information of the peer
+     */
+    void withdrawPeerRib(MsgBusInterface *mbus_ptr, MsgBusInterface::obj_bgp_peer &peer, peer_info &info);
+
+    /**
+     * Advance the peer flap trackers and send the flap reports when due
+     *
+     * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+     */
+    void flapTick(MsgBusInterface *mbus_ptr);
+
+    /**
+     * Send the collector computed peer stats when due
+     *
+     * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+     */
+    void peerStatsTick(MsgBusInterface *mbus_ptr);
+
+    /**
+     * Fill the peer entry from the persistent peer information
+     *
+     * \param [in]  info        Persistent peer information
+     * \param [out] peer        Peer entry
+     */
+    void peerFromInfo(peer_info &info, MsgBusInterface::obj_bgp_peer &peer);
+
+    /**
+     * Withdraw the digest prefixes that were not received again after the reconnect
+     *
+     * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+     * \param [in]  peer        Peer entry
+     * \param [in]  info        Persistent peer information of the peer
+     * \param [in]  rib         RIB type, AdjRibIn::RIB_TYPES
+     * \param [in]  isIPv4      True if IPv4, false if IPv6
+     */
+    void finishDigest(MsgBusInterface *mbus_ptr, MsgBusInterface::obj_bgp_peer &peer, peer_info &info,
+                      int rib, bool isIPv4);
+
+    /**
+     * Finish the digests once the initial RIB dump is done and save the peer digests when due
+     *
+     * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+     * \param [in]  client      Client information pointer
+     */
+    void digestTick(MsgBusInterface *mbus_ptr, BMPListener::ClientInfo *client);
+
+    /**
+     * Save the digests of the peers that are not dumping their RIB
+     *
+     * \param [in]  client      Client information pointer
+     */
+    void saveDigests(BMPListener::ClientInfo *client);
+
 };
 
 #endif /* BMPReader_H_ */
@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <ctime>
+#include <sstream>
+
+#include "RibQueryServer.h"
+#include "RibSnapshot.h"
+#include "BMPReader.h"
+#include "AttrTable.h"
+
+/**
+ * RIB names by AdjRibIn::RIB_TYPES
+ */
+static const char *rib_names[] = { "pre-policy", "post-policy", "loc-rib" };
+
+/**
+ * Constructor for class - Opens the UNIX socket and starts the query thread
+ *
+ * \param [in] logPtr   Pointer to Logger instance
+ * \param [in] cfg      Pointer to the config instance
+ *
+ * \throw (char const *str) message indicate error
+ */
+RibQueryServer::RibQueryServer(Logger *logPtr, Config *cfg) {
+    logger = logPtr;
+    this->cfg = cfg;
+    debug = cfg->debug_general;
+    query_thread = NULL;
+
+    sockaddr_un addr;
+    bzero(&addr, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (cfg->query_socket.size() >= sizeof(addr.sun_path))
+        throw "ERROR: Query socket path is too long";
+
+    strncpy(addr.sun_path, cfg->query_socket.c_str(), sizeof(addr.sun_path) - 1);
+
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        throw "ERROR: Cannot open query socket";
+
+    // Remove the socket file left over from a previous run
+    unlink(cfg->query_socket.c_str());
+
+    if (::bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(sock);
+        throw "ERROR: Cannot bind to the query socket path";
+    }
+
+    chmod(cfg->query_socket.c_str(), 0660);
+    listen(sock, 10);
+
+    running = true;
+    query_thread = new std::thread(&RibQueryServer::queryLoop, this);
+
+    LOG_INFO("RIB query socket listening on %s", cfg->query_socket.c_str());
+}
+
+/**
+ * Destructor for class - Stops the query thread and removes the socket
+ */
+RibQueryServer::~RibQueryServer() {
+    running = false;
+
+    if (query_thread != NULL) {
+        query_thread->join();
+        delete query_thread;
+    }
+
+    close(sock);
+    unlink(cfg->query_socket.c_str());
+}
+
+/**
+ * Query thread loop - Accepts and serves clients
+ */
+void RibQueryServer::queryLoop() {
+    std::vector<client> clients;
+    std::vector<pollfd> pfds;
+    pollfd pfd;
+
+    while (running) {
+        pfds.clear();
+
+        // Stop accepting at the client limit, new connections wait in the backlog
+        pfd.fd = sock;
+        pfd.events = clients.size() < RIB_QUERY_MAX_CLIENTS ? POLLIN : 0;
+        pfd.revents = 0;
+        pfds.push_back(pfd);
+
+        for (size_t i = 0; i < clients.size(); i++) {
+            pfd.fd = clients[i].fd;
+            pfd.events = clients[i].out.empty() ? POLLIN : POLLOUT;
+            pfd.revents = 0;
+            pfds.push_back(pfd);
+        }
+
+        if (poll(&pfds[0], pfds.size(), 500) < 0) {
+            if (errno != EINTR)
+                LOG_WARN("Failed to poll the query sockets: %s", strerror(errno));
+            continue;
+        }
+
+        time_t now = time(NULL);
+
+        for (size_t i = clients.size(); i-- > 0; ) {
+            if (not serveClient(clients[i], pfds[i + 1].revents, now)) {
+                close(clients[i].fd);
+                clients.erase(clients.begin() + i);
+            }
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            int fd = accept(sock, NULL, NULL);
+            if (fd < 0) {
+                LOG_WARN("Failed to accept query connection: %s", strerror(errno));
+                continue;
+            }
+
+            client c;
+            c.fd = fd;
+            c.last_active = now;
+            clients.push_back(c);
+        }
+    }
+
+    for (size_t i = 0; i < clients.size(); i++)
+        close(clients[i].fd);
+}
+
+/**
+ * Read from or send to a client and run its complete commands
+ *
+ * \param [in] c        Client
+ * \param [in] revents  Poll events of the client socket
+ * \param [in] now      Current time
+ *
+ * \return false if the client should be closed, true otherwise
+ */
+bool RibQueryServer::serveClient(client &c, short revents, time_t now) {
+    char read_buf[RIB_QUERY_MAX_LINE];
+    size_t pos;
+
+    if (revents & (POLLERR | POLLNVAL))
+        return false;
+
+    if (not c.out.empty()) {
+        if (revents == 0)
+            return now - c.last_active < RIB_QUERY_CLIENT_TIMEOUT;
+
+        ssize_t n = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 and errno != EAGAIN and errno != EWOULDBLOCK)
+            return false;
+
+        if (n > 0) {
+            c.out.erase(0, n);
+            c.last_active = now;
+        }
+
+    } else if (revents & (POLLIN | POLLHUP)) {
+        ssize_t n = recv(c.fd, read_buf, sizeof(read_buf), MSG_DONTWAIT);
+        if (n == 0 or (n < 0 and errno != EAGAIN and errno != EWOULDBLOCK))
+            return false;
+
+        if (n > 0) {
+            c.in.append(read_buf, n);
+            c.last_active = now;
+        }
+
+    } else if (now - c.last_active >= RIB_QUERY_CLIENT_TIMEOUT) {
+        return false;
+    }
+
+    // Run the next complete command once the previous reply is sent
+    while (c.out.empty() and (pos = c.in.find('\n')) != std::string::npos) {
+        std::string line = c.in.substr(0, pos);
+        c.in.erase(0, pos + 1);
+
+        if (line.size() > 0 and line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+
+        command(line, c.out);
+    }
+
+    if (c.in.size() > RIB_QUERY_MAX_LINE and c.in.find('\n') == std::string::npos) {
+        LOG_NOTICE("Query command line too long, closing query connection");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Run a command
+ *
+ * \param [in]  line    Command line, without the newline
+ * \param [out] reply   Reply lines
+ */
+void RibQueryServer::command(const std::string &line, std::string &reply) {
+    std::istringstream args(line);
+    std::string cmd, arg;
+
+    args >> cmd >> arg;
+
+    SELF_DEBUG("Query command: %s", line.c_str());
+
+    if (cmd == "lpm") {
+        lookup(arg, reply);
+
+    } else if (cmd == "snapshot") {
+        RibSnapshot snapshot(logger, cfg);
+
+        if (snapshot.write(cfg->snapshot_file))
+            reply = "END\t0\n";
+        else
+            reply = "ERROR\tfailed to write the snapshot, see the log\n";
+
+    } else if (cmd == "reload") {
+        try {
+            cfg->reload();
+            LOG_NOTICE("Reloaded the mapping and topics from the configuration file");
+            reply = "END\t0\n";
+
+        } catch (char const *str) {
+            LOG_ERR("Failed to reload the configuration, keeping the current one: %s", str);
+            reply = std::string("ERROR\t") + str + "\n";
+        }
+
+    } else if (cmd == "help") {
+        reply = "lpm <address>[/<len>]\n"
+                "snapshot\n"
+                "reload\n"
+                "help\n"
+                "END\t4\n";
+
+    } else if (cmd.size() > 0) {
+        reply = "ERROR\tunknown command, try help\n";
+    }
+}
+
+/**
+ * Longest prefix match in all peer RIBs
+ *
+ * \details Each reader is paused while its peer RIBs are searched, one reader at a time.
+ *
+ * \param [in]  arg     Address or prefix in printed form
+ * \param [out] reply   Reply lines
+ */
+void RibQueryServer::lookup(const std::string &arg, std::string &reply) {
+    uint8_t addr[16];
+    std::string addr_str = arg;
+    int len = -1;
+    bool isIPv4;
+    size_t count = 0;
+    std::ostringstream out;
+    MsgBusInterface::obj_path_attr attr;
+
+    size_t slash = arg.find('/');
+    if (slash != std::string::npos) {
+        addr_str = arg.substr(0, slash);
+        len = atoi(arg.c_str() + slash + 1);
+    }
+
+    bzero(addr, sizeof(addr));
+
+    if (inet_pton(AF_INET, addr_str.c_str(), addr) == 1)
+        isIPv4 = true;
+    else if (inet_pton(AF_INET6, addr_str.c_str(), addr) == 1)
+        isIPv4 = false;
+    else {
+        reply = "ERROR\tinvalid address\n";
+        return;
+    }
+
+    if (len < 0)
+        len = isIPv4 ? 32 : 128;
+
+    if (len > (isIPv4 ? 32 : 128)) {
+        reply = "ERROR\tinvalid prefix length\n";
+        return;
+    }
+
+    std::lock_guard<std::mutex> readers_lock(BMPReader::readers_mutex);
+
+    for (std::list<BMPReader *>::iterator it = BMPReader::readers.begin(); it != BMPReader::readers.end(); it++) {
+        BMPReader *reader = *it;
+
+        // Only this reader is paused while its RIBs are searched
+        std::lock_guard<std::mutex> rib_lock(reader->rib_mutex);
+
+        if (reader->reader_client == NULL)
+            continue;
+
+        for (BMPReader::peer_info_map_iter p_it = reader->peer_info_map.begin();
+                                           p_it != reader->peer_info_map.end(); p_it++) {
+            BMPReader::peer_info &info = p_it->second;
+
+            for (int rib = 0; rib < AdjRibIn::RIB_MAX; rib++) {
+                info.adj_rib_in.lookup(rib, isIPv4, addr, len, [&](const uint8_t *prefix, uint8_t prefix_len,
+                                                                   uint32_t path_id, uint32_t attr_id, bool has_labels) {
+                    char prefix_str[46];
+                    inet_ntop(isIPv4 ? AF_INET : AF_INET6, prefix, prefix_str, sizeof(prefix_str));
+
+                    out << reader->reader_client->c_ip << '\t' << info.peer_addr << '\t' << info.peer_rd << '\t'
+                        << info.peer_as << '\t' << rib_names[rib] << '\t' << prefix_str << '/' << (int)prefix_len
+                        << '\t' << path_id << '\t';
+
+                    if (AttrTable::instance().get(attr_id, attr))
+                        out << attr.as_path << '\t' << attr.next_hop;
+                    else
+                        out << '\t';
+
+                    out << '\n';
+                    count++;
+                });
+            }
+        }
+    }
+
+    out << "END\t" << count << '\n';
+    reply = out.str();
+}
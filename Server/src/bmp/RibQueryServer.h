@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef OPENBMP_RIBQUERYSERVER_H
+#define OPENBMP_RIBQUERYSERVER_H
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include <thread>
+#include <atomic>
+
+#include "Logger.h"
+#include "Config.h"
+
+/**
+ * \class   RibQueryServer
+ *
+ * \brief   Local query interface to the peer RIBs over a UNIX socket
+ * \details Line protocol, one command per line:
+ *
+ *              lpm <address>[/<len>]   Longest prefix match in every peer RIB.  Replies with one line
+ *                                      per matching path: router, peer address, peer RD, peer ASN, RIB,
+ *                                      prefix/len, path ID, AS path, next hop (tab delimited)
+ *              snapshot                Write the RIB snapshot file (see RibSnapshot)
+ *              reload                  Reload the mapping and kafka topics (see Config::reload())
+ *              help                    List the commands
+ *
+ *          Each reply ends with "END\t<count>" or is a single "ERROR\t<text>" line.  The query
+ *          thread polls up to RIB_QUERY_MAX_CLIENTS clients, further connections wait in the listen
+ *          backlog.  Commands are run one at a time, so a snapshot delays the other clients until
+ *          it is written.
+ */
+class RibQueryServer {
+public:
+    #define RIB_QUERY_MAX_LINE          512         ///< Max command line length
+    #define RIB_QUERY_CLIENT_TIMEOUT    5           ///< Seconds a client can be idle before it is closed
+    #define RIB_QUERY_MAX_CLIENTS       16          ///< Max clients served at the same time
+
+    /**
+     * Constructor for class - Opens the UNIX socket and starts the query thread
+     *
+     * \param [in] logPtr   Pointer to Logger instance
+     * \param [in] cfg      Pointer to the config instance
+     *
+     * \throw (char const *str) message indicate error
+     */
+    RibQueryServer(Logger *logPtr, Config *cfg);
+
+    /**
+     * Destructor for class - Stops the query thread and removes the socket
+     */
+    ~RibQueryServer();
+
+private:
+    /**
+     * Query client connection
+     */
+    struct client {
+        int         fd;                         ///< Client socket
+        std::string in;                         ///< Received data not run yet
+        std::string out;                        ///< Reply data not sent yet
+        time_t      last_active;                ///< Time of the last read or send
+    };
+
+    Config          *cfg;                       ///< Configuration instance
+    Logger          *logger;                    ///< Logging class pointer
+    bool            debug;                      ///< debug flag to indicate debugging
+
+    int             sock;                       ///< Listening socket
+    std::atomic<bool> running;                  ///< Indicates the query thread should run
+    std::thread     *query_thread;              ///< Query thread
+
+    /**
+     * Query thread loop - Accepts and serves clients
+     */
+    void queryLoop();
+
+    /**
+     * Read from or send to a client and run its complete commands
+     *
+     * \details The next command is run once the reply to the previous one has been sent.
+     *
+     * \param [in] c        Client
+     * \param [in] revents  Poll events of the client socket
+     * \param [in] now      Current time
+     *
+     * \return false if the client should be closed, true otherwise
+     */
+    bool serveClient(client &c, short revents, time_t now);
+
+    /**
+     * Run a command
+     *
+     * \param [in]  line    Command line, without the newline
+     * \param [out] reply   Reply lines
+     */
+    void command(const std::string &line, std::string &reply);
+
+    /**
+     * Longest prefix match in all peer RIBs
+     *
+     * \details Each reader is paused while its peer RIBs are searched, one reader at a time.  The
+     *          search is one trie lookup per peer and RIB, so a router is paused for about
+     *          peers * AdjRibIn::RIB_MAX lookups per query.
+     *
+     * \param [in]  arg     Address or prefix in printed form
+     * \param [out] reply   Reply lines
+     */
+    void lookup(const std::string &arg, std::string &reply);
+};
+
+#endif //OPENBMP_RIBQUERYSERVER_H
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cstring>
+#include <cinttypes>
+#include <ctime>
+#include <cerrno>
+#include <unistd.h>
+#include <vector>
+#include <unordered_map>
+#include <sstream>
+
+#include "RibSnapshot.h"
+#include "BMPReader.h"
+#include "AttrTable.h"
+
+/**
+ * Constructor for class
+ *
+ * \param [in] logPtr   Pointer to Logger instance
+ * \param [in] cfg      Pointer to the config instance
+ */
+RibSnapshot::RibSnapshot(Logger *logPtr, Config *cfg) {
+    logger = logPtr;
+    this->cfg = cfg;
+    debug = cfg->debug_general;
+}
+
+/**
+ * Write the snapshot of all peer RIBs
+ *
+ * \param [in] filename     Snapshot filename, replaced once the snapshot is complete
+ *
+ * \return true if written, false on error
+ */
+bool RibSnapshot::write(const std::string &filename) {
+    std::string tmp_filename = filename + ".tmp";
+    snap_header hdr;
+    std::vector<snap_router> routers;
+    std::vector<snap_peer> peers;
+    std::vector<uint32_t> attr_ids;                         // Attribute IDs by snapshot index
+    std::vector<uint32_t> attr_peers;                       // Peer index by snapshot index
+    std::unordered_map<uint64_t, uint32_t> attr_idx;        // Snapshot index by peer index and attribute ID
+    bool write_error = false;
+    time_t start_time = time(NULL);
+
+    // Snapshots can be requested by signal and by the query socket at the same time
+    static std::mutex write_mutex;
+    std::lock_guard<std::mutex> write_lock(write_mutex);
+
+    FILE *fp = fopen(tmp_filename.c_str(), "w");
+    if (fp == NULL) {
+        LOG_ERR("Failed to open RIB snapshot file %s: %s", tmp_filename.c_str(), strerror(errno));
+        return false;
+    }
+
+    bzero(&hdr, sizeof(hdr));
+    memcpy(hdr.magic, RIB_SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.version = RIB_SNAPSHOT_VERSION;
+    hdr.byte_order = RIB_SNAPSHOT_BYTE_ORDER;
+    hdr.header_size = sizeof(hdr);
+    hdr.timestamp = start_time;
+
+    // Placeholder, the header is written again once the offsets are known
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    hdr.prefixes_offset = align(fp);
+
+    /*
+     * Pause one reader at a time to copy its RIBs, the records are written once it runs again.  The
+     * readers list lock only defers routers connecting or closing until the snapshot is written.
+     */
+    {
+        std::lock_guard<std::mutex> readers_lock(BMPReader::readers_mutex);
+        std::vector<snap_prefix> recs;
+
+        for (std::list<BMPReader *>::iterator it = BMPReader::readers.begin(); it != BMPReader::readers.end(); it++) {
+            BMPReader *reader = *it;
+            recs.clear();
+
+            {
+                std::lock_guard<std::mutex> rib_lock(reader->rib_mutex);
+
+                if (reader->reader_client == NULL or reader->reader_mbus == NULL)
+                    continue;
+
+                snap_router router;
+                bzero(&router, sizeof(router));
+                memcpy(router.hash_id, reader->router_hash_id, sizeof(router.hash_id));
+                snprintf(router.ip_addr, sizeof(router.ip_addr), "%s", reader->reader_client->c_ip);
+                router.unicast_prefix_seq = reader->reader_mbus->getUnicastPrefixSeq();
+                router.peer_first = peers.size();
+
+                for (BMPReader::peer_info_map_iter p_it = reader->peer_info_map.begin();
+                                                   p_it != reader->peer_info_map.end(); p_it++) {
+                    BMPReader::peer_info &info = p_it->second;
+
+                    for (int rib = 0; rib < AdjRibIn::RIB_MAX; rib++) {
+                        snap_peer peer;
+                        bzero(&peer, sizeof(peer));
+                        memcpy(peer.hash_id, info.peer_hash_id, sizeof(peer.hash_id));
+                        memcpy(peer.peer_addr, info.peer_addr, sizeof(peer.peer_addr));
+                        memcpy(peer.peer_rd, info.peer_rd, sizeof(peer.peer_rd));
+                        peer.rib_type = rib;
+                        peer.peer_as = info.peer_as;
+                        peer.router_idx = routers.size();
+                        peer.prefix_first = hdr.prefix_count;
+
+                        for (int afi = 0; afi < 2; afi++) {
+                            info.adj_rib_in.walk(rib, afi == 0, [&](const uint8_t *prefix, uint8_t len,
+                                                                    uint32_t path_id, uint32_t attr_id,
+                                                                    bool has_labels) {
+                                snap_prefix rec;
+                                bzero(&rec, sizeof(rec));
+                                memcpy(rec.prefix, prefix, sizeof(rec.prefix));
+                                rec.len = len;
+                                rec.isIPv4 = afi == 0 ? 1 : 0;
+                                rec.has_labels = has_labels ? 1 : 0;
+                                rec.path_id = path_id;
+                                rec.peer_idx = peers.size();
+                                rec.attr_idx = RIB_SNAPSHOT_NO_ATTR;
+
+                                if (attr_id != 0) {
+                                    // Attributes are shared by the peers, the hash ID in the record is per peer
+                                    uint64_t key = (uint64_t) rec.peer_idx << 32 | attr_id;
+                                    std::unordered_map<uint64_t, uint32_t>::iterator a_it = attr_idx.find(key);
+
+                                    if (a_it != attr_idx.end()) {
+                                        rec.attr_idx = a_it->second;
+
+                                    } else {
+                                        // Keep the attributes while the readers are resumed
+                                        AttrTable::instance().addRef(attr_id);
+                                        rec.attr_idx = attr_ids.size();
+                                        attr_idx[key] = rec.attr_idx;
+                                        attr_ids.push_back(attr_id);
+                                        attr_peers.push_back(rec.peer_idx);
+                                    }
+                                }
+
+                                recs.push_back(rec);
+                                hdr.prefix_count++;
+                            });
+                        }
+
+                        peer.prefix_count = hdr.prefix_count - peer.prefix_first;
+
+                        if (peer.prefix_count > 0)
+                            peers.push_back(peer);
+                    }
+                }
+
+                router.peer_count = peers.size() - router.peer_first;
+                routers.push_back(router);
+            }
+
+            if (recs.size() > 0 and fwrite(&recs[0], sizeof(snap_prefix), recs.size(), fp) != recs.size())
+                write_error = true;
+        }
+    }
+
+    /*
+     * Write the peers, routers and attributes
+     */
+    hdr.peers_offset = align(fp);
+    hdr.peer_count = peers.size();
+    if (peers.size() > 0 and fwrite(&peers[0], sizeof(snap_peer), peers.size(), fp) != peers.size())
+        write_error = true;
+
+    hdr.routers_offset = align(fp);
+    hdr.router_count = routers.size();
+    if (routers.size() > 0 and fwrite(&routers[0], sizeof(snap_router), routers.size(), fp) != routers.size())
+        write_error = true;
+
+    std::string attr_data;
+    std::vector<snap_attr> attrs(attr_ids.size());
+    MsgBusInterface::obj_path_attr attr;
+
+    for (size_t i = 0; i < attr_ids.size(); i++) {
+        bzero(&attrs[i], sizeof(snap_attr));
+        attrs[i].data_offset = attr_data.size();
+
+        if (AttrTable::instance().get(attr_ids[i], attr)) {
+            std::ostringstream data;
+
+            AttrTable::pathHash(attr, peers[attr_peers[i]].hash_id, attrs[i].hash_id);
+
+            data << attr.origin << '\t' << attr.as_path << '\t' << attr.as_path_count << '\t' << attr.origin_as
+                 << '\t' << attr.next_hop << '\t' << attr.med << '\t' << attr.local_pref << '\t' << attr.aggregator
+                 << '\t' << attr.community_list << '\t' << attr.ext_community_list << '\t' << attr.cluster_list
+                 << '\t' << attr.atomic_agg << '\t' << attr.nexthop_isIPv4 << '\t' << attr.originator_id
+                 << '\t' << attr.large_community_list;
+
+            attr_data.append(data.str());
+        }
+
+        attrs[i].data_len = attr_data.size() - attrs[i].data_offset;
+        AttrTable::instance().release(attr_ids[i]);
+    }
+
+    hdr.attrs_offset = align(fp);
+    hdr.attr_count = attrs.size();
+    if (attrs.size() > 0 and fwrite(&attrs[0], sizeof(snap_attr), attrs.size(), fp) != attrs.size())
+        write_error = true;
+
+    hdr.attr_data_offset = align(fp);
+    hdr.attr_data_size = attr_data.size();
+    if (attr_data.size() > 0 and fwrite(attr_data.data(), attr_data.size(), 1, fp) != 1)
+        write_error = true;
+
+    // Update the header now that the offsets are known
+    if (fseek(fp, 0, SEEK_SET) != 0 or fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+        write_error = true;
+
+    if (fflush(fp) != 0 or fsync(fileno(fp)) != 0)
+        write_error = true;
+
+    fclose(fp);
+
+    if (write_error) {
+        LOG_ERR("Failed to write RIB snapshot file %s: %s", tmp_filename.c_str(), strerror(errno));
+        unlink(tmp_filename.c_str());
+        return false;
+    }
+
+    if (rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        LOG_ERR("Failed to rename RIB snapshot file %s: %s", tmp_filename.c_str(), strerror(errno));
+        unlink(tmp_filename.c_str());
+        return false;
+    }
+
+    LOG_INFO("Wrote RIB snapshot %s: routers=%u peers=%" PRIu64 " prefixes=%" PRIu64 " attrs=%" PRIu64 " in %ld seconds",
+             filename.c_str(), hdr.router_count, hdr.peer_count, hdr.prefix_count, hdr.attr_count,
+             (long)(time(NULL) - start_time));
+
+    return true;
+}
+
+/**
+ * Pad the file to the next 8 byte boundary
+ *
+ * \param [in] fp       File pointer
+ *
+ * \return file offset after the padding
+ */
+uint64_t RibSnapshot::align(FILE *fp) {
+    static const char pad[8] = { 0 };
+    long offset = ftell(fp);
+
+    if (offset % 8)
+        offset += fwrite(pad, 1, 8 - (offset % 8), fp);
+
+    return offset;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef OPENBMP_RIBSNAPSHOT_H
+#define OPENBMP_RIBSNAPSHOT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <sys/types.h>
+
+#include "Logger.h"
+#include "Config.h"
+
+/**
+ * \class   RibSnapshot
+ *
+ * \brief   Writes a point-in-time snapshot of all peer RIBs to a binary file
+ * \details Each BMP reader is paused only while its RIBs are copied, so the snapshot is consistent
+ *          per router.  The file is written to a temp file and renamed when complete.
+ *
+ *          File layout (host byte order, sections are 8 byte aligned and fixed size records
+ *          so the file can be memory mapped):
+ *
+ *              snap_header
+ *              snap_prefix[prefix_count]   - Grouped by peer, sorted by address family and prefix
+ *              snap_peer[peer_count]       - One per peer and RIB (pre-policy, post-policy, loc-rib)
+ *              snap_router[router_count]
+ *              snap_attr[attr_count]
+ *              attribute data              - Tab delimited attributes, see snap_attr
+ *
+ *          Consumers load the snapshot and then follow the unicast prefix topic of each router
+ *          from snap_router.unicast_prefix_seq.
+ */
+class RibSnapshot {
+public:
+    #define RIB_SNAPSHOT_MAGIC          "OBRS"
+    #define RIB_SNAPSHOT_VERSION        1
+    #define RIB_SNAPSHOT_BYTE_ORDER     0x0102          ///< Reads as 0x0201 if the byte order differs
+    #define RIB_SNAPSHOT_NO_ATTR        0xFFFFFFFF      ///< Attribute index when the attributes are unknown
+
+    struct snap_header {
+        char        magic[4];                   ///< RIB_SNAPSHOT_MAGIC
+        uint16_t    version;                    ///< RIB_SNAPSHOT_VERSION
+        uint16_t    byte_order;                 ///< RIB_SNAPSHOT_BYTE_ORDER
+        uint32_t    header_size;                ///< Size of this header
+        uint32_t    router_count;               ///< Number of routers
+        uint64_t    timestamp;                  ///< Time of the snapshot in seconds since EPOC
+        uint64_t    peer_count;                 ///< Number of peer records
+        uint64_t    prefix_count;               ///< Number of prefix records
+        uint64_t    attr_count;                 ///< Number of attribute records
+        uint64_t    prefixes_offset;            ///< File offset of the prefix records
+        uint64_t    peers_offset;               ///< File offset of the peer records
+        uint64_t    routers_offset;             ///< File offset of the router records
+        uint64_t    attrs_offset;               ///< File offset of the attribute records
+        uint64_t    attr_data_offset;           ///< File offset of the attribute data
+        uint64_t    attr_data_size;             ///< Size of the attribute data
+    } __attribute__ ((__packed__));
+
+    struct snap_router {
+        u_char      hash_id[16];                ///< Router hash ID
+        char        ip_addr[46];                ///< Router IP address in printed form
+        uint16_t    reserved;
+        uint64_t    unicast_prefix_seq;         ///< Unicast prefix sequence of the next message
+        uint64_t    peer_first;                 ///< Index of the first peer record of the router
+        uint64_t    peer_count;                 ///< Number of peer records of the router
+    } __attribute__ ((__packed__));
+
+    struct snap_peer {
+        u_char      hash_id[16];                ///< Peer hash ID
+        char        peer_addr[46];              ///< Peer IP address in printed form
+        char        peer_rd[32];                ///< Peer distinguisher in printed form
+        uint8_t     rib_type;                   ///< AdjRibIn::RIB_TYPES
+        uint8_t     reserved;
+        uint32_t    peer_as;                    ///< Peer ASN
+        uint32_t    router_idx;                 ///< Index of the router record
+        uint64_t    prefix_first;               ///< Index of the first prefix record of the peer
+        uint64_t    prefix_count;               ///< Number of prefix records of the peer
+    } __attribute__ ((__packed__));
+
+    struct snap_prefix {
+        uint8_t     prefix[16];                 ///< Prefix in binary form (network byte order)
+        uint8_t     len;                        ///< Prefix length in bits
+        uint8_t     isIPv4;                     ///< 1 if IPv4, 0 if IPv6
+        uint8_t     has_labels;                 ///< 1 if the prefix has labels
+        uint8_t     reserved;
+        uint32_t    path_id;                    ///< Add path ID, zero if not used
+        uint32_t    attr_idx;                   ///< Index of the attribute record or RIB_SNAPSHOT_NO_ATTR
+        uint32_t    peer_idx;                   ///< Index of the peer record
+    } __attribute__ ((__packed__));
+
+    /**
+     * Attribute record - Data is origin, as_path, as_path_count, origin_as, next_hop, med, local_pref,
+     *      aggregator, community_list, ext_community_list, cluster_list, atomic_agg, nexthop_isIPv4,
+     *      originator_id and large_community_list delimited by tabs
+     */
+    struct snap_attr {
+        u_char      hash_id[16];                ///< Path attribute hash ID
+        uint64_t    data_offset;                ///< Offset in the attribute data
+        uint32_t    data_len;                   ///< Length of the data
+        uint32_t    reserved;
+    } __attribute__ ((__packed__));
+
+    /**
+     * Constructor for class
+     *
+     * \param [in] logPtr   Pointer to Logger instance
+     * \param [in] cfg      Pointer to the config instance
+     */
+    RibSnapshot(Logger *logPtr, Config *cfg);
+
+    /**
+     * Write the snapshot of all peer RIBs
+     *
+     * \param [in] filename     Snapshot filename, replaced once the snapshot is complete
+     *
+     * \return true if written, false on error
+     */
+    bool write(const std::string &filename);
+
+private:
+    Config          *cfg;                       ///< Configuration instance
+    Logger          *logger;                    ///< Logging class pointer
+    bool            debug;                      ///< debug flag to indicate debugging
+
+    /**
+     * Pad the file to the next 8 byte boundary
+     *
+     * \param [in] fp       File pointer
+     *
+     * \return file offset after the padding
+     */
+    uint64_t align(FILE *fp);
+};
+
+#endif //OPENBMP_RIBSNAPSHOT_H
@@ -9,13 +9,17 @@
 
 #include <sys/socket.h>
 
+#include <cerrno>
 #include <cstdlib>
 #include <cstring>
+#include <string>
 #include <thread>
 #include <unistd.h>
 
 #include "client_thread.h"
 #include "BMPReader.h"
+#include "MsgBusFactory.h"
+#include "Takeover.h"
 #include "Logger.h"
 
 
@@ -63,6 +67,83 @@ void ClientThread_cancel(void *arg) {
     }
 }
 
+/**
+ * Write all data to the reader pipe, blocks until the reader thread has read enough of it
+ *
+ * \param [in] fd          Write end of the reader pipe
+ * \param [in] data        Data to write
+ *
+ * \throw (char const *str) message indicate error
+ */
+static void writeReader(int fd, const std::string &data) {
+    for (size_t sent = 0; sent < data.size(); ) {
+        ssize_t n = write(fd, data.data() + sent, data.size() - sent);
+
+        if (n <= 0) {
+            if (n < 0 and errno == EINTR)
+                continue;
+
+            throw "Failed to write the buffered data to the reader";
+        }
+
+        sent += n;
+    }
+}
+
+/**
+ * Hand the session over to the new process, the reader thread must be stopped
+ *
+ * \param [in]  thr         Thread management info of the session
+ * \param [in]  cInfo       Client thread info
+ * \param [in]  rBMP        Reader of the session
+ * \param [in]  pipe_fd     Read end of the reader pipe
+ * \param [in]  ring        Buffered data not yet written to the reader pipe
+ * \param [out] pipe_bytes  Data read back from the reader pipe, written again if the session continues
+ *
+ * \return true if handed over, false if the session continues here
+ */
+static bool handoverSession(ThreadMgmt *thr, ClientThreadInfo &cInfo, BMPReader &rBMP, int pipe_fd,
+                            const std::string &ring, std::string &pipe_bytes) {
+    Logger *logger = cInfo.log;
+    Takeover::State state;
+    char buf[CLIENT_WRITE_BUFFER_BLOCK_SIZE];
+    ssize_t n;
+
+    // Data in the reader pipe is older than the buffered data
+    while ((n = recv(pipe_fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+        pipe_bytes.append(buf, n);
+
+    state.putString(pipe_bytes + ring);
+    rBMP.saveState(state);
+
+    // Send the messages of this process before the new process continues the router
+    cInfo.mbus->handoverRouter();
+    delete cInfo.mbus;
+    cInfo.mbus = NULL;
+
+    thr->session_state.swap(state.data);
+
+    int expected = Takeover::HANDOVER_REQUESTED;
+    if (not thr->handover.compare_exchange_strong(expected, Takeover::HANDOVER_READY)) {
+        thr->session_state.clear();
+        return false;
+    }
+
+    LOG_INFO("%s: Session is ready for the takeover with %zu bytes unread", cInfo.client->c_ip,
+             pipe_bytes.size() + ring.size());
+
+    while (thr->handover.load() == Takeover::HANDOVER_READY)
+        usleep(10000);
+
+    if (thr->handover.load() == Takeover::HANDOVER_SENT) {
+        LOG_INFO("%s: Session handed over to the new process", cInfo.client->c_ip);
+        return true;
+    }
+
+    LOG_INFO("%s: Session was not taken over, continuing", cInfo.client->c_ip);
+    return false;
+}
+
 /**
  * Client thread function
  *
@@ -93,9 +174,29 @@ void *ClientThread(void *arg) {
      */
     pthread_cleanup_push(ClientThread_cancel, &cInfo);
 
+    /*
+     * Pin the router thread before anything is allocated.  The reader thread inherits the affinity and
+     *    the buffers are first touched by these threads, so they are allocated on the local NUMA node.
+     */
+    bool pinned = false;
+    if (CPU_COUNT(&thr->cfg->ingest_cpus) > 0) {
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &thr->cfg->ingest_cpus) == 0)
+            pinned = true;
+        else
+            LOG_WARN("%s: unable to set the ingest cpu affinity", cInfo.client->c_ip);
+    }
+
     try {
+        cInfo.metrics = std::make_shared<RouterMetrics>(cInfo.client->c_ip);
+        cInfo.metrics->buf_size = thr->cfg->bmp_buffer_size;
+
+        if (LatencyTrace::sample_rate > 0)
+            cInfo.arrivals.reset(new LatencyArrivals());
+        cInfo.client->arrivals = cInfo.arrivals.get();
+
         // connect to message bus
-        cInfo.mbus = new msgBus_kafka(logger, thr->cfg, thr->cfg->c_hash_id);
+        cInfo.mbus = newMsgBus(logger, thr->cfg, thr->cfg->c_hash_id);
+        cInfo.mbus->metrics = cInfo.metrics;
 
         if (thr->cfg->debug_msgbus)
             cInfo.mbus->enableDebug();
@@ -109,16 +210,47 @@ void *ClientThread(void *arg) {
         cInfo.bmp_write_end_sock = sock_fds[1];
         cInfo.client->pipe_sock = sock_fds[0];
 
+        // Session taken over from the previous process, its unread data goes to the reader first
+        std::string unread;
+        if (thr->session_state.size() > 0) {
+            Takeover::State state;
+            state.data.swap(thr->session_state);
+
+            state.getString(unread);
+            rBMP.restoreState(state);
+            rBMP.resumeRouter(cInfo.mbus);
+
+            LOG_INFO("%s: Took over the session with %zu bytes unread", cInfo.client->c_ip, unread.size());
+        }
+
         /*
          * Create and start the reader thread to monitor the pipe fd (read end)
          */
         bool bmp_run = true;
         //cInfo.bmp_reader_thread = new std::thread([&] {rBMP.readerThreadLoop(bmp_run,cInfo.client,
         cInfo.bmp_reader_thread = new std::thread(&BMPReader::readerThreadLoop, &rBMP, std::ref(bmp_run), cInfo.client,
-                                                                             (MsgBusInterface *)cInfo.mbus );
+                                                                             cInfo.mbus);
+
+        if (unread.size() > 0) {
+            // Traced as if read now
+            if (cInfo.arrivals)
+                cInfo.arrivals->received(unread.size());
+
+            writeReader(cInfo.bmp_write_end_sock, unread);
+
+            if (cInfo.arrivals)
+                cInfo.arrivals->forwarded(unread.size());
+
+            unread.clear();
+        }
 
         // Variables to handle circular buffer
         sock_buf = new unsigned char[thr->cfg->bmp_buffer_size];
+
+        // Fault in the buffer now so its pages come from the node of the pinned cpus
+        if (pinned)
+            memset(sock_buf, 0, thr->cfg->bmp_buffer_size);
+
         int bytes_read = 0;
         int write_buf_pos = 0;
         int read_buf_pos = 0;
@@ -126,13 +258,105 @@ void *ClientThread(void *arg) {
         unsigned char *sock_buf_read_ptr = sock_buf;
         unsigned char *sock_buf_write_ptr = sock_buf;
 
+        /*
+         * Flow control - Socket reads pause when the buffer reaches the high watermark and resume once the
+         *    reader thread drains it to the low watermark.  The reader thread blocks when the kafka producer
+         *    queue is at its high watermark, so back pressure propagates to the router via TCP.
+         */
+        int buf_used = 0;
+        int buf_high = (int)((int64_t)thr->cfg->bmp_buffer_size * thr->cfg->buf_high_watermark / 100);
+        int buf_low = (int)((int64_t)thr->cfg->bmp_buffer_size * thr->cfg->buf_low_watermark / 100);
+        bool read_paused = false;
+        bool handover_wait = false;                 // Waiting for the reader to stop for a takeover
+
         /*
          * monitor and buffer the client socket
          */
         while (bmp_run) {
 
-            if ((wrap_state and (write_buf_pos + 1) < read_buf_pos) or
-                    (not wrap_state and write_buf_pos < thr->cfg->bmp_buffer_size)) {
+            /*
+             * Takeover by a new process - The reader stops at the next message boundary while the socket
+             *    is still read.  Then the unread data and the reader state are handed over.
+             */
+            if (not handover_wait and thr->handover.load() == Takeover::HANDOVER_REQUESTED) {
+                rBMP.requestPause();
+                handover_wait = true;
+            }
+
+            if (handover_wait) {
+                int pause = rBMP.getPauseState();
+
+                if (pause == BMPReader::PAUSE_DONE) {
+                    handover_wait = false;
+                    cInfo.bmp_reader_thread->join();
+
+                    std::string ring;
+                    if (wrap_state) {
+                        ring.assign((char *)sock_buf + read_buf_pos, thr->cfg->bmp_buffer_size - read_buf_pos);
+                        ring.append((char *)sock_buf, write_buf_pos);
+                    } else {
+                        ring.assign((char *)sock_buf + read_buf_pos, write_buf_pos - read_buf_pos);
+                    }
+
+                    std::string pipe_bytes;
+                    if (handoverSession(thr, cInfo, rBMP, sock_fds[0], ring, pipe_bytes)) {
+                        // Only close this process's copy, the new process has the connection
+                        close(sock_fds[0]);
+                        close(sock_fds[1]);
+                        close(cInfo.client->c_sock);
+
+                        bmp_run = false;
+                        break;
+                    }
+
+                    // Session continues here, the message bus was already released
+                    if (cInfo.mbus == NULL) {
+                        cInfo.mbus = newMsgBus(logger, thr->cfg, thr->cfg->c_hash_id);
+                        cInfo.mbus->metrics = cInfo.metrics;
+
+                        if (thr->cfg->debug_msgbus)
+                            cInfo.mbus->enableDebug();
+
+                        rBMP.resumeRouter(cInfo.mbus);
+                    }
+
+                    rBMP.clearPause();
+                    delete cInfo.bmp_reader_thread;
+                    cInfo.bmp_reader_thread = new std::thread(&BMPReader::readerThreadLoop, &rBMP, std::ref(bmp_run),
+                                                              cInfo.client, cInfo.mbus);
+
+                    writeReader(cInfo.bmp_write_end_sock, pipe_bytes);
+
+                } else if (pause == BMPReader::PAUSE_DECLINED) {
+                    handover_wait = false;
+                    rBMP.clearPause();
+
+                    int expected = Takeover::HANDOVER_REQUESTED;
+                    thr->handover.compare_exchange_strong(expected, Takeover::HANDOVER_DECLINED);
+
+                } else if (thr->handover.load() != Takeover::HANDOVER_REQUESTED and rBMP.cancelPause()) {
+                    handover_wait = false;                      // Main loop stopped waiting
+                }
+            }
+
+            buf_used = wrap_state ? thr->cfg->bmp_buffer_size - read_buf_pos + write_buf_pos
+                                  : write_buf_pos - read_buf_pos;
+
+            cInfo.client->bufFill.store((int)((int64_t)buf_used * 100 / thr->cfg->bmp_buffer_size),
+                                        std::memory_order_relaxed);
+            cInfo.metrics->buf_used.store(buf_used, std::memory_order_relaxed);
+
+            if (read_paused and buf_used <= buf_low) {
+                LOG_INFO("%s: buffer drained to low watermark, resuming socket reads", cInfo.client->c_ip);
+                read_paused = false;
+
+            } else if (not read_paused and buf_used >= buf_high) {
+                LOG_NOTICE("%s: buffer reached high watermark, pausing socket reads", cInfo.client->c_ip);
+                read_paused = true;
+            }
+
+            if (not read_paused and ((wrap_state and (write_buf_pos + 1) < read_buf_pos) or
+                    (not wrap_state and write_buf_pos < thr->cfg->bmp_buffer_size))) {
 
                 pfd.fd = cInfo.client->c_sock;
                 pfd.events = POLLIN | POLLHUP | POLLERR;
@@ -167,6 +391,10 @@ void *ClientThread(void *arg) {
                     else {
                         sock_buf_write_ptr += bytes_read;
                         write_buf_pos += bytes_read;
+                        cInfo.metrics->bytes_read.fetch_add(bytes_read, std::memory_order_relaxed);
+
+                        if (cInfo.arrivals)
+                            cInfo.arrivals->received(bytes_read);
                     }
 
                 }
@@ -225,6 +453,9 @@ void *ClientThread(void *arg) {
                     if (bytes_read > 0) {
                         sock_buf_read_ptr += bytes_read;
                         read_buf_pos += bytes_read;
+
+                        if (cInfo.arrivals)
+                            cInfo.arrivals->forwarded(bytes_read);
                     }
                 }
             }
@@ -236,6 +467,10 @@ void *ClientThread(void *arg) {
             }
         }
 
+        // The reader thread and the parse threads use rBMP, they must be done before it goes out of scope
+        if (cInfo.bmp_reader_thread->joinable())
+            cInfo.bmp_reader_thread->join();
+
         LOG_INFO("%s: Thread for sock [%d] ended normally", cInfo.client->c_ip, cInfo.client->c_sock);
 
     } catch (char const *str) {
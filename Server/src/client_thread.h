@@ -10,10 +10,15 @@
 #ifndef CLIENT_THREAD_H_
 #define CLIENT_THREAD_H_
 
-#include "MsgBusImpl_kafka.h"
+#include "MsgBusInterface.hpp"
 #include "BMPListener.h"
 #include "Logger.h"
 #include "Config.h"
+#include "Metrics.h"
+#include "LatencyTrace.h"
+#include <atomic>
+#include <memory>
+#include <string>
 #include <thread>
 
 #define CLIENT_WRITE_BUFFER_BLOCK_SIZE    8192        // Number of bytes to write to BMP reader from buffer
@@ -25,10 +30,12 @@ struct ThreadMgmt {
     Logger *log;
     bool running;                       // true if running, zero if not running
     bool baselineTimeout;		        // true if past the baseline time of the router
+    std::atomic<int> handover;          // Handover state for a takeover, Takeover::HANDOVER_STATES
+    std::string session_state;          // Serialized session state handed over to or taken over from another process
 };
 
 struct ClientThreadInfo {
-    msgBus_kafka *mbus;
+    MsgBusInterface *mbus;
     BMPListener::ClientInfo *client;
     Logger *log;
 
@@ -37,6 +44,9 @@ struct ClientThreadInfo {
 
     bool closing;                      // Indicates if client is closing normally (set when socket is disconnected)
 
+    std::shared_ptr<RouterMetrics> metrics;     // Session metrics, shared with the message bus
+    std::unique_ptr<LatencyArrivals> arrivals;  // Socket read times for latency tracing, NULL if disabled
+
 };
 
 /**
@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <cinttypes>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "MsgBusImpl_file.h"
+#include "LatencyTrace.h"
+
+std::atomic<uint64_t> msgBus_file::segment_seq(0);
+
+/**
+ * Create the directory and any missing parent directories
+ *
+ * \param [in] path     Directory path
+ *
+ * \return true if the directory exists or was created, false on error
+ */
+static bool makeDirs(const std::string &path) {
+    size_t pos = 0;
+
+    do {
+        pos = path.find('/', pos + 1);
+
+        std::string dir = path.substr(0, pos);
+        if (mkdir(dir.c_str(), 0755) != 0 and errno != EEXIST)
+            return false;
+
+    } while (pos != std::string::npos);
+
+    return true;
+}
+
+/******************************************************************//**
+ * \brief Constructor for class
+ *
+ *  \param [in] logPtr      Pointer to Logger instance
+ *  \param [in] cfg         Pointer to the config instance
+ *  \param [in] c_hash_id   Collector Hash ID
+ ********************************************************************/
+msgBus_file::msgBus_file(Logger *logPtr, Config *cfg, u_char *c_hash_id)
+        : msgBus_kafka(logPtr, cfg, c_hash_id, false) {
+
+    if (not makeDirs(cfg->file_dir)) {
+        LOG_ERR("Unable to create file output directory %s: %s", cfg->file_dir.c_str(), strerror(errno));
+        throw "ERROR: Unable to create file output directory";
+    }
+
+    // Topic selector is only used to resolve the topic names
+    topicSel = new KafkaTopicSelector(logger, cfg, NULL);
+    topic_handle_gen++;
+
+    isConnected = true;
+
+    rotate_stop = false;
+    rotate_thr = NULL;
+
+    if (cfg->file_rotate_interval > 0)
+        rotate_thr = new std::thread(&msgBus_file::rotateLoop, this);
+}
+
+/**
+ * Destructor
+ */
+msgBus_file::~msgBus_file() {
+    if (rotate_thr != NULL) {
+        {
+            std::lock_guard<std::mutex> lock(segments_mutex);
+            rotate_stop = true;
+        }
+
+        rotate_cond.notify_all();
+        rotate_thr->join();
+        delete rotate_thr;
+    }
+
+    // Router term must be written before the segments are closed
+    termRouter();
+
+    disconnect(0);
+}
+
+/**
+ * Close the segments, renaming them to their final names
+ */
+void msgBus_file::disconnect(int wait_ms) {
+    {
+        std::lock_guard<std::mutex> lock(segments_mutex);
+        closeSegments();
+    }
+
+    msgBus_kafka::disconnect(wait_ms);
+}
+
+/**
+ * Files are always available, only makes sure the topic selector exists
+ */
+void msgBus_file::checkConnection() {
+    if (topicSel == NULL) {
+        topicSel = new KafkaTopicSelector(logger, cfg, NULL);
+        topic_handle_gen++;
+    }
+}
+
+/**
+ * Close the segments, they are by topic handle, and replace the topic selector
+ */
+void msgBus_file::reloadTopics() {
+    {
+        std::lock_guard<std::mutex> lock(segments_mutex);
+        closeSegments();
+    }
+
+    delete topicSel;
+    topicSel = new KafkaTopicSelector(logger, cfg, NULL);
+}
+
+/**
+ * Write a prepared message (headers and payload) to the topic segment file
+ *
+ * \details Record format is <key len (4 bytes)> <value len (4 bytes)> <key> <value>, with
+ *          the lengths in network byte order.
+ *
+ * \param [in] topic_id      Topic ID, KafkaTopicSelector::TOPIC_ID_*
+ * \param [in] p_topic       Peer topic info - NULL if not a peer topic
+ * \param [in] buf           Message buffer
+ * \param [in] len           Length of the message in bytes
+ * \param [in] key           Hash key
+ */
+void msgBus_file::send(int topic_id, peer_topic_info *p_topic, unsigned char *buf, size_t len,
+                       const std::string &key) {
+    int handle = getTopicHandle(topic_id, p_topic);
+    const std::string *topic_name = topicSel->getTopicName(handle);
+
+    if (topic_name == NULL) {
+        LOG_NOTICE("rtr=%s: failed to write message because topic couldn't be found: topic=%s key=%s, msg size = %lu",
+                   router_ip.c_str(), KafkaTopicSelector::topic_vars[topic_id], key.c_str(), len);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(segments_mutex);
+    segment_file &seg = segments[handle];
+
+    // Rotate the segment if full or past the rotate interval
+    if (seg.fd != NULL and (seg.size >= cfg->file_segment_size or
+            (cfg->file_rotate_interval > 0 and time(NULL) - seg.start >= cfg->file_rotate_interval)))
+        closeSegment(seg);
+
+    if (seg.fd == NULL and not openSegment(*topic_name, seg))
+        return;
+
+    SELF_DEBUG("rtr=%s: Writing message: topic=%s key=%s, msg size = %lu", router_ip.c_str(),
+               topic_name->c_str(), key.c_str(), len);
+
+    uint32_t rec_hdr[2];
+    rec_hdr[0] = htonl(key.size());
+    rec_hdr[1] = htonl(len);
+
+    if (gzwrite(seg.fd, rec_hdr, sizeof(rec_hdr)) <= 0 or
+            (key.size() > 0 and gzwrite(seg.fd, key.data(), key.size()) <= 0) or
+            gzwrite(seg.fd, buf, len) <= 0) {
+
+        int errnum;
+        LOG_ERR("rtr=%s: Failed to write message to %s: %s", router_ip.c_str(), seg.path.c_str(),
+                gzerror(seg.fd, &errnum));
+        closeSegment(seg);
+        return;
+    }
+
+    seg.size += sizeof(rec_hdr) + key.size() + len;
+
+    // Written is delivered for the file output
+    if (send_trace != 0)
+        LatencyTrace::record(LatencyTrace::STAGE_DELIVERED, send_trace);
+}
+
+/**
+ * Open a new segment file for the topic
+ *
+ * \param [in]  topic_name  Resolved topic name, used as the directory name
+ * \param [out] seg         Segment to open
+ *
+ * \return true if opened, false on error
+ */
+bool msgBus_file::openSegment(const std::string &topic_name, segment_file &seg) {
+    char filename[128];
+    std::string dir = cfg->file_dir + "/" + topic_name;
+
+    if (not makeDirs(dir)) {
+        LOG_ERR("rtr=%s: Unable to create directory %s: %s", router_ip.c_str(), dir.c_str(), strerror(errno));
+        return false;
+    }
+
+    seg.start = time(NULL);
+    seg.size = 0;
+
+    snprintf(filename, sizeof(filename), "/%ld.%d.%06" PRIu64 ".log%s", (long)seg.start, getpid(),
+             segment_seq++, cfg->file_compress ? ".gz" : "");
+    seg.path = dir + filename;
+
+    // 'T' writes without gzip framing, level 1 favors throughput when compressing
+    seg.fd = gzopen((seg.path + FILE_SEGMENT_TMP_SUFFIX).c_str(), cfg->file_compress ? "wb1" : "wbT");
+
+    if (seg.fd == NULL) {
+        LOG_ERR("rtr=%s: Unable to open segment %s: %s", router_ip.c_str(), seg.path.c_str(), strerror(errno));
+        return false;
+    }
+
+    gzbuffer(seg.fd, FILE_WRITE_BUF_SIZE);
+
+    SELF_DEBUG("rtr=%s: Opened segment %s", router_ip.c_str(), seg.path.c_str());
+    return true;
+}
+
+/**
+ * Close the segment file, renaming it to its final name
+ *
+ * \param [in,out] seg      Segment to close
+ */
+void msgBus_file::closeSegment(segment_file &seg) {
+    if (seg.fd == NULL)
+        return;
+
+    if (gzclose(seg.fd) != Z_OK)
+        LOG_ERR("rtr=%s: Failed to close segment %s", router_ip.c_str(), seg.path.c_str());
+
+    else if (rename((seg.path + FILE_SEGMENT_TMP_SUFFIX).c_str(), seg.path.c_str()) != 0)
+        LOG_ERR("rtr=%s: Failed to rename segment %s: %s", router_ip.c_str(), seg.path.c_str(), strerror(errno));
+
+    seg.fd = NULL;
+    seg.size = 0;
+}
+
+/**
+ * Close all segments, caller must hold the segments mutex
+ */
+void msgBus_file::closeSegments() {
+    for (segments_iter it = segments.begin(); it != segments.end(); ++it)
+        closeSegment(it->second);
+
+    segments.clear();
+}
+
+/**
+ * Rotate thread loop - closes the segments past the rotate interval
+ *
+ * \details send() only rotates a segment when it writes to it, so without this the last segment
+ *          of a topic that went idle would stay open with the .tmp suffix.
+ */
+void msgBus_file::rotateLoop() {
+    std::unique_lock<std::mutex> lock(segments_mutex);
+
+    while (not rotate_cond.wait_for(lock, std::chrono::seconds(FILE_ROTATE_CHECK_INTERVAL),
+                                    [this] { return rotate_stop; })) {
+        time_t now = time(NULL);
+
+        for (segments_iter it = segments.begin(); it != segments.end(); ++it) {
+            if (it->second.fd != NULL and now - it->second.start >= cfg->file_rotate_interval)
+                closeSegment(it->second);
+        }
+    }
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef MSGBUSIMPL_FILE_H_
+#define MSGBUSIMPL_FILE_H_
+
+#include <string>
+#include <map>
+#include <atomic>
+#include <ctime>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+#include <zlib.h>
+
+#include "MsgBusImpl_kafka.h"
+#include "Config.h"
+#include "Logger.h"
+
+/**
+ * \class   msgBus_file
+ *
+ * \brief   File message bus implementation
+ * \details Messages are encoded the same as for Kafka and written per topic to rotating
+ *          segment files, for deployments that do not run Kafka.  Each instance (router)
+ *          writes its own segments so per router order is kept.  A rotate thread per instance
+ *          closes segments past the rotate interval, so topics that went idle are not left as
+ *          .tmp files.
+ */
+class msgBus_file: public msgBus_kafka {
+public:
+    #define FILE_WRITE_BUF_SIZE         (1024 * 1024)       ///< Write buffer size per segment
+    #define FILE_SEGMENT_TMP_SUFFIX     ".tmp"              ///< Suffix while the segment is being written
+    #define FILE_ROTATE_CHECK_INTERVAL  1                   ///< Seconds between checks for segments to rotate
+
+    /******************************************************************//**
+     * \brief Constructor for class
+     *
+     *  \param [in] logPtr      Pointer to Logger instance
+     *  \param [in] cfg         Pointer to the config instance
+     *  \param [in] c_hash_id   Collector Hash ID
+     ********************************************************************/
+    msgBus_file(Logger *logPtr, Config *cfg, u_char *c_hash_id);
+    ~msgBus_file();
+
+protected:
+    /**
+     * Write a prepared message (headers and payload) to the topic segment file
+     *
+     * \param [in] topic_id      Topic ID, KafkaTopicSelector::TOPIC_ID_*
+     * \param [in] p_topic       Peer topic info - NULL if not a peer topic
+     * \param [in] buf           Message buffer
+     * \param [in] len           Length of the message in bytes
+     * \param [in] key           Hash key
+     */
+    void send(int topic_id, peer_topic_info *p_topic, unsigned char *buf, size_t len, const std::string &key);
+
+    /**
+     * Files are always available, only makes sure the topic selector exists
+     */
+    void checkConnection();
+
+    /**
+     * Close the segments, they are by topic handle, and replace the topic selector
+     */
+    void reloadTopics();
+
+    /**
+     * Close the segments, renaming them to their final names
+     */
+    void disconnect(int wait_ms=2000);
+
+private:
+    /**
+     * Segment file being written for a topic
+     */
+    struct segment_file {
+        gzFile      fd;                         ///< Segment file, buffered and optionally compressed
+        std::string path;                       ///< Final path of the segment, written with a .tmp suffix
+        uint64_t    size;                       ///< Bytes (uncompressed) written to the segment
+        time_t      start;                      ///< Time the segment was opened
+
+        segment_file() : fd(NULL), size(0), start(0) { }
+    };
+
+    static std::atomic<uint64_t> segment_seq;   ///< Segment sequence, unique across instances
+
+    std::map<int, segment_file> segments;       ///< Open segments by topic handle
+    typedef std::map<int, segment_file>::iterator segments_iter;
+
+    std::mutex      segments_mutex;             ///< Protects the segments from the rotate thread
+    std::condition_variable rotate_cond;        ///< Signaled to stop the rotate thread
+    bool            rotate_stop;                ///< Indicates the rotate thread should stop
+    std::thread     *rotate_thr;                ///< Rotate thread, NULL if the rotate interval is disabled
+
+    /**
+     * Rotate thread loop - closes the segments past the rotate interval
+     */
+    void rotateLoop();
+
+    /**
+     * Close all segments, caller must hold the segments mutex
+     */
+    void closeSegments();
+
+    /**
+     * Open a new segment file for the topic
+     *
+     * \param [in]  topic_name  Resolved topic name, used as the directory name
+     * \param [out] seg         Segment to open
+     *
+     * \return true if opened, false on error
+     */
+    bool openSegment(const std::string &topic_name, segment_file &seg);
+
+    /**
+     * Close the segment file, renaming it to its final name
+     *
+     * \param [in,out] seg      Segment to close
+     */
+    void closeSegment(segment_file &seg);
+};
+
+#endif /* MSGBUSIMPL_FILE_H_ */
@@ -7,8 +7,17 @@
  *
  */
 
+#include <cstdint>
+
 #include "KafkaDeliveryReportCallback.h"
+#include "MsgBusInterface.hpp"
+#include "LatencyTrace.h"
 
 void KafkaDeliveryReportCallback::dr_cb (RdKafka::Message &message) {
-    //std::cout << "Message delivery for (" << message.len() << " bytes): " << message.errstr() << std::endl;
+    if (message.err() != RdKafka::ERR_NO_ERROR) {
+        if (mbus->metrics != NULL)
+            mbus->metrics->produce_errors.fetch_add(1, std::memory_order_relaxed);
+
+    } else if (message.msg_opaque() != NULL)
+        LatencyTrace::record(LatencyTrace::STAGE_DELIVERED, (uintptr_t) message.msg_opaque());
 }
\ No newline at end of file
@@ -13,9 +13,28 @@
 #include <librdkafka/rdkafkacpp.h>
 #include "Logger.h"
 
+class MsgBusInterface;
+
+/**
+ * \class   KafkaDeliveryReportCallback
+ *
+ * \brief   Delivery reports of a router's producer
+ * \details Records the delivered stage of traced messages, see LatencyTrace, and counts failed
+ *          deliveries.  Called by the producer poll.
+ */
 class KafkaDeliveryReportCallback : public RdKafka::DeliveryReportCb {
 public:
+    /**
+     * Constructor for class
+     *
+     * \param [in] mbus     Message bus of the producer, its metrics are read when called
+     */
+    KafkaDeliveryReportCallback(MsgBusInterface *mbus) : mbus(mbus) { }
+
     void dr_cb (RdKafka::Message &message);
+
+private:
+    MsgBusInterface *mbus;
 };
 
 #endif //OPENBMP_KAFKADELIVERYREPORTCALLBACK_H
@@ -0,0 +1,768 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <cinttypes>
+#include <sstream>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <zlib.h>
+
+#include "KafkaJournal.h"
+
+/*********************************************************************//**
+ * Constructor for class
+ *
+ * \details Loads existing segments and starts the drainer thread
+ *
+ * \param [in] logPtr   Pointer to Logger instance
+ * \param [in] cfg      Pointer to the config instance
+ ***********************************************************************/
+KafkaJournal::KafkaJournal(Logger *logPtr, Config *cfg) {
+    logger = logPtr;
+    this->cfg = cfg;
+    debug = cfg->debug_msgbus;
+
+    directory       = cfg->journal_dir;
+    segment_size    = cfg->journal_segment_size;
+    max_size        = cfg->journal_max_size;
+
+    last_seq        = 0;
+    total_size      = 0;
+    write_fd        = -1;
+    write_dirty     = false;
+    full_logged     = false;
+    has_pending     = false;
+
+    conf                 = NULL;
+    tconf                = NULL;
+    producer             = NULL;
+    event_callback       = NULL;
+    delivery_callback    = NULL;
+    partitioner_callback = NULL;
+    producer_connected   = false;
+    delivery_failed      = false;
+
+    read_seq        = 0;
+    read_fd         = -1;
+    read_offset     = 0;
+    read_buf        = new unsigned char[JOURNAL_READ_BUF_SIZE];
+
+    if (mkdir(directory.c_str(), 0755) != 0 and errno != EEXIST) {
+        LOG_ERR("Unable to create journal directory %s: %s", directory.c_str(), strerror(errno));
+        delete [] read_buf;
+        throw "ERROR: Unable to create journal directory";
+    }
+
+    loadSegments();
+
+    running = true;
+    drainer_thread = new std::thread(&KafkaJournal::drainerLoop, this);
+}
+
+/*********************************************************************//**
+ * Destructor for class - Stops the drainer. Undelivered segments are kept for the next run
+ ***********************************************************************/
+KafkaJournal::~KafkaJournal() {
+    running = false;
+
+    if (drainer_thread != NULL) {
+        drainer_thread->join();
+        delete drainer_thread;
+    }
+
+    if (write_fd >= 0) {
+        fdatasync(write_fd);
+        close(write_fd);
+    }
+
+    if (read_fd >= 0)
+        close(read_fd);
+
+    for (std::map<std::string, RdKafka::Topic *>::iterator it = topics.begin(); it != topics.end(); ++it)
+        delete it->second;
+
+    if (producer != NULL) delete producer;
+    if (conf != NULL) delete conf;
+    if (tconf != NULL) delete tconf;
+    if (event_callback != NULL) delete event_callback;
+    if (delivery_callback != NULL) delete delivery_callback;
+    if (partitioner_callback != NULL) delete partitioner_callback;
+
+    delete [] read_buf;
+
+    if (segments.size() > 0)
+        LOG_INFO("Journal has %" PRIu64 " bytes in %lu segments that will be replayed on next start",
+                 total_size, segments.size());
+}
+
+/*********************************************************************//**
+ * Append message to the journal
+ *
+ * \param [in] topic_name   Kafka topic name (resolved name, not the topic var)
+ * \param [in] key          Message key
+ * \param [in] data         Message data (headers and payload)
+ * \param [in] len          Length of the data in bytes
+ *
+ * \return true if journaled, false if the journal is full, the message is too large or on error
+ ***********************************************************************/
+bool KafkaJournal::append(const std::string &topic_name, const std::string &key, const unsigned char *data,
+                          size_t len) {
+    rec_hdr hdr;
+    struct iovec iov[4];
+
+    size_t rec_len = sizeof(hdr) + topic_name.size() + key.size() + len;
+
+    // The drainer reads a record at once, a larger one would be taken for corruption
+    if (rec_len > JOURNAL_READ_BUF_SIZE or topic_name.size() > UINT16_MAX or key.size() > UINT16_MAX) {
+        LOG_ERR("Message of %lu bytes for %s is too large to journal", len, topic_name.c_str());
+        return false;
+    }
+
+    hdr.magic       = JOURNAL_REC_MAGIC;
+    hdr.topic_len   = topic_name.size();
+    hdr.key_len     = key.size();
+    hdr.data_len    = len;
+
+    hdr.crc = crc32(0L, Z_NULL, 0);
+    hdr.crc = crc32(hdr.crc, (const Bytef *)topic_name.data(), topic_name.size());
+    hdr.crc = crc32(hdr.crc, (const Bytef *)key.data(), key.size());
+    hdr.crc = crc32(hdr.crc, (const Bytef *)data, len);
+
+    iov[0].iov_base = &hdr;                         iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = (void *)topic_name.data();    iov[1].iov_len = topic_name.size();
+    iov[2].iov_base = (void *)key.data();           iov[2].iov_len = key.size();
+    iov[3].iov_base = (void *)data;                 iov[3].iov_len = len;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (max_size > 0 and total_size + rec_len > max_size) {
+        if (not full_logged) {
+            LOG_WARN("Journal is full (%" PRIu64 " bytes), messages will not be journaled until it drains",
+                     total_size);
+            full_logged = true;
+        }
+        return false;
+    }
+
+    full_logged = false;
+
+    if (write_fd < 0 or segments.back().size + rec_len > segment_size) {
+        if (not openSegment())
+            return false;
+    }
+
+    ssize_t written = writev(write_fd, iov, 4);
+    if (written != (ssize_t)rec_len) {
+        LOG_ERR("Failed to write to journal segment %" PRIu64 ": %s", segments.back().seq,
+                written < 0 ? strerror(errno) : "short write");
+
+        // Drop the partial record, it would otherwise corrupt the segment
+        if (written > 0 and ftruncate(write_fd, segments.back().size) != 0)
+            segments.back().closed = true;
+
+        return false;
+    }
+
+    segments.back().size += rec_len;
+    total_size += rec_len;
+    write_dirty = true;
+    has_pending = true;
+
+    return true;
+}
+
+/**
+ * Drainer thread loop
+ */
+void KafkaJournal::drainerLoop() {
+    time_t last_sync = time(NULL);
+
+    LOG_INFO("Journal drainer started, directory = %s", directory.c_str());
+
+    while (running) {
+
+        // Periodically sync appended records to disk
+        if (time(NULL) - last_sync >= 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (write_fd >= 0 and write_dirty) {
+                fdatasync(write_fd);
+                write_dirty = false;
+            }
+
+            last_sync = time(NULL);
+        }
+
+        if (not has_pending) {
+            usleep(100000);
+            continue;
+        }
+
+        if (producer == NULL and not createProducer()) {
+            sleep(JOURNAL_RETRY_INTERVAL);
+            continue;
+        }
+
+        if (delivery_failed) {
+            replay();
+            continue;
+        }
+
+        int count = drainSegment();
+        producer->poll(count > 0 ? 0 : 100);
+
+        releaseDelivered();
+    }
+
+    // Give outstanding messages a chance to be delivered, segments are kept regardless
+    if (producer != NULL) {
+        int i = 0;
+        while (producer->outq_len() > 0 and i++ < 10)
+            producer->poll(100);
+    }
+}
+
+/**
+ * Produce records from the current read segment
+ *
+ * \return number of records produced
+ */
+int KafkaJournal::drainSegment() {
+    uint64_t limit;
+    bool     closed;
+    int      count = 0;
+
+    /*
+     * Find the segment to read and how much of it has been written
+     */
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::list<segment>::iterator it;
+
+        for (it = segments.begin(); it != segments.end(); ++it) {
+            if (it->seq >= read_seq)
+                break;
+        }
+
+        if (it == segments.end())
+            return 0;
+
+        if (it->seq != read_seq or read_fd < 0) {
+            if (read_fd >= 0)
+                close(read_fd);
+
+            read_seq = it->seq;
+            read_offset = 0;
+
+            if ((read_fd = open(segmentFilename(read_seq).c_str(), O_RDONLY)) < 0) {
+                LOG_ERR("Unable to open journal segment %s: %s", segmentFilename(read_seq).c_str(),
+                        strerror(errno));
+                it->closed = true;
+                delivery[read_seq].read_done = true;
+                read_seq++;
+                return 0;
+            }
+
+            delivery[read_seq].produced = 0;
+            delivery[read_seq].delivered = 0;
+            delivery[read_seq].read_done = false;
+        }
+
+        limit = it->size;
+        closed = it->closed;
+    }
+
+    if (read_offset >= limit) {
+        if (closed) {
+            close(read_fd);
+            read_fd = -1;
+            delivery[read_seq].read_done = true;
+            read_seq++;
+        }
+        return 0;
+    }
+
+    size_t len = limit - read_offset > JOURNAL_READ_BUF_SIZE ? JOURNAL_READ_BUF_SIZE : limit - read_offset;
+    ssize_t rlen = pread(read_fd, read_buf, len, read_offset);
+
+    if (rlen <= 0) {
+        LOG_ERR("Unable to read journal segment %" PRIu64 ": %s", read_seq, rlen < 0 ? strerror(errno) : "EOF");
+
+        // Segment is shorter than expected, nothing more will be written to it
+        if (rlen == 0 and closed)
+            read_offset = limit;
+
+        return 0;
+    }
+
+    /*
+     * Produce each complete record in the buffer
+     */
+    size_t pos = 0;
+    bool partial = false;
+
+    while (pos < (size_t)rlen) {
+        if (pos + sizeof(rec_hdr) > (size_t)rlen) {
+            partial = true;
+            break;
+        }
+
+        rec_hdr hdr;
+        memcpy(&hdr, read_buf + pos, sizeof(hdr));
+
+        size_t rec_len = sizeof(hdr) + hdr.topic_len + hdr.key_len + hdr.data_len;
+
+        if (hdr.magic != JOURNAL_REC_MAGIC or rec_len > JOURNAL_READ_BUF_SIZE) {
+            LOG_ERR("Journal segment %" PRIu64 " is corrupt at offset %" PRIu64 ", skipping rest of segment",
+                    read_seq, read_offset);
+            read_offset = limit;
+            break;
+        }
+
+        if (pos + rec_len > (size_t)rlen) {
+            partial = true;             // Partial record, read again starting at this record
+            break;
+        }
+
+        unsigned char *ptr = read_buf + pos + sizeof(hdr);
+        std::string topic_name((char *)ptr, hdr.topic_len);         ptr += hdr.topic_len;
+        std::string key((char *)ptr, hdr.key_len);                  ptr += hdr.key_len;
+
+        uint32_t crc = crc32(0L, Z_NULL, 0);
+        crc = crc32(crc, (const Bytef *)read_buf + pos + sizeof(hdr), rec_len - sizeof(hdr));
+
+        if (crc != hdr.crc) {
+            LOG_ERR("Journal segment %" PRIu64 " record at offset %" PRIu64 " failed crc check, skipping record",
+                    read_seq, read_offset);
+
+        } else {
+            RdKafka::Topic *topic = getTopic(topic_name);
+            if (topic == NULL)
+                break;
+
+            RdKafka::ErrorCode resp = producer->produce(topic, RdKafka::Topic::PARTITION_UA,
+                                                        RdKafka::Producer::RK_MSG_COPY,
+                                                        ptr, hdr.data_len, &key,
+                                                        (void *)(uintptr_t)read_seq);
+
+            if (resp == RdKafka::ERR__QUEUE_FULL) {
+                producer->poll(100);
+                break;                  // Retry this record on the next pass
+
+            } else if (resp != RdKafka::ERR_NO_ERROR) {
+                LOG_ERR("Failed to produce journal message to %s, message dropped: %s", topic_name.c_str(),
+                        RdKafka::err2str(resp).c_str());
+
+            } else {
+                delivery[read_seq].produced++;
+                count++;
+            }
+        }
+
+        pos += rec_len;
+        read_offset += rec_len;
+    }
+
+    // A crash can leave a partial record at the end of a segment, it is never completed once closed
+    if (partial and closed and read_offset + (rlen - pos) >= limit) {
+        LOG_WARN("Journal segment %" PRIu64 " ends with a partial record of %" PRIu64 " bytes, skipping it",
+                 read_seq, limit - read_offset);
+        read_offset = limit;
+    }
+
+    return count;
+}
+
+/**
+ * Remove delivered segments and clear pending once caught up with the writer
+ */
+void KafkaJournal::releaseDelivered() {
+    std::map<uint64_t, segment_delivery>::iterator it = delivery.begin();
+
+    while (it != delivery.end()) {
+        segment_delivery &sd = it->second;
+
+        if (sd.delivered < sd.produced)
+            break;                          // Keep order, don't release newer segments before older ones
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (segments.size() == 0 or segments.front().seq != it->first)
+            break;
+
+        segment &seg = segments.front();
+
+        if (not sd.read_done) {
+            /*
+             * Caught up with the writer when the last segment has been read and delivered
+             */
+            if (segments.size() > 1 or it->first != read_seq or read_offset < seg.size)
+                break;
+
+            if (write_fd >= 0) {
+                close(write_fd);
+                write_fd = -1;
+                write_dirty = false;
+            }
+
+            if (read_fd >= 0) {
+                close(read_fd);
+                read_fd = -1;
+            }
+
+            read_seq = seg.seq + 1;
+        }
+
+        SELF_DEBUG("Journal segment %" PRIu64 " delivered, removing", seg.seq);
+        unlink(segmentFilename(seg.seq).c_str());
+
+        total_size -= seg.size;
+        segments.pop_front();
+        delivery.erase(it++);
+
+        if (segments.size() == 0 and write_fd < 0) {
+            has_pending = false;
+            LOG_INFO("Journal has been drained");
+        }
+    }
+}
+
+/**
+ * Wait for outstanding deliveries and restart the replay from the oldest undelivered segment
+ */
+void KafkaJournal::replay() {
+    LOG_WARN("Journal delivery failed, will replay from the oldest undelivered segment in %d seconds",
+             JOURNAL_RETRY_INTERVAL);
+
+    while (producer->outq_len() > 0 and running)
+        producer->poll(100);
+
+    // Release segments that completed before the failure
+    releaseDelivered();
+
+    if (read_fd >= 0) {
+        close(read_fd);
+        read_fd = -1;
+    }
+
+    // Delivered segments are released in order, so the first one left has the failed message
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        read_seq = segments.size() > 0 ? segments.front().seq : last_seq + 1;
+    }
+
+    read_offset = 0;
+    delivery.clear();
+    delivery_failed = false;
+
+    for (int i=0; i < JOURNAL_RETRY_INTERVAL and running; i++)
+        sleep(1);
+}
+
+/**
+ * Check if a delivery error is transient, such as the brokers or the partition leader being unavailable
+ *
+ * \param [in] err      Delivery error
+ *
+ * \return true if the message can be delivered by a replay, false if it never can
+ */
+static bool retriableError(RdKafka::ErrorCode err) {
+    switch (err) {
+        case RdKafka::ERR__TRANSPORT :
+        case RdKafka::ERR__MSG_TIMED_OUT :
+        case RdKafka::ERR__TIMED_OUT :
+        case RdKafka::ERR__ALL_BROKERS_DOWN :
+        case RdKafka::ERR__RESOLVE :
+        case RdKafka::ERR__QUEUE_FULL :
+        case RdKafka::ERR_LEADER_NOT_AVAILABLE :
+        case RdKafka::ERR_NOT_LEADER_FOR_PARTITION :
+        case RdKafka::ERR_REQUEST_TIMED_OUT :
+        case RdKafka::ERR_BROKER_NOT_AVAILABLE :
+        case RdKafka::ERR_NOT_ENOUGH_REPLICAS :
+        case RdKafka::ERR_NOT_ENOUGH_REPLICAS_AFTER_APPEND :
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * Delivery report callback - called by the drainer thread via poll()
+ *
+ * \details Transient errors replay the journal.  A message with a permanent error would fail
+ *          again, it is dropped and counted as delivered so its segment can be released.
+ */
+void KafkaJournal::DeliveryReportCallback::dr_cb(RdKafka::Message &message) {
+    uint64_t seq = (uintptr_t)message.msg_opaque();
+
+    if (message.err() != RdKafka::ERR_NO_ERROR) {
+        if (retriableError(message.err())) {
+            journal->delivery_failed = true;
+            return;
+        }
+
+        Logger *logger = journal->logger;
+        LOG_ERR("Journal message to %s can not be delivered, message dropped: %s",
+                message.topic_name().c_str(), message.errstr().c_str());
+    }
+
+    std::map<uint64_t, segment_delivery>::iterator it = journal->delivery.find(seq);
+
+    if (it != journal->delivery.end())
+        it->second.delivered++;
+}
+
+/**
+ * Create the drainer producer
+ *
+ * \return true if created, false on error
+ */
+bool KafkaJournal::createProducer() {
+    std::string errstr;
+    std::ostringstream value;
+
+    conf = RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL);
+    tconf = RdKafka::Conf::create(RdKafka::Conf::CONF_TOPIC);
+
+    event_callback = new KafkaEventCallback(&producer_connected, logger);
+    delivery_callback = new DeliveryReportCallback(this);
+    partitioner_callback = new KafkaPeerPartitionerCallback();
+
+    /*
+     * Same settings as the router producers, see msgBus_kafka::connect()
+     */
+    conf->set("log.connection.close", "false", errstr);
+    conf->set("api.version.request", "true", errstr);
+    conf->set("batch.num.messages", "100", errstr);
+
+    value.str(""); value << cfg->q_buf_max_ms;
+    conf->set("queue.buffering.max.ms", value.str(), errstr);
+
+    value.str(""); value << cfg->q_buf_max_msgs;
+    conf->set("queue.buffering.max.messages", value.str(), errstr);
+
+    value.str(""); value << cfg->q_buf_max_kbytes;
+    conf->set("queue.buffering.max.kbytes", value.str(), errstr);
+
+    value.str(""); value << cfg->tx_max_bytes;
+    conf->set("message.max.bytes", value.str(), errstr);
+
+    value.str(""); value << cfg->msg_send_max_retry;
+    conf->set("message.send.max.retries", value.str(), errstr);
+
+    value.str(""); value << cfg->retry_backoff_ms;
+    conf->set("retry.backoff.ms", value.str(), errstr);
+
+    conf->set("compression.codec", cfg->compression, errstr);
+
+    if (conf->set("metadata.broker.list", cfg->kafka_brokers, errstr) != RdKafka::Conf::CONF_OK or
+        conf->set("event_cb", event_callback, errstr) != RdKafka::Conf::CONF_OK or
+        conf->set("dr_cb", delivery_callback, errstr) != RdKafka::Conf::CONF_OK or
+        tconf->set("partitioner_cb", partitioner_callback, errstr) != RdKafka::Conf::CONF_OK) {
+
+        LOG_ERR("Failed to configure journal producer: %s", errstr.c_str());
+
+    } else if ((producer = RdKafka::Producer::create(conf, errstr)) == NULL) {
+        LOG_ERR("Failed to create journal producer: %s", errstr.c_str());
+
+    } else {
+        producer_connected = true;
+        return true;
+    }
+
+    delete conf;                    conf = NULL;
+    delete tconf;                   tconf = NULL;
+    delete event_callback;          event_callback = NULL;
+    delete delivery_callback;       delivery_callback = NULL;
+    delete partitioner_callback;    partitioner_callback = NULL;
+
+    return false;
+}
+
+/**
+ * Get (or create) the drainer topic by name
+ *
+ * \param [in] name     Topic name
+ *
+ * \return topic pointer or NULL on error
+ */
+RdKafka::Topic *KafkaJournal::getTopic(const std::string &name) {
+    std::map<std::string, RdKafka::Topic *>::iterator it = topics.find(name);
+
+    if (it != topics.end())
+        return it->second;
+
+    std::string errstr;
+    RdKafka::Topic *topic = RdKafka::Topic::create(producer, name, tconf, errstr);
+
+    if (topic == NULL) {
+        LOG_ERR("Failed to create journal topic '%s': %s", name.c_str(), errstr.c_str());
+        return NULL;
+    }
+
+    topics[name] = topic;
+    return topic;
+}
+
+/**
+ * Open a new segment for writing, closing the current one. Caller must hold the mutex.
+ *
+ * \return true if opened, false on error
+ */
+bool KafkaJournal::openSegment() {
+    if (write_fd >= 0) {
+        fdatasync(write_fd);
+        close(write_fd);
+        write_fd = -1;
+        write_dirty = false;
+        segments.back().closed = true;
+    }
+
+    segment seg;
+    seg.seq     = ++last_seq;
+    seg.size    = 0;
+    seg.closed  = false;
+
+    std::string filename = segmentFilename(seg.seq);
+
+    if ((write_fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644)) < 0) {
+        LOG_ERR("Unable to create journal segment %s: %s", filename.c_str(), strerror(errno));
+        return false;
+    }
+
+    SELF_DEBUG("Opened journal segment %s", filename.c_str());
+    segments.push_back(seg);
+
+    return true;
+}
+
+/**
+ * Load existing segments from the journal directory
+ */
+void KafkaJournal::loadSegments() {
+    DIR *dir;
+    struct dirent *entry;
+    struct stat st;
+    std::map<uint64_t, uint64_t> found;             // Segments sorted by seq, value is size
+
+    if ((dir = opendir(directory.c_str())) == NULL) {
+        LOG_ERR("Unable to open journal directory %s: %s", directory.c_str(), strerror(errno));
+        throw "ERROR: Unable to open journal directory";
+    }
+
+    size_t prefix_len = strlen(JOURNAL_SEGMENT_PREFIX);
+    size_t suffix_len = strlen(JOURNAL_SEGMENT_SUFFIX);
+
+    while ((entry = readdir(dir)) != NULL) {
+        std::string name(entry->d_name);
+
+        if (name.size() <= prefix_len + suffix_len or name.compare(0, prefix_len, JOURNAL_SEGMENT_PREFIX) or
+                name.compare(name.size() - suffix_len, suffix_len, JOURNAL_SEGMENT_SUFFIX))
+            continue;
+
+        uint64_t seq = strtoull(name.c_str() + prefix_len, NULL, 10);
+
+        if (seq > 0 and stat(segmentFilename(seq).c_str(), &st) == 0)
+            found[seq] = st.st_size;
+    }
+
+    closedir(dir);
+
+    // Only the last segment was being written, a crash can leave a partial record at its end
+    if (found.size() > 0)
+        found.rbegin()->second = recoverSegment(found.rbegin()->first, found.rbegin()->second);
+
+    for (std::map<uint64_t, uint64_t>::iterator it = found.begin(); it != found.end(); ++it) {
+        segment seg;
+        seg.seq     = it->first;
+        seg.size    = it->second;
+        seg.closed  = true;
+
+        segments.push_back(seg);
+        total_size += seg.size;
+        last_seq = seg.seq;
+    }
+
+    if (segments.size() > 0) {
+        has_pending = true;
+        LOG_INFO("Journal has %" PRIu64 " bytes in %lu segments from a previous run, replaying",
+                 total_size, segments.size());
+    }
+}
+
+/**
+ * Truncate a partial record left at the end of a segment by a crash
+ *
+ * \param [in] seq      Segment sequence number
+ * \param [in] size     Size of the segment file
+ *
+ * \return size of the segment without the partial record
+ */
+uint64_t KafkaJournal::recoverSegment(uint64_t seq, uint64_t size) {
+    rec_hdr hdr;
+    uint64_t offset = 0;
+    int fd;
+
+    if ((fd = open(segmentFilename(seq).c_str(), O_RDWR)) < 0) {
+        LOG_ERR("Unable to open journal segment %s: %s", segmentFilename(seq).c_str(), strerror(errno));
+        return size;
+    }
+
+    while (offset < size) {
+        if (offset + sizeof(hdr) > size or pread(fd, &hdr, sizeof(hdr), offset) != sizeof(hdr))
+            break;
+
+        // Corruption is not a crash, it is skipped when read
+        if (hdr.magic != JOURNAL_REC_MAGIC) {
+            offset = size;
+            break;
+        }
+
+        uint64_t rec_len = sizeof(hdr) + hdr.topic_len + hdr.key_len + hdr.data_len;
+
+        if (offset + rec_len > size)
+            break;
+
+        offset += rec_len;
+    }
+
+    if (offset < size) {
+        LOG_WARN("Journal segment %" PRIu64 " ends with a partial record of %" PRIu64 " bytes, truncating it",
+                 seq, size - offset);
+
+        if (ftruncate(fd, offset) != 0)
+            LOG_ERR("Unable to truncate journal segment %" PRIu64 ": %s", seq, strerror(errno));
+    }
+
+    close(fd);
+    return offset;
+}
+
+/**
+ * Get the segment filename
+ *
+ * \param [in] seq      Segment sequence number
+ *
+ * \return full path of the segment file
+ */
+std::string KafkaJournal::segmentFilename(uint64_t seq) {
+    char name[64];
+
+    snprintf(name, sizeof(name), "/%s%020" PRIu64 "%s", JOURNAL_SEGMENT_PREFIX, seq, JOURNAL_SEGMENT_SUFFIX);
+
+    return directory + name;
+}
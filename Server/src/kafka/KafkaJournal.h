@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef OPENBMP_KAFKAJOURNAL_H
+#define OPENBMP_KAFKAJOURNAL_H
+
+#include <string>
+#include <list>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include <librdkafka/rdkafkacpp.h>
+
+#include "Config.h"
+#include "Logger.h"
+#include "KafkaEventCallback.h"
+#include "KafkaPeerPartitionerCallback.h"
+
+/**
+ * \class   KafkaJournal
+ *
+ * \brief   Local write-ahead journal for kafka messages
+ * \details Messages are appended to segment files when kafka is unavailable or the producer queue
+ *          is full.  A drainer thread replays the journal in order, using its own producer, and
+ *          removes a segment once all of its messages have been delivered.
+ *
+ *          Delivery is at-least-once.  If a delivery fails with a transient error, the journal is
+ *          replayed from the oldest undelivered segment.  Messages that fail with a permanent error
+ *          (e.g. too large) are logged and dropped.  Segments left over from a previous run are
+ *          replayed on startup.
+ */
+class KafkaJournal {
+public:
+    #define JOURNAL_SEGMENT_PREFIX      "journal."
+    #define JOURNAL_SEGMENT_SUFFIX      ".log"
+    #define JOURNAL_REC_MAGIC           0x4f424a31          ///< "OBJ1"
+    #define JOURNAL_READ_BUF_SIZE       (4 * 1024 * 1024)   ///< Largest record, larger messages are not journaled
+    #define JOURNAL_RETRY_INTERVAL      5                   ///< Seconds to wait before replaying after a failure
+
+    /*********************************************************************//**
+     * Constructor for class
+     *
+     * \details Loads existing segments and starts the drainer thread
+     *
+     * \param [in] logPtr   Pointer to Logger instance
+     * \param [in] cfg      Pointer to the config instance
+     ***********************************************************************/
+    KafkaJournal(Logger *logPtr, Config *cfg);
+
+    /*********************************************************************//**
+     * Destructor for class - Stops the drainer. Undelivered segments are kept for the next run
+     ***********************************************************************/
+    ~KafkaJournal();
+
+    /*********************************************************************//**
+     * Append message to the journal
+     *
+     * \param [in] topic_name   Kafka topic name (resolved name, not the topic var)
+     * \param [in] key          Message key
+     * \param [in] data         Message data (headers and payload)
+     * \param [in] len          Length of the data in bytes
+     *
+     * \return true if journaled, false if the journal is full, the message is too large or on error
+     ***********************************************************************/
+    bool append(const std::string &topic_name, const std::string &key, const unsigned char *data, size_t len);
+
+    /*********************************************************************//**
+     * Check if the journal has messages that have not been delivered yet
+     *
+     * \details While pending, messages should be appended to the journal instead of being
+     *          produced directly so that the order is maintained.
+     *
+     * \return true if pending, false if the journal is empty
+     ***********************************************************************/
+    inline bool pending() {
+        return has_pending;
+    }
+
+private:
+    /**
+     * Journal record header - followed by the topic name, key and data
+     */
+    struct rec_hdr {
+        uint32_t    magic;                      ///< JOURNAL_REC_MAGIC
+        uint32_t    crc;                        ///< crc32 of the topic name, key and data
+        uint16_t    topic_len;                  ///< Length of the topic name
+        uint16_t    key_len;                    ///< Length of the key
+        uint32_t    data_len;                   ///< Length of the data
+    } __attribute__ ((__packed__));
+
+    /**
+     * Journal segment file
+     */
+    struct segment {
+        uint64_t    seq;                        ///< Segment sequence number, part of the filename
+        uint64_t    size;                       ///< Bytes written to the segment
+        bool        closed;                     ///< Indicates no more records will be appended
+    };
+
+    /**
+     * Delivery state of a segment being replayed (drainer thread only)
+     */
+    struct segment_delivery {
+        uint64_t    produced;                   ///< Number of records produced
+        uint64_t    delivered;                  ///< Number of records delivered
+        bool        read_done;                  ///< Indicates all records have been produced
+    };
+
+    /**
+     * Delivery report callback for the drainer producer
+     */
+    class DeliveryReportCallback : public RdKafka::DeliveryReportCb {
+    public:
+        DeliveryReportCallback(KafkaJournal *journal) : journal(journal) { }
+        void dr_cb(RdKafka::Message &message);
+
+    private:
+        KafkaJournal *journal;
+    };
+
+    Config          *cfg;                       ///< Configuration instance
+    Logger          *logger;                    ///< Logging class pointer
+    bool            debug;                      ///< debug flag to indicate debugging
+
+    std::string     directory;                  ///< Journal directory
+    uint64_t        segment_size;               ///< Max segment size in bytes
+    uint64_t        max_size;                   ///< Max journal size in bytes, zero is unlimited
+
+    std::mutex      mutex;                      ///< Protects the append side below
+    std::list<segment> segments;                ///< Segments on disk, oldest first
+    uint64_t        last_seq;                   ///< Last segment sequence number used
+    uint64_t        total_size;                 ///< Total bytes in all segments
+    int             write_fd;                   ///< File descriptor of the last segment, -1 if not open
+    bool            write_dirty;                ///< Indicates writes have not been synced to disk
+    bool            full_logged;                ///< Indicates the journal full warning has been logged
+
+    std::atomic<bool> has_pending;              ///< Indicates the journal has undelivered messages
+    std::atomic<bool> running;                  ///< Indicates the drainer should run
+
+    std::thread     *drainer_thread;            ///< Drainer thread
+
+    /*
+     * Drainer thread state
+     */
+    RdKafka::Conf     *conf;                    ///< Drainer producer configuration
+    RdKafka::Conf     *tconf;                   ///< Drainer topic configuration
+    RdKafka::Producer *producer;                ///< Drainer producer
+    KafkaEventCallback           *event_callback;
+    DeliveryReportCallback       *delivery_callback;
+    KafkaPeerPartitionerCallback *partitioner_callback;
+    bool              producer_connected;       ///< Updated by the event callback, informational only
+
+    std::map<std::string, RdKafka::Topic *> topics;         ///< Topics by name
+    std::map<uint64_t, segment_delivery>    delivery;       ///< Delivery state by segment seq
+    bool            delivery_failed;            ///< Indicates a delivery failed and a replay is needed
+
+    uint64_t        read_seq;                   ///< Segment being read
+    int             read_fd;                    ///< File descriptor of segment being read, -1 if not open
+    uint64_t        read_offset;                ///< Offset of the next record in the segment
+    unsigned char   *read_buf;                  ///< Read buffer
+
+    /**
+     * Drainer thread loop
+     */
+    void drainerLoop();
+
+    /**
+     * Produce records from the current read segment
+     *
+     * \return number of records produced
+     */
+    int drainSegment();
+
+    /**
+     * Remove delivered segments and clear pending once caught up with the writer
+     */
+    void releaseDelivered();
+
+    /**
+     * Wait for outstanding deliveries and restart the replay from the oldest segment
+     */
+    void replay();
+
+    /**
+     * Create the drainer producer
+     *
+     * \return true if created, false on error
+     */
+    bool createProducer();
+
+    /**
+     * Get (or create) the drainer topic by name
+     *
+     * \param [in] name     Topic name
+     *
+     * \return topic pointer or NULL on error
+     */
+    RdKafka::Topic *getTopic(const std::string &name);
+
+    /**
+     * Open a new segment for writing, closing the current one. Caller must hold the mutex.
+     *
+     * \return true if opened, false on error
+     */
+    bool openSegment();
+
+    /**
+     * Load existing segments from the journal directory
+     */
+    void loadSegments();
+
+    /**
+     * Truncate a partial record left at the end of a segment by a crash
+     *
+     * \param [in] seq      Segment sequence number
+     * \param [in] size     Size of the segment file
+     *
+     * \return size of the segment without the partial record
+     */
+    uint64_t recoverSegment(uint64_t seq, uint64_t size);
+
+    /**
+     * Get the segment filename
+     *
+     * \param [in] seq      Segment sequence number
+     *
+     * \return full path of the segment file
+     */
+    std::string segmentFilename(uint64_t seq);
+};
+
+
+#endif //OPENBMP_KAFKAJOURNAL_H
@@ -13,12 +13,32 @@
 #include "KafkaTopicSelector.h"
 #include "kafka/MsgBusImpl_kafka.h"
 
+/**
+ * Topic var names indexed by topic ID - order must match KafkaTopicSelector::topic_ids
+ */
+const char * const KafkaTopicSelector::topic_vars[KafkaTopicSelector::TOPIC_ID_MAX] = {
+        MSGBUS_TOPIC_VAR_COLLECTOR,
+        MSGBUS_TOPIC_VAR_ROUTER,
+        MSGBUS_TOPIC_VAR_PEER,
+        MSGBUS_TOPIC_VAR_BASE_ATTRIBUTE,
+        MSGBUS_TOPIC_VAR_UNICAST_PREFIX,
+        MSGBUS_TOPIC_VAR_L3VPN,
+        MSGBUS_TOPIC_VAR_EVPN,
+        MSGBUS_TOPIC_VAR_LS_NODE,
+        MSGBUS_TOPIC_VAR_LS_LINK,
+        MSGBUS_TOPIC_VAR_LS_PREFIX,
+        MSGBUS_TOPIC_VAR_BMP_STAT,
+        MSGBUS_TOPIC_VAR_BMP_RAW,
+        MSGBUS_TOPIC_VAR_FLAP,
+        MSGBUS_TOPIC_VAR_PEER_STATS
+};
+
 /*********************************************************************//**
  * Constructor for class
  *
  * \param [in] logPtr   Pointer to Logger instance
  * \param [in] cfg      Pointer to the config instance
- * \param [in] producer Pointer to the kafka producer
+ * \param [in] producer Pointer to the kafka producer, NULL to only resolve topic names
  ***********************************************************************/
 KafkaTopicSelector::KafkaTopicSelector(Logger *logPtr, Config *cfg,  RdKafka::Producer *producer) {
     logger = logPtr;
@@ -35,6 +55,12 @@ KafkaTopicSelector::KafkaTopicSelector(Logger *logPtr, Config *cfg,  RdKafka::Pr
     peer_partitioner_callback = new KafkaPeerPartitionerCallback();
     tconf = RdKafka::Conf::create(RdKafka::Conf::CONF_TOPIC);
 
+    // Topics and groups come from the live settings at creation, a reload creates a new selector
+    live = cfg->getLive();
+
+    // Topic names do not change for the life of the selector, so resolve the enabled state once
+    for (int i=0; i < TOPIC_ID_MAX; i++)
+        topic_enabled[i] = topicEnabled(std::string(topic_vars[i]));
 }
 
 /*********************************************************************//**
@@ -74,16 +100,49 @@ RdKafka::Topic * KafkaTopicSelector::getTopic(const std::string &topic_var,
     topic_map::iterator t_it;
 
     if ( (t_it=topic.find(topic_key)) != topic.end()) {
-        return t_it->second;                                              // Return the existing initialized topic
+        return getTopic(t_it->second);                                    // Return the existing initialized topic
     }
     else {
         SELF_DEBUG("Requesting to create topic for key=%s", topic_key.c_str());
-        return initTopic(topic_var, router_group, peer_group, peer_asn);  // create and return newly created topic
+        return getTopic(initTopic(topic_var, router_group, peer_group, peer_asn));  // create and return new topic
     }
 
     return NULL;
 }
 
+/*********************************************************************//**
+ * Gets (resolves) the topic handle by topic ID, router and peer group.  If the topic doesn't
+ *      exist, a new entry will be initialized.
+ *
+ * \param [in]  topic_id        TOPIC_ID_<name>
+ * \param [in]  router_group    Router group - empty/NULL means no router group
+ * \param [in]  peer_group      Peer group - empty/NULL means no peer group
+ * \param [in]  peer_asn        Peer asn (remote asn)
+ *
+ * \return topic handle or TOPIC_HANDLE_UNRESOLVED if error
+ ***********************************************************************/
+int KafkaTopicSelector::getTopicHandle(int topic_id, const std::string *router_group,
+                                       const std::string *peer_group, uint32_t peer_asn) {
+
+    if (topic_id < 0 or topic_id >= TOPIC_ID_MAX)
+        return TOPIC_HANDLE_UNRESOLVED;
+
+    std::string topic_var = topic_vars[topic_id];
+
+    // Update the topic key based on the peer_group/router_group
+    std::string topic_key = getTopicKey(topic_var, router_group, peer_group, peer_asn);
+
+    topic_map::iterator t_it;
+
+    if ( (t_it=topic.find(topic_key)) != topic.end()) {
+        return t_it->second;                                              // Return the existing topic handle
+    }
+    else {
+        SELF_DEBUG("Requesting to create topic for key=%s", topic_key.c_str());
+        return initTopic(topic_var, router_group, peer_group, peer_asn);  // create and return new topic handle
+    }
+}
+
 /*********************************************************************//**
  * Check if a topic is enabled
  *
@@ -92,7 +151,7 @@ RdKafka::Topic * KafkaTopicSelector::getTopic(const std::string &topic_var,
  * \return bool true if the topic is enabled, false otherwise
 ***********************************************************************/
 bool KafkaTopicSelector::topicEnabled(const std::string &topic_var) {
-    return this->cfg->topic_names_map[topic_var].length() > 0;
+    return live->topicName(topic_var).length() > 0;
 }
 
 /*********************************************************************//**
@@ -116,11 +175,11 @@ void KafkaTopicSelector::lookupPeerGroup(std::string hostname, std::string ip_ad
     if (hostname.size() > 0) {
 
         // Loop through all groups and their regular expressions
-        for (Config::match_peer_group_by_name_iter it = cfg->match_peer_group_by_name.begin();
-            it != cfg->match_peer_group_by_name.end(); ++it) {
+        for (Config::match_peer_group_by_name_iter it = live->match_peer_group_by_name.begin();
+            it != live->match_peer_group_by_name.end(); ++it) {
 
             // loop through all regexps to see if there is a match
-            for (std::list<Config::match_type_regex>::iterator lit = it->second.begin();
+            for (std::list<Config::match_type_regex>::const_iterator lit = it->second.begin();
                     lit != it->second.end(); ++lit) {
                 if (regex_search(hostname, lit->regexp)) {
                     SELF_DEBUG("Regexp matched hostname %s to peer group '%s'",
@@ -144,11 +203,11 @@ void KafkaTopicSelector::lookupPeerGroup(std::string hostname, std::string ip_ad
     inet_pton(isIPv4 ? AF_INET : AF_INET6, ip_addr.c_str(), prefix);
 
     // Loop through all groups and their regular expressions
-    for (Config::match_peer_group_by_ip_iter it = cfg->match_peer_group_by_ip.begin();
-         it != cfg->match_peer_group_by_ip.end(); ++it) {
+    for (Config::match_peer_group_by_ip_iter it = live->match_peer_group_by_ip.begin();
+         it != live->match_peer_group_by_ip.end(); ++it) {
 
         // loop through all prefix ranges to see if there is a match
-        for (std::list<Config::match_type_ip>::iterator lit = it->second.begin();
+        for (std::list<Config::match_type_ip>::const_iterator lit = it->second.begin();
              lit != it->second.end(); ++lit) {
 
             if (lit->isIPv4 == isIPv4) { // IPv4
@@ -192,11 +251,11 @@ void KafkaTopicSelector::lookupPeerGroup(std::string hostname, std::string ip_ad
      * Match against asn list
      */
     // Loop through all groups and their regular expressions
-    for (Config::match_peer_group_by_asn_iter it = cfg->match_peer_group_by_asn.begin();
-         it != cfg->match_peer_group_by_asn.end(); ++it) {
+    for (Config::match_peer_group_by_asn_iter it = live->match_peer_group_by_asn.begin();
+         it != live->match_peer_group_by_asn.end(); ++it) {
 
         // loop through all prefix ranges to see if there is a match
-        for (std::list<uint32_t>::iterator lit = it->second.begin();
+        for (std::list<uint32_t>::const_iterator lit = it->second.begin();
              lit != it->second.end(); ++lit) {
 
             if (*lit == peer_asn) {
@@ -231,11 +290,11 @@ void KafkaTopicSelector::lookupRouterGroup(std::string hostname, std::string ip_
     if (hostname.size() > 0) {
 
         // Loop through all groups and their regular expressions
-        for (Config::match_router_group_by_name_iter it = cfg->match_router_group_by_name.begin();
-             it != cfg->match_router_group_by_name.end(); ++it) {
+        for (Config::match_router_group_by_name_iter it = live->match_router_group_by_name.begin();
+             it != live->match_router_group_by_name.end(); ++it) {
 
             // loop through all regexps to see if there is a match
-            for (std::list<Config::match_type_regex>::iterator lit = it->second.begin();
+            for (std::list<Config::match_type_regex>::const_iterator lit = it->second.begin();
                  lit != it->second.end(); ++lit) {
 
                 if (regex_search(hostname, lit->regexp)) {
@@ -260,11 +319,11 @@ void KafkaTopicSelector::lookupRouterGroup(std::string hostname, std::string ip_
     inet_pton(isIPv4 ? AF_INET : AF_INET6, ip_addr.c_str(), prefix);
 
     // Loop through all groups and their regular expressions
-    for (Config::match_router_group_by_ip_iter it = cfg->match_router_group_by_ip.begin();
-         it != cfg->match_router_group_by_ip.end(); ++it) {
+    for (Config::match_router_group_by_ip_iter it = live->match_router_group_by_ip.begin();
+         it != live->match_router_group_by_ip.end(); ++it) {
 
         // loop through all prefix ranges to see if there is a match
-        for (std::list<Config::match_type_ip>::iterator lit = it->second.begin();
+        for (std::list<Config::match_type_ip>::const_iterator lit = it->second.begin();
              lit != it->second.end(); ++lit) {
 
             if (lit->isIPv4 == isIPv4) { // IPv4
@@ -318,16 +377,20 @@ void KafkaTopicSelector::lookupRouterGroup(std::string hostname, std::string ip_
  * \param [in]  peer_group      Peer group - empty/NULL means no peer group
  * \param [in]  peer_asn        Peer asn (remote asn)
  *
- * \return  (RdKafka::Topic *) pointer or NULL if error
+ * \return  topic handle or TOPIC_HANDLE_UNRESOLVED if error
  */
-RdKafka::Topic * KafkaTopicSelector::initTopic(const std::string &topic_var,
-                                               const std::string *router_group, const std::string *peer_group,
-                                               uint32_t peer_asn) {
+int KafkaTopicSelector::initTopic(const std::string &topic_var,
+                                  const std::string *router_group, const std::string *peer_group,
+                                  uint32_t peer_asn) {
     std::string errstr;
     char uint32_str[12];
 
     // Get the actual topic name based on var
-    std::string topic_name = this->cfg->topic_names_map[topic_var];
+    std::string topic_name = live->topicName(topic_var);
+
+    // Disabled, messages queued before a reload disabled the topic are dropped
+    if (topic_name.size() == 0)
+        return TOPIC_HANDLE_UNRESOLVED;
 
     /*
      * topics that contain the peer asn need to have the key include the peer asn
@@ -365,13 +428,31 @@ RdKafka::Topic * KafkaTopicSelector::initTopic(const std::string &topic_var,
 
     SELF_DEBUG("Creating topic %s (map key=%s)" , topic_name.c_str(), topic_key.c_str());
 
-    // Delete topic if it already exists
+    // Reuse the handle (deleting the old topic) if it already exists, otherwise allocate a new handle
+    int handle;
     topic_map::iterator t_it;
 
-    if ( (t_it=topic.find(topic_key)) != topic.end() and t_it->second != NULL) {
-        delete t_it->second;
+    if ( (t_it=topic.find(topic_key)) != topic.end()) {
+        handle = t_it->second;
+
+        if (topic_list[handle] != NULL) {
+            delete topic_list[handle];
+            topic_list[handle] = NULL;
+        }
+
+    } else {
+        handle = topic_list.size();
+        topic_list.push_back(NULL);
+        topic_name_list.push_back(topic_name);
+        topic[topic_key] = handle;
     }
 
+    topic_name_list[handle] = topic_name;
+
+    // Without a producer only the topic name is resolved
+    if (producer == NULL)
+        return handle;
+
     /*
      * Topic configuration
      */
@@ -380,17 +461,17 @@ RdKafka::Topic * KafkaTopicSelector::initTopic(const std::string &topic_var,
         throw "ERROR: Failed to configure kafka partitioner callback";
     }
 
-    topic[topic_key] = RdKafka::Topic::create(producer, topic_name.c_str(), tconf, errstr);
+    topic_list[handle] = RdKafka::Topic::create(producer, topic_name.c_str(), tconf, errstr);
 
-    if (topic[topic_key] == NULL) {
+    if (topic_list[handle] == NULL) {
         LOG_ERR("Failed to create '%s' topic: %s", topic_name.c_str(), errstr.c_str());
         throw "ERROR: Failed to create topic";
 
     } else {
-        return topic[topic_key];
+        return handle;
     }
 
-    return NULL;
+    return TOPIC_HANDLE_UNRESOLVED;
 }
 
 /**
@@ -443,10 +524,10 @@ std::string KafkaTopicSelector::getTopicKey(const std::string &topic_var,
  */
 void KafkaTopicSelector::freeTopicMap() {
     // Free topic pointers
-    for (topic_map::iterator it = topic.begin(); it != topic.end(); it++) {
-        if (it->second) {
-            delete it->second;
-            it->second = NULL;
+    for (size_t i=0; i < topic_list.size(); i++) {
+        if (topic_list[i] != NULL) {
+            delete topic_list[i];
+            topic_list[i] = NULL;
         }
     }
 }
\ No newline at end of file
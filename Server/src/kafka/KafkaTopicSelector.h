@@ -11,6 +11,7 @@
 #define OPENBMP_KAFKATOPICSELECTOR_H
 
 #include <librdkafka/rdkafkacpp.h>
+#include <vector>
 #include "Config.h"
 #include "Logger.h"
 #include "KafkaPeerPartitionerCallback.h"
@@ -32,6 +33,8 @@ public:
     #define MSGBUS_TOPIC_LS_PREFIX              "openbmp.parsed.ls_prefix"
     #define MSGBUS_TOPIC_BMP_STAT               "openbmp.parsed.bmp_stat"
     #define MSGBUS_TOPIC_BMP_RAW                "openbmp.bmp_raw"
+    #define MSGBUS_TOPIC_FLAP                   "openbmp.parsed.flap"
+    #define MSGBUS_TOPIC_PEER_STATS             "openbmp.parsed.peer_stats"
 
     /**
      * MSGBUS_TOPIC_VAR_* defines the topic var/key for the topic maps.
@@ -49,6 +52,42 @@ public:
     #define MSGBUS_TOPIC_VAR_LS_PREFIX          "ls_prefix"
     #define MSGBUS_TOPIC_VAR_BMP_STAT           "bmp_stat"
     #define MSGBUS_TOPIC_VAR_BMP_RAW            "bmp_raw"
+    #define MSGBUS_TOPIC_VAR_FLAP               "flap"
+    #define MSGBUS_TOPIC_VAR_PEER_STATS         "peer_stats"
+
+    /**
+     * Topic ID's - Integer form of MSGBUS_TOPIC_VAR_<name>, used to index arrays instead of string maps
+     *
+     *      Order must match the topic_vars[] table
+     */
+    enum topic_ids {
+        TOPIC_ID_COLLECTOR=0,
+        TOPIC_ID_ROUTER,
+        TOPIC_ID_PEER,
+        TOPIC_ID_BASE_ATTRIBUTE,
+        TOPIC_ID_UNICAST_PREFIX,
+        TOPIC_ID_L3VPN,
+        TOPIC_ID_EVPN,
+        TOPIC_ID_LS_NODE,
+        TOPIC_ID_LS_LINK,
+        TOPIC_ID_LS_PREFIX,
+        TOPIC_ID_BMP_STAT,
+        TOPIC_ID_BMP_RAW,
+        TOPIC_ID_FLAP,
+        TOPIC_ID_PEER_STATS,
+
+        TOPIC_ID_MAX                    // Must be last - number of topic ID's
+    };
+
+    /**
+     * Topic var names indexed by topic ID (MSGBUS_TOPIC_VAR_<name>)
+     */
+    static const char * const topic_vars[TOPIC_ID_MAX];
+
+    /**
+     * Topic handle value used to indicate the handle has not been resolved yet
+     */
+    #define TOPIC_HANDLE_UNRESOLVED     -1
 
 
     /*********************************************************************//**
@@ -56,7 +95,7 @@ public:
      *
      * \param [in] logPtr   Pointer to Logger instance
      * \param [in] cfg      Pointer to the config instance
-     * \param [in] producer Pointer to the kafka producer
+     * \param [in] producer Pointer to the kafka producer, NULL to only resolve topic names
      ***********************************************************************/
     KafkaTopicSelector(Logger *logPtr, Config *cfg,  RdKafka::Producer *producer);
 
@@ -80,6 +119,51 @@ public:
                               const std::string *peer_group,
                               uint32_t peer_asn);
 
+    /*********************************************************************//**
+     * Gets (resolves) the topic handle by topic ID, router and peer group.  If the topic doesn't
+     *      exist, a new entry will be initialized.
+     *
+     * \details The returned handle is stable for the life of this instance, so callers should
+     *          resolve it once (e.g. per peer) and then use getTopic(handle) when producing.
+     *
+     * \param [in]  topic_id        TOPIC_ID_<name>
+     * \param [in]  router_group    Router group - empty/NULL means no router group
+     * \param [in]  peer_group      Peer group - empty/NULL means no peer group
+     * \param [in]  peer_asn        Peer asn (remote asn)
+     *
+     * \return topic handle or TOPIC_HANDLE_UNRESOLVED if error
+     ***********************************************************************/
+    int getTopicHandle(int topic_id, const std::string *router_group,
+                       const std::string *peer_group, uint32_t peer_asn);
+
+    /*********************************************************************//**
+     * Gets topic pointer by topic handle
+     *
+     * \param [in]  handle          Handle returned by getTopicHandle()
+     *
+     * \return (RdKafka::Topic *) pointer or NULL if invalid handle
+     ***********************************************************************/
+    inline RdKafka::Topic * getTopic(int handle) {
+        if (handle < 0 or handle >= (int)topic_list.size())
+            return NULL;
+
+        return topic_list[handle];
+    }
+
+    /*********************************************************************//**
+     * Gets the resolved topic name by topic handle
+     *
+     * \param [in]  handle          Handle returned by getTopicHandle()
+     *
+     * \return topic name or NULL if invalid handle
+     ***********************************************************************/
+    inline const std::string * getTopicName(int handle) {
+        if (handle < 0 or handle >= (int)topic_name_list.size())
+            return NULL;
+
+        return &topic_name_list[handle];
+    }
+
     /*********************************************************************//**
      * Check if a topic is enabled
      *
@@ -89,6 +173,17 @@ public:
      ***********************************************************************/
     bool topicEnabled(const std::string &topic_var);
 
+    /*********************************************************************//**
+     * Check if a topic is enabled
+     *
+     * \param [in]  topic_id        TOPIC_ID_<name>
+     *
+     * \return bool true if the topic is enabled, false otherwise
+     ***********************************************************************/
+    inline bool topicEnabled(int topic_id) {
+        return topic_id >= 0 and topic_id < TOPIC_ID_MAX and topic_enabled[topic_id];
+    }
+
     /*********************************************************************//**
      * Lookup router group
      *
@@ -116,6 +211,7 @@ public:
 
 private:
     Config          *cfg;                       ///< Configuration instance
+    Config::live_ptr live;                      ///< Live settings (mapping and topics) used by this selector
     Logger          *logger;                    ///< Logging class pointer
     bool            debug;                      ///< debug flag to indicate debugging
 
@@ -126,8 +222,10 @@ private:
     ///< Partition callback for peer
     KafkaPeerPartitionerCallback *peer_partitioner_callback;
 
+    bool            topic_enabled[TOPIC_ID_MAX];  ///< Topic enabled flags, indexed by topic ID
+
     /**
-     * Topic name to rdkafka pointer map (key=Name, value=topic pointer)
+     * Topic name to topic handle map (key=Name, value=index into topic_list)
      *
      *      Key will be MSGBUS_TOPIC_VAR_<topic>_<router_group>_<peer_group>[_<peer_asn>]
      *          Keys will not contain the optional values unless topic_flags_map includes them.
@@ -138,8 +236,11 @@ private:
      *          unicast_prefix__peergrp1_ (router group is empty but peer group is defined)
      *          unicast_prefix_routergrp1_peergroup1_ (both router and peer groups are defiend)
      */
-    typedef std::map<std::string, RdKafka::Topic *> topic_map;
-    std::map<std::string, RdKafka::Topic*> topic;
+    typedef std::map<std::string, int> topic_map;
+    std::map<std::string, int> topic;
+
+    std::vector<RdKafka::Topic *> topic_list;   ///< rdkafka topic pointers indexed by topic handle
+    std::vector<std::string> topic_name_list;   ///< Resolved topic names indexed by topic handle
 
 
     /**
@@ -165,9 +266,9 @@ private:
      * \param [in]  peer_group      Peer group - empty/NULL means no peer group
      * \param [in]  peer_asn        Peer asn (remote asn)
      *
-     * \return  (RdKafka::Topic *) pointer or NULL if error
+     * \return  topic handle or TOPIC_HANDLE_UNRESOLVED if error
      */
-    RdKafka::Topic * initTopic(const std::string &topic_var,
+    int initTopic(const std::string &topic_var,
                                const std::string *router_group, const std::string *peer_group,
                                uint32_t peer_asn);
 
@@ -17,12 +17,17 @@
 #include <unistd.h>
 
 #include <thread>
+#include <memory>
+#include <algorithm>
+#include <pthread.h>
 #include <arpa/inet.h>
 
 #include "MsgBusImpl_kafka.h"
 #include "KafkaEventCallback.h"
 #include "KafkaDeliveryReportCallback.h"
 #include "KafkaTopicSelector.h"
+#include "LatencyTrace.h"
+#include "AttrTable.h"
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -33,6 +38,99 @@
 
 using namespace std;
 
+KafkaJournal *msgBus_kafka::journal         = NULL;
+int           msgBus_kafka::journal_refs    = 0;
+std::mutex    msgBus_kafka::journal_mutex;
+
+WorkerPool   *msgBus_kafka::encode_pool         = NULL;
+int           msgBus_kafka::encode_pool_refs    = 0;
+std::mutex    msgBus_kafka::encode_pool_mutex;
+
+/**
+ * Working buffer of the calling encode thread
+ */
+static char *encodeBuffer() {
+    static thread_local std::unique_ptr<char[]> buf(new char[MSGBUS_WORKING_BUF_SIZE]);
+
+    return buf.get();
+}
+
+/**
+ * Unicast prefix message encoded by the encode pool
+ */
+struct msgBus_kafka::unicast_prefix_task : public WorkerPool::Task {
+    msgBus_kafka                *mbus;
+    obj_bgp_peer                peer;
+    std::vector<obj_rib>        rib;
+    obj_path_attr               attr;
+    bool                        has_attr;
+    unicast_prefix_action_code  code;
+    uint64_t                    seq;
+    std::string                 rtr_ip;
+    uint64_t                    trace;
+
+    void run() {
+        char *buf = encodeBuffer();
+        char headers[256];
+        string p_hash_str;
+
+        size_t len = mbus->encodeUnicastPrefix(buf, peer, rib, has_attr ? &attr : NULL, code, seq, rtr_ip);
+        if (trace != 0)
+            LatencyTrace::record(LatencyTrace::STAGE_ENCODED, trace);
+
+        size_t hdr_len = mbus->prepHeaders(headers, sizeof(headers), KafkaTopicSelector::TOPIC_ID_UNICAST_PREFIX,
+                                           len, rib.size());
+
+        hash_toStr(peer.hash_id, p_hash_str);
+        mbus->queueMessage(KafkaTopicSelector::TOPIC_ID_UNICAST_PREFIX, p_hash_str, &p_hash_str, peer.peer_as,
+                           false, headers, hdr_len, buf, len, trace);
+        mbus->encodeDone();
+    }
+};
+
+/**
+ * L3VPN message encoded by the encode pool
+ */
+struct msgBus_kafka::l3vpn_task : public WorkerPool::Task {
+    msgBus_kafka                *mbus;
+    obj_bgp_peer                peer;
+    std::vector<obj_vpn>        vpn;
+    obj_path_attr               attr;
+    bool                        has_attr;
+    vpn_action_code             code;
+    uint64_t                    seq;
+    std::string                 rtr_ip;
+    uint64_t                    trace;
+
+    void run() {
+        char *buf = encodeBuffer();
+        char headers[256];
+        string p_hash_str;
+
+        size_t len = mbus->encodeL3Vpn(buf, peer, vpn, has_attr ? &attr : NULL, code, seq, rtr_ip);
+        if (trace != 0)
+            LatencyTrace::record(LatencyTrace::STAGE_ENCODED, trace);
+
+        size_t hdr_len = mbus->prepHeaders(headers, sizeof(headers), KafkaTopicSelector::TOPIC_ID_L3VPN,
+                                           len, vpn.size());
+
+        hash_toStr(peer.hash_id, p_hash_str);
+        mbus->queueMessage(KafkaTopicSelector::TOPIC_ID_L3VPN, p_hash_str, &p_hash_str, peer.peer_as,
+                           false, headers, hdr_len, buf, len, trace);
+        mbus->encodeDone();
+    }
+};
+
+/**
+ * Encode pool shard for a peer, keeps the messages of a peer on the same encode thread
+ */
+static inline uint32_t peerShard(const MsgBusInterface::obj_bgp_peer &peer) {
+    uint32_t shard;
+    memcpy(&shard, peer.hash_id, sizeof(shard));
+
+    return shard;
+}
+
 /******************************************************************//**
  * \brief This function will initialize and connect to Kafka.
  *
@@ -42,8 +140,21 @@ using namespace std;
  *  \param [in] cfg         Pointer to the config instance
  *  \param [in] c_hash_id   Collector Hash ID
  ********************************************************************/
-msgBus_kafka::msgBus_kafka(Logger *logPtr, Config *cfg, u_char *c_hash_id) {
+msgBus_kafka::msgBus_kafka(Logger *logPtr, Config *cfg, u_char *c_hash_id)
+        : msgBus_kafka(logPtr, cfg, c_hash_id, true) {
+}
+
+/******************************************************************//**
+ * \brief Constructor for derived classes
+ *
+ *  \param [in] logPtr      Pointer to Logger instance
+ *  \param [in] cfg         Pointer to the config instance
+ *  \param [in] c_hash_id   Collector Hash ID
+ *  \param [in] use_kafka   True to create the kafka producer and connect
+ ********************************************************************/
+msgBus_kafka::msgBus_kafka(Logger *logPtr, Config *cfg, u_char *c_hash_id, bool use_kafka) {
     logger = logPtr;
+    this->use_kafka = use_kafka;
 
     producer_buf = new unsigned char[MSGBUS_WORKING_BUF_SIZE];
     prep_buf = new char[MSGBUS_WORKING_BUF_SIZE];
@@ -51,7 +162,12 @@ msgBus_kafka::msgBus_kafka(Logger *logPtr, Config *cfg, u_char *c_hash_id) {
     hash_toStr(c_hash_id, collector_hash);
 
     isConnected = false;
-    conf = RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL);
+    last_connect = 0;
+    send_trace = 0;
+
+    outq_high = cfg->q_buf_max_msgs * cfg->buf_high_watermark / 100;
+    outq_low  = cfg->q_buf_max_msgs * cfg->buf_low_watermark / 100;
+    conf = NULL;
 
     disableDebug();
 
@@ -68,18 +184,60 @@ msgBus_kafka::msgBus_kafka(Logger *logPtr, Config *cfg, u_char *c_hash_id) {
     ls_link_seq         = 0L;
     ls_prefix_seq       = 0L;
     bmp_stat_seq        = 0L;
+    flap_seq            = 0L;
+    peer_stats_seq      = 0L;
 
     this->cfg           = cfg;
 
+    // Outputs follow the live settings, they are applied again on a reload
+    applyLiveSettings();
+
+    // Encode pool is shared by all instances, first instance creates it
+    pipeline            = cfg->encode_threads > 0;
+    produce_queue       = NULL;
+    produce_thr         = NULL;
+    encode_pending      = 0;
+    produce_inflight    = 0;
+    last_queue_fill     = 0;
+
+    if (pipeline) {
+        std::lock_guard<std::mutex> lock(encode_pool_mutex);
+
+        if (encode_pool == NULL)
+            encode_pool = new WorkerPool(logger, "encode", cfg->encode_threads, cfg->pipeline_queue_size,
+                                         cfg->encode_cpus);
+
+        encode_pool_refs++;
+    }
+
     // Make the connection to the server
     event_callback       = NULL;
     delivery_callback    = NULL;
     producer             = NULL;
     topicSel             = NULL;
+    topic_handle_gen     = 1;
 
     router_ip.assign("");
     bzero(router_hash, sizeof(router_hash));
 
+    if (not use_kafka)
+        return;
+
+    conf = RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL);
+
+    // Delivery reports are kept across reconnects, freed by the destructor
+    delivery_callback = new KafkaDeliveryReportCallback(this);
+
+    // Journal is shared by all instances, first instance creates it
+    if (cfg->journal_dir.size() > 0) {
+        std::lock_guard<std::mutex> lock(journal_mutex);
+
+        if (journal == NULL)
+            journal = new KafkaJournal(logger, cfg);
+
+        journal_refs++;
+    }
+
     connect();
 }
 
@@ -90,7 +248,47 @@ msgBus_kafka::~msgBus_kafka() {
 
     SELF_DEBUG("Destory msgBus Kafka instance");
 
-    // Disconnect/term the router if not already done
+    termRouter();
+
+    if (use_kafka)
+        sleep(2);
+
+    delete [] producer_buf;
+    delete [] prep_buf;
+
+    peer_list.clear();
+
+    disconnect(use_kafka ? 500 : 0);
+
+    if (conf != NULL)
+        delete conf;
+
+    if (delivery_callback != NULL)
+        delete delivery_callback;
+
+    if (use_kafka and cfg->journal_dir.size() > 0) {
+        std::lock_guard<std::mutex> lock(journal_mutex);
+
+        if (--journal_refs <= 0 and journal != NULL) {
+            delete journal;
+            journal = NULL;
+        }
+    }
+
+    if (cfg->encode_threads > 0) {
+        std::lock_guard<std::mutex> lock(encode_pool_mutex);
+
+        if (--encode_pool_refs <= 0 and encode_pool != NULL) {
+            delete encode_pool;
+            encode_pool = NULL;
+        }
+    }
+}
+
+/**
+ * Send the router term message if the router is still defined
+ */
+void msgBus_kafka::termRouter() {
     MsgBusInterface::obj_router r_object;
     bool router_defined = false;
     for (int i=0; i < sizeof(router_hash); i++) {
@@ -111,16 +309,8 @@ msgBus_kafka::~msgBus_kafka() {
         update_Router(r_object, msgBus_kafka::ROUTER_ACTION_TERM);
     }
 
-    sleep(2);
-
-    delete [] producer_buf;
-    delete [] prep_buf;
-
-    peer_list.clear();
-
-    disconnect(500);
-
-    delete conf;
+    // Queued messages must be sent while send() is still valid
+    stopPipeline();
 }
 
 /**
@@ -128,7 +318,7 @@ msgBus_kafka::~msgBus_kafka() {
  */
 void msgBus_kafka::disconnect(int wait_ms) {
 
-    if (isConnected) {
+    if (isConnected and producer != NULL) {
         int i = 0;
         while (producer->outq_len() > 0 and i < 8) {
             LOG_INFO("Waiting for producer to finish before disconnecting: outq=%d", producer->outq_len());
@@ -150,9 +340,6 @@ void msgBus_kafka::disconnect(int wait_ms) {
     if (event_callback != NULL) delete event_callback;
     event_callback = NULL;
 
-    if (delivery_callback != NULL) delete delivery_callback;
-    delivery_callback = NULL;
-
     isConnected = false;
 }
 
@@ -312,39 +499,45 @@ void msgBus_kafka::connect() {
         throw "ERROR: Failed to configure kafka event callback";
     }
 
-    // Register delivery report callback
-    /*
-    delivery_callback = new KafkaDeliveryReportCallback();
-
+    // Register delivery report callback, counts produce errors and records sampled delivery latency
     if (conf->set("dr_cb", delivery_callback, errstr) != RdKafka::Conf::CONF_OK) {
         LOG_ERR("Failed to configure kafka delivery report callback: %s", errstr.c_str());
         throw "ERROR: Failed to configure kafka delivery report callback";
     }
-    */
 
 
-    // Create producer and connect
+    /*
+     * Create producer and connect
+     *      The librdkafka threads inherit the affinity of the thread creating the producer, so the
+     *      calling thread is pinned to the kafka cpus while it is created.
+     */
+    cpu_set_t prev_cpus;
+    bool pinned = CPU_COUNT(&cfg->kafka_cpus) > 0 and
+                  pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &prev_cpus) == 0 and
+                  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cfg->kafka_cpus) == 0;
+
     producer = RdKafka::Producer::create(conf, errstr);
+
+    if (pinned)
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &prev_cpus);
+
     if (producer == NULL) {
         LOG_ERR("rtr=%s: Failed to create producer: %s", router_ip.c_str(), errstr.c_str());
         throw "ERROR: Failed to create producer";
     }
 
     isConnected = true;
+    last_connect = time(NULL);
 
     producer->poll(1000);
 
-    if (not isConnected) {
-        LOG_ERR("rtr=%s: Failed to connect to Kafka, will try again in a few", router_ip.c_str());
-        return;
-
-    }
-
     /*
      * Initialize the topic selector/handler
+     *      Done even if not connected so topic names can be resolved for the journal
      */
     try {
         topicSel = new KafkaTopicSelector(logger, cfg, producer);
+        topic_handle_gen++;                 // Handles from the previous selector are no longer valid
 
     } catch (char const *str) {
         LOG_ERR("rtr=%s: Failed to create one or more topics, will try again in a few: err=%s", router_ip.c_str(), str);
@@ -352,24 +545,376 @@ void msgBus_kafka::connect() {
         return;
     }
 
+    if (not isConnected) {
+        LOG_ERR("rtr=%s: Failed to connect to Kafka, will try again in a few", router_ip.c_str());
+        return;
+    }
+
     producer->poll(100);
 }
 
 /**
  * produce message to Kafka
  *
- * \param [in] topic_var     Topic var to use in KafkaTopicSelector::getTopic() MSGBUS_TOPIC_VAR_*
+ * \param [in] topic_id      Topic ID, KafkaTopicSelector::TOPIC_ID_*
  * \param [in] msg           message to produce
  * \param [in] msg_size      Length in bytes of the message
  * \param [in] rows          Number of rows
+ * \param [in] key           Hash key - the peer hash string for peer topics
+ * \param [in] peer          Peer - NULL if not a peer topic
+ * \param [in] peer_down     True to remove the peer topic info after the message
+ * \param [in] trace         Latency trace of the message, zero if not traced
+ */
+void msgBus_kafka::produce(int topic_id, char *msg, size_t msg_size, int rows, const string &key,
+                           obj_bgp_peer *peer, bool peer_down, uint64_t trace) {
+    size_t len;
+
+    checkReload();
+
+    // Rows of the peer still being encoded are sent before its down message
+    if (peer_down and pipeline)
+        waitEncode();
+
+    // if topic is disabled, don't bother producing the message
+    //    update_* methods check outputs before encoding, this catches the ones that must run (e.g. peer cache)
+    if (not topic_enabled[topic_id]) {
+        if (peer_down and pipeline) {
+            reserveProduce();
+            queueMessage(topic_id, key, &key, peer->peer_as, true, NULL, 0, NULL, 0);
+
+        } else if (peer_down)
+            peer_list.erase(key);
+
+        return;
+    }
+
+    char headers[256];
+    len = prepHeaders(headers, sizeof(headers), topic_id, msg_size, rows);
+
+    if (pipeline) {
+        reserveProduce();
+        queueMessage(topic_id, key, peer != NULL ? &key : NULL, peer != NULL ? peer->peer_as : 0, peer_down,
+                     headers, len, msg, msg_size, trace);
+        return;
+    }
+
+    checkConnection();
+
+    memcpy(producer_buf, headers, len);
+    memcpy(producer_buf+len, msg, msg_size);
+
+    send_trace = trace;
+    send(topic_id, peer != NULL ? getPeerTopicInfo(key, peer->peer_as) : NULL, producer_buf, msg_size + len, key);
+    send_trace = 0;
+
+    if (peer_down)
+        peer_list.erase(key);
+}
+
+/**
+ * Message bus API headers for a message
+ *
+ * \param [out] buf          Buffer for the headers
+ * \param [in]  size         Size of buf
+ * \param [in]  topic_id     Topic ID, KafkaTopicSelector::TOPIC_ID_*
+ * \param [in]  msg_size     Length in bytes of the message
+ * \param [in]  rows         Number of rows in the message
+ *
+ * \return length of the headers
+ */
+size_t msgBus_kafka::prepHeaders(char *buf, size_t size, int topic_id, size_t msg_size, int rows) {
+    return snprintf(buf, size, "V: %s\nC_HASH_ID: %s\nT: %s\nL: %lu\nR: %d\n\n",
+            MSGBUS_API_VERSION, collector_hash.c_str(), KafkaTopicSelector::topic_vars[topic_id], msg_size, rows);
+}
+
+/**
+ * Queue a message for the producer thread without blocking
+ *
+ * \details reserveProduce() must have been called by the router thread for the message.
+ *
+ * \param [in] topic_id      Topic ID, KafkaTopicSelector::TOPIC_ID_*
  * \param [in] key           Hash key
- * \param [in] peer_group    Peer group name - empty/NULL if not set or used
+ * \param [in] peer_hash     Peer hash string - NULL if not a peer topic
  * \param [in] peer_asn      Peer ASN
+ * \param [in] peer_down     True to remove the peer topic info after sending
+ * \param [in] hdr           Message headers
+ * \param [in] hdr_len       Length of the headers
+ * \param [in] msg           Message payload
+ * \param [in] msg_len       Length of the payload
+ * \param [in] trace         Latency trace of the message, zero if not traced
  */
-void msgBus_kafka::produce(const char *topic_var, char *msg, size_t msg_size, int rows, string key,
-                           const string *peer_group, uint32_t peer_asn) {
-    size_t len;
-    RdKafka::Topic *topic = NULL;
+void msgBus_kafka::queueMessage(int topic_id, const std::string &key, const std::string *peer_hash, uint32_t peer_asn,
+                                bool peer_down, const char *hdr, size_t hdr_len, const char *msg, size_t msg_len,
+                                uint64_t trace) {
+    produce_msg *p_msg = new produce_msg;
+
+    p_msg->topic_id = topic_id;
+    p_msg->key = key;
+    p_msg->peer_asn = peer_asn;
+    p_msg->peer_down = peer_down;
+    p_msg->trace = trace;
+
+    if (peer_hash != NULL)
+        p_msg->peer_hash = *peer_hash;
+
+    if (hdr_len > 0) {
+        p_msg->data.reserve(hdr_len + msg_len);
+        p_msg->data.append(hdr, hdr_len);
+        p_msg->data.append(msg, msg_len);
+    }
+
+    // The slot was reserved by reserveProduce(), an encode worker never blocks on a router's queue
+    if (produce_queue->pushBulk(&p_msg, 1) != 1) {
+        LOG_ERR("rtr=%s: Producer queue is closed, dropped message for topic %s", router_ip.c_str(),
+                KafkaTopicSelector::topic_vars[topic_id]);
+        delete p_msg;
+
+        produce_inflight--;
+        notifyPipeline();
+
+        if (metrics != NULL)
+            metrics->produce_errors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Set the outputs and enabled topics from the config live settings
+ *
+ * \details Disabled topics are skipped before any parsing or encoding work is done.  The flags are
+ *          atomic since the parse threads read them while a reload is applied.
+ */
+void msgBus_kafka::applyLiveSettings() {
+    std::lock_guard<std::mutex> lock(live_mutex);
+
+    // Generation first, a reload in between is applied again with the next message
+    live_gen = cfg->getLiveGen();
+    Config::live_ptr live = cfg->getLive();
+
+    outputs.base_attribute  = live->topicName(MSGBUS_TOPIC_VAR_BASE_ATTRIBUTE).length() > 0;
+    outputs.unicast_prefix  = live->topicName(MSGBUS_TOPIC_VAR_UNICAST_PREFIX).length() > 0;
+    outputs.l3vpn           = live->topicName(MSGBUS_TOPIC_VAR_L3VPN).length() > 0;
+    outputs.evpn            = live->topicName(MSGBUS_TOPIC_VAR_EVPN).length() > 0;
+    outputs.ls_node         = live->topicName(MSGBUS_TOPIC_VAR_LS_NODE).length() > 0;
+    outputs.ls_link         = live->topicName(MSGBUS_TOPIC_VAR_LS_LINK).length() > 0;
+    outputs.ls_prefix       = live->topicName(MSGBUS_TOPIC_VAR_LS_PREFIX).length() > 0;
+    outputs.bmp_stat        = live->topicName(MSGBUS_TOPIC_VAR_BMP_STAT).length() > 0;
+    outputs.bmp_raw         = live->topicName(MSGBUS_TOPIC_VAR_BMP_RAW).length() > 0;
+    outputs.flap            = live->topicName(MSGBUS_TOPIC_VAR_FLAP).length() > 0;
+    outputs.peer_stats      = live->topicName(MSGBUS_TOPIC_VAR_PEER_STATS).length() > 0;
+
+    for (int i=0; i < KafkaTopicSelector::TOPIC_ID_MAX; i++)
+        topic_enabled[i] = live->topicName(KafkaTopicSelector::topic_vars[i]).length() > 0;
+}
+
+/**
+ * Apply reloaded config live settings
+ *
+ * \details Called by the API methods.  A new topic selector creates the topics again and the router
+ *          and peer groups are matched again.  The producer and the BMP session are not touched.
+ */
+void msgBus_kafka::reloadLive() {
+    applyLiveSettings();
+
+    std::lock_guard<std::mutex> lock(bus_mutex);
+
+    // Group lookups only need the live settings, not the producer
+    KafkaTopicSelector lookup(logger, cfg, NULL);
+
+    if (router_ip.size() > 0) {
+        router_group_name.clear();
+        lookup.lookupRouterGroup(router_name, router_ip, router_group_name);
+    }
+
+    for (peer_list_iter it = peer_list.begin(); it != peer_list.end(); ++it) {
+        if (it->second.peer_addr.size() > 0) {
+            it->second.peer_group.clear();
+            lookup.lookupPeerGroup(it->second.hostname, it->second.peer_addr, it->second.peer_asn,
+                                   it->second.peer_group);
+        }
+    }
+
+    reloadTopics();
+    topic_handle_gen++;                     // Handles of the previous selector and groups are no longer valid
+
+    LOG_INFO("rtr=%s: Applied the reloaded mapping and topics", router_ip.c_str());
+}
+
+/**
+ * Replace the topic selector with one for the reloaded topics, called with the bus mutex held
+ */
+void msgBus_kafka::reloadTopics() {
+    if (topicSel != NULL) {
+        delete topicSel;
+        topicSel = new KafkaTopicSelector(logger, cfg, producer);
+    }
+}
+
+/**
+ * Start the producer thread if not already running
+ *
+ * \details Started by the router thread with its first message instead of in the constructor, so
+ *          the derived class is constructed before its send() can be called.
+ */
+void msgBus_kafka::startPipeline() {
+    if (produce_thr != NULL)
+        return;
+
+    produce_queue = new mpmcQueue<produce_msg *>(cfg->pipeline_queue_size);
+    produce_thr = new std::thread(&msgBus_kafka::produceLoop, this);
+    pthread_setname_np(produce_thr->native_handle(), "produce");
+
+    if (CPU_COUNT(&cfg->kafka_cpus) > 0 and
+            pthread_setaffinity_np(produce_thr->native_handle(), sizeof(cpu_set_t), &cfg->kafka_cpus) != 0)
+        LOG_WARN("rtr=%s: unable to set the producer thread cpu affinity", router_ip.c_str());
+}
+
+/**
+ * Start the pipeline and reserve a producer queue slot for a message
+ *
+ * \details Called by the router thread before a message is queued or submitted to the encode
+ *          pool.  Blocks while the router has a full producer queue of messages in flight, so a
+ *          slow producer only stalls its own router.  The encode workers are shared by all routers
+ *          and queue their messages without blocking.
+ */
+void msgBus_kafka::reserveProduce() {
+    startPipeline();
+
+    int limit = produce_queue->capacity();
+
+    if (++produce_inflight <= limit)
+        return;
+
+    std::unique_lock<std::mutex> lock(pipeline_mutex);
+    pipeline_cond.wait(lock, [this, limit] { return produce_inflight <= limit; });
+}
+
+/**
+ * Wake the router thread waiting in reserveProduce()
+ */
+void msgBus_kafka::notifyPipeline() {
+    // Taking the mutex orders the change with a waiter that just checked the condition
+    { std::lock_guard<std::mutex> lock(pipeline_mutex); }
+
+    pipeline_cond.notify_all();
+}
+
+/**
+ * Wait for the encode pool and producer thread to send the queued messages and stop the
+ *      producer thread.  Messages are sent by the caller afterwards.
+ */
+void msgBus_kafka::stopPipeline() {
+    if (not pipeline)
+        return;
+
+    waitEncode();
+
+    // Messages produced from now on are sent directly, so pipeline is cleared before the thread exits
+    pipeline = false;
+
+    if (produce_thr != NULL) {
+        produce_queue->close();
+        produce_thr->join();
+
+        delete produce_thr;
+        delete produce_queue;
+
+        produce_thr = NULL;
+        produce_queue = NULL;
+        produce_inflight = 0;
+    }
+}
+
+/**
+ * Wait for the encode pool to queue the messages submitted for this router
+ *
+ * \details Peer down and router term messages are queued directly, so they wait for the prefix
+ *          rows of the router to be queued before them.  Otherwise the producer could remove the
+ *          peer before its last rows are sent.
+ */
+void msgBus_kafka::waitEncode() {
+    std::unique_lock<std::mutex> lock(pipeline_mutex);
+    pipeline_cond.wait(lock, [this] { return encode_pending == 0; });
+}
+
+/**
+ * Count an encode task of this router as queued - encode pool only
+ *
+ * \details The count drops under the mutex, so waitEncode() can't return, and the router be
+ *          deleted, before the task is done with it.
+ */
+void msgBus_kafka::encodeDone() {
+    std::lock_guard<std::mutex> lock(pipeline_mutex);
+
+    if (--encode_pending == 0)
+        pipeline_cond.notify_all();
+}
+
+/**
+ * Producer thread loop - sends the queued messages in batches
+ *
+ * \details The bus mutex is held for each batch, so the router thread can only change the peer
+ *          and router topic info between batches.
+ */
+void msgBus_kafka::produceLoop() {
+    produce_msg *msgs[WORKER_POOL_BATCH];
+    size_t count;
+
+    while ((count = produce_queue->popBulk(msgs, WORKER_POOL_BATCH)) > 0) {
+        // The router thread only waits in reserveProduce() when it went over the capacity
+        if (produce_inflight.fetch_sub(count) > (int) produce_queue->capacity())
+            notifyPipeline();
+
+        std::lock_guard<std::mutex> lock(bus_mutex);
+
+        try {
+            checkConnection();
+
+            for (size_t i = 0; i < count; i++) {
+                produce_msg *p_msg = msgs[i];
+                peer_topic_info *p_topic = NULL;
+
+                if (p_msg->peer_hash.size() > 0)
+                    p_topic = getPeerTopicInfo(p_msg->peer_hash, p_msg->peer_asn);
+
+                // Empty message only removes the peer, the topic is disabled
+                if (p_msg->data.size() > 0) {
+                    send_trace = p_msg->trace;
+                    send(p_msg->topic_id, p_topic, (unsigned char *) &p_msg->data[0], p_msg->data.size(), p_msg->key);
+                    send_trace = 0;
+                }
+
+                // Not removed if the peer came back up before the down message was sent
+                if (p_msg->peer_down and p_topic->down)
+                    peer_list.erase(p_msg->peer_hash);
+            }
+
+        } catch (char const *str) {
+            LOG_ERR("rtr=%s: Failed to send queued messages: %s", router_ip.c_str(), str);
+        }
+
+        for (size_t i = 0; i < count; i++)
+            delete msgs[i];
+    }
+}
+
+/**
+ * Check the Kafka connection, reconnecting if needed
+ *
+ * \details Without a journal this blocks until connected.  With a journal, messages are journaled
+ *          while disconnected.  Reconnects are only attempted periodically and after the journal
+ *          has drained, which indicates the brokers are reachable again.
+ */
+void msgBus_kafka::checkConnection() {
+
+    if (journal != NULL and topicSel != NULL) {
+        if (not isConnected and not journal->pending()
+                and time(NULL) - last_connect >= MSGBUS_RECONNECT_INTERVAL) {
+            LOG_WARN("rtr=%s: Not connected to Kafka, attempting to reconnect", router_ip.c_str());
+            connect();
+        }
+
+        return;
+    }
 
     while (isConnected == false or topicSel == NULL) {
         // Do not attempt to reconnect if this is the main process (router ip is null)
@@ -384,45 +929,208 @@ void msgBus_kafka::produce(const char *topic_var, char *msg, size_t msg_size, in
 
         sleep(1);
     }
+}
 
-    // if topic is disabled, don't bother producing the message
-    // TODO: it would be more efficient to move this check to the top of the various update_* methods, but I'm not sure which parts of these methods have side-effects that need to be preserved.
-    if (!topicSel->topicEnabled(topic_var))
+/**
+ * Send a prepared message (headers and payload) to Kafka or to the journal
+ *
+ * \details Messages are journaled while Kafka is down, while the journal has pending messages
+ *          (to keep the order) and when the producer queue is full.
+ *
+ * \param [in] topic_id      Topic ID, KafkaTopicSelector::TOPIC_ID_*
+ * \param [in] p_topic       Peer topic info - NULL if not a peer topic
+ * \param [in] buf           Message buffer
+ * \param [in] len           Length of the message in bytes
+ * \param [in] key           Hash key
+ */
+void msgBus_kafka::send(int topic_id, peer_topic_info *p_topic, unsigned char *buf, size_t len,
+                        const std::string &key) {
+    RdKafka::Topic *topic = topicSel->getTopic(getTopicHandle(topic_id, p_topic));
+
+    if (topic == NULL) {
+        LOG_NOTICE("rtr=%s: failed to produce message because topic couldn't be found: topic=%s key=%s, msg size = %lu", router_ip.c_str(),
+                   KafkaTopicSelector::topic_vars[topic_id], key.c_str(), len);
+
+        if (metrics != NULL)
+            metrics->produce_errors.fetch_add(1, std::memory_order_relaxed);
         return;
+    }
 
-    char headers[256];
-    len = snprintf(headers, sizeof(headers), "V: %s\nC_HASH_ID: %s\nT: %s\nL: %lu\nR: %d\n\n",
-            MSGBUS_API_VERSION, collector_hash.c_str(), topic_var, msg_size, rows);
+    if (journal != NULL and (not isConnected or journal->pending())) {
+        if (journal->append(topic->name(), key, buf, len))
+            return;
 
-    memcpy(producer_buf, headers, len);
-    memcpy(producer_buf+len, msg, msg_size);
+        // Journal is full, fall back to waiting on Kafka
+        while (not isConnected) {
+            LOG_WARN("rtr=%s: Not connected to Kafka, attempting to reconnect", router_ip.c_str());
+            connect();
+            sleep(1);
+        }
 
+        topic = topicSel->getTopic(getTopicHandle(topic_id, p_topic));
+        if (topic == NULL)
+            return;
+    }
 
-    topic = topicSel->getTopic(topic_var, &router_group_name, peer_group, peer_asn);
-    if (topic != NULL) {
-        SELF_DEBUG("rtr=%s: Producing message: topic=%s key=%s, msg size = %lu", router_ip.c_str(),
-                   topic->name().c_str(), key.c_str(), msg_size);
+    waitForQueue();
 
-        RdKafka::ErrorCode resp = producer->produce(topic, RdKafka::Topic::PARTITION_UA,
-                                                    RdKafka::Producer::RK_MSG_COPY,
-                                                    producer_buf, msg_size + len,
-                                                    (const std::string *) &key, NULL);
-        if (resp != RdKafka::ERR_NO_ERROR) {
-            LOG_ERR("rtr=%s: Failed to produce message: %s", router_ip.c_str(), RdKafka::err2str(resp).c_str());
-            producer->poll(100);
+    if (journal != NULL and not isConnected and journal->append(topic->name(), key, buf, len))
+        return;
+
+    SELF_DEBUG("rtr=%s: Producing message: topic=%s key=%s, msg size = %lu", router_ip.c_str(),
+               topic->name().c_str(), key.c_str(), len);
+
+    RdKafka::ErrorCode resp;
+    while ((resp = producer->produce(topic, RdKafka::Topic::PARTITION_UA,
+                                     RdKafka::Producer::RK_MSG_COPY,
+                                     buf, len,
+                                     (const std::string *) &key,
+                                     (void *) (uintptr_t) send_trace)) == RdKafka::ERR__QUEUE_FULL) {
+
+        if (journal != NULL and journal->append(topic->name(), key, buf, len)) {
+            SELF_DEBUG("rtr=%s: Producer queue is full, message journaled", router_ip.c_str());
+            resp = RdKafka::ERR_NO_ERROR;
+            break;
         }
-    } else {
-        LOG_NOTICE("rtr=%s: failed to produce message because topic couldn't be found: topic=%s key=%s, msg size = %lu", router_ip.c_str(),
-                   topic_var, key.c_str(), msg_size);
+
+        // Queue is full (e.g. the kbytes limit was reached first), wait for deliveries instead of dropping
+        producer->poll(100);
+    }
+
+    if (resp != RdKafka::ERR_NO_ERROR) {
+        LOG_ERR("rtr=%s: Failed to produce message: %s", router_ip.c_str(), RdKafka::err2str(resp).c_str());
+
+        if (metrics != NULL)
+            metrics->produce_errors.fetch_add(1, std::memory_order_relaxed);
+
+        producer->poll(100);
     }
 
     producer->poll(0);
+
+    if (metrics != NULL)
+        metrics->kafka_outq.store(producer->outq_len(), std::memory_order_relaxed);
+}
+
+/**
+ * Wait for the producer queue to drain when it reaches the high watermark
+ *
+ * \details Uses hysteresis; once the high watermark is reached, messages are held until
+ *          the queue drains to the low watermark.  Each router has its own producer, so only
+ *          the router that is producing faster than Kafka accepts is throttled.
+ */
+void msgBus_kafka::waitForQueue() {
+    if (producer->outq_len() < outq_high)
+        return;
+
+    LOG_NOTICE("rtr=%s: Producer queue reached high watermark (%d), throttling", router_ip.c_str(), outq_high);
+
+    while (producer->outq_len() > outq_low) {
+        // With a journal, stop waiting if Kafka went away; the message will be journaled
+        if (journal != NULL and not isConnected)
+            break;
+
+        producer->poll(10);
+    }
+
+    LOG_INFO("rtr=%s: Producer queue drained to low watermark (%d), resuming", router_ip.c_str(), outq_low);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+int msgBus_kafka::getQueueFill() {
+    int fill = 0;
+
+    if (pipeline) {
+        std::unique_lock<std::mutex> lock(bus_mutex, std::try_to_lock);
+
+        // Producer thread holds the lock while throttled, use the last fill
+        if (not lock.owns_lock())
+            return last_queue_fill;
+
+        if (use_kafka and producer != NULL and cfg->q_buf_max_msgs > 0)
+            fill = (int)((int64_t)producer->outq_len() * 100 / cfg->q_buf_max_msgs);
+
+        if (produce_queue != NULL)
+            fill = std::max(fill, (int)(produce_queue->count() * 100 / produce_queue->capacity()));
+
+        fill = std::max(fill, encode_pool->getQueueFill());
+
+        last_queue_fill = fill;
+        return fill;
+    }
+
+    if (not use_kafka or producer == NULL or cfg->q_buf_max_msgs <= 0)
+        return 0;
+
+    return (int)((int64_t)producer->outq_len() * 100 / cfg->q_buf_max_msgs);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_kafka::handoverRouter() {
+    std::lock_guard<std::mutex> api_lock(api_mutex);
+
+    // The new process continues the router, termRouter() has nothing to send
+    bzero(router_hash, sizeof(router_hash));
+}
+
+/**
+ * Get the peer topic info by peer hash, adding a new entry if needed
+ *
+ * \param [in] p_hash_str    Peer hash string
+ * \param [in] peer_asn      Peer ASN - used if the entry is new
+ *
+ * \return Pointer to the peer topic info entry
+ */
+msgBus_kafka::peer_topic_info *msgBus_kafka::getPeerTopicInfo(const std::string &p_hash_str, uint32_t peer_asn) {
+    peer_list_iter it = peer_list.find(p_hash_str);
+
+    if (it != peer_list.end())
+        return &it->second;
+
+    peer_topic_info &p_topic = peer_list[p_hash_str];
+    p_topic.peer_asn = peer_asn;
+
+    return &p_topic;
+}
+
+/**
+ * Get the topic handle for the topic ID, resolving and caching it in the topic info if needed
+ *
+ * \param [in]     topic_id   Topic ID, KafkaTopicSelector::TOPIC_ID_*
+ * \param [in,out] p_topic    Peer topic info - NULL to use the router topic info
+ *
+ * \return topic handle or TOPIC_HANDLE_UNRESOLVED if error
+ */
+int msgBus_kafka::getTopicHandle(int topic_id, peer_topic_info *p_topic) {
+    if (p_topic == NULL)
+        p_topic = &router_topic;
+
+    // Drop handles resolved by a previous topic selector or router group
+    if (p_topic->handle_gen != topic_handle_gen) {
+        for (int i=0; i < KafkaTopicSelector::TOPIC_ID_MAX; i++)
+            p_topic->topic_handle[i] = TOPIC_HANDLE_UNRESOLVED;
+
+        p_topic->handle_gen = topic_handle_gen;
+    }
+
+    int &handle = p_topic->topic_handle[topic_id];
+
+    if (handle == TOPIC_HANDLE_UNRESOLVED)
+        handle = topicSel->getTopicHandle(topic_id, &router_group_name, &p_topic->peer_group, p_topic->peer_asn);
+
+    return handle;
 }
 
 /**
  * Abstract method Implementation - See MsgBusInterface.hpp for details
  */
 void msgBus_kafka::update_Collector(obj_collector &c_object, collector_action_code action_code) {
+    std::lock_guard<std::mutex> api_lock(api_mutex);
+
     char buf[4096]; // Misc working buffer
 
     string ts;
@@ -450,7 +1158,7 @@ void msgBus_kafka::update_Collector(obj_collector &c_object, collector_action_co
              action, collector_seq, c_object.admin_id, collector_hash.c_str(),
              c_object.routers, c_object.router_count, ts.c_str());
 
-    produce(MSGBUS_TOPIC_VAR_COLLECTOR, buf, strlen(buf), 1, collector_hash, NULL, 0);
+    produce(KafkaTopicSelector::TOPIC_ID_COLLECTOR, buf, strlen(buf), 1, collector_hash, NULL);
 
     collector_seq++;
 }
@@ -459,6 +1167,8 @@ void msgBus_kafka::update_Collector(obj_collector &c_object, collector_action_co
  * Abstract method Implementation - See MsgBusInterface.hpp for details
  */
 void msgBus_kafka::update_Router(obj_router &r_object, router_action_code code) {
+    std::lock_guard<std::mutex> api_lock(api_mutex);
+
     char buf[4096]; // Misc working buffer
 
     // Convert binary hash to string
@@ -498,7 +1208,9 @@ void msgBus_kafka::update_Router(obj_router &r_object, router_action_code code)
     if (code != ROUTER_ACTION_TERM)
         memcpy(router_hash, r_object.hash_id, sizeof(router_hash));
 
+    std::unique_lock<std::mutex> lock(bus_mutex);
     router_ip.assign((char *)r_object.ip_addr);                     // Update router IP for logging
+    lock.unlock();
 
     string descr((char *)r_object.descr);
     boost::replace_all(descr, "\n", "\\n");
@@ -522,8 +1234,14 @@ void msgBus_kafka::update_Router(obj_router &r_object, router_action_code code)
         snprintf((char *)r_object.name, sizeof(r_object.name)-1, "%s", hostname.c_str());
     }
 
-    if (topicSel != NULL)
+    lock.lock();
+    router_name.assign((char *)r_object.name);
+
+    if (topicSel != NULL) {
         topicSel->lookupRouterGroup((char *)r_object.name, (char *)r_object.ip_addr, router_group_name);
+        topic_handle_gen++;                 // Router group is part of every topic, re-resolve the handles
+    }
+    lock.unlock();
 
     size_t size = snprintf(buf, sizeof(buf),
              "%s\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%" PRIu16 "\t%s\t%s\t%s\t%s\t%s\n", action.c_str(),
@@ -531,7 +1249,11 @@ void msgBus_kafka::update_Router(obj_router &r_object, router_action_code code)
              r_object.term_reason_code, r_object.term_reason_text,
              initData.c_str(), termData.c_str(), ts.c_str(), r_object.bgp_id);
 
-    produce(MSGBUS_TOPIC_VAR_ROUTER, buf, size, 1, r_hash_str, NULL, 0);
+    // Rows of the router still being encoded are sent before its term message
+    if (code == ROUTER_ACTION_TERM and pipeline)
+        waitEncode();
+
+    produce(KafkaTopicSelector::TOPIC_ID_ROUTER, buf, size, 1, r_hash_str, NULL);
 
     router_seq++;
 }
@@ -540,6 +1262,7 @@ void msgBus_kafka::update_Router(obj_router &r_object, router_action_code code)
  * Abstract method Implementation - See MsgBusInterface.hpp for details
  */
 void msgBus_kafka::update_Peer(obj_bgp_peer &peer, obj_peer_up_event *up, obj_peer_down_event *down, peer_action_code code) {
+    std::lock_guard<std::mutex> api_lock(api_mutex);
 
     char buf[4096]; // Misc working buffer
 
@@ -593,18 +1316,18 @@ void msgBus_kafka::update_Peer(obj_bgp_peer &peer, obj_peer_up_event *up, obj_pe
             skip_if_in_cache = false;
             action.assign("down");
             add_to_cache = false;
-
-            if (peer_list.find(p_hash_str) != peer_list.end())
-                peer_list.erase(p_hash_str);
-
             break;
     }
 
+    std::unique_lock<std::mutex> lock(bus_mutex);
+
     // Check if we have already processed this entry, if so return
     if (skip_if_in_cache and peer_list.find(p_hash_str) != peer_list.end()) {
         return;
     }
 
+    lock.unlock();
+
     // Get the hostname using DNS
     string hostname;
     resolveIp(peer.peer_addr, hostname);
@@ -613,10 +1336,25 @@ void msgBus_kafka::update_Peer(obj_bgp_peer &peer, obj_peer_up_event *up, obj_pe
     getTimestamp(peer.timestamp_secs, peer.timestamp_us, ts);
 
     // Insert/Update map entry
+    lock.lock();
     if (add_to_cache) {
+        peer_topic_info &p_topic = peer_list[p_hash_str];
+        p_topic.peer_asn = peer.peer_as;
+        p_topic.handle_gen = 0;             // Peer group/asn may have changed, re-resolve the handles
+        p_topic.down = false;
+        p_topic.hostname = hostname;
+        p_topic.peer_addr = peer.peer_addr;
+
         if (topicSel != NULL)
-            topicSel->lookupPeerGroup(hostname, peer.peer_addr, peer.peer_as, peer_list[p_hash_str]);
+            topicSel->lookupPeerGroup(hostname, peer.peer_addr, peer.peer_as, p_topic.peer_group);
+
+    } else {
+        peer_list_iter it = peer_list.find(p_hash_str);
+
+        if (it != peer_list.end())
+            it->second.down = true;
     }
+    lock.unlock();
 
     switch (code) {
         case PEER_ACTION_FIRST :
@@ -670,15 +1408,13 @@ void msgBus_kafka::update_Peer(obj_bgp_peer &peer, obj_peer_up_event *up, obj_pe
             skip_if_in_cache = false;
             action.assign("down");
             add_to_cache = false;
-
-            if (peer_list.find(p_hash_str) != peer_list.end())
-                peer_list.erase(p_hash_str);
-
             break;
         }
     }
 
-    produce(MSGBUS_TOPIC_VAR_PEER, buf, strlen(buf), 1, p_hash_str, &peer_list[p_hash_str], peer.peer_as);
+    // Peer is down, remove it from the cache after producing the down message to the peer's topic
+    produce(KafkaTopicSelector::TOPIC_ID_PEER, buf, strlen(buf), 1, p_hash_str, &peer,
+            code == PEER_ACTION_DOWN);
 
     peer_seq++;
 }
@@ -687,6 +1423,7 @@ void msgBus_kafka::update_Peer(obj_bgp_peer &peer, obj_peer_up_event *up, obj_pe
  * Abstract method Implementation - See MsgBusInterface.hpp for details
  */
 void msgBus_kafka::update_baseAttribute(obj_bgp_peer &peer, obj_path_attr &attr, base_attr_action_code code) {
+    std::lock_guard<std::mutex> api_lock(api_mutex);
 
     prep_buf[0] = 0;
     size_t  buf_len;                    // size of the message in buf
@@ -697,32 +1434,12 @@ void msgBus_kafka::update_baseAttribute(obj_bgp_peer &peer, obj_path_attr &attr,
     hash_toStr(peer.hash_id, p_hash_str);
     hash_toStr(peer.router_hash_id, r_hash_str);
 
-
     // Generate the hash
-    MD5 hash;
-
-    //hash.update(path_object.peer_hash_id, HASH_SIZE);
-    hash.update((unsigned char *) attr.as_path.c_str(), attr.as_path.length());
-    hash.update((unsigned char *) attr.next_hop,
-                strlen(attr.next_hop));
-    hash.update((unsigned char *) attr.aggregator,
-                strlen(attr.aggregator));
-    hash.update((unsigned char *) attr.origin,
-                strlen(attr.origin));
-    hash.update((unsigned char *) &attr.med, sizeof(attr.med));
-    hash.update((unsigned char *) &attr.local_pref,
-                sizeof(attr.local_pref));
-
-    hash.update((unsigned char *) attr.community_list.c_str(), attr.community_list.length());
-    hash.update((unsigned char *) attr.ext_community_list.c_str(), attr.ext_community_list.length());
-    hash.update((unsigned char *) p_hash_str.c_str(), p_hash_str.length());
-
-    hash.finalize();
+    AttrTable::pathHash(attr, peer.hash_id, attr.hash_id);
 
-    // Save the hash
-    unsigned char *hash_raw = hash.raw_digest();
-    memcpy(attr.hash_id, hash_raw, 16);
-    delete[] hash_raw;
+    // Other outputs reference the attribute hash, only the message itself is skipped when disabled
+    if (not outputs.base_attribute)
+        return;
 
     hash_toStr(attr.hash_id, path_hash_str);
 
@@ -739,7 +1456,8 @@ void msgBus_kafka::update_baseAttribute(obj_bgp_peer &peer, obj_path_attr &attr,
                      attr.local_pref, attr.aggregator, attr.community_list.c_str(), attr.ext_community_list.c_str(), attr.cluster_list.c_str(),
                      attr.atomic_agg, attr.nexthop_isIPv4, attr.originator_id,attr.large_community_list.c_str());
 
-    produce(MSGBUS_TOPIC_VAR_BASE_ATTRIBUTE, prep_buf, buf_len, 1, p_hash_str, &peer_list[p_hash_str], peer.peer_as);
+    produce(KafkaTopicSelector::TOPIC_ID_BASE_ATTRIBUTE, prep_buf, buf_len, 1, p_hash_str,
+            &peer);
 
     ++base_attr_seq;
 }
@@ -749,8 +1467,67 @@ void msgBus_kafka::update_baseAttribute(obj_bgp_peer &peer, obj_path_attr &attr,
  */
 void msgBus_kafka::update_L3Vpn(obj_bgp_peer &peer, std::vector<obj_vpn> &vpn,
                                 obj_path_attr *attr, vpn_action_code code) {
+    std::lock_guard<std::mutex> api_lock(api_mutex);
 
-    prep_buf[0] = 0;
+    if (not outputs.l3vpn)
+        return;
+
+    if (code == VPN_ACTION_ADD and attr == NULL)
+        return;
+
+    if (pipeline) {
+        l3vpn_task *task = new l3vpn_task;
+
+        task->mbus = this;
+        task->peer = peer;
+        task->vpn = vpn;
+        task->has_attr = attr != NULL;
+        if (attr != NULL)
+            task->attr = *attr;
+        task->code = code;
+        task->seq = l3vpn_seq;
+        task->rtr_ip = router_ip;
+        task->trace = LatencyTrace::current;
+
+        l3vpn_seq += vpn.size();
+
+        reserveProduce();
+        encode_pending++;
+        encode_pool->submit(peerShard(peer), task);
+        return;
+    }
+
+    size_t len = encodeL3Vpn(prep_buf, peer, vpn, attr, code, l3vpn_seq, router_ip);
+    l3vpn_seq += vpn.size();
+
+    if (LatencyTrace::current != 0)
+        LatencyTrace::record(LatencyTrace::STAGE_ENCODED, LatencyTrace::current);
+
+    string p_hash_str;
+    hash_toStr(peer.hash_id, p_hash_str);
+
+    produce(KafkaTopicSelector::TOPIC_ID_L3VPN, prep_buf, len, vpn.size(), p_hash_str, &peer, false,
+            LatencyTrace::current);
+}
+
+/**
+ * Encode l3vpn rows
+ *
+ * \param [out] buf          Output buffer of MSGBUS_WORKING_BUF_SIZE
+ * \param [in]  peer         Peer
+ * \param [in]  vpn          Prefixes, the hash IDs are updated
+ * \param [in]  attr         Path attributes, NULL if withdrawn
+ * \param [in]  code         Action code
+ * \param [in]  seq          Sequence of the first row
+ * \param [in]  rtr_ip       Router IP in printed form
+ *
+ * \return length of the encoded rows
+ */
+size_t msgBus_kafka::encodeL3Vpn(char *buf, obj_bgp_peer &peer, std::vector<obj_vpn> &vpn, obj_path_attr *attr,
+                                 vpn_action_code code, uint64_t seq, const std::string &rtr_ip) {
+    MetricsTimer timer(metrics != NULL ? &metrics->encode_time : NULL);
+
+    buf[0] = 0;
 
     char    buf2[80000];                         // Second working buffer
     size_t  buf_len = 0;                         // query buffer length
@@ -814,14 +1591,14 @@ void msgBus_kafka::update_L3Vpn(obj_bgp_peer &peer, std::vector<obj_vpn> &vpn,
 
             case VPN_ACTION_ADD:
                 if (attr == NULL)
-                    return;
+                    return 0;
 
                 buf_len += snprintf(buf2, sizeof(buf2),
                                     "add\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%s\t%s\t%d\t%d\t%s\t%s\t%" PRIu16
                                             "\t%" PRIu32 "\t%s\t%" PRIu32 "\t%" PRIu32 "\t%s\t%s\t%s\t%s\t%d\t%d\t%s\t%" PRIu32
                                             "\t%s\t%d\t%d\t%s:%s\t%d\t%s\n",
-                                    l3vpn_seq, vpn_hash_str.c_str(), r_hash_str.c_str(),
-                                    router_ip.c_str(),path_hash_str.c_str(), p_hash_str.c_str(),
+                                    seq, vpn_hash_str.c_str(), r_hash_str.c_str(),
+                                    rtr_ip.c_str(),path_hash_str.c_str(), p_hash_str.c_str(),
                                     peer.peer_addr, peer.peer_as, ts.c_str(), vpn[i].prefix, vpn[i].prefix_len,
                                     vpn[i].isIPv4, attr->origin,
                                     attr->as_path.c_str(), attr->as_path_count, attr->origin_as, attr->next_hop, attr->med, attr->local_pref,
@@ -839,8 +1616,8 @@ void msgBus_kafka::update_L3Vpn(obj_bgp_peer &peer, std::vector<obj_vpn> &vpn,
                                     "del\t%" PRIu64 "\t%s\t%s\t%s\t\t%s\t%s\t%" PRIu32 "\t%s\t%s\t%d\t%d\t\t\t"
                                             "\t\t\t\t\t\t\t\t\t\t\t\t%" PRIu32
                                             "\t%s\t%d\t%d\t%s:%s\t%d\t\n",
-                                    l3vpn_seq, vpn_hash_str.c_str(), r_hash_str.c_str(),
-                                    router_ip.c_str(), p_hash_str.c_str(),
+                                    seq, vpn_hash_str.c_str(), r_hash_str.c_str(),
+                                    rtr_ip.c_str(), p_hash_str.c_str(),
                                     peer.peer_addr, peer.peer_as, ts.c_str(), vpn[i].prefix, vpn[i].prefix_len,
                                     vpn[i].isIPv4, vpn[i].path_id, vpn[i].labels, peer.isPrePolicy, peer.isAdjIn,
                                     vpn[i].rd_administrator_subfield.c_str(), vpn[i].rd_assigned_number.c_str(),
@@ -851,13 +1628,12 @@ void msgBus_kafka::update_L3Vpn(obj_bgp_peer &peer, std::vector<obj_vpn> &vpn,
 
         // Cat the entry to the query buff
         if (buf_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */)
-            strcat(prep_buf, buf2);
+            strcat(buf, buf2);
 
-        ++l3vpn_seq;
+        ++seq;
     }
 
-    produce(MSGBUS_TOPIC_VAR_L3VPN, prep_buf, strlen(prep_buf), vpn.size(), p_hash_str,
-            &peer_list[p_hash_str], peer.peer_as);
+    return strlen(buf);
 }
 
 
@@ -866,6 +1642,10 @@ void msgBus_kafka::update_L3Vpn(obj_bgp_peer &peer, std::vector<obj_vpn> &vpn,
  */
 void msgBus_kafka::update_eVPN(obj_bgp_peer &peer, std::vector<obj_evpn> &vpn,
                               obj_path_attr *attr, vpn_action_code code) {
+    std::lock_guard<std::mutex> api_lock(api_mutex);
+
+    if (not outputs.evpn)
+        return;
 
     prep_buf[0] = 0;
 
@@ -969,8 +1749,8 @@ void msgBus_kafka::update_eVPN(obj_bgp_peer &peer, std::vector<obj_evpn> &vpn,
         ++evpn_seq;
     }
 
-    produce(MSGBUS_TOPIC_VAR_EVPN, prep_buf, strlen(prep_buf), vpn.size(), p_hash_str,
-            &peer_list[p_hash_str], peer.peer_as);
+    produce(KafkaTopicSelector::TOPIC_ID_EVPN, prep_buf, strlen(prep_buf), vpn.size(), p_hash_str,
+            &peer);
 }
 
 
@@ -979,8 +1759,72 @@ void msgBus_kafka::update_eVPN(obj_bgp_peer &peer, std::vector<obj_evpn> &vpn,
  */
 void msgBus_kafka::update_unicastPrefix(obj_bgp_peer &peer, std::vector<obj_rib> &rib,
                                         obj_path_attr *attr, unicast_prefix_action_code code) {
-    //bzero(prep_buf, MSGBUS_WORKING_BUF_SIZE);
-    prep_buf[0] = 0;
+    std::lock_guard<std::mutex> api_lock(api_mutex);
+
+    if (not outputs.unicast_prefix) {
+        ribSeq += rib.size();               // RIB sequence is used for the baseline rate
+        return;
+    }
+
+    if (code == UNICAST_PREFIX_ACTION_ADD and attr == NULL)
+        return;
+
+    if (pipeline) {
+        unicast_prefix_task *task = new unicast_prefix_task;
+
+        task->mbus = this;
+        task->peer = peer;
+        task->rib = rib;
+        task->has_attr = attr != NULL;
+        if (attr != NULL)
+            task->attr = *attr;
+        task->code = code;
+        task->seq = unicast_prefix_seq;
+        task->rtr_ip = router_ip;
+        task->trace = LatencyTrace::current;
+
+        unicast_prefix_seq += rib.size();
+        ribSeq += rib.size();
+
+        reserveProduce();
+        encode_pending++;
+        encode_pool->submit(peerShard(peer), task);
+        return;
+    }
+
+    size_t len = encodeUnicastPrefix(prep_buf, peer, rib, attr, code, unicast_prefix_seq, router_ip);
+    unicast_prefix_seq += rib.size();
+    ribSeq += rib.size();
+
+    if (LatencyTrace::current != 0)
+        LatencyTrace::record(LatencyTrace::STAGE_ENCODED, LatencyTrace::current);
+
+    string p_hash_str;
+    hash_toStr(peer.hash_id, p_hash_str);
+
+    produce(KafkaTopicSelector::TOPIC_ID_UNICAST_PREFIX, prep_buf, len, rib.size(), p_hash_str, &peer, false,
+            LatencyTrace::current);
+}
+
+/**
+ * Encode unicast prefix rows
+ *
+ * \param [out] buf          Output buffer of MSGBUS_WORKING_BUF_SIZE
+ * \param [in]  peer         Peer
+ * \param [in]  rib          Prefixes, the hash IDs are updated
+ * \param [in]  attr         Path attributes, NULL if withdrawn
+ * \param [in]  code         Action code
+ * \param [in]  seq          Sequence of the first row
+ * \param [in]  rtr_ip       Router IP in printed form
+ *
+ * \return length of the encoded rows
+ */
+size_t msgBus_kafka::encodeUnicastPrefix(char *buf, obj_bgp_peer &peer, std::vector<obj_rib> &rib,
+                                         obj_path_attr *attr, unicast_prefix_action_code code, uint64_t seq,
+                                         const std::string &rtr_ip) {
+    MetricsTimer timer(metrics != NULL ? &metrics->encode_time : NULL);
+
+    buf[0] = 0;
 
     char    buf2[80000];                         // Second working buffer
     size_t  buf_len = 0;                         // query buffer length
@@ -1049,14 +1893,14 @@ void msgBus_kafka::update_unicastPrefix(obj_bgp_peer &peer, std::vector<obj_rib>
 
             case UNICAST_PREFIX_ACTION_ADD:
                 if (attr == NULL)
-                    return;
+                    return 0;
 
                 buf_len += snprintf(buf2, sizeof(buf2),
                                     "%s\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%s\t%s\t%d\t%d\t%s\t%s\t%" PRIu16
                                             "\t%" PRIu32 "\t%s\t%" PRIu32 "\t%" PRIu32 "\t%s\t%s\t%s\t%s\t%d\t%d\t%s\t%" PRIu32
                                             "\t%s\t%d\t%d\t%s\n",
-                                    action.c_str(), unicast_prefix_seq, rib_hash_str.c_str(), r_hash_str.c_str(),
-                                    router_ip.c_str(),path_hash_str.c_str(), p_hash_str.c_str(),
+                                    action.c_str(), seq, rib_hash_str.c_str(), r_hash_str.c_str(),
+                                    rtr_ip.c_str(),path_hash_str.c_str(), p_hash_str.c_str(),
                                     peer.peer_addr, peer.peer_as, ts.c_str(), rib[i].prefix, rib[i].prefix_len,
                                     rib[i].isIPv4, attr->origin,
                                     attr->as_path.c_str(), attr->as_path_count, attr->origin_as, attr->next_hop, attr->med, attr->local_pref,
@@ -1071,8 +1915,8 @@ void msgBus_kafka::update_unicastPrefix(obj_bgp_peer &peer, std::vector<obj_rib>
                 buf_len += snprintf(buf2, sizeof(buf2),
                                     "%s\t%" PRIu64 "\t%s\t%s\t%s\t\t%s\t%s\t%" PRIu32 "\t%s\t%s\t%d\t%d\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t%" PRIu32
                                             "\t%s\t%d\t%d\t\n",
-                                    action.c_str(), unicast_prefix_seq, rib_hash_str.c_str(), r_hash_str.c_str(),
-                                    router_ip.c_str(), p_hash_str.c_str(),
+                                    action.c_str(), seq, rib_hash_str.c_str(), r_hash_str.c_str(),
+                                    rtr_ip.c_str(), p_hash_str.c_str(),
                                     peer.peer_addr, peer.peer_as, ts.c_str(), rib[i].prefix, rib[i].prefix_len,
                                     rib[i].isIPv4, rib[i].path_id, rib[i].labels, peer.isPrePolicy, peer.isAdjIn);
                 break;
@@ -1080,23 +1924,25 @@ void msgBus_kafka::update_unicastPrefix(obj_bgp_peer &peer, std::vector<obj_rib>
 
         // Cat the entry to the query buff
         if (buf_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */)
-            strcat(prep_buf, buf2);
+            strcat(buf, buf2);
 
-        ++unicast_prefix_seq;
-	++ribSeq;
+        ++seq;
     }
 
-
-    produce(MSGBUS_TOPIC_VAR_UNICAST_PREFIX, prep_buf, strlen(prep_buf), rib.size(), p_hash_str,
-            &peer_list[p_hash_str], peer.peer_as);
+    return strlen(buf);
 }
 
 /**
  * Abstract method Implementation - See MsgBusInterface.hpp for details
  */
 void msgBus_kafka::add_StatReport(obj_bgp_peer &peer, obj_stats_report &stats) {
+    std::lock_guard<std::mutex> api_lock(api_mutex);
+
     char buf[4096];                 // Misc working buffer
 
+    if (not outputs.bmp_stat)
+        return;
+
     // Build the query
     string p_hash_str;
     string r_hash_str;
@@ -1115,15 +1961,107 @@ void msgBus_kafka::add_StatReport(obj_bgp_peer &peer, obj_stats_report &stats) {
              stats.routes_adj_rib_in, stats.routes_loc_rib);
 
 
-    produce(MSGBUS_TOPIC_VAR_BMP_STAT, buf, strlen(buf), 1, p_hash_str, &peer_list[p_hash_str], peer.peer_as);
+    produce(KafkaTopicSelector::TOPIC_ID_BMP_STAT, buf, strlen(buf), 1, p_hash_str,
+            &peer);
     ++bmp_stat_seq;
 }
 
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_kafka::add_PeerStats(obj_bgp_peer &peer, obj_peer_stats &stats) {
+    std::lock_guard<std::mutex> api_lock(api_mutex);
+
+    char buf[4096];                 // Misc working buffer
+    string size_hist;
+
+    if (not outputs.peer_stats)
+        return;
+
+    // Build the query
+    string p_hash_str;
+    string r_hash_str;
+    hash_toStr(peer.hash_id, p_hash_str);
+    hash_toStr(peer.router_hash_id, r_hash_str);
+
+    string ts;
+    getTimestamp(peer.timestamp_secs, peer.timestamp_us, ts);
+
+    // Histogram buckets are comma separated, smallest first
+    for (int i = 0; i < PEER_STATS_SIZE_BUCKETS; i++) {
+        snprintf(buf, sizeof(buf), "%s%" PRIu64, i > 0 ? "," : "", stats.size_hist[i]);
+        size_hist.append(buf);
+    }
+
+    snprintf(buf, sizeof(buf),
+             "add\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%s\t%" PRIu32 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
+                     "\t%.2f\t%.2f\t%" PRIu64 "\t%" PRIu64 "\t%s\n",
+             peer_stats_seq, r_hash_str.c_str(), router_ip.c_str(), p_hash_str.c_str(), peer.peer_addr, peer.peer_as,
+             ts.c_str(), stats.interval, stats.updates, stats.announcements, stats.withdrawals,
+             stats.announce_rate, stats.withdraw_rate, stats.unique_prefixes, stats.attr_sets, size_hist.c_str());
+
+    produce(KafkaTopicSelector::TOPIC_ID_PEER_STATS, buf, strlen(buf), 1, p_hash_str,
+            &peer);
+    ++peer_stats_seq;
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_kafka::add_FlapReport(obj_bgp_peer &peer, std::vector<obj_flap_report> &flaps) {
+    std::lock_guard<std::mutex> api_lock(api_mutex);
+
+    char    buf2[4096];                          // Second working buffer
+    size_t  buf_len = 0;                         // query buffer length
+
+    if (not outputs.flap)
+        return;
+
+    prep_buf[0] = 0;
+
+    string p_hash_str;
+    string r_hash_str;
+    hash_toStr(peer.hash_id, p_hash_str);
+    hash_toStr(peer.router_hash_id, r_hash_str);
+
+    string ts;
+    getTimestamp(peer.timestamp_secs, peer.timestamp_us, ts);
+
+    string first_ts, last_ts;
+
+    for (size_t i = 0; i < flaps.size(); i++) {
+        getTimestamp(flaps[i].first_flap, 0, first_ts);
+        getTimestamp(flaps[i].last_flap, 0, last_ts);
+
+        buf_len += snprintf(buf2, sizeof(buf2),
+                            "add\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%s\t%s\t%d\t%d\t%" PRIu32 "\t%d\t%d\t%d"
+                                    "\t%" PRIu32 "\t%" PRIu32 "\t%" PRIu32 "\t%s\t%s\n",
+                            flap_seq, r_hash_str.c_str(), router_ip.c_str(), p_hash_str.c_str(), peer.peer_addr,
+                            peer.peer_as, ts.c_str(), flaps[i].prefix, flaps[i].prefix_len, flaps[i].isIPv4,
+                            flaps[i].path_id, flaps[i].rib_type == 0, flaps[i].rib_type != 2, flaps[i].rib_type == 2,
+                            flaps[i].flaps, flaps[i].total_flaps, flaps[i].penalty, first_ts.c_str(), last_ts.c_str());
+
+        // Cat the entry to the query buff
+        if (buf_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */)
+            strcat(prep_buf, buf2);
+
+        ++flap_seq;
+    }
+
+    produce(KafkaTopicSelector::TOPIC_ID_FLAP, prep_buf, strlen(prep_buf), flaps.size(), p_hash_str,
+            &peer);
+}
+
 /**
  * Abstract method Implementation - See MsgBusInterface.hpp for details
  */
 void msgBus_kafka::update_LsNode(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_node> &nodes,
                                   ls_action_code code) {
+    std::lock_guard<std::mutex> api_lock(api_mutex);
+
+    if (not outputs.ls_node)
+        return;
+
     bzero(prep_buf, MSGBUS_WORKING_BUF_SIZE);
 
     char    buf2[8192];                          // Second working buffer
@@ -1229,7 +2167,8 @@ void msgBus_kafka::update_LsNode(obj_bgp_peer &peer, obj_path_attr &attr, std::l
     }
 
 
-    produce(MSGBUS_TOPIC_VAR_LS_NODE, prep_buf, buf_len, rows, peer_hash_str, &peer_list[peer_hash_str], peer.peer_as);
+    produce(KafkaTopicSelector::TOPIC_ID_LS_NODE, prep_buf, buf_len, rows, peer_hash_str,
+            &peer);
 }
 
 /**
@@ -1237,6 +2176,11 @@ void msgBus_kafka::update_LsNode(obj_bgp_peer &peer, obj_path_attr &attr, std::l
  */
 void msgBus_kafka::update_LsLink(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_link> &links,
                                  ls_action_code code) {
+    std::lock_guard<std::mutex> api_lock(api_mutex);
+
+    if (not outputs.ls_link)
+        return;
+
     bzero(prep_buf, MSGBUS_WORKING_BUF_SIZE);
 
     char    buf2[8192];                          // Second working buffer
@@ -1397,8 +2341,8 @@ void msgBus_kafka::update_LsLink(obj_bgp_peer &peer, obj_path_attr &attr, std::l
         ++ls_link_seq;
     }
 
-    produce(MSGBUS_TOPIC_VAR_LS_LINK, prep_buf, strlen(prep_buf), rows, peer_hash_str,
-            &peer_list[peer_hash_str], peer.peer_as);
+    produce(KafkaTopicSelector::TOPIC_ID_LS_LINK, prep_buf, strlen(prep_buf), rows, peer_hash_str,
+            &peer);
 }
 
 /**
@@ -1406,6 +2350,11 @@ void msgBus_kafka::update_LsLink(obj_bgp_peer &peer, obj_path_attr &attr, std::l
  */
 void msgBus_kafka::update_LsPrefix(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_prefix> &prefixes,
                                    ls_action_code code) {
+    std::lock_guard<std::mutex> api_lock(api_mutex);
+
+    if (not outputs.ls_prefix)
+        return;
+
     bzero(prep_buf, MSGBUS_WORKING_BUF_SIZE);
 
     char    buf2[8192];                          // Second working buffer
@@ -1539,65 +2488,47 @@ void msgBus_kafka::update_LsPrefix(obj_bgp_peer &peer, obj_path_attr &attr, std:
         ++ls_prefix_seq;
     }
 
-    produce(MSGBUS_TOPIC_VAR_LS_PREFIX, prep_buf, strlen(prep_buf), rows, peer_hash_str,
-            &peer_list[peer_hash_str], peer.peer_as);
+    produce(KafkaTopicSelector::TOPIC_ID_LS_PREFIX, prep_buf, strlen(prep_buf), rows, peer_hash_str,
+            &peer);
 }
 
 /**
  * Abstract method Implementation - See MsgBusInterface.hpp for details
- *
- * TODO: Consolidate this to single produce method
  */
 void msgBus_kafka::send_bmp_raw(u_char *r_hash, obj_bgp_peer &peer, u_char *data, size_t data_len) {
+    std::lock_guard<std::mutex> api_lock(api_mutex);
+
     string r_hash_str;
     string p_hash_str;
-    RdKafka::Topic *topic = NULL;
-
-    hash_toStr(peer.hash_id, p_hash_str);
-    hash_toStr(r_hash, r_hash_str);
 
-    if (data_len == 0)
+    if (data_len == 0 or not outputs.bmp_raw)
         return;
 
-    while (isConnected == false) {
-        LOG_WARN("rtr=%s: Not connected to Kafka, attempting to reconnect", router_ip.c_str());
-        connect();
-
-        sleep(2);
-    }
+    hash_toStr(peer.hash_id, p_hash_str);
+    hash_toStr(r_hash, r_hash_str);
 
     // if topic is disabled, don't bother producing the message
-    if (!topicSel->topicEnabled(MSGBUS_TOPIC_VAR_BMP_RAW))
+    if (not topic_enabled[KafkaTopicSelector::TOPIC_ID_BMP_RAW])
         return;
 
     char headers[256];
     size_t hdr_len = snprintf(headers, sizeof(headers), "V: %s\nC_HASH_ID: %s\nR_HASH: %s\nR_IP: %s\nL: %lu\n\n",
              MSGBUS_API_VERSION, collector_hash.c_str(), r_hash_str.c_str(), router_ip.c_str(), data_len);
 
-    memcpy(producer_buf, headers, hdr_len);
-    memcpy(producer_buf+hdr_len, data, data_len);
-
-    topic = topicSel->getTopic(MSGBUS_TOPIC_VAR_BMP_RAW, &router_group_name, &peer_list[p_hash_str], peer.peer_as);
-    if (topic != NULL) {
-        SELF_DEBUG("rtr=%s: Producing bmp raw message: topic=%s key=%s, msg size = %lu", router_ip.c_str(),
-                   topic->name().c_str(), r_hash_str.c_str(), data_len);
+    if (pipeline) {
+        reserveProduce();
+        queueMessage(KafkaTopicSelector::TOPIC_ID_BMP_RAW, r_hash_str, &p_hash_str, peer.peer_as, false,
+                     headers, hdr_len, (char *) data, data_len);
+        return;
+    }
 
-        RdKafka::ErrorCode resp = producer->produce(topic, RdKafka::Topic::PARTITION_UA,
-                                                    RdKafka::Producer::RK_MSG_COPY /* Copy payload */,
-                                                    producer_buf, data_len + hdr_len,
-                                                    (const std::string *)&r_hash_str, NULL);
+    checkConnection();
 
-        if (resp != RdKafka::ERR_NO_ERROR) {
-            LOG_ERR("rtr=%s: Failed to produce bmp raw message: %s", router_ip.c_str(), RdKafka::err2str(resp).c_str());
-            producer->poll(100);
-        }
-    }
-    else {
-        SELF_DEBUG("rtr=%s: failed to produce bmp raw message because topic couldn't be found: topic=%s key=%s, msg size = %lu",
-                   router_ip.c_str(), MSGBUS_TOPIC_VAR_BMP_RAW, r_hash_str.c_str(), data_len);
-    }
+    memcpy(producer_buf, headers, hdr_len);
+    memcpy(producer_buf+hdr_len, data, data_len);
 
-    producer->poll(0);
+    send(KafkaTopicSelector::TOPIC_ID_BMP_RAW, getPeerTopicInfo(p_hash_str, peer.peer_as),
+         producer_buf, data_len + hdr_len, r_hash_str);
 }
 
 /**
@@ -1633,6 +2564,12 @@ void msgBus_kafka::enableDebug() {
     string value = "all";
     string errstr;
 
+    // Derived outputs have no producer to reconnect with debug
+    if (not use_kafka) {
+        debug = true;
+        return;
+    }
+
     disconnect();
 
     if (conf->set("debug", value, errstr) != RdKafka::Conf::CONF_OK) {
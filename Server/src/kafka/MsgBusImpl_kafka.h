@@ -22,10 +22,15 @@
 #include <librdkafka/rdkafkacpp.h>
 
 #include <thread>
-#include "safeQueue.hpp"
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "ringQueue.hpp"
+#include "WorkerPool.h"
 #include "KafkaEventCallback.h"
 #include "KafkaDeliveryReportCallback.h"
 #include "KafkaTopicSelector.h"
+#include "KafkaJournal.h"
 
 #include "Config.h"
 
@@ -33,11 +38,23 @@
  * \class   msgBus_kafka
  *
  * \brief   Kafka message bus implementation
+ * \details Messages are encoded per the message bus API.  Derived classes can send the
+ *          encoded messages elsewhere by overriding send() and checkConnection().
+ *
+ *          When encode threads are configured, messages are not sent by the router thread.  Prefix
+ *          messages are encoded by a worker pool shared by all routers, sharded by peer hash so
+ *          the peer order is kept.  All messages are then queued to a producer thread per router,
+ *          which is the only thread calling send().  The topic and producer state used by send()
+ *          is protected by bus_mutex.
+ *
+ *          The API methods are serialized by api_mutex, the parse threads of a router call them
+ *          concurrently.
   */
 class msgBus_kafka: public MsgBusInterface {
 public:
     #define MSGBUS_WORKING_BUF_SIZE         1800000
     #define MSGBUS_API_VERSION              "1.7"
+    #define MSGBUS_RECONNECT_INTERVAL       5           ///< Seconds between reconnects when journaling
 
     /******************************************************************//**
      * \brief This function will initialize and connect to Kafka.
@@ -49,7 +66,7 @@ public:
      *  \param [in] c_hash_id   Collector Hash ID
      ********************************************************************/
     msgBus_kafka(Logger *logPtr, Config *cfg, u_char *c_hash_id);
-    ~msgBus_kafka();
+    virtual ~msgBus_kafka();
 
     /*
      * abstract methods implemented
@@ -61,6 +78,8 @@ public:
     void update_baseAttribute(obj_bgp_peer &peer, obj_path_attr &attr, base_attr_action_code code);
     void update_unicastPrefix(obj_bgp_peer &peer, std::vector<obj_rib> &rib, obj_path_attr *attr, unicast_prefix_action_code code);
     void add_StatReport(obj_bgp_peer &peer, obj_stats_report &stats);
+    void add_FlapReport(obj_bgp_peer &peer, std::vector<obj_flap_report> &flaps);
+    void add_PeerStats(obj_bgp_peer &peer, obj_peer_stats &stats);
 
     void update_LsNode(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_node> &nodes,
                      ls_action_code code);
@@ -79,9 +98,28 @@ public:
     void enableDebug();
     void disableDebug();
 
-private:
+    inline uint64_t getUnicastPrefixSeq() {
+        return unicast_prefix_seq;
+    }
+
+    int getQueueFill();
+
+    void handoverRouter();
+
+protected:
+    /******************************************************************//**
+     * \brief Constructor for derived classes
+     *
+     *  \param [in] logPtr      Pointer to Logger instance
+     *  \param [in] cfg         Pointer to the config instance
+     *  \param [in] c_hash_id   Collector Hash ID
+     *  \param [in] use_kafka   True to create the kafka producer and connect
+     ********************************************************************/
+    msgBus_kafka(Logger *logPtr, Config *cfg, u_char *c_hash_id, bool use_kafka);
+
     char            *prep_buf;                  ///< Large working buffer for message preparation
     unsigned char   *producer_buf;              ///< Producer message buffer
+    uint64_t        send_trace;                 ///< Latency trace of the message given to send(), zero if none
     bool            debug;                      ///< debug flag to indicate debugging
     Logger          *logger;                    ///< Logging class pointer
 
@@ -93,6 +131,8 @@ private:
     uint64_t        base_attr_seq;              ///< Base attribute sequence
     uint64_t        unicast_prefix_seq;         ///< Unicast prefix sequence
     uint64_t        bmp_stat_seq;               ///< BMP stats sequence
+    uint64_t        flap_seq;                   ///< Flap report sequence
+    uint64_t        peer_stats_seq;             ///< Peer stats sequence
     uint64_t        ls_node_seq;                ///< LS node sequence
     uint64_t        ls_link_seq;                ///< LS link sequence
     uint64_t        ls_prefix_seq;              ///< LS prefix sequence
@@ -114,20 +154,91 @@ private:
     KafkaEventCallback              *event_callback;
     KafkaDeliveryReportCallback     *delivery_callback;
 
+    bool use_kafka;                             ///< Indicates the kafka producer is used
     bool isConnected;                           ///< Indicates if Kafka is connected or not
+    time_t last_connect;                        ///< Time of the last connect attempt
+
+    int  outq_high;                             ///< Producer queue length that starts throttling
+    int  outq_low;                              ///< Producer queue length that ends throttling
+
+    /**
+     * Journal shared by all instances - NULL if disabled
+     */
+    static KafkaJournal *journal;
+    static int          journal_refs;           ///< Number of instances using the journal
+    static std::mutex   journal_mutex;          ///< Protects journal creation/deletion
+
+    /**
+     * Per peer topic info - Topic handles are resolved once per peer and then reused on every produce
+     */
+    struct peer_topic_info {
+        std::string peer_group;                 ///< Peer group name - if matched
+        std::string hostname;                   ///< Peer hostname, used to match the peer group again on reload
+        std::string peer_addr;                  ///< Peer address, used to match the peer group again on reload
+        uint32_t    peer_asn;                   ///< Peer ASN used to resolve the topic handles
+        uint32_t    handle_gen;                 ///< Handle generation - handles are stale if not topic_handle_gen
+        bool        down;                       ///< Peer is down, removed once the down message is sent
+
+        ///< Resolved topic handles indexed by KafkaTopicSelector::topic_ids
+        int         topic_handle[KafkaTopicSelector::TOPIC_ID_MAX];
+
+        peer_topic_info() : peer_asn(0), handle_gen(0), down(false) {
+            for (int i=0; i < KafkaTopicSelector::TOPIC_ID_MAX; i++)
+                topic_handle[i] = TOPIC_HANDLE_UNRESOLVED;
+        }
+    };
 
     // array of hashes
-    std::map<std::string, std::string> peer_list;
-    typedef std::map<std::string, std::string>::iterator peer_list_iter;
+    std::map<std::string, peer_topic_info> peer_list;
+    typedef std::map<std::string, peer_topic_info>::iterator peer_list_iter;
+
+    peer_topic_info router_topic;               ///< Topic info for non-peer topics (collector/router)
+    uint32_t        topic_handle_gen;           ///< Topic handle generation, bumped when cached handles are invalid
 
     std::string router_ip;                      ///< Router IP in printed format
     u_char      router_hash[16];                ///< Router Hash in binary format
     std::string router_group_name;              ///< Router group name - if matched
+    std::string router_name;                    ///< Router name, used to match the router group again on reload
+    std::atomic<uint32_t> live_gen;             ///< Config live settings generation applied
+    std::mutex  live_mutex;                     ///< Serializes applying the live settings
 
+    KafkaTopicSelector *topicSel;               ///< Kafka topic selector/handler
 
-    std::map<std::string, RdKafka::Topic*> topic;
+    std::atomic<bool> topic_enabled[KafkaTopicSelector::TOPIC_ID_MAX]; ///< Topics with a name configured, read by the parse threads
 
-    KafkaTopicSelector *topicSel;               ///< Kafka topic selector/handler
+    /**
+     * Encoded message queued for the producer thread
+     */
+    struct produce_msg {
+        int         topic_id;                   ///< Topic ID, KafkaTopicSelector::TOPIC_ID_*
+        std::string key;                        ///< Hash key
+        std::string peer_hash;                  ///< Peer hash string - empty if not a peer topic
+        uint32_t    peer_asn;                   ///< Peer ASN
+        bool        peer_down;                  ///< Remove the peer topic info after sending
+        uint64_t    trace;                      ///< Latency trace, zero if not traced
+        std::string data;                       ///< Message headers and payload
+    };
+
+    struct unicast_prefix_task;
+    struct l3vpn_task;
+
+    bool            pipeline;                   ///< Indicates messages are sent by the producer thread
+    std::mutex      bus_mutex;                  ///< Protects the topic/producer state when pipelined
+    std::mutex      api_mutex;                  ///< Serializes the API calls of the parse threads
+    mpmcQueue<produce_msg *> *produce_queue;    ///< Messages for the producer thread
+    std::thread     *produce_thr;               ///< Producer thread, started with the first message
+    std::atomic<int> encode_pending;            ///< Messages submitted to the encode pool and not yet queued
+    std::atomic<int> produce_inflight;          ///< Messages reserved by reserveProduce() and not yet popped
+    std::mutex      pipeline_mutex;             ///< Waits of the router thread for the encode pool or producer
+    std::condition_variable pipeline_cond;      ///< Signaled when encode_pending or produce_inflight drops
+    int             last_queue_fill;            ///< Producer queue fill when it could not be read
+
+    /**
+     * Encode pool shared by all instances - NULL if disabled
+     */
+    static WorkerPool   *encode_pool;
+    static int          encode_pool_refs;       ///< Number of instances using the encode pool
+    static std::mutex   encode_pool_mutex;      ///< Protects encode pool creation/deletion
 
     /**
      * Connects to kafka broker
@@ -137,21 +248,203 @@ private:
     /**
      * Disconnects from kafka broker
      */
-    void disconnect(int wait_ms=2000);
+    virtual void disconnect(int wait_ms=2000);
 
     /**
      * produce message to Kafka
      *
-     * \param [in] topic_var     Topic var to use in KafkaTopicSelector::getTopic()
+     * \param [in] topic_id      Topic ID, KafkaTopicSelector::TOPIC_ID_*
      * \param [in] msg           message to produce
      * \param [in] msg_size      Length in bytes of the message
      * \param [in] rows          Number of rows in data
+     * \param [in] key           Hash key - the peer hash string for peer topics
+     * \param [in] peer          Peer - NULL if not a peer topic
+     * \param [in] peer_down     True to remove the peer topic info after the message
+     * \param [in] trace         Latency trace of the message, zero if not traced
+     */
+    void produce(int topic_id, char *msg, size_t msg_size, int rows,
+                 const std::string &key, obj_bgp_peer *peer, bool peer_down=false, uint64_t trace=0);
+
+    /**
+     * Message bus API headers for a message
+     *
+     * \param [out] buf          Buffer for the headers
+     * \param [in]  size         Size of buf
+     * \param [in]  topic_id     Topic ID, KafkaTopicSelector::TOPIC_ID_*
+     * \param [in]  msg_size     Length in bytes of the message
+     * \param [in]  rows         Number of rows in the message
+     *
+     * \return length of the headers
+     */
+    size_t prepHeaders(char *buf, size_t size, int topic_id, size_t msg_size, int rows);
+
+    /**
+     * Queue a message for the producer thread without blocking
+     *
+     * \details Called by the router thread and the encode threads.
+     *
+     * \param [in] topic_id      Topic ID, KafkaTopicSelector::TOPIC_ID_*
      * \param [in] key           Hash key
-     * \param [in] peer_group    Peer group name - empty/NULL if not set or used
+     * \param [in] peer_hash     Peer hash string - NULL if not a peer topic
      * \param [in] peer_asn      Peer ASN
+     * \param [in] peer_down     True to remove the peer topic info after sending
+     * \param [in] hdr           Message headers
+     * \param [in] hdr_len       Length of the headers
+     * \param [in] msg           Message payload
+     * \param [in] msg_len       Length of the payload
+     * \param [in] trace         Latency trace of the message, zero if not traced
+     */
+    void queueMessage(int topic_id, const std::string &key, const std::string *peer_hash, uint32_t peer_asn,
+                      bool peer_down, const char *hdr, size_t hdr_len, const char *msg, size_t msg_len,
+                      uint64_t trace=0);
+
+    /**
+     * Set the outputs and enabled topics from the config live settings
+     */
+    void applyLiveSettings();
+
+    /**
+     * Apply reloaded config live settings if they changed - see Config::reload()
+     */
+    inline void checkReload() {
+        if (live_gen != cfg->getLiveGen())
+            reloadLive();
+    }
+
+    /**
+     * Apply reloaded config live settings
+     */
+    void reloadLive();
+
+    /**
+     * Start the producer thread if not already running
+     */
+    void startPipeline();
+
+    /**
+     * Wait for the encode pool and producer thread to send the queued messages and stop the
+     *      producer thread.  Messages are sent by the caller afterwards.
+     */
+    void stopPipeline();
+
+    /**
+     * Wait for the encode pool to queue the messages submitted for this router
+     */
+    void waitEncode();
+
+    /**
+     * Count an encode task of this router as queued - encode pool only
+     */
+    void encodeDone();
+
+    /**
+     * Start the pipeline and reserve a producer queue slot for a message
+     */
+    void reserveProduce();
+
+    /**
+     * Wake the router thread waiting in reserveProduce()
+     */
+    void notifyPipeline();
+
+    /**
+     * Producer thread loop - sends the queued messages in batches
+     */
+    void produceLoop();
+
+    /**
+     * Encode unicast prefix rows
+     *
+     * \details Only reads the arguments, so it can run on any thread.
+     *
+     * \param [out] buf          Output buffer of MSGBUS_WORKING_BUF_SIZE
+     * \param [in]  peer         Peer
+     * \param [in]  rib          Prefixes, the hash IDs are updated
+     * \param [in]  attr         Path attributes, NULL if withdrawn
+     * \param [in]  code         Action code
+     * \param [in]  seq          Sequence of the first row
+     * \param [in]  rtr_ip       Router IP in printed form
+     *
+     * \return length of the encoded rows
+     */
+    size_t encodeUnicastPrefix(char *buf, obj_bgp_peer &peer, std::vector<obj_rib> &rib, obj_path_attr *attr,
+                               unicast_prefix_action_code code, uint64_t seq, const std::string &rtr_ip);
+
+    /**
+     * Encode l3vpn rows
+     *
+     * \details Only reads the arguments, so it can run on any thread.
+     *
+     * \param [out] buf          Output buffer of MSGBUS_WORKING_BUF_SIZE
+     * \param [in]  peer         Peer
+     * \param [in]  vpn          Prefixes, the hash IDs are updated
+     * \param [in]  attr         Path attributes, NULL if withdrawn
+     * \param [in]  code         Action code
+     * \param [in]  seq          Sequence of the first row
+     * \param [in]  rtr_ip       Router IP in printed form
+     *
+     * \return length of the encoded rows
+     */
+    size_t encodeL3Vpn(char *buf, obj_bgp_peer &peer, std::vector<obj_vpn> &vpn, obj_path_attr *attr,
+                       vpn_action_code code, uint64_t seq, const std::string &rtr_ip);
+
+    /**
+     * Send a prepared message (headers and payload) to Kafka or to the journal
+     *
+     * \param [in] topic_id      Topic ID, KafkaTopicSelector::TOPIC_ID_*
+     * \param [in] p_topic       Peer topic info - NULL if not a peer topic
+     * \param [in] buf           Message buffer
+     * \param [in] len           Length of the message in bytes
+     * \param [in] key           Hash key
+     */
+    virtual void send(int topic_id, peer_topic_info *p_topic, unsigned char *buf, size_t len, const std::string &key);
+
+    /**
+     * Check the Kafka connection, reconnecting if needed
+     */
+    virtual void checkConnection();
+
+    /**
+     * Replace the topic selector with one for the reloaded topics, called with the bus mutex held
+     */
+    virtual void reloadTopics();
+
+    /**
+     * Send the router term message if the router is still defined
+     *
+     * \details Called by the destructor; derived classes must call it in their destructor
+     *          so the message is sent while their send() is still valid.
+     */
+    void termRouter();
+
+    /**
+     * Wait for the producer queue to drain when it reaches the high watermark
+     *
+     * \details Blocking here stops the BMP reader thread for this router, which in turn
+     *          stops reading the router socket once its buffer fills.  When pipelined, the
+     *          producer thread blocks and the reader thread stops once the producer queue fills.
+     */
+    void waitForQueue();
+
+    /**
+     * Get the peer topic info by peer hash, adding a new entry if needed
+     *
+     * \param [in] p_hash_str    Peer hash string
+     * \param [in] peer_asn      Peer ASN - used if the entry is new
+     *
+     * \return Pointer to the peer topic info entry
+     */
+    peer_topic_info *getPeerTopicInfo(const std::string &p_hash_str, uint32_t peer_asn);
+
+    /**
+     * Get the topic handle for the topic ID, resolving and caching it in the topic info if needed
+     *
+     * \param [in]     topic_id   Topic ID, KafkaTopicSelector::TOPIC_ID_*
+     * \param [in,out] p_topic    Peer topic info - NULL to use the router topic info
+     *
+     * \return topic handle or TOPIC_HANDLE_UNRESOLVED if error
      */
-    void produce(const char *topic_var, char *msg, size_t msg_size, int rows,
-                 std::string key, const std::string *peer_group, uint32_t);
+    int getTopicHandle(int topic_id, peer_topic_info *p_topic);
 
     /**
     * \brief Method to resolve the IP address to a hostname
@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cstring>
+#include <cinttypes>
+
+#include "MsgBusImpl_null.h"
+#include "LatencyTrace.h"
+
+/******************************************************************//**
+ * \brief Constructor for class
+ *
+ *  \param [in] logPtr      Pointer to Logger instance
+ *  \param [in] cfg         Pointer to the config instance
+ *  \param [in] c_hash_id   Collector Hash ID
+ ********************************************************************/
+msgBus_null::msgBus_null(Logger *logPtr, Config *cfg, u_char *c_hash_id)
+        : msgBus_kafka(logPtr, cfg, c_hash_id, false) {
+
+    encode = cfg->null_encode;
+
+    bzero(&interval, sizeof(interval));
+    bzero(&total, sizeof(total));
+
+    clock_gettime(CLOCK_MONOTONIC, &total_start);
+    interval_start = total_start;
+
+    // Topic selector is only used to check if topics are enabled
+    topicSel = new KafkaTopicSelector(logger, cfg, NULL);
+    topic_handle_gen++;
+
+    isConnected = true;
+}
+
+/**
+ * Destructor
+ */
+msgBus_null::~msgBus_null() {
+    termRouter();
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    report(total, (now.tv_sec - total_start.tv_sec) + (now.tv_nsec - total_start.tv_nsec) / 1e9, "total");
+}
+
+/**
+ * Nothing to connect to, only makes sure the topic selector exists
+ */
+void msgBus_null::checkConnection() {
+    if (topicSel == NULL) {
+        topicSel = new KafkaTopicSelector(logger, cfg, NULL);
+        topic_handle_gen++;
+    }
+}
+
+/**
+ * Count the encoded message and discard it
+ *
+ * \param [in] topic_id      Topic ID, KafkaTopicSelector::TOPIC_ID_*
+ * \param [in] p_topic       Peer topic info - NULL if not a peer topic
+ * \param [in] buf           Message buffer
+ * \param [in] len           Length of the message in bytes
+ * \param [in] key           Hash key
+ */
+void msgBus_null::send(int topic_id, peer_topic_info *p_topic, unsigned char *buf, size_t len,
+                       const std::string &key) {
+    std::lock_guard<std::mutex> lock(counters_mutex);
+
+    interval.topic[topic_id].bytes += len;
+    total.topic[topic_id].bytes += len;
+
+    if (send_trace != 0)
+        LatencyTrace::record(LatencyTrace::STAGE_DELIVERED, send_trace);
+}
+
+/**
+ * Count a message bus call, reporting the counters if the interval has elapsed
+ *
+ * \param [in] topic_id      Topic ID, KafkaTopicSelector::TOPIC_ID_*
+ * \param [in] rows          Number of rows in the call
+ * \param [in] ts            Call start time
+ */
+void msgBus_null::count(int topic_id, size_t rows, const timespec &ts) {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    uint64_t latency = (now.tv_sec - ts.tv_sec) * 1000000000ULL + now.tv_nsec - ts.tv_nsec;
+
+    std::lock_guard<std::mutex> lock(counters_mutex);
+
+    for (counters *c : { &interval, &total }) {
+        c->topic[topic_id].calls++;
+        c->topic[topic_id].rows += rows;
+        c->calls++;
+        c->latency_ns += latency;
+
+        if (latency > c->latency_max_ns)
+            c->latency_max_ns = latency;
+    }
+
+    if (now.tv_sec - interval_start.tv_sec >= cfg->null_report_interval) {
+        report(interval, (now.tv_sec - interval_start.tv_sec) + (now.tv_nsec - interval_start.tv_nsec) / 1e9,
+               "interval");
+
+        bzero(&interval, sizeof(interval));
+        interval_start = now;
+    }
+}
+
+/**
+ * Log the counters
+ *
+ * \param [in] c            Counters to log
+ * \param [in] secs         Seconds the counters cover
+ * \param [in] label        Label for the log message
+ */
+void msgBus_null::report(const counters &c, double secs, const char *label) {
+    uint64_t rows = 0, bytes = 0;
+
+    if (secs <= 0)
+        secs = 1;
+
+    for (int i=0; i < KafkaTopicSelector::TOPIC_ID_MAX; i++) {
+        rows += c.topic[i].rows;
+        bytes += c.topic[i].bytes;
+    }
+
+    LOG_INFO("rtr=%s: null %s %.1fs: calls=%" PRIu64 " rows=%" PRIu64 " (%.0f/s) bytes=%" PRIu64 " (%.2f MB/s)"
+             " latency avg=%.2fus max=%.2fus", router_ip.c_str(), label, secs, c.calls, rows, rows / secs,
+             bytes, bytes / secs / 1048576, c.calls ? c.latency_ns / 1000.0 / c.calls : 0.0,
+             c.latency_max_ns / 1000.0);
+
+    for (int i=0; i < KafkaTopicSelector::TOPIC_ID_MAX; i++) {
+        if (c.topic[i].calls == 0)
+            continue;
+
+        LOG_INFO("rtr=%s: null %s %s: calls=%" PRIu64 " rows=%" PRIu64 " (%.0f/s) bytes=%" PRIu64,
+                 router_ip.c_str(), label, KafkaTopicSelector::topic_vars[i], c.topic[i].calls,
+                 c.topic[i].rows, c.topic[i].rows / secs, c.topic[i].bytes);
+    }
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_null::update_Collector(obj_collector &c_obj, collector_action_code action_code) {
+    timespec ts;
+    start(ts);
+
+    msgBus_kafka::update_Collector(c_obj, action_code);
+
+    count(KafkaTopicSelector::TOPIC_ID_COLLECTOR, 1, ts);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_null::update_Router(obj_router &r_entry, router_action_code code) {
+    timespec ts;
+    start(ts);
+
+    msgBus_kafka::update_Router(r_entry, code);
+
+    count(KafkaTopicSelector::TOPIC_ID_ROUTER, 1, ts);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_null::update_Peer(obj_bgp_peer &peer, obj_peer_up_event *up, obj_peer_down_event *down,
+                              peer_action_code code) {
+    timespec ts;
+    start(ts);
+
+    msgBus_kafka::update_Peer(peer, up, down, code);
+
+    count(KafkaTopicSelector::TOPIC_ID_PEER, 1, ts);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_null::update_baseAttribute(obj_bgp_peer &peer, obj_path_attr &attr, base_attr_action_code code) {
+    timespec ts;
+    start(ts);
+
+    if (encode)
+        msgBus_kafka::update_baseAttribute(peer, attr, code);
+    else
+        bzero(attr.hash_id, sizeof(attr.hash_id));  // Hash is only used by the encoded messages
+
+    count(KafkaTopicSelector::TOPIC_ID_BASE_ATTRIBUTE, 1, ts);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_null::update_unicastPrefix(obj_bgp_peer &peer, std::vector<obj_rib> &rib, obj_path_attr *attr,
+                                       unicast_prefix_action_code code) {
+    timespec ts;
+    start(ts);
+
+    if (encode)
+        msgBus_kafka::update_unicastPrefix(peer, rib, attr, code);
+    else
+        ribSeq += rib.size();               // RIB sequence is used for the baseline rate
+
+    count(KafkaTopicSelector::TOPIC_ID_UNICAST_PREFIX, rib.size(), ts);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_null::add_StatReport(obj_bgp_peer &peer, obj_stats_report &stats) {
+    timespec ts;
+    start(ts);
+
+    if (encode)
+        msgBus_kafka::add_StatReport(peer, stats);
+
+    count(KafkaTopicSelector::TOPIC_ID_BMP_STAT, 1, ts);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_null::add_PeerStats(obj_bgp_peer &peer, obj_peer_stats &stats) {
+    timespec ts;
+    start(ts);
+
+    if (encode)
+        msgBus_kafka::add_PeerStats(peer, stats);
+
+    count(KafkaTopicSelector::TOPIC_ID_PEER_STATS, 1, ts);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_null::add_FlapReport(obj_bgp_peer &peer, std::vector<obj_flap_report> &flaps) {
+    timespec ts;
+    start(ts);
+
+    if (encode)
+        msgBus_kafka::add_FlapReport(peer, flaps);
+
+    count(KafkaTopicSelector::TOPIC_ID_FLAP, flaps.size(), ts);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_null::update_LsNode(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_node> &nodes,
+                                ls_action_code code) {
+    timespec ts;
+    start(ts);
+
+    if (encode)
+        msgBus_kafka::update_LsNode(peer, attr, nodes, code);
+
+    count(KafkaTopicSelector::TOPIC_ID_LS_NODE, nodes.size(), ts);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_null::update_LsLink(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_link> &links,
+                                ls_action_code code) {
+    timespec ts;
+    start(ts);
+
+    if (encode)
+        msgBus_kafka::update_LsLink(peer, attr, links, code);
+
+    count(KafkaTopicSelector::TOPIC_ID_LS_LINK, links.size(), ts);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_null::update_LsPrefix(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_prefix> &prefixes,
+                                  ls_action_code code) {
+    timespec ts;
+    start(ts);
+
+    if (encode)
+        msgBus_kafka::update_LsPrefix(peer, attr, prefixes, code);
+
+    count(KafkaTopicSelector::TOPIC_ID_LS_PREFIX, prefixes.size(), ts);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_null::update_L3Vpn(obj_bgp_peer &peer, std::vector<obj_vpn> &vpn, obj_path_attr *attr, vpn_action_code code) {
+    timespec ts;
+    start(ts);
+
+    if (encode)
+        msgBus_kafka::update_L3Vpn(peer, vpn, attr, code);
+
+    count(KafkaTopicSelector::TOPIC_ID_L3VPN, vpn.size(), ts);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_null::update_eVPN(obj_bgp_peer &peer, std::vector<obj_evpn> &vpn, obj_path_attr *attr, vpn_action_code code) {
+    timespec ts;
+    start(ts);
+
+    if (encode)
+        msgBus_kafka::update_eVPN(peer, vpn, attr, code);
+
+    count(KafkaTopicSelector::TOPIC_ID_EVPN, vpn.size(), ts);
+}
+
+/**
+ * Abstract method Implementation - See MsgBusInterface.hpp for details
+ */
+void msgBus_null::send_bmp_raw(u_char *r_hash, obj_bgp_peer &peer, u_char *data, size_t data_len) {
+    timespec ts;
+    start(ts);
+
+    if (encode)
+        msgBus_kafka::send_bmp_raw(r_hash, peer, data, data_len);
+
+    count(KafkaTopicSelector::TOPIC_ID_BMP_RAW, 1, ts);
+}
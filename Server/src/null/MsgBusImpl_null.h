@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef MSGBUSIMPL_NULL_H_
+#define MSGBUSIMPL_NULL_H_
+
+#include <ctime>
+
+#include "MsgBusImpl_kafka.h"
+#include "Config.h"
+#include "Logger.h"
+
+/**
+ * \class   msgBus_null
+ *
+ * \brief   Null message bus implementation
+ * \details Accepts all messages and only counts rows, bytes and call latency.  Used to measure
+ *          parser throughput in isolation from Kafka.  When encoding is enabled, messages are
+ *          encoded the same as for Kafka and then discarded.
+ *
+ *          Router, peer and collector messages are always encoded since they update the
+ *          router/peer state and hashes used by the parser.
+ */
+class msgBus_null: public msgBus_kafka {
+public:
+    /******************************************************************//**
+     * \brief Constructor for class
+     *
+     *  \param [in] logPtr      Pointer to Logger instance
+     *  \param [in] cfg         Pointer to the config instance
+     *  \param [in] c_hash_id   Collector Hash ID
+     ********************************************************************/
+    msgBus_null(Logger *logPtr, Config *cfg, u_char *c_hash_id);
+    ~msgBus_null();
+
+    /*
+     * abstract methods implemented
+     * See MsgBusInterface.hpp for method details
+     */
+    void update_Collector(struct obj_collector &c_obj, collector_action_code action_code);
+    void update_Router(struct obj_router &r_entry, router_action_code code);
+    void update_Peer(obj_bgp_peer &peer, obj_peer_up_event *up, obj_peer_down_event *down, peer_action_code code);
+    void update_baseAttribute(obj_bgp_peer &peer, obj_path_attr &attr, base_attr_action_code code);
+    void update_unicastPrefix(obj_bgp_peer &peer, std::vector<obj_rib> &rib, obj_path_attr *attr, unicast_prefix_action_code code);
+    void add_StatReport(obj_bgp_peer &peer, obj_stats_report &stats);
+    void add_FlapReport(obj_bgp_peer &peer, std::vector<obj_flap_report> &flaps);
+    void add_PeerStats(obj_bgp_peer &peer, obj_peer_stats &stats);
+
+    void update_LsNode(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_node> &nodes,
+                     ls_action_code code);
+    void update_LsLink(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_link> &links,
+                     ls_action_code code);
+    void update_LsPrefix(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_prefix> &prefixes,
+                      ls_action_code code);
+
+    void update_L3Vpn(obj_bgp_peer &peer, std::vector<obj_vpn> &vpn, obj_path_attr *attr, vpn_action_code code);
+
+    void update_eVPN(obj_bgp_peer &peer, std::vector<obj_evpn> &vpn, obj_path_attr *attr, vpn_action_code code);
+
+    void send_bmp_raw(u_char *r_hash, obj_bgp_peer &peer, u_char *data, size_t data_len);
+
+protected:
+    /**
+     * Count the encoded message and discard it
+     *
+     * \param [in] topic_id      Topic ID, KafkaTopicSelector::TOPIC_ID_*
+     * \param [in] p_topic       Peer topic info - NULL if not a peer topic
+     * \param [in] buf           Message buffer
+     * \param [in] len           Length of the message in bytes
+     * \param [in] key           Hash key
+     */
+    void send(int topic_id, peer_topic_info *p_topic, unsigned char *buf, size_t len, const std::string &key);
+
+    /**
+     * Nothing to connect to, only makes sure the topic selector exists
+     */
+    void checkConnection();
+
+private:
+    /**
+     * Counters per topic
+     */
+    struct topic_counters {
+        uint64_t    calls;                      ///< Number of message bus calls
+        uint64_t    rows;                       ///< Number of rows (prefixes, nodes, ...)
+        uint64_t    bytes;                      ///< Encoded bytes, only counted when encoding
+    };
+
+    /**
+     * Counters for a report interval (or the totals)
+     */
+    struct counters {
+        topic_counters  topic[KafkaTopicSelector::TOPIC_ID_MAX];
+        uint64_t        latency_ns;             ///< Sum of the call latencies
+        uint64_t        latency_max_ns;         ///< Max call latency
+        uint64_t        calls;                  ///< Number of calls
+    };
+
+    bool            encode;                     ///< Indicates messages are encoded before being discarded
+    counters        interval;                   ///< Counters for the current report interval
+    counters        total;                      ///< Counters since start
+    timespec        interval_start;             ///< Start of the current report interval
+    timespec        total_start;                ///< Start time
+    std::mutex      counters_mutex;             ///< Bytes are counted by the producer thread when pipelined
+
+    /**
+     * Get the call start time
+     *
+     * \param [out] ts      Current monotonic time
+     */
+    inline void start(timespec &ts) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+    }
+
+    /**
+     * Count a message bus call, reporting the counters if the interval has elapsed
+     *
+     * \param [in] topic_id      Topic ID, KafkaTopicSelector::TOPIC_ID_*
+     * \param [in] rows          Number of rows in the call
+     * \param [in] ts            Call start time
+     */
+    void count(int topic_id, size_t rows, const timespec &ts);
+
+    /**
+     * Log the counters
+     *
+     * \param [in] c            Counters to log
+     * \param [in] secs         Seconds the counters cover
+     * \param [in] label        Label for the log message
+     */
+    void report(const counters &c, double secs, const char *label);
+};
+
+#endif /* MSGBUSIMPL_NULL_H_ */
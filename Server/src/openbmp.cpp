@@ -16,11 +16,17 @@
  */
 
 #include "BMPListener.h"
-#include "MsgBusImpl_kafka.h"
+#include "MsgBusFactory.h"
 #include "MsgBusInterface.hpp"
 #include "client_thread.h"
 #include "openbmpd_version.h"
 #include "Config.h"
+#include "RibSnapshot.h"
+#include "RibQueryServer.h"
+#include "MetricsServer.h"
+#include "AdmissionController.h"
+#include "Takeover.h"
+#include "LatencyTrace.h"
 
 #include <unistd.h>
 #include <fstream>
@@ -39,7 +45,11 @@ const char *log_filename    = NULL;                 // Output file to log messag
 const char *debug_filename  = NULL;                 // Debug file to log messages to
 const char *pid_filename    = NULL;                 // PID file to record the daemon pid
 bool        run             = true;                 // Indicates if server should run
+volatile sig_atomic_t snapshot_requested = 0;       // Indicates a RIB snapshot should be written (SIGUSR1)
+volatile sig_atomic_t reload_requested = 0;         // Indicates the live config should be reloaded (SIGHUP)
 bool        run_foreground  = false;                // Indicates if server should run in forground
+bool        takeover        = false;                // Take over the sessions of the running collector
+int         null_output     = 0;                    // Null output from cmd line: 0=not set, 1=count only, 2=encode
 
 
 // Global thread list
@@ -63,6 +73,9 @@ void Usage(char *prog) {
     cout << "     -l <filename>     Log filename, default is STDOUT" << endl;
     cout << "     -d <filename>     Debug filename, default is log filename" << endl;
     cout << "     -f                Run in foreground instead of daemon (use for upstart)" << endl;
+    cout << "     -null             Discard messages and only count them (measure parser throughput)" << endl;
+    cout << "     -null_encode      Same as -null, but encode the messages before discarding them" << endl;
+    cout << "     -takeover         Take over the router sessions of the running collector (see takeover_socket)" << endl;
 
     cout << endl << "  OTHER OPTIONS:" << endl;
     cout << "     -v                   Version" << endl;
@@ -167,9 +180,18 @@ void signal_handler(int signum)
             LOG_INFO("Done closing all active BMP connections");
 
             run = false;
+            logger->stopWriter();
             exit(0);
             break;
 
+        case SIGUSR1 : // Write a RIB snapshot from the server loop
+            snapshot_requested = 1;
+            break;
+
+        case SIGHUP : // Reload the mapping and topics from the server loop
+            reload_requested = 1;
+            break;
+
         default:
             LOG_INFO("Ignoring signal %d", signum);
             break;
@@ -304,6 +326,13 @@ bool ReadCmdArgs(int argc, char **argv, Config &cfg) {
 
         } else if (!strcmp(argv[i], "-f")) {
             run_foreground = true;
+
+        } else if (!strcmp(argv[i], "-null")) {
+            null_output = 1;
+        } else if (!strcmp(argv[i], "-null_encode")) {
+            null_output = 2;
+        } else if (!strcmp(argv[i], "-takeover")) {
+            takeover = true;
         }
 
         // Config filename
@@ -361,11 +390,11 @@ bool ReadCmdArgs(int argc, char **argv, Config &cfg) {
 /**
  * Collector Update Message
  *
- * \param [in] kafka                 Pointer to kafka instance
+ * \param [in] mbus                  Pointer to message bus instance
  * \param [in] cfg                   Reference to configuration
  * \param [in] code                  reason code for the update
  */
-void collector_update_msg(msgBus_kafka *kafka, Config &cfg,
+void collector_update_msg(MsgBusInterface *mbus, Config &cfg,
                           MsgBusInterface::collector_action_code code) {
 
     MsgBusInterface::obj_collector oc;
@@ -390,7 +419,68 @@ void collector_update_msg(msgBus_kafka *kafka, Config &cfg,
     oc.timestamp_secs = tv.tv_sec;
     oc.timestamp_us = tv.tv_usec;
 
-    kafka->update_Collector(oc, code);
+    mbus->update_Collector(oc, code);
+}
+
+/**
+ * Open the RIB query socket, the collector runs without it if it can't be opened
+ *
+ * \param [in]  cfg    Reference to the config options
+ *
+ * \return query server, NULL if disabled or it could not be opened
+ */
+RibQueryServer *openQueryServer(Config &cfg) {
+    if (cfg.query_socket.size() > 0) {
+        try {
+            return new RibQueryServer(logger, &cfg);
+        } catch (char const *str) {
+            LOG_WARN("%s: %s", str, cfg.query_socket.c_str());
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Open the metrics port, the collector runs without it if it can't be opened
+ *
+ * \param [in]  cfg    Reference to the config options
+ *
+ * \return metrics server, NULL if disabled or it could not be opened
+ */
+MetricsServer *openMetricsServer(Config &cfg) {
+    if (cfg.metrics_port > 0) {
+        try {
+            return new MetricsServer(logger, &cfg);
+        } catch (char const *str) {
+            LOG_WARN("%s: %s port %u", str, cfg.metrics_address.c_str(), cfg.metrics_port);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Start the thread of a router connection
+ *
+ * \param [in]  thr    Thread management info, the client is set
+ */
+void startClientThread(ThreadMgmt *thr) {
+    pthread_attr_t thr_attr;            // thread attribute
+    pthread_attr_init(&thr_attr);
+    //pthread_attr_setdetachstate(&thr.thr_attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setdetachstate(&thr_attr, PTHREAD_CREATE_JOINABLE);
+    thr->running = 1;
+
+    // Start the thread to handle the client connection
+    pthread_create(&thr->thr, &thr_attr,
+                   ClientThread, thr);
+
+    // Add thread to vector
+    thr_list.insert(thr_list.end(), thr);
+
+    // Free attribute
+    pthread_attr_destroy(&thr_attr);
 }
 
 /**
@@ -399,10 +489,11 @@ void collector_update_msg(msgBus_kafka *kafka, Config &cfg,
  * \param [in]  cfg    Reference to the config options
  */
 void runServer(Config &cfg) {
-    msgBus_kafka *kafka;
+    MsgBusInterface *mbus;
     int active_connections = 0;                 // Number of active connections/threads
     int concurrent_routers = 0;			// Number of concurrent routers
     time_t last_heartbeat_time = 0;
+    bool handed_over = false;                   // Sessions were handed over to a new process
    
     LOG_INFO("Initializing server");
 
@@ -417,19 +508,110 @@ void runServer(Config &cfg) {
         memcpy(cfg.c_hash_id, hash_raw, 16);
         delete[] hash_raw;
 
-        // Kafka connection
-        kafka = new msgBus_kafka(logger, &cfg, cfg.c_hash_id);
+        // Before any router session is started
+        LatencyTrace::init(cfg.latency_sample_rate);
+
+        // Take over the listening sockets and router sessions before anything is opened
+        std::vector<ThreadMgmt *> sessions;
+        int v4_sock = 0, v6_sock = 0;
+
+        if (takeover) {
+            try {
+                Takeover::receive(logger, &cfg, v4_sock, v6_sock, sessions);
+            } catch (char const *str) {
+                LOG_ERR("Failed to take over the running collector: %s", str);
+                return;
+            }
+        }
+
+        // Message bus (kafka or file) connection
+        mbus = newMsgBus(logger, &cfg, cfg.c_hash_id);
 
         // allocate and start a new bmp server
-        BMPListener *bmp_svr = new BMPListener(logger, &cfg);
+        BMPListener *bmp_svr = new BMPListener(logger, &cfg, v4_sock, v6_sock);
+
+        // Local RIB query socket
+        RibQueryServer *query_svr = openQueryServer(cfg);
+
+        // Metrics endpoint
+        MetricsServer *metrics_svr = openMetricsServer(cfg);
+
+        // Takeover socket for the next upgrade, the collector runs without it if it can't be opened
+        Takeover *takeover_svr = NULL;
+        if (cfg.takeover_socket.size() > 0) {
+            try {
+                takeover_svr = new Takeover(logger, &cfg);
+            } catch (char const *str) {
+                LOG_WARN("%s: %s", str, cfg.takeover_socket.c_str());
+            }
+        }
+
+        // Decides when routers may connect while others are dumping their RIB
+        AdmissionController admission(logger, &cfg);
 
-        collector_update_msg(kafka, cfg, MsgBusInterface::COLLECTOR_ACTION_STARTED);
+        // Continue the sessions taken over, routers still dumping their RIB count as concurrent
+        for (size_t i = 0; i < sessions.size(); i++) {
+            ThreadMgmt *thr = sessions.at(i);
+            thr->cfg = &cfg;
+            thr->log = logger;
+            thr->baselineTimeout = thr->client.initDumpDone;
+
+            ++active_connections;
+            if (not thr->baselineTimeout)
+                ++concurrent_routers;
+
+            startClientThread(thr);
+        }
+
+        // Consumers keep the routers of the collector when it was taken over
+        collector_update_msg(mbus, cfg, takeover ? MsgBusInterface::COLLECTOR_ACTION_CHANGE
+                                                 : MsgBusInterface::COLLECTOR_ACTION_STARTED);
         last_heartbeat_time = time(NULL);
 
         LOG_INFO("Ready. Waiting for connections");
 
         // Loop to accept new connections
         while (run) {
+            if (snapshot_requested) {
+                snapshot_requested = 0;
+
+                RibSnapshot snapshot(logger, &cfg);
+                snapshot.write(cfg.snapshot_file);
+            }
+
+            if (reload_requested) {
+                reload_requested = 0;
+
+                try {
+                    cfg.reload();
+                    LOG_NOTICE("Reloaded the mapping and topics from the configuration file");
+
+                } catch (char const *str) {
+                    LOG_ERR("Failed to reload the configuration, keeping the current one: %s", str);
+                }
+            }
+
+            // New process taking over, it opens the query socket path and metrics port as well
+            if (takeover_svr != NULL and takeover_svr->pending()) {
+                if (query_svr != NULL) {
+                    delete query_svr;
+                    query_svr = NULL;
+                }
+
+                if (metrics_svr != NULL) {
+                    delete metrics_svr;
+                    metrics_svr = NULL;
+                }
+
+                if (takeover_svr->handover(bmp_svr, thr_list)) {
+                    handed_over = true;
+                    break;
+                }
+
+                query_svr = openQueryServer(cfg);
+                metrics_svr = openMetricsServer(cfg);
+            }
+
             /*
              * Check for any stale threads/connections
              */
@@ -449,42 +631,35 @@ void runServer(Config &cfg) {
                     delete thr_list.at(i);
                     thr_list.erase(thr_list.begin() + i);
 
-                    collector_update_msg(kafka, cfg,
+                    collector_update_msg(mbus, cfg,
                                          MsgBusInterface::COLLECTOR_ACTION_CHANGE);
 
                 }
 
 		        else if (!thr_list.at(i)->baselineTimeout) {
 
-                    int initial_time = cfg.initial_router_time;
-                    string hash(reinterpret_cast<char*>(thr_list.at(i)->client.hash_id), 16);
-
-                    //if calculate_baseline is true and the baseline time for the router is calculated, use the baseline time
-                    if (cfg.calculate_baseline && cfg.router_baseline_time.find(hash) != cfg.router_baseline_time.end())
-                        initial_time = cfg.router_baseline_time[hash];
-
-                    timeval now;
-                    gettimeofday(&now, NULL);
-
-                    //If past the baseline time, decrement concurrent router count
-                    if(now.tv_sec - thr_list.at(i)->client.startTime.tv_sec >= initial_time) {
+                    //If the initial RIB dump is done, decrement concurrent router count
+                    if (admission.startupDone(thr_list.at(i))) {
                         --concurrent_routers;
-                    thr_list.at(i)->baselineTimeout = true;		// Indicating that this router is not counted in the concurrent routers count
+                        thr_list.at(i)->baselineTimeout = true;		// Indicating that this router is not counted in the concurrent routers count
                     }
 		        }
 
                 //TODO: Add code to check for a socket that is open, but not really connected/half open
             }
 
+            admission.sample(thr_list, concurrent_routers);
+
             /*
              * Create a new client thread if we aren't at the max number of active sessions
              */
-            if(concurrent_routers < cfg.max_concurrent_routers)
+            if (admission.admit(concurrent_routers))
             {
                 if (active_connections <= MAX_THREADS) {
                     ThreadMgmt *thr = new ThreadMgmt;
                     thr->cfg = &cfg;
                     thr->log = logger;
+                    thr->handover = Takeover::HANDOVER_NONE;
 
                     // wait for a new connection and accept
                     if (bmp_svr->wait_and_accept_connection(thr->client, 500)) {
@@ -501,24 +676,10 @@ void runServer(Config &cfg) {
                         LOG_INFO("Client Connected => %s:%s, sock = %d",
                                  thr->client.c_ip, thr->client.c_port, thr->client.c_sock);
 
-                        pthread_attr_t thr_attr;            // thread attribute
-                        pthread_attr_init(&thr_attr);
-                        //pthread_attr_setdetachstate(&thr.thr_attr, PTHREAD_CREATE_DETACHED);
-                        pthread_attr_setdetachstate(&thr_attr, PTHREAD_CREATE_JOINABLE);
-                        thr->running = 1;
                         thr->baselineTimeout = false;
+                        startClientThread(thr);
 
-                        // Start the thread to handle the client connection
-                        pthread_create(&thr->thr, &thr_attr,
-                                       ClientThread, thr);
-
-                        // Add thread to vector
-                        thr_list.insert(thr_list.end(), thr);
-
-                        // Free attribute
-                        pthread_attr_destroy(&thr_attr);
-
-                        collector_update_msg(kafka, cfg,
+                        collector_update_msg(mbus, cfg,
                                              MsgBusInterface::COLLECTOR_ACTION_CHANGE);
 
                         last_heartbeat_time = time(NULL);
@@ -528,7 +689,7 @@ void runServer(Config &cfg) {
 
                         // Send heartbeat if needed
                         if ( (time(NULL) - last_heartbeat_time) >= cfg.heartbeat_interval) {
-                            collector_update_msg(kafka, cfg, MsgBusInterface::COLLECTOR_ACTION_HEARTBEAT);
+                            collector_update_msg(mbus, cfg, MsgBusInterface::COLLECTOR_ACTION_HEARTBEAT);
                             last_heartbeat_time = time(NULL);
                         }
 
@@ -540,10 +701,45 @@ void runServer(Config &cfg) {
                     sleep (1);
                 }
 	        }
+            else {
+                // Waiting for routers to finish their RIB dump, new connections wait in the listen backlog
+                if ( (time(NULL) - last_heartbeat_time) >= cfg.heartbeat_interval) {
+                    collector_update_msg(mbus, cfg, MsgBusInterface::COLLECTOR_ACTION_HEARTBEAT);
+                    last_heartbeat_time = time(NULL);
+                }
+
+                usleep(10000);
+            }
 	    }
 
-        collector_update_msg(kafka, cfg, MsgBusInterface::COLLECTOR_ACTION_STOPPED);
-        delete kafka;
+        if (handed_over) {
+            // Sessions handed over exit on their own, the others are closed as usual
+            for (size_t i = 0; i < thr_list.size(); i++) {
+                ThreadMgmt *thr = thr_list.at(i);
+
+                if (thr->handover.load() != Takeover::HANDOVER_SENT and thr->running)
+                    pthread_cancel(thr->thr);
+
+                pthread_join(thr->thr, NULL);
+                delete thr;
+            }
+
+            thr_list.clear();
+
+        } else {
+            collector_update_msg(mbus, cfg, MsgBusInterface::COLLECTOR_ACTION_STOPPED);
+        }
+
+        if (takeover_svr != NULL)
+            delete takeover_svr;
+
+        if (query_svr != NULL)
+            delete query_svr;
+
+        if (metrics_svr != NULL)
+            delete metrics_svr;
+
+        delete mbus;
 
     } catch (char const *str) {
         LOG_WARN(str);
@@ -571,6 +767,12 @@ int main(int argc, char **argv) {
         }
     }
 
+    // Command line null output overrides the configuration
+    if (null_output > 0) {
+        cfg.output_type = "null";
+        cfg.null_encode = null_output == 2;
+    }
+
     // Make sure we have the required ARGS
     if (strlen(cfg.admin_id) <= 0) {
         cout << "ERROR: Missing required 'admin ID', use -c <config> or -a <string> to set the collector admin ID" << endl;
@@ -599,6 +801,9 @@ int main(int argc, char **argv) {
         daemonize();
     }
 
+    // Log from here on through the writer thread, it would not survive the daemon fork
+    logger->startWriter();
+
     /*
      * Setup the signal handlers
      */
@@ -620,6 +825,7 @@ int main(int argc, char **argv) {
     runServer(cfg);
 
 	LOG_NOTICE("Program ended normally");
+	logger->stopWriter();
 
 	return 0;
 }
@@ -0,0 +1,550 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#ifndef RINGQUEUE_HPP_
+#define RINGQUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <climits>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <thread>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#else
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#endif
+
+#define RING_QUEUE_CACHE_LINE   64              ///< Cache line size used for padding
+#define RING_QUEUE_SPIN         128             ///< Retries before a blocking call sleeps
+
+/**
+ * \class   ringQueueAligned
+ *
+ * \brief   Cache line aligned heap allocation
+ * \details C++11 operator new only guarantees the alignment of max_align_t, so objects with
+ *          alignas(RING_QUEUE_CACHE_LINE) members are allocated through this base.  Classes that
+ *          hold a ring by value inherit it as well.
+ */
+class ringQueueAligned {
+public:
+    static void *operator new(size_t size) {
+        void *p;
+
+        if (posix_memalign(&p, RING_QUEUE_CACHE_LINE, size))
+            throw std::bad_alloc();
+
+        return p;
+    }
+
+    static void *operator new[](size_t size) {
+        return operator new(size);
+    }
+
+    static void operator delete(void *p) {
+        free(p);
+    }
+
+    static void operator delete[](void *p) {
+        free(p);
+    }
+};
+
+/**
+ * \class   ringQueueSignal
+ *
+ * \brief   Wakeup signal for the blocking queue calls
+ * \details A sequence number is bumped on every wake.  A waiter reads the sequence, checks its
+ *          condition and then sleeps only if the sequence has not changed.  Wakes are skipped when
+ *          nobody waits, so the non-blocking path never makes a syscall.  Uses a futex on Linux and a
+ *          condition variable elsewhere.
+ */
+class ringQueueSignal {
+public:
+    ringQueueSignal() : seq(0), waiters(0) { }
+
+    /**
+     * Register as a waiter and get the sequence to wait on - must be followed by wait()
+     */
+    inline uint32_t prepare() {
+        waiters.fetch_add(1);
+
+        // Orders the waiters change before the queue state check, pairs with wake()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return seq.load();
+    }
+
+    /**
+     * Sleep until woken or timeout, unless the sequence changed since prepare()
+     *
+     * \param [in] expected     Sequence returned by prepare()
+     * \param [in] timeout_ms   Milliseconds to wait, negative waits forever
+     */
+    void wait(uint32_t expected, int timeout_ms) {
+#ifdef __linux__
+        timespec ts;
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&seq), FUTEX_WAIT_PRIVATE, expected,
+                timeout_ms < 0 ? NULL : &ts, NULL, 0);
+#else
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if (timeout_ms < 0)
+            cond.wait(lock, [&] { return seq.load() != expected; });
+        else
+            cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] { return seq.load() != expected; });
+#endif
+        waiters.fetch_sub(1);
+    }
+
+    /**
+     * Cancel a prepare() without waiting
+     */
+    inline void cancel() {
+        waiters.fetch_sub(1);
+    }
+
+    /**
+     * Wake all waiters - Call after the state the waiters check has changed
+     */
+    inline void wake() {
+        // Orders the state change before the waiters check, pairs with prepare()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (waiters.load(std::memory_order_relaxed) == 0)
+            return;
+
+#ifdef __linux__
+        seq.fetch_add(1);
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&seq), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            seq.fetch_add(1);
+        }
+        cond.notify_all();
+#endif
+    }
+
+private:
+    std::atomic<uint32_t>   seq;                ///< Bumped on every wake, the futex word
+    std::atomic<uint32_t>   waiters;            ///< Number of threads in prepare()/wait()
+
+#ifndef __linux__
+    std::mutex              mutex;
+    std::condition_variable cond;
+#endif
+};
+
+/**
+ * \class   ringQueueBase
+ *
+ * \brief   Blocking and batch calls shared by the SPSC and MPMC rings
+ * \details The derived ring implements tryPush()/tryPop().  The blocking calls spin briefly and
+ *          then sleep on a ringQueueSignal.
+ */
+template <typename ring, typename type>
+class ringQueueBase : public ringQueueAligned {
+public:
+    ringQueueBase() : closed(false) { }
+
+    /**
+     * Add an element, blocks while the queue is full
+     *
+     * \param [in] elem         Element to add
+     *
+     * \return true if added, false if the queue is closed
+     */
+    bool push(type const &elem) {
+        for (int i = 0; ; i++) {
+            if (closed.load(std::memory_order_relaxed))
+                return false;
+
+            if (self().tryPush(elem)) {
+                not_empty.wake();
+                return true;
+            }
+
+            if (i < RING_QUEUE_SPIN) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            uint32_t seq = not_full.prepare();
+
+            if (self().tryPush(elem)) {
+                not_full.cancel();
+                not_empty.wake();
+                return true;
+            }
+
+            if (closed.load()) {
+                not_full.cancel();
+                return false;
+            }
+
+            not_full.wait(seq, -1);
+        }
+    }
+
+    /**
+     * Remove the front element, blocks while the queue is empty
+     *
+     * \param [out] elem        Removed element
+     * \param [in]  timeout_ms  Milliseconds to wait, negative waits forever
+     *
+     * \return true if an element was removed, false on timeout or if the queue is closed and empty
+     */
+    bool pop(type &elem, int timeout_ms = -1) {
+        return popBulk(&elem, 1, timeout_ms) == 1;
+    }
+
+    /**
+     * Add up to count elements without blocking
+     *
+     * \param [in] elems        Elements to add
+     * \param [in] count        Number of elements
+     *
+     * \return number of elements added, in order
+     */
+    size_t pushBulk(type const *elems, size_t count) {
+        size_t i = 0;
+
+        while (i < count and self().tryPush(elems[i]))
+            i++;
+
+        if (i > 0)
+            not_empty.wake();
+
+        return i;
+    }
+
+    /**
+     * Remove up to max elements, blocks until at least one is available
+     *
+     * \details A batch hands off many elements with one wakeup, which is how the pipeline stages
+     *          should move work between each other.
+     *
+     * \param [out] elems       Removed elements
+     * \param [in]  max         Maximum number of elements to remove
+     * \param [in]  timeout_ms  Milliseconds to wait, negative waits forever, zero does not wait
+     *
+     * \return number of elements removed, zero on timeout or if the queue is closed and empty
+     */
+    size_t popBulk(type *elems, size_t max, int timeout_ms = -1) {
+        size_t n = 0;
+
+        for (int i = 0; ; i++) {
+            while (n < max and self().tryPop(elems[n]))
+                n++;
+
+            if (n > 0) {
+                not_full.wake();
+                return n;
+            }
+
+            if (timeout_ms == 0 or closed.load(std::memory_order_relaxed))
+                return 0;
+
+            if (i < RING_QUEUE_SPIN) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            uint32_t seq = not_empty.prepare();
+
+            if (self().tryPop(elems[0])) {
+                not_empty.cancel();
+                n = 1;
+                continue;
+            }
+
+            if (closed.load()) {
+                not_empty.cancel();
+                return 0;
+            }
+
+            not_empty.wait(seq, timeout_ms);
+
+            // Only one sleep with a timeout, a spurious wake just returns empty
+            if (timeout_ms > 0 and not self().tryPop(elems[0]))
+                return 0;
+            else if (timeout_ms > 0)
+                n = 1;
+        }
+    }
+
+    /**
+     * Close the queue - Wakes all blocked callers.  Remaining elements can still be popped.
+     */
+    void close() {
+        closed.store(true);
+        not_empty.wake();
+        not_full.wake();
+    }
+
+    /**
+     * Check if the queue is closed
+     */
+    inline bool isClosed() {
+        return closed.load(std::memory_order_relaxed);
+    }
+
+protected:
+    std::atomic<bool>   closed;                 ///< Set by close()
+    ringQueueSignal     not_empty;              ///< Woken when elements are added
+    ringQueueSignal     not_full;               ///< Woken when elements are removed
+
+private:
+    inline ring &self() {
+        return static_cast<ring &>(*this);
+    }
+};
+
+/**
+ * \class   spscQueue
+ *
+ * \brief   Bounded lock-free single producer, single consumer ring
+ * \details Used between two pipeline stages.  Each side caches the other side's index so the shared
+ *          cache lines are only read when the cached view says the ring is full or empty.  The
+ *          capacity is rounded up to a power of two.
+ */
+template <typename type>
+class spscQueue : public ringQueueBase<spscQueue<type>, type> {
+public:
+    /**
+     * Class constructor
+     *
+     * \param [in] capacity     Maximum number of elements
+     */
+    explicit spscQueue(size_t capacity) {
+        size = 2;
+        while (size < capacity)
+            size <<= 1;
+
+        mask = size - 1;
+        buf = new type[size];
+
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        cached_head = 0;
+        cached_tail = 0;
+    }
+
+    ~spscQueue() {
+        delete[] buf;
+    }
+
+    spscQueue(const spscQueue &) = delete;
+    spscQueue &operator=(const spscQueue &) = delete;
+
+    /**
+     * Add an element without blocking - producer thread only
+     *
+     * \return true if added, false if full
+     */
+    inline bool tryPush(type const &elem) {
+        size_t t = tail.load(std::memory_order_relaxed);
+
+        if (t - cached_head >= size) {
+            cached_head = head.load(std::memory_order_acquire);
+
+            if (t - cached_head >= size)
+                return false;
+        }
+
+        buf[t & mask] = elem;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Remove the front element without blocking - consumer thread only
+     *
+     * \return true if removed, false if empty
+     */
+    inline bool tryPop(type &elem) {
+        size_t h = head.load(std::memory_order_relaxed);
+
+        if (h == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+
+            if (h == cached_tail)
+                return false;
+        }
+
+        elem = buf[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Approximate number of elements
+     */
+    inline size_t count() {
+        return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_relaxed);
+    }
+
+    inline size_t capacity() {
+        return size;
+    }
+
+private:
+    type            *buf;                       ///< Ring buffer
+    size_t          size;                       ///< Capacity, power of two
+    size_t          mask;                       ///< size - 1
+
+    alignas(RING_QUEUE_CACHE_LINE) std::atomic<size_t> head;    ///< Next to pop, written by the consumer
+    size_t          cached_tail;                ///< Consumer's copy of tail
+
+    alignas(RING_QUEUE_CACHE_LINE) std::atomic<size_t> tail;    ///< Next to push, written by the producer
+    size_t          cached_head;                ///< Producer's copy of head
+
+    char            pad[RING_QUEUE_CACHE_LINE - sizeof(size_t) * 2];
+};
+
+/**
+ * \class   mpmcQueue
+ *
+ * \brief   Bounded lock-free multi producer, multi consumer ring
+ * \details Used for pools shared by several threads.  Each cell has a sequence number that tells
+ *          producers and consumers whether it is free or filled for their lap, so the only shared
+ *          writes are one CAS on the enqueue or dequeue position.  The capacity is rounded up to a
+ *          power of two.
+ */
+template <typename type>
+class mpmcQueue : public ringQueueBase<mpmcQueue<type>, type> {
+public:
+    /**
+     * Class constructor
+     *
+     * \param [in] capacity     Maximum number of elements
+     */
+    explicit mpmcQueue(size_t capacity) {
+        size = 2;
+        while (size < capacity)
+            size <<= 1;
+
+        mask = size - 1;
+        cells = new cell[size];
+
+        for (size_t i = 0; i < size; i++)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+
+        enqueue_pos.store(0, std::memory_order_relaxed);
+        dequeue_pos.store(0, std::memory_order_relaxed);
+    }
+
+    ~mpmcQueue() {
+        delete[] cells;
+    }
+
+    mpmcQueue(const mpmcQueue &) = delete;
+    mpmcQueue &operator=(const mpmcQueue &) = delete;
+
+    /**
+     * Add an element without blocking
+     *
+     * \return true if added, false if full
+     */
+    inline bool tryPush(type const &elem) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        cell *c;
+
+        for (;;) {
+            c = &cells[pos & mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+
+            } else if (diff < 0)
+                return false;               // Full
+
+            else
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+
+        c->data = elem;
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Remove the front element without blocking
+     *
+     * \return true if removed, false if empty
+     */
+    inline bool tryPop(type &elem) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        cell *c;
+
+        for (;;) {
+            c = &cells[pos & mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t) seq - (intptr_t)(pos + 1);
+
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+
+            } else if (diff < 0)
+                return false;               // Empty
+
+            else
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+        }
+
+        elem = c->data;
+        c->seq.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Approximate number of elements
+     */
+    inline size_t count() {
+        size_t e = enqueue_pos.load(std::memory_order_relaxed);
+        size_t d = dequeue_pos.load(std::memory_order_relaxed);
+
+        return e > d ? e - d : 0;
+    }
+
+    inline size_t capacity() {
+        return size;
+    }
+
+private:
+    struct cell {
+        std::atomic<size_t> seq;                ///< Cell lap sequence
+        type                data;               ///< Element
+    };
+
+    cell            *cells;                     ///< Ring buffer
+    size_t          size;                       ///< Capacity, power of two
+    size_t          mask;                       ///< size - 1
+
+    alignas(RING_QUEUE_CACHE_LINE) std::atomic<size_t> enqueue_pos;    ///< Next cell to fill
+    alignas(RING_QUEUE_CACHE_LINE) std::atomic<size_t> dequeue_pos;    ///< Next cell to empty
+
+    char            pad[RING_QUEUE_CACHE_LINE - sizeof(size_t)];
+};
+
+#endif /* RINGQUEUE_HPP_ */
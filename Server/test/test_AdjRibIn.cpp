@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "unitTest.h"
+#include "AdjRibIn.h"
+#include "AttrTable.h"
+
+/**
+ * Access to the trie nodes of AdjRibIn
+ */
+struct AdjRibInTest {
+    static size_t nodes(AdjRibIn &rib, int type, bool isIPv4) {
+        return countNodes(rib.root[type][isIPv4 ? 0 : 1]);
+    }
+
+private:
+    static size_t countNodes(AdjRibIn::node *n) {
+        return n == NULL ? 0 : 1 + countNodes(n->child[0]) + countNodes(n->child[1]);
+    }
+};
+
+/**
+ * Prefix in binary form from its printed form
+ */
+struct prefix {
+    uint8_t     addr[16];
+    uint8_t     len;
+    bool        isIPv4;
+
+    prefix(const char *str) {
+        std::string s(str);
+        size_t slash = s.find('/');
+        std::string a = s.substr(0, slash);
+
+        memset(addr, 0, sizeof(addr));
+        isIPv4 = inet_pton(AF_INET, a.c_str(), addr) == 1;
+        if (not isIPv4)
+            inet_pton(AF_INET6, a.c_str(), addr);
+
+        len = slash != std::string::npos ? atoi(s.c_str() + slash + 1) : (isIPv4 ? 32 : 128);
+    }
+};
+
+/**
+ * Interned attributes with the AS path, the caller releases the reference
+ */
+static uint32_t makeAttr(const char *as_path) {
+    MsgBusInterface::obj_path_attr attr = MsgBusInterface::obj_path_attr();
+    attr.as_path = as_path;
+    return AttrTable::instance().intern(attr);
+}
+
+static bool update(AdjRibIn &rib, const char *p, uint32_t attr_id, uint32_t path_id = 0, bool *replaced = NULL) {
+    prefix pfx(p);
+    return rib.update(AdjRibIn::RIB_PRE_POLICY, pfx.isIPv4, pfx.addr, pfx.len, path_id, attr_id, 0, replaced);
+}
+
+static bool withdraw(AdjRibIn &rib, const char *p, uint32_t path_id = 0) {
+    prefix pfx(p);
+    return rib.withdraw(AdjRibIn::RIB_PRE_POLICY, pfx.isIPv4, pfx.addr, pfx.len, path_id);
+}
+
+/**
+ * Longest prefix match in printed form, empty if none
+ */
+static std::string lookup(AdjRibIn &rib, const char *p) {
+    prefix pfx(p);
+    std::string found;
+
+    rib.lookup(AdjRibIn::RIB_PRE_POLICY, pfx.isIPv4, pfx.addr, pfx.len,
+               [&](const uint8_t *addr, uint8_t len, uint32_t path_id, uint32_t attr_id, uint32_t label_hash) {
+        char str[46];
+        inet_ntop(pfx.isIPv4 ? AF_INET : AF_INET6, addr, str, sizeof(str));
+        found = std::string(str) + "/" + std::to_string(len);
+    });
+
+    return found;
+}
+
+static std::vector<std::string> walk(AdjRibIn &rib, bool isIPv4 = true) {
+    std::vector<std::string> found;
+
+    rib.walk(AdjRibIn::RIB_PRE_POLICY, isIPv4,
+             [&](const uint8_t *addr, uint8_t len, uint32_t path_id, uint32_t attr_id, uint32_t label_hash) {
+        char str[46];
+        inet_ntop(isIPv4 ? AF_INET : AF_INET6, addr, str, sizeof(str));
+        found.push_back(std::string(str) + "/" + std::to_string(len));
+    });
+
+    return found;
+}
+
+TEST(insertNewAndUnchanged) {
+    AdjRibIn rib;
+    uint32_t a = makeAttr("65001 65002");
+    uint32_t b = makeAttr("65001 65003");
+    bool replaced;
+
+    CHECK(update(rib, "10.0.0.0/24", a, 0, &replaced));
+    CHECK(not replaced);
+    CHECK(rib.size() == 1);
+
+    // Same attributes are unchanged, other attributes replace the path
+    CHECK(not update(rib, "10.0.0.0/24", a, 0, &replaced));
+    CHECK(update(rib, "10.0.0.0/24", b, 0, &replaced));
+    CHECK(replaced);
+    CHECK(rib.size() == 1);
+
+    // Unknown attributes are always changed
+    CHECK(update(rib, "10.0.1.0/24", 0));
+    CHECK(update(rib, "10.0.1.0/24", 0));
+
+    // Add paths are separate entries of the prefix
+    CHECK(update(rib, "10.0.0.0/24", a, 7));
+    CHECK(rib.size() == 3);
+
+    // Host bits past the length are ignored
+    CHECK(not update(rib, "10.0.0.99/24", b));
+
+    AttrTable::instance().release(a);
+    AttrTable::instance().release(b);
+}
+
+TEST(withdraw) {
+    AdjRibIn rib;
+    uint32_t a = makeAttr("65001");
+
+    update(rib, "10.0.0.0/24", a);
+    update(rib, "10.0.0.0/24", a, 2);
+
+    CHECK(not withdraw(rib, "10.0.0.0/25"));
+    CHECK(not withdraw(rib, "10.0.0.0/24", 3));
+    CHECK(withdraw(rib, "10.0.0.0/24", 2));
+    CHECK(rib.size() == 1);
+    CHECK(withdraw(rib, "10.0.0.0/24"));
+    CHECK(not withdraw(rib, "10.0.0.0/24"));
+    CHECK(rib.size() == 0);
+    CHECK(walk(rib).empty());
+
+    AttrTable::instance().release(a);
+}
+
+TEST(pruneCollapsesGlueNode) {
+    AdjRibIn rib;
+    uint32_t a = makeAttr("65001");
+
+    // Siblings are joined by a 10.0.0.0/23 glue node
+    update(rib, "10.0.0.0/24", a);
+    update(rib, "10.0.1.0/24", a);
+    CHECK(AdjRibInTest::nodes(rib, AdjRibIn::RIB_PRE_POLICY, true) == 3);
+
+    withdraw(rib, "10.0.1.0/24");
+    CHECK(AdjRibInTest::nodes(rib, AdjRibIn::RIB_PRE_POLICY, true) == 1);
+    CHECK(lookup(rib, "10.0.0.1") == "10.0.0.0/24");
+
+    withdraw(rib, "10.0.0.0/24");
+    CHECK(AdjRibInTest::nodes(rib, AdjRibIn::RIB_PRE_POLICY, true) == 0);
+
+    // Glue node below a prefix collapses into the prefix's child link
+    update(rib, "10.0.0.0/16", a);
+    update(rib, "10.0.0.0/24", a);
+    update(rib, "10.0.1.0/24", a);
+    CHECK(AdjRibInTest::nodes(rib, AdjRibIn::RIB_PRE_POLICY, true) == 4);
+
+    withdraw(rib, "10.0.0.0/24");
+    CHECK(AdjRibInTest::nodes(rib, AdjRibIn::RIB_PRE_POLICY, true) == 2);
+    CHECK(walk(rib) == std::vector<std::string>({ "10.0.0.0/16", "10.0.1.0/24" }));
+
+    // A prefix with two children stays as a glue node when withdrawn
+    update(rib, "10.0.0.0/24", a);
+    update(rib, "10.0.0.0/23", a);
+    CHECK(AdjRibInTest::nodes(rib, AdjRibIn::RIB_PRE_POLICY, true) == 4);
+
+    withdraw(rib, "10.0.0.0/23");
+    CHECK(AdjRibInTest::nodes(rib, AdjRibIn::RIB_PRE_POLICY, true) == 4);
+    CHECK(walk(rib) == std::vector<std::string>({ "10.0.0.0/16", "10.0.0.0/24", "10.0.1.0/24" }));
+
+    withdraw(rib, "10.0.0.0/16");
+    CHECK(AdjRibInTest::nodes(rib, AdjRibIn::RIB_PRE_POLICY, true) == 3);
+    withdraw(rib, "10.0.0.0/24");
+    withdraw(rib, "10.0.1.0/24");
+    CHECK(AdjRibInTest::nodes(rib, AdjRibIn::RIB_PRE_POLICY, true) == 0);
+
+    AttrTable::instance().release(a);
+}
+
+TEST(lookupLongestMatch) {
+    AdjRibIn rib;
+    uint32_t a = makeAttr("65001");
+
+    update(rib, "10.0.0.0/8", a);
+    update(rib, "10.1.0.0/16", a);
+    update(rib, "10.1.2.0/24", a);
+    update(rib, "2001:db8::/32", a);
+    update(rib, "2001:db8:1::/48", a);
+
+    CHECK(lookup(rib, "10.1.2.3") == "10.1.2.0/24");
+    CHECK(lookup(rib, "10.1.3.1") == "10.1.0.0/16");
+    CHECK(lookup(rib, "10.2.0.1") == "10.0.0.0/8");
+    CHECK(lookup(rib, "11.0.0.1") == "");
+
+    // Prefix queries only match prefixes of the same length or shorter
+    CHECK(lookup(rib, "10.1.0.0/16") == "10.1.0.0/16");
+    CHECK(lookup(rib, "10.1.2.0/23") == "10.1.0.0/16");
+    CHECK(lookup(rib, "10.0.0.0/7") == "");
+
+    CHECK(lookup(rib, "2001:db8:1::1") == "2001:db8:1::/48");
+    CHECK(lookup(rib, "2001:db8:2::1") == "2001:db8::/32");
+    CHECK(lookup(rib, "2001:db9::1") == "");
+
+    // Address families are separate tries
+    CHECK(walk(rib, true).size() == 3);
+    CHECK(walk(rib, false).size() == 2);
+
+    AttrTable::instance().release(a);
+}
+
+TEST(releasesAttributes) {
+    size_t before = AttrTable::instance().size();
+
+    {
+        AdjRibIn rib;
+        uint32_t a = makeAttr("65001 65010");
+        uint32_t b = makeAttr("65001 65011");
+
+        update(rib, "10.0.0.0/24", a);
+        update(rib, "10.0.1.0/24", b);
+
+        // The RIB holds its own references
+        AttrTable::instance().release(a);
+        AttrTable::instance().release(b);
+        CHECK(AttrTable::instance().size() == before + 2);
+
+        // Replaced attributes are released
+        update(rib, "10.0.1.0/24", 0);
+        CHECK(AttrTable::instance().size() == before + 1);
+    }
+
+    // Destructor releases the rest
+    CHECK(AttrTable::instance().size() == before);
+}
+
+TEST_MAIN()
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cstring>
+
+#include "unitTest.h"
+#include "AttrTable.h"
+
+/**
+ * Attributes with the AS path and next-hop
+ */
+static MsgBusInterface::obj_path_attr makeAttr(const char *as_path, const char *next_hop = "192.0.2.1") {
+    MsgBusInterface::obj_path_attr attr = MsgBusInterface::obj_path_attr();
+    attr.as_path = as_path;
+    strncpy(attr.next_hop, next_hop, sizeof(attr.next_hop) - 1);
+    attr.nexthop_isIPv4 = true;
+    attr.local_pref = 100;
+    return attr;
+}
+
+TEST(equalAttrsShareId) {
+    AttrTable &table = AttrTable::instance();
+    size_t before = table.size();
+
+    MsgBusInterface::obj_path_attr attr = makeAttr("65001 65002");
+    uint32_t a = table.intern(attr);
+
+    // The hash_id includes the peer, it is not part of the key
+    memset(attr.hash_id, 0xff, sizeof(attr.hash_id));
+    uint32_t b = table.intern(attr);
+
+    CHECK(a != 0);
+    CHECK(a == b);
+    CHECK(table.size() == before + 1);
+
+    table.release(a);
+    table.release(b);
+    CHECK(table.size() == before);
+}
+
+TEST(differentAttrsGetOtherId) {
+    AttrTable &table = AttrTable::instance();
+    size_t before = table.size();
+
+    uint32_t a = table.intern(makeAttr("65001 65002"));
+    uint32_t b = table.intern(makeAttr("65001 65003"));
+    uint32_t c = table.intern(makeAttr("65001 65002", "192.0.2.2"));
+
+    MsgBusInterface::obj_path_attr med = makeAttr("65001 65002");
+    med.med = 10;
+    uint32_t d = table.intern(med);
+
+    CHECK(a != b);
+    CHECK(a != c);
+    CHECK(a != d);
+    CHECK(b != c);
+    CHECK(table.size() == before + 4);
+
+    table.release(a);
+    table.release(b);
+    table.release(c);
+    table.release(d);
+    CHECK(table.size() == before);
+}
+
+TEST(lastReleaseFreesEntry) {
+    AttrTable &table = AttrTable::instance();
+    MsgBusInterface::obj_path_attr attr;
+    size_t before = table.size();
+
+    uint32_t a = table.intern(makeAttr("65001 65004"));
+    table.addRef(a);
+
+    // Still referenced after one release
+    table.release(a);
+    CHECK(table.get(a, attr));
+    CHECK(attr.as_path == "65001 65004");
+    CHECK(table.size() == before + 1);
+
+    table.release(a);
+    CHECK(not table.get(a, attr));
+    CHECK(table.size() == before);
+
+    // Releasing or referencing a freed ID does not bring it back
+    table.release(a);
+    table.addRef(a);
+    CHECK(not table.get(a, attr));
+
+    // The same attributes are interned again as a new entry
+    uint32_t b = table.intern(makeAttr("65001 65004"));
+    CHECK(table.get(b, attr));
+    CHECK(table.size() == before + 1);
+
+    table.release(b);
+    CHECK(table.size() == before);
+}
+
+TEST(getReturnsCopy) {
+    AttrTable &table = AttrTable::instance();
+    MsgBusInterface::obj_path_attr attr = makeAttr("65001 65005");
+    attr.community_list = "65001:1 65001:2";
+    memset(attr.hash_id, 0xff, sizeof(attr.hash_id));
+
+    uint32_t a = table.intern(attr);
+
+    MsgBusInterface::obj_path_attr copy;
+    CHECK(table.get(a, copy));
+    CHECK(copy.as_path == "65001 65005");
+    CHECK(copy.community_list == "65001:1 65001:2");
+    CHECK(strcmp(copy.next_hop, "192.0.2.1") == 0);
+    CHECK(copy.local_pref == 100);
+
+    // The hash_id is not stored
+    u_char zero[16] = { 0 };
+    CHECK(memcmp(copy.hash_id, zero, sizeof(zero)) == 0);
+
+    // Changing the copy does not change the entry
+    copy.as_path = "65009";
+    CHECK(table.get(a, copy));
+    CHECK(copy.as_path == "65001 65005");
+
+    CHECK(not table.get(0, copy));
+
+    table.release(a);
+}
+
+TEST(pathHashIncludesPeer) {
+    MsgBusInterface::obj_path_attr attr = makeAttr("65001 65006");
+    u_char peer1[16] = { 1 }, peer2[16] = { 2 };
+    u_char hash1[16], hash2[16], hash3[16];
+
+    AttrTable::pathHash(attr, peer1, hash1);
+    AttrTable::pathHash(attr, peer2, hash2);
+    AttrTable::pathHash(attr, peer1, hash3);
+
+    CHECK(memcmp(hash1, hash2, sizeof(hash1)) != 0);
+    CHECK(memcmp(hash1, hash3, sizeof(hash1)) == 0);
+}
+
+TEST_MAIN()
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "unitTest.h"
+#include "KafkaJournal.h"
+
+static Logger logger(NULL, NULL);
+
+/**
+ * Temporary journal directory, removed with its segments
+ */
+struct journalDir {
+    std::string path;
+    Config      cfg;
+
+    journalDir() {
+        char tmpl[] = "/tmp/test_KafkaJournal.XXXXXX";
+        path = mkdtemp(tmpl);
+
+        cfg.journal_dir = path;
+
+        // Nothing listens here, so records are never delivered and segments are kept
+        cfg.kafka_brokers = "127.0.0.1:1";
+    }
+
+    ~journalDir() {
+        std::vector<std::string> files = segments();
+
+        for (size_t i = 0; i < files.size(); i++)
+            unlink(files[i].c_str());
+
+        rmdir(path.c_str());
+    }
+
+    /**
+     * Segment files, oldest first
+     */
+    std::vector<std::string> segments() {
+        std::vector<std::string> files;
+        DIR *dir = opendir(path.c_str());
+        struct dirent *entry;
+
+        while (dir != NULL and (entry = readdir(dir)) != NULL) {
+            if (strncmp(entry->d_name, JOURNAL_SEGMENT_PREFIX, strlen(JOURNAL_SEGMENT_PREFIX)) == 0)
+                files.push_back(path + "/" + entry->d_name);
+        }
+
+        if (dir != NULL)
+            closedir(dir);
+
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+};
+
+static off_t fileSize(const std::string &filename) {
+    struct stat st;
+    return stat(filename.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+/**
+ * Append bytes to the end of a file, as left by a crash in the middle of a write
+ */
+static void appendBytes(const std::string &filename, const unsigned char *data, size_t len) {
+    FILE *fp = fopen(filename.c_str(), "a");
+    fwrite(data, 1, len, fp);
+    fclose(fp);
+}
+
+static std::string readFile(const std::string &filename) {
+    std::string data;
+    char buf[4096];
+    size_t len;
+    FILE *fp = fopen(filename.c_str(), "r");
+
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+        data.append(buf, len);
+
+    fclose(fp);
+    return data;
+}
+
+/**
+ * Journal records of the same size in a single segment
+ *
+ * \return size of each record
+ */
+static off_t writeRecords(journalDir &dir, int count) {
+    const unsigned char data[100] = { 0 };
+
+    {
+        KafkaJournal journal(&logger, &dir.cfg);
+
+        for (int i = 0; i < count; i++)
+            journal.append("openbmp.parsed.unicast_prefix", "key", data, sizeof(data));
+    }
+
+    return dir.segments().size() == 1 ? fileSize(dir.segments()[0]) / count : 0;
+}
+
+TEST(keepsCompleteSegment) {
+    journalDir dir;
+    off_t rec_len = writeRecords(dir, 3);
+    CHECK(rec_len > 0);
+
+    std::string segment = dir.segments()[0];
+
+    {
+        KafkaJournal journal(&logger, &dir.cfg);
+        CHECK(journal.pending());
+    }
+
+    CHECK(fileSize(segment) == rec_len * 3);
+}
+
+TEST(truncatesPartialRecord) {
+    journalDir dir;
+    off_t rec_len = writeRecords(dir, 3);
+    CHECK(rec_len > 0);
+
+    std::string segment = dir.segments()[0];
+    std::string records = readFile(segment);
+
+    // Crash after the header and part of the data of the fourth record
+    appendBytes(segment, (const unsigned char *)records.data(), rec_len / 2);
+    CHECK(fileSize(segment) == rec_len * 3 + rec_len / 2);
+
+    {
+        KafkaJournal journal(&logger, &dir.cfg);
+        CHECK(journal.pending());
+        CHECK(fileSize(segment) == rec_len * 3);
+    }
+
+    CHECK(readFile(segment) == records);
+}
+
+TEST(truncatesPartialHeader) {
+    journalDir dir;
+    off_t rec_len = writeRecords(dir, 2);
+    CHECK(rec_len > 0);
+
+    std::string segment = dir.segments()[0];
+    std::string records = readFile(segment);
+
+    appendBytes(segment, (const unsigned char *)records.data(), 3);
+
+    {
+        KafkaJournal journal(&logger, &dir.cfg);
+    }
+
+    CHECK(fileSize(segment) == rec_len * 2);
+}
+
+TEST(keepsCorruptRecord) {
+    journalDir dir;
+    off_t rec_len = writeRecords(dir, 2);
+    CHECK(rec_len > 0);
+
+    std::string segment = dir.segments()[0];
+
+    // A full header with a bad magic is corruption, not a crash, the drainer skips it when read
+    const unsigned char garbage[40] = { 0xde, 0xad, 0xbe, 0xef };
+    appendBytes(segment, garbage, sizeof(garbage));
+
+    {
+        KafkaJournal journal(&logger, &dir.cfg);
+    }
+
+    CHECK(fileSize(segment) == rec_len * 2 + (off_t)sizeof(garbage));
+}
+
+TEST(appendsAfterRecoveredSegment) {
+    journalDir dir;
+    const unsigned char data[100] = { 0 };
+    off_t rec_len = writeRecords(dir, 2);
+    CHECK(rec_len > 0);
+
+    std::string segment = dir.segments()[0];
+    std::string records = readFile(segment);
+    appendBytes(segment, (const unsigned char *)records.data(), rec_len - 1);
+
+    {
+        KafkaJournal journal(&logger, &dir.cfg);
+        CHECK(journal.append("openbmp.parsed.unicast_prefix", "key", data, sizeof(data)));
+    }
+
+    // The recovered segment is closed, new records go to the next one
+    std::vector<std::string> files = dir.segments();
+    CHECK(files.size() == 2);
+    CHECK(files[0] == segment);
+    CHECK(fileSize(files[0]) == rec_len * 2);
+    CHECK(fileSize(files[1]) == rec_len);
+}
+
+TEST_MAIN()
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <thread>
+#include <vector>
+#include <chrono>
+
+#include "unitTest.h"
+#include "ringQueue.hpp"
+
+#define PRODUCERS       4
+#define CONSUMERS       4
+#define PER_PRODUCER    100000
+
+/**
+ * Push and pop around a small ring many times, the order is kept
+ */
+template <typename queue>
+static bool wraparound(queue &q) {
+    size_t next_push = 0, next_pop = 0;
+    size_t value;
+
+    for (int lap = 0; lap < 1000; lap++) {
+        while (q.tryPush(next_push))
+            next_push++;
+
+        if (q.count() != q.capacity())
+            return false;
+
+        // Leave some behind so head and tail wrap at different points
+        for (int i = 0; i < 3; i++) {
+            if (not q.tryPop(value) or value != next_pop++)
+                return false;
+        }
+    }
+
+    while (q.tryPop(value)) {
+        if (value != next_pop++)
+            return false;
+    }
+
+    return next_pop == next_push and q.count() == 0;
+}
+
+/**
+ * Single producer and consumer through a ring much smaller than the data, so both block
+ */
+template <typename queue>
+static bool threadedOrder(queue &q) {
+    size_t next = 0;
+    size_t values[16];
+
+    std::thread producer([&]() {
+        for (size_t i = 0; i < PER_PRODUCER; i++)
+            q.push(i);
+
+        q.close();
+    });
+
+    size_t n;
+    bool ok = true;
+
+    while ((n = q.popBulk(values, 16)) > 0) {
+        for (size_t i = 0; i < n; i++)
+            ok = ok and values[i] == next++;
+    }
+
+    producer.join();
+
+    return ok and next == PER_PRODUCER;
+}
+
+TEST(capacityRoundsUp) {
+    CHECK(spscQueue<int>(1).capacity() == 2);
+    CHECK(spscQueue<int>(5).capacity() == 8);
+    CHECK(spscQueue<int>(8).capacity() == 8);
+    CHECK(mpmcQueue<int>(100).capacity() == 128);
+}
+
+TEST(spscWraparound) {
+    spscQueue<size_t> q(8);
+    size_t value;
+
+    CHECK(not q.tryPop(value));
+    CHECK(wraparound(q));
+}
+
+TEST(mpmcWraparound) {
+    mpmcQueue<size_t> q(8);
+    size_t value;
+
+    CHECK(not q.tryPop(value));
+    CHECK(wraparound(q));
+}
+
+TEST(spscThreadedOrder) {
+    spscQueue<size_t> q(8);
+    CHECK(threadedOrder(q));
+}
+
+TEST(mpmcThreadedOrder) {
+    mpmcQueue<size_t> q(8);
+    CHECK(threadedOrder(q));
+}
+
+TEST(mpmcContention) {
+    mpmcQueue<size_t> q(64);
+    std::vector<std::thread> producers, consumers;
+    std::vector<std::vector<size_t> > popped(CONSUMERS);
+
+    for (int c = 0; c < CONSUMERS; c++) {
+        consumers.push_back(std::thread([&q, &popped, c]() {
+            size_t value;
+
+            while (q.pop(value))
+                popped[c].push_back(value);
+        }));
+    }
+
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.push_back(std::thread([&q, p]() {
+            for (size_t i = 0; i < PER_PRODUCER; i++)
+                q.push(p * PER_PRODUCER + i);
+        }));
+    }
+
+    for (int p = 0; p < PRODUCERS; p++)
+        producers[p].join();
+
+    // Consumers drain what is left, then see the queue closed and empty
+    q.close();
+
+    for (int c = 0; c < CONSUMERS; c++)
+        consumers[c].join();
+
+    std::vector<int> seen(PRODUCERS * PER_PRODUCER, 0);
+
+    for (int c = 0; c < CONSUMERS; c++) {
+        std::vector<size_t> last(PRODUCERS, 0);
+
+        for (size_t i = 0; i < popped[c].size(); i++) {
+            size_t value = popped[c][i];
+            CHECK(value < seen.size());
+
+            seen[value]++;
+
+            // Each consumer sees the values of a producer in the order they were pushed
+            size_t p = value / PER_PRODUCER;
+            CHECK(value + 1 > last[p]);
+            last[p] = value + 1;
+        }
+    }
+
+    // Every value exactly once
+    for (size_t i = 0; i < seen.size(); i++)
+        CHECK(seen[i] == 1);
+}
+
+TEST(closeDrainsAndRejects) {
+    mpmcQueue<int> q(4);
+    int value;
+
+    CHECK(q.push(1));
+    CHECK(q.push(2));
+    q.close();
+
+    CHECK(q.isClosed());
+    CHECK(not q.push(3));
+
+    // Remaining elements are still popped, then pop returns without waiting
+    CHECK(q.pop(value) and value == 1);
+    CHECK(q.pop(value) and value == 2);
+    CHECK(not q.pop(value));
+}
+
+TEST(closeWakesBlocked) {
+    spscQueue<int> empty(4), full(2);
+    bool pop_result = true, push_result = true;
+
+    full.push(1);
+    full.push(2);
+
+    std::thread consumer([&]() {
+        int value;
+        pop_result = empty.pop(value);
+    });
+
+    std::thread producer([&]() {
+        push_result = full.push(3);
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    empty.close();
+    full.close();
+
+    consumer.join();
+    producer.join();
+
+    CHECK(not pop_result);
+    CHECK(not push_result);
+}
+
+TEST(popTimeout) {
+    spscQueue<int> q(4);
+    int value;
+
+    auto start = std::chrono::steady_clock::now();
+    CHECK(not q.pop(value, 20));
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(10));
+
+    CHECK(not q.pop(value, 0));
+
+    q.push(7);
+    CHECK(q.pop(value, 20) and value == 7);
+}
+
+TEST_MAIN()
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef OPENBMP_UNITTEST_H
+#define OPENBMP_UNITTEST_H
+
+#include <cstdio>
+#include <vector>
+
+/**
+ * \class   unitTest
+ *
+ * \brief   Minimal unit test runner
+ * \details Each test file is its own executable, registered with ctest.  TEST() defines a test
+ *          case and CHECK() fails the current case, the other cases still run.
+ *
+ *      \code{.cpp}
+ *      TEST(lookupEmpty) {
+ *          AdjRibIn rib;
+ *          CHECK(not rib.lookup(...));
+ *      }
+ *
+ *      TEST_MAIN()
+ *      \endcode
+ */
+struct unitTest {
+    typedef void (*test_fn)();
+
+    const char      *name;                      ///< Test case name
+    test_fn         fn;                         ///< Test case function
+
+    unitTest(const char *name, test_fn fn) : name(name), fn(fn) {
+        all().push_back(*this);
+    }
+
+    /**
+     * Registered test cases
+     */
+    static std::vector<unitTest> &all() {
+        static std::vector<unitTest> tests;
+        return tests;
+    }
+
+    /**
+     * Number of failed checks in the current test case
+     */
+    static int &failed() {
+        static int count = 0;
+        return count;
+    }
+
+    /**
+     * Run all test cases
+     *
+     * \return process exit code, non zero if a test case failed
+     */
+    static int runAll() {
+        int failed_tests = 0;
+
+        for (size_t i = 0; i < all().size(); i++) {
+            failed() = 0;
+            all()[i].fn();
+
+            printf("%-40s %s\n", all()[i].name, failed() ? "FAILED" : "ok");
+
+            if (failed())
+                failed_tests++;
+        }
+
+        printf("%zu tests, %d failed\n", all().size(), failed_tests);
+        return failed_tests ? 1 : 0;
+    }
+};
+
+#define TEST(name) static void name(); static unitTest name##_test(#name, name); static void name()
+
+#define CHECK(cond) do { if (not (cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            unitTest::failed()++; return; } } while (0)
+
+#define TEST_MAIN() int main() { return unitTest::runAll(); }
+
+#endif //OPENBMP_UNITTEST_H